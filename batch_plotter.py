@@ -9,10 +9,15 @@ Created on Wed Feb  6 08:00:57 2013
 import multiprocessing
 import os
 import os.path
+import subprocess
 import sys
 
 import numpy as np
 import scipy.signal
+try:
+    import gocatorscan
+except ImportError: # _gocatorscan not built (make python) - CSV scans only
+    gocatorscan = None
 import matplotlib
 matplotlib.use('Agg')
 import matplotlib.cm as cm
@@ -21,7 +26,9 @@ from matplotlib.figure import Figure
 
 def generate_scatterplot(datafname, imgfname):
     """Creates a 2D scatter plot of the specified Gocator XYZ
-    data and saves it in the specified image filename."""
+    data and saves it in the specified image filename.  Binary and
+    compressed scans are mapped rather than parsed (see gocatorscan.py),
+    so workers plotting the same scan share its pages."""
     matplotlib.rcParams['axes.formatter.limits'] = -4, 4
     matplotlib.rcParams['font.size'] = 14
     matplotlib.rcParams['axes.titlesize'] = 12
@@ -31,7 +38,10 @@ def generate_scatterplot(datafname, imgfname):
     figure = Figure()
     canvas = FigureCanvas(figure)
     axes = figure.gca()
-    x,y,z = np.genfromtxt(datafname, delimiter=",", unpack=True)
+    if gocatorscan is not None:
+        x,y,z = gocatorscan.read_xyz(datafname)
+    else:
+        x,y,z = np.genfromtxt(datafname, delimiter=",", unpack=True)
     xi = x[z!=-32.768]
     yi = y[z!=-32.768]
     zi = z[z!=-32.768]
@@ -45,6 +55,27 @@ def generate_scatterplot(datafname, imgfname):
     axes.set_ylabel("Scan Position [mm]")
     figure.savefig(imgfname)
 
+def find_renderer():
+    """Returns the path to scan2png (make scan2png) if it's alongside this
+    script or on the PATH, otherwise None."""
+    local = os.path.join(os.path.dirname(os.path.abspath(__file__)), "scan2png")
+    if os.path.isfile(local) and os.access(local, os.X_OK):
+        return local
+    for folder in os.environ.get("PATH", "").split(os.pathsep):
+        candidate = os.path.join(folder, "scan2png")
+        if os.path.isfile(candidate) and os.access(candidate, os.X_OK):
+            return candidate
+    return None
+
+def render_all(renderer, file_list):
+    """Renders every scan to a height map with scan2png in one call - it
+    shares the scans out between the cores itself.  Returns True on success."""
+    if subprocess.call([renderer] + list(file_list)) != 0:
+        return False
+    for fname in file_list:
+        generate_plotfname(fname)
+    return True
+
 def generate_plotfname(datafname, extension='png'):
     """Returns an image filename based on the supplied data filename.
     Defaults to .PNG unless specified otherwise."""
@@ -61,7 +92,11 @@ if __name__ == "__main__":
         file_list = sys.argv[1:]
     except IndexError: # no args specified
         print("Usage: batch_plotter.py files_to_plot")
-        print("e.g. batch_plotter.py data/*.csv")
+        print("e.g. batch_plotter.py data/*.csv data/*.bin")
+        sys.exit(0)
+    renderer = find_renderer()
+    if renderer is not None and render_all(renderer, file_list):
+        print("\nPlotting complete.")
         sys.exit(0)
     if multiprocessing.cpu_count() == 1:
         print("Single CPU detected, running one process.")
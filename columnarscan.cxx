@@ -0,0 +1,79 @@
+#include "columnarscan.h"
+
+template<typename T> static void append(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T> static void append(std::string& out, const std::vector<T>& values) {
+    if (!values.empty()) {
+        out.append(reinterpret_cast<const char*>(&values[0]), values.size()*sizeof(T));
+    }
+}
+
+void writeColumnarHeader(const std::string& header, std::string& out) {
+    out.append(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    append(out, static_cast<Go2UInt32>(COLUMNAR_VERSION));
+    append(out, static_cast<Go2UInt32>(header.size()));
+    out += header;
+}
+
+void writeColumnBlock(const ColumnBlock& block, std::string& out) {
+    if (block.points() == 0) {
+        return;
+    }
+    append(out, static_cast<Go2UInt32>(block.points()));
+    append(out, static_cast<Go2UInt32>(block.profiles()));
+    append(out, block.y);
+    append(out, block.profilePoints);
+    append(out, block.x);
+    append(out, block.z);
+}
+
+void writeColumnarFooter(Go2UInt64 profiles, Go2UInt64 points, std::string& out) {
+    append(out, static_cast<Go2UInt32>(0));
+    append(out, profiles);
+    append(out, points);
+}
+
+ColumnarScanReader::ColumnarScanReader(const std::string& scanFilename):filename(scanFilename), finished(false),
+profiles(0), points(0) {
+    fidin.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!fidin.is_open()) {
+        throw std::runtime_error("Unable to open scan '" + filename + "'");
+    }
+    char magic[sizeof(COLUMNAR_MAGIC)];
+    Go2UInt32 version, headerLength;
+    if (!fidin.read(magic, sizeof(magic)) || memcmp(magic, COLUMNAR_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("'" + filename + "' is not a columnar scan");
+    }
+    if (!read(version) || version != COLUMNAR_VERSION) {
+        throw std::runtime_error("Unsupported columnar scan version in '" + filename + "'");
+    }
+    if (!read(headerLength)) {
+        throw std::runtime_error("Truncated header in '" + filename + "'");
+    }
+    header.resize(headerLength);
+    if (headerLength > 0 && !fidin.read(&header[0], headerLength)) {
+        throw std::runtime_error("Truncated header in '" + filename + "'");
+    }
+}
+
+bool ColumnarScanReader::next(ColumnBlock& block) {
+    Go2UInt32 pointCount, profileCount;
+    if (finished || !read(pointCount)) {
+        return false;
+    }
+    if (pointCount == 0) {
+        Go2UInt64 totalProfiles, totalPoints;
+        finished = read(totalProfiles) && read(totalPoints) && totalProfiles == profiles && totalPoints == points;
+        return false;
+    }
+    if (!read(profileCount) || !read(block.y, profileCount) || !read(block.profilePoints, profileCount) ||
+        !read(block.x, pointCount) || !read(block.z, pointCount)) {
+        block.clear();
+        return false;
+    }
+    profiles += profileCount;
+    points += pointCount;
+    return true;
+}
@@ -0,0 +1,236 @@
+#include "compressedscan.h"
+
+// Appends a plain value to the block in host byte order
+template<typename T> static void append(std::string& block, const T& value) {
+    block.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+CompressedProfileWriter::CompressedProfileWriter(unsigned int threads):
+threadCount(threads > 0 ? threads : 1), chunks(2*threadCount + 1), filled(0), emitted(0), stopping(false),
+profileNumber(0), offset(0), rawBytes(0), packedBytes(0), chunksWritten(0), waits(0), cpuSeconds(0),
+maxCpuSeconds(0), startTime(0), finishTime(0) {
+    jobs.reserve(chunks.size());
+    for (size_t i=0; i<chunks.size(); i++) {
+        chunks[i].profiles = 0;
+        chunks[i].ready = false;
+    }
+    for (unsigned int i=0; i<threadCount; i++) {
+        workers.create_thread(boost::bind(&CompressedProfileWriter::compress, this));
+    }
+}
+
+CompressedProfileWriter::~CompressedProfileWriter() {
+    {
+        boost::lock_guard<boost::mutex> guard(lock);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    workers.join_all();
+}
+
+// Leaves a core each for receiving and conversion where there are enough
+unsigned int CompressedProfileWriter::defaultThreads() {
+    unsigned int cores = boost::thread::hardware_concurrency();
+    if (cores <= 2) {
+        return 1;
+    }
+    return std::min(cores - 2, static_cast<unsigned int>(COMPRESSION_MAX_THREADS));
+}
+
+void CompressedProfileWriter::writeHeader(const ScanInfo& info, std::string& block) {
+    size_t start = block.size();
+    writeScanHeader(COMPRESSED_SCAN_MAGIC, COMPRESSED_SCAN_VERSION, info, block);
+    append(block, static_cast<Go2UInt32>(CHUNK_PROFILES));
+    offset = block.size() - start;
+    profileNumber = 0;
+    index.clear();
+    // The statistics cover the whole recording, however many files (segments) it's split into
+    if (startTime == 0) {
+        startTime = monotonicMicroseconds();
+    }
+}
+
+void CompressedProfileWriter::writeProfile(const Profile& profile, std::string& block) {
+    CompressedChunk& chunk = chunks[filled % chunks.size()];
+    if (chunk.profiles == 0) {
+        // Chunks are decoded independently - no geometry or prediction carried over
+        haveGeometry = false;
+        previous.clear();
+        chunk.raw.clear();
+        chunk.firstProfile = profileNumber;
+        chunk.minEncoder = chunk.maxEncoder = profile.encoder;
+    }
+    size_t width = profile.width();
+    const short* ranges = profile.rangeData();
+    bool predicted = width > 0 && previous.size() == width;
+    writeRecordHeader(profile, predicted ? SCAN_RECORD_PREDICTED : 0, chunk.raw);
+    size_t start = chunk.raw.size();
+    chunk.raw.resize(start + width*sizeof(short));
+    unsigned char* low = reinterpret_cast<unsigned char*>(&chunk.raw[start]);
+    unsigned char* high = low + width;
+    // Unsigned arithmetic - residuals wrap around, invalid ranges included
+    unsigned short left = 0, aboveLeft = 0;
+    for (size_t i=0; i<width; i++) {
+        unsigned short value = static_cast<unsigned short>(ranges[i]);
+        unsigned short residual = value - left;
+        if (predicted) {
+            unsigned short above = static_cast<unsigned short>(previous[i]);
+            residual -= above - aboveLeft;
+            aboveLeft = above;
+        }
+        low[i] = static_cast<unsigned char>(residual);
+        high[i] = static_cast<unsigned char>(residual >> 8);
+        left = value;
+    }
+    previous.assign(ranges, ranges+width);
+    chunk.minEncoder = std::min(chunk.minEncoder, static_cast<Go2Int64>(profile.encoder));
+    chunk.maxEncoder = std::max(chunk.maxEncoder, static_cast<Go2Int64>(profile.encoder));
+    chunk.profiles++;
+    profileNumber++;
+    if (chunk.profiles >= CHUNK_PROFILES) {
+        submit();
+    }
+    // Only wait if every chunk is still with the workers
+    collect(block, filled >= chunks.size() ? filled - chunks.size() + 1 : 0);
+}
+
+// Compresses the last partial chunk and appends the chunk index
+void CompressedProfileWriter::writeFooter(std::string& block) {
+    if (chunks[filled % chunks.size()].profiles > 0) {
+        submit();
+    }
+    collect(block, filled);
+    size_t start = block.size();
+    Go2UInt64 indexOffset = offset;
+    append(block, static_cast<Go2UInt32>(0));
+    append(block, static_cast<Go2UInt64>(index.size()));
+    for (size_t i=0; i<index.size(); i++) {
+        append(block, index[i].offset);
+        append(block, index[i].firstProfile);
+        append(block, index[i].profiles);
+        append(block, index[i].minEncoder);
+        append(block, index[i].maxEncoder);
+    }
+    append(block, indexOffset);
+    block.append(COMPRESSED_INDEX_MAGIC, sizeof(COMPRESSED_INDEX_MAGIC));
+    offset += block.size() - start;
+    finishTime = monotonicMicroseconds();
+}
+
+// Hands the chunk being filled to the workers
+void CompressedProfileWriter::submit() {
+    {
+        boost::lock_guard<boost::mutex> guard(lock);
+        chunks[filled % chunks.size()].ready = false;
+        jobs.push_back(filled % chunks.size());
+        filled++;
+    }
+    jobAvailable.notify_one();
+}
+
+void CompressedProfileWriter::collect(std::string& block, Go2UInt64 until) {
+    boost::unique_lock<boost::mutex> guard(lock);
+    if (emitted < until && !chunks[emitted % chunks.size()].ready) {
+        waits++;
+    }
+    while (emitted < filled) {
+        CompressedChunk& chunk = chunks[emitted % chunks.size()];
+        if (!chunk.ready) {
+            if (emitted >= until) {
+                break;
+            }
+            chunkReady.wait(guard);
+            continue;
+        }
+        guard.unlock();
+        ScanIndexEntry entry;
+        entry.offset = offset;
+        entry.firstProfile = chunk.firstProfile;
+        entry.profiles = chunk.profiles;
+        entry.minEncoder = chunk.minEncoder;
+        entry.maxEncoder = chunk.maxEncoder;
+        index.push_back(entry);
+        append(block, chunk.profiles);
+        append(block, static_cast<Go2UInt32>(chunk.raw.size()));
+        append(block, static_cast<Go2UInt32>(chunk.packed.size()));
+        block += chunk.packed;
+        offset += 3*sizeof(Go2UInt32) + chunk.packed.size();
+        chunksWritten++;
+        rawBytes += chunk.raw.size();
+        packedBytes += chunk.packed.size();
+        cpuSeconds += chunk.cpuSeconds;
+        maxCpuSeconds = std::max(maxCpuSeconds, chunk.cpuSeconds);
+        chunk.profiles = 0;
+        guard.lock();
+        emitted++;
+    }
+}
+
+// Worker thread - deflates submitted chunks
+void CompressedProfileWriter::compress() {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit(&stream, COMPRESSION_LEVEL) != Z_OK) {
+        std::cerr << "<< Unable to start compression thread >>" << std::endl;
+        return;
+    }
+    while (true) {
+        size_t slot;
+        {
+            boost::unique_lock<boost::mutex> guard(lock);
+            while (jobs.empty() && !stopping) {
+                jobAvailable.wait(guard);
+            }
+            if (jobs.empty()) {
+                break;
+            }
+            slot = jobs.front();
+            jobs.erase(jobs.begin());
+        }
+        CompressedChunk& chunk = chunks[slot];
+        double cpuStart = threadCpuSeconds();
+        deflateReset(&stream);
+        chunk.packed.resize(deflateBound(&stream, chunk.raw.size()));
+        stream.next_in = reinterpret_cast<Bytef*>(&chunk.raw[0]);
+        stream.avail_in = chunk.raw.size();
+        stream.next_out = reinterpret_cast<Bytef*>(&chunk.packed[0]);
+        stream.avail_out = chunk.packed.size();
+        if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+            std::cerr << "<< Unable to compress chunk of profiles " << chunk.firstProfile << "-"
+                      << chunk.firstProfile + chunk.profiles << " >>" << std::endl;
+        }
+        chunk.packed.resize(stream.total_out);
+        chunk.cpuSeconds = threadCpuSeconds() - cpuStart;
+        {
+            boost::lock_guard<boost::mutex> guard(lock);
+            chunk.ready = true;
+        }
+        chunkReady.notify_all();
+    }
+    deflateEnd(&stream);
+}
+
+double CompressedProfileWriter::threadCpuSeconds() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+// Prints the compression ratio and how hard the workers had to work
+void CompressedProfileWriter::report(std::ostream& os) {
+    os << "<< Compression >>" << std::endl;
+    os << "    Chunks:  " << chunksWritten << " of up to " << CHUNK_PROFILES << " profiles, "
+       << threadCount << " compression thread(s)" << std::endl;
+    if (chunksWritten == 0) {
+        return;
+    }
+    os << "    Compression ratio:  " << (packedBytes > 0 ? static_cast<double>(rawBytes)/packedBytes : 0)
+       << ":1 (" << rawBytes << " -> " << packedBytes << " bytes)" << std::endl;
+    os << "    CPU per chunk:  mean " << 1e3*cpuSeconds/chunksWritten << " ms, max "
+       << 1e3*maxCpuSeconds << " ms" << std::endl;
+    if (finishTime > startTime) {
+        os << "    Compression load:  " << 100*cpuSeconds/(threadCount*(finishTime - startTime)*1e-6)
+           << "% of " << threadCount << " thread(s)" << std::endl;
+    }
+    os << "    Waits for a free chunk:  " << waits << std::endl;
+}
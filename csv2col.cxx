@@ -0,0 +1,63 @@
+/* csv2col - converts archived x,y,z CSV scans to the compact columnar format
+
+Usage: csv2col [--output-folder path] [--threads n] [--chunk MB] input.csv [input.csv ...]
+Each input is written as <input>.cols (format in include/columnarscan.h), next
+to it or in the output folder.  Files are converted in parallel and large
+files are split into chunks at line ends, so one huge scan uses every core
+too.  Reports files/s and MB/s of CSV read.
+*/
+#include "csvconverter.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace opts = boost::program_options;
+namespace filesystem = boost::filesystem;
+
+int main(int argc, char* argv[]) {
+    opts::options_description opt_desc("Available options");
+    opt_desc.add_options()
+        ("input", opts::value<std::vector<std::string> >(), "CSV scans to convert")
+        ("output-folder,o", opts::value<std::string>(), "folder for the columnar scans (default next to each input)")
+        ("threads,t", opts::value<unsigned int>()->default_value(CsvConverter::defaultThreads()), "worker threads")
+        ("chunk", opts::value<unsigned int>()->default_value(CSV_CHUNK_SIZE/1048576), "MB of CSV per task")
+        ("help,h", "display basic help information")
+    ;
+    opts::positional_options_description positional;
+    positional.add("input", -1);
+    opts::variables_map cmdline;
+    opts::store(opts::command_line_parser(argc, argv).options(opt_desc).positional(positional).run(), cmdline);
+    opts::notify(cmdline);
+    if (cmdline.count("help") || !cmdline.count("input")) {
+        std::cout << "Usage: csv2col [options] input.csv [input.csv ...]\n" << opt_desc << std::endl;
+        return 1;
+    }
+    unsigned int chunk = cmdline["chunk"].as<unsigned int>();
+    if (chunk == 0) {
+        std::cerr << "<< Chunk size must be at least 1 MB >>" << std::endl;
+        return 1;
+    }
+    filesystem::path folder;
+    if (cmdline.count("output-folder")) {
+        folder = cmdline["output-folder"].as<std::string>();
+        if (!filesystem::is_directory(folder)) {
+            std::cerr << "<< Output folder '" << folder.string() << "' doesn't exist, aborting >>" << std::endl;
+            return 1;
+        }
+    }
+    CsvConverter converter(cmdline["threads"].as<unsigned int>(), static_cast<size_t>(chunk)*1048576);
+    const std::vector<std::string>& inputs = cmdline["input"].as<std::vector<std::string> >();
+    for (size_t i=0; i<inputs.size(); i++) {
+        filesystem::path output = filesystem::path(inputs[i]).replace_extension(COLUMNAR_EXTENSION);
+        if (!folder.empty()) {
+            output = folder / output.filename();
+        }
+        converter.add(inputs[i], output.string());
+    }
+    bool ok = converter.run();
+    converter.report(std::cout);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+/* csvbench - compares the CsvWriter with the original per-point ofstream path
+
+Usage: csvbench [profiles] [points per profile] [output folder]
+Writes the same synthetic scan both ways and reports points/second.
+*/
+#include "csvwriter.h"
+#include "outputfile.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace filesystem = boost::filesystem;
+namespace posixtime = boost::posix_time;
+
+// Builds a gently curved synthetic profile with a few dropouts
+void syntheticProfile(Profile& profile, unsigned int width, Go2Int64 encoder) {
+    profile.encoder = encoder;
+    profile.xOffset = -12.5;
+    profile.xResolution = 25.0/width;
+    profile.zOffset = 20.0;
+    profile.zResolution = 0.00125;
+    profile.ranges.resize(width);
+    for (unsigned int i=0; i<width; i++) {
+        if ((i*7 + encoder) % 97 == 0) {
+            profile.ranges[i] = static_cast<short>(INVALID_RANGE_16BIT);
+        } else {
+            profile.ranges[i] = static_cast<short>(4000*std::sin(i*0.01 + encoder*0.001));
+        }
+    }
+}
+
+double elapsedSeconds(const posixtime::ptime& start) {
+    return (posixtime::microsec_clock::universal_time() - start).total_microseconds()/1e6;
+}
+
+// The original recordProfile inner loop: iostream formatting and a flush per point
+double benchOfstream(const std::vector<Profile>& profiles, const std::string& filename, Go2UInt64& points) {
+    std::ofstream fidout(filename.c_str());
+    double resolution = 0.01;
+    points = 0;
+    posixtime::ptime start = posixtime::microsec_clock::universal_time();
+    for (size_t p=0; p<profiles.size(); p++) {
+        const Profile& profile = profiles[p];
+        for (unsigned int arrayIndex=0; arrayIndex<profile.ranges.size(); ++arrayIndex) {
+            if (profile.ranges[arrayIndex] != static_cast<short>(INVALID_RANGE_16BIT)) {
+                fidout << profile.xOffset+profile.xResolution*arrayIndex << "," << profile.encoder*resolution << "," 
+                       << profile.zOffset+profile.zResolution*profile.ranges[arrayIndex] << std::endl << std::flush;
+                points++;
+            }
+        }
+    }
+    fidout.close();
+    return elapsedSeconds(start);
+}
+
+// CsvWriter formatting into blocks written with OutputFile
+double benchCsvWriter(const std::vector<Profile>& profiles, const std::string& filename, Go2UInt64& bytes) {
+    filesystem::remove(filename);
+    OutputFile fidout;
+    fidout.open(filename);
+    CsvWriter writer;
+    ScanInfo info;
+    info.startingEncoder = 0;
+    info.encoderResolution = 0.01;
+    std::string block;
+    block.reserve(OUTPUT_BLOCK_SIZE*2);
+    posixtime::ptime start = posixtime::microsec_clock::universal_time();
+    writer.writeHeader(info, block);
+    for (size_t p=0; p<profiles.size(); p++) {
+        writer.writeProfile(profiles[p], block);
+        if (block.size() >= OUTPUT_BLOCK_SIZE) {
+            fidout.write(block);
+            block.clear();
+        }
+    }
+    fidout.write(block);
+    fidout.close();
+    double seconds = elapsedSeconds(start);
+    bytes = fidout.bytesWritten();
+    return seconds;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int profileCount = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned int width = argc > 2 ? atoi(argv[2]) : 1280;
+    filesystem::path folder = argc > 3 ? filesystem::path(argv[3]) : filesystem::temp_directory_path();
+    std::vector<Profile> profiles(profileCount);
+    for (unsigned int i=0; i<profileCount; i++) {
+        syntheticProfile(profiles[i], width, i*10);
+    }
+    std::string ofstreamFile = (folder / "csvbench_ofstream.csv").string();
+    std::string writerFile = (folder / "csvbench_csvwriter.csv").string();
+    Go2UInt64 points, bytes;
+    double ofstreamSeconds = benchOfstream(profiles, ofstreamFile, points);
+    double writerSeconds = benchCsvWriter(profiles, writerFile, bytes);
+    std::cout << profileCount << " profiles x " << width << " points (" << points << " valid)" << std::endl;
+    std::cout << "    ofstream:   " << points/ofstreamSeconds << " points/s" << std::endl;
+    std::cout << "    CsvWriter:  " << points/writerSeconds << " points/s, "
+              << bytes/writerSeconds/1048576.0 << " MB/s" << std::endl;
+    std::cout << "    Speedup:    " << ofstreamSeconds/writerSeconds << "x" << std::endl;
+    filesystem::remove(ofstreamFile);
+    filesystem::remove(writerFile);
+    return 0;
+}
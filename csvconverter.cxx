@@ -0,0 +1,331 @@
+#include "csvconverter.h"
+
+static const double powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Rare numbers the fast path can't do exactly
+static bool parseSlowly(const char* start, const char* end, double& value) {
+    static locale_t cLocale = newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+    char text[CSV_NUMBER_MAX + 1];
+    size_t length = static_cast<size_t>(end - start);
+    if (length > CSV_NUMBER_MAX || cLocale == static_cast<locale_t>(0)) {
+        return false;
+    }
+    memcpy(text, start, length);
+    text[length] = '\0';
+    char* parsedEnd;
+    value = strtod_l(text, &parsedEnd, cLocale);
+    return parsedEnd == text + length;
+}
+
+bool parseNumber(const char*& p, const char* end, double& value) {
+    const char* start = p;
+    const char* q = p;
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+        negative = *q == '-';
+        q++;
+    }
+    Go2UInt64 mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool anyDigits = false, truncated = false;
+    for (; q < end && isDigit(*q); q++) {
+        anyDigits = true;
+        if (digits < 19) {
+            mantissa = mantissa*10 + (*q - '0');
+            digits += mantissa > 0;
+        } else {
+            exponent++;
+            truncated = true;
+        }
+    }
+    if (q < end && *q == '.') {
+        for (q++; q < end && isDigit(*q); q++) {
+            anyDigits = true;
+            if (digits < 19) {
+                mantissa = mantissa*10 + (*q - '0');
+                digits += mantissa > 0;
+                exponent--;
+            } else {
+                truncated = true;
+            }
+        }
+    }
+    if (!anyDigits) {
+        return false;
+    }
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        q++;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            negativeExponent = *q == '-';
+            q++;
+        }
+        if (q >= end || !isDigit(*q)) {
+            return false;
+        }
+        int written = 0;
+        for (; q < end && isDigit(*q); q++) {
+            if (written < 10000) {
+                written = written*10 + (*q - '0');
+            }
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+    if (!truncated && mantissa <= (static_cast<Go2UInt64>(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double magnitude = static_cast<double>(mantissa);
+        magnitude = exponent < 0 ? magnitude/powersOfTen[-exponent] : magnitude*powersOfTen[exponent];
+        value = negative ? -magnitude : magnitude;
+    } else if (!parseSlowly(start, q, value)) {
+        return false;
+    }
+    p = q;
+    return true;
+}
+
+// Moves past a comma and any blanks around it
+static bool separator(const char*& p, const char* end) {
+    while (p < end && isBlank(*p)) {
+        p++;
+    }
+    if (p >= end || *p != ',') {
+        return false;
+    }
+    for (p++; p < end && isBlank(*p); p++) {
+    }
+    return true;
+}
+
+bool parseXyz(const char* p, const char* lineEnd, double& x, double& y, double& z) {
+    bool valid = parseNumber(p, lineEnd, x) && separator(p, lineEnd) && parseNumber(p, lineEnd, y) &&
+                 separator(p, lineEnd) && parseNumber(p, lineEnd, z);
+    while (valid && p < lineEnd && isBlank(*p)) {
+        p++;
+    }
+    return valid && p == lineEnd;
+}
+
+CsvConverter::CsvConverter(unsigned int threads, size_t chunkSize):threadCount(threads > 0 ? threads : 1),
+chunkBytes(chunkSize > 0 ? chunkSize : CSV_CHUNK_SIZE), seconds(0) {}
+
+unsigned int CsvConverter::defaultThreads() {
+    unsigned int cores = boost::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+void CsvConverter::add(const std::string& input, const std::string& output) {
+    ConversionResult result;
+    result.input = input;
+    result.output = output;
+    result.bytes = result.profiles = result.points = result.badLines = 0;
+    result.ok = true;
+    results.push_back(result);
+}
+
+bool CsvConverter::run() {
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    files.reset(new FileState[results.size()]);
+    queues.reset(new WorkerQueue[threadCount]);
+    size_t dealt = 0;
+    for (size_t f=0; f<results.size(); f++) {
+        struct stat status;
+        if (stat(results[f].input.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+            results[f].ok = false;
+            results[f].error = "Unable to open '" + results[f].input + "'";
+            continue;
+        }
+        results[f].bytes = static_cast<Go2UInt64>(status.st_size);
+        files[f].chunks = std::max<Go2UInt64>(1, (results[f].bytes + chunkBytes - 1)/chunkBytes);
+        files[f].written = 0;
+        files[f].opened = false;
+        for (Go2UInt64 c=0; c<files[f].chunks; c++) {
+            ConversionTask task;
+            task.file = f;
+            task.chunk = c;
+            task.begin = static_cast<size_t>(c*chunkBytes);
+            task.end = static_cast<size_t>(std::min<Go2UInt64>(results[f].bytes, (c + 1)*chunkBytes));
+            queues[dealt++ % threadCount].tasks.push_back(task);
+        }
+    }
+    boost::thread_group workers;
+    for (unsigned int i=0; i<threadCount; i++) {
+        workers.create_thread(boost::bind(&CsvConverter::work, this, i));
+    }
+    workers.join_all();
+    bool ok = true;
+    for (size_t f=0; f<results.size(); f++) {
+        if (!results[f].ok) {
+            ok = false;
+            if (files[f].opened) {
+                unlink(results[f].output.c_str());
+            }
+        }
+    }
+    seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds()/1e6;
+    return ok;
+}
+
+void CsvConverter::work(unsigned int worker) {
+    ConversionTask task;
+    while (nextTask(worker, task)) {
+        boost::shared_ptr<ParsedChunk> parsed(new ParsedChunk);
+        parse(task, *parsed);
+        store(task, parsed);
+    }
+}
+
+// Own queue first, then the oldest task of each other worker in turn - so
+// the chunks of a big file still finish roughly in order and few of them
+// wait to be written.  No tasks are added once running, so when every
+// queue is empty the work is done.
+bool CsvConverter::nextTask(unsigned int worker, ConversionTask& task) {
+    for (unsigned int i=0; i<threadCount; i++) {
+        WorkerQueue& queue = queues[(worker + i) % threadCount];
+        boost::lock_guard<boost::mutex> guard(queue.lock);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void CsvConverter::parse(const ConversionTask& task, ParsedChunk& parsed) {
+    parsed.badLines = 0;
+    const ConversionResult& result = results[task.file];
+    size_t size = static_cast<size_t>(result.bytes);
+    if (task.begin >= size) {
+        return;
+    }
+    int fd = open(result.input.c_str(), O_RDONLY);
+    if (fd < 0) {
+        parsed.error = "Unable to open '" + result.input + "'";
+        return;
+    }
+    // From the page holding the byte before the chunk (to see whether a line
+    // starts there) to the end of the file, where the chunk's last line may end
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t from = task.begin > 0 ? (task.begin - 1)/page*page : 0;
+    void* mapped = mmap(NULL, size - from, PROT_READ, MAP_PRIVATE, fd, from);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        parsed.error = "Unable to map '" + result.input + "': " + strerror(errno);
+        return;
+    }
+    madvise(mapped, size - from, MADV_SEQUENTIAL);
+    const char* base = static_cast<const char*>(mapped);
+    parseLines(base + (task.begin - from), base + (task.end - from), base + (size - from), task.begin == 0, parsed);
+    munmap(mapped, size - from);
+}
+
+// Parses the lines that start from begin up to end; the last may run on to fileEnd
+void CsvConverter::parseLines(const char* begin, const char* end, const char* fileEnd, bool atStart,
+                              ParsedChunk& parsed) {
+    const char* p = begin;
+    if (!atStart && p[-1] != '\n') {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', fileEnd - p));
+        p = newline != NULL ? newline + 1 : fileEnd;
+    }
+    // gocator_encoder writes 20-30 bytes a point
+    parsed.block.x.reserve((end - begin)/20);
+    parsed.block.z.reserve((end - begin)/20);
+    bool leading = atStart;
+    while (p < end) {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', fileEnd - p));
+        if (lineEnd == NULL) {
+            lineEnd = fileEnd;
+        }
+        const char* q = p;
+        while (q < lineEnd && isBlank(*q)) {
+            q++;
+        }
+        if (q < lineEnd && *q == '#') {
+            if (leading) {
+                parsed.header.append(p, std::min(lineEnd + 1, fileEnd) - p);
+            }
+        } else if (q < lineEnd) {
+            leading = false;
+            double x, y, z;
+            if (parseXyz(q, lineEnd, x, y, z)) {
+                parsed.block.add(x, y, z);
+            } else {
+                parsed.badLines++;
+            }
+        }
+        p = lineEnd + 1;
+    }
+}
+
+// Writes the file's next chunks in order, as far as they're finished
+void CsvConverter::store(const ConversionTask& task, const boost::shared_ptr<ParsedChunk>& parsed) {
+    FileState& state = files[task.file];
+    ConversionResult& result = results[task.file];
+    boost::lock_guard<boost::mutex> guard(state.lock);
+    state.finished[task.chunk] = parsed;
+    while (!state.finished.empty() && state.finished.begin()->first == state.written) {
+        boost::shared_ptr<ParsedChunk> chunk = state.finished.begin()->second;
+        state.finished.erase(state.finished.begin());
+        bool last = state.written + 1 == state.chunks;
+        if (result.ok && !chunk->error.empty()) {
+            result.ok = false;
+            result.error = chunk->error;
+        }
+        if (result.ok && state.written == 0) {
+            state.fidout.open(result.output.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+            state.opened = state.fidout.is_open();
+            writeColumnarHeader(chunk->header, state.pending);
+        }
+        if (result.ok) {
+            writeColumnBlock(chunk->block, state.pending);
+            result.profiles += chunk->block.profiles();
+            result.points += chunk->block.points();
+            result.badLines += chunk->badLines;
+            if (last) {
+                writeColumnarFooter(result.profiles, result.points, state.pending);
+            }
+            state.fidout.write(state.pending.data(), state.pending.size());
+            state.pending.clear();
+            if (last) {
+                state.fidout.close();
+            }
+            if (!state.fidout) {
+                result.ok = false;
+                result.error = "Unable to write to '" + result.output + "'";
+            }
+        }
+        state.written++;
+    }
+}
+
+void CsvConverter::report(std::ostream& os) {
+    Go2UInt64 converted = 0, bytes = 0, points = 0, profiles = 0, badLines = 0;
+    for (size_t f=0; f<results.size(); f++) {
+        const ConversionResult& result = results[f];
+        if (!result.ok) {
+            std::cerr << "<< " << result.error << " >>" << std::endl;
+            continue;
+        }
+        converted++;
+        bytes += result.bytes;
+        points += result.points;
+        profiles += result.profiles;
+        badLines += result.badLines;
+    }
+    os << "Converted " << converted << " of " << results.size() << " files, " << bytes/1048576.0 << " MB ("
+       << points << " points in " << profiles << " profiles";
+    if (badLines > 0) {
+        os << ", " << badLines << " malformed lines skipped";
+    }
+    os << ") in " << seconds << " s on " << threadCount << " threads: "
+       << (seconds > 0 ? converted/seconds : 0) << " files/s, "
+       << (seconds > 0 ? bytes/1048576.0/seconds : 0) << " MB/s" << std::endl;
+}
@@ -0,0 +1,83 @@
+#include "csvwriter.h"
+
+static const double powersOfTen[CSV_MAX_PRECISION+1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+int formatFixed(double value, int precision, char* out) {
+    if (precision < 0) {
+        precision = 0;
+    } else if (precision > CSV_MAX_PRECISION) {
+        precision = CSV_MAX_PRECISION;
+    }
+    double scaled = std::fabs(value)*powersOfTen[precision] + 0.5;
+    // Anything that won't fit in 64 bits (or isn't a number) goes the slow way
+    if (!(scaled < 1.8e19)) {
+        int length = snprintf(out, CSV_MAX_FIELD, "%.17g", value);
+        return length < CSV_MAX_FIELD ? length : CSV_MAX_FIELD-1;
+    }
+    Go2UInt64 digits = static_cast<Go2UInt64>(scaled);
+    int length = 0;
+    // Don't write "-0.000" for values that round to zero
+    if (value < 0 && digits != 0) {
+        out[length++] = '-';
+    }
+    char reversed[CSV_MAX_FIELD];
+    int count = 0;
+    do {
+        reversed[count++] = static_cast<char>('0' + digits%10);
+        digits /= 10;
+    } while (digits != 0 || count <= precision);
+    while (count > precision) {
+        out[length++] = reversed[--count];
+    }
+    if (precision > 0) {
+        out[length++] = '.';
+        while (count > 0) {
+            out[length++] = reversed[--count];
+        }
+    }
+    return length;
+}
+
+CsvWriter::CsvWriter(int xDecimals, int yDecimals, int zDecimals):
+xPrecision(xDecimals), yPrecision(yDecimals), zPrecision(zDecimals) {}
+
+void CsvWriter::writeHeader(const ScanInfo& info, std::string& block) {
+    scan = info;
+    block += "# File format: X Position [mm], Y Position [mm], Z Range [mm]\n";
+    block += "# " + info.comment + "\n";
+}
+
+void CsvWriter::writeProfile(const Profile& profile, std::string& block) {
+    unsigned int width = profile.width();
+    if (width == 0) {
+        return;
+    }
+    // Worst case per point is three fields, two commas and a newline
+    size_t needed = width*(3*CSV_MAX_FIELD+3);
+    if (buffer.size() < needed) {
+        buffer.resize(needed);
+    }
+    // Y is the same for every point in the profile - format it once as ",y,"
+    char yField[CSV_MAX_FIELD+2];
+    yField[0] = ',';
+    int yLength = 1 + formatFixed((profile.encoder-scan.startingEncoder)*scan.encoderResolution, yPrecision, yField+1);
+    yField[yLength++] = ',';
+
+    if (x.size() < width) {
+        x.resize(width);
+        z.resize(width);
+    }
+    unsigned int validCount = compactRanges(profile, &x[0], &z[0]);
+    char* out = &buffer[0];
+    char* start = out;
+    for (unsigned int point=0; point<validCount; ++point) {
+        out += formatFixed(x[point], xPrecision, out);
+        memcpy(out, yField, yLength);
+        out += yLength;
+        out += formatFixed(z[point], zPrecision, out);
+        *out++ = '\n';
+    }
+    block.append(start, out-start);
+}
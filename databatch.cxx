@@ -0,0 +1,27 @@
+#include "databatch.h"
+
+// One spare node - the queue keeps a dummy
+BatchPool::BatchPool(size_t depth):
+count(depth > 0 ? depth : 1), batches(new DataBatch[count]), freeBatches(count+1) {
+    for (size_t i=0; i<count; i++) {
+        batches[i].data = GO2_NULL;
+        batches[i].references = 0;
+        batches[i].pool = this;
+        freeBatches.push(&batches[i]);
+    }
+}
+
+BatchRef BatchPool::acquire() {
+    DataBatch* batch = NULL;
+    if (!freeBatches.pop(batch)) {
+        return BatchRef();
+    }
+    batch->references.store(1, boost::memory_order_relaxed);
+    return BatchRef(batch);
+}
+
+// Last reference gone - makes the batch available again
+void BatchPool::recycle(DataBatch* batch) {
+    clear(*batch);
+    freeBatches.push(batch);
+}
@@ -0,0 +1,129 @@
+#include "gapdetector.h"
+
+GapDetector::GapDetector():havePrevious(false), previousEncoder(0), previousTimestamp(0), direction(0),
+profileNumber(0), gaps(0), missing(0), duplicates(0), reversals(0), lastWarning(0), unwarned(0) {
+    spacing.encoderStep = 0;
+    spacing.framePeriod = 0;
+}
+
+void GapDetector::reset(const ScanInfo& scanInfo, const GapSettings& settings) {
+    info = scanInfo;
+    spacing = settings;
+    havePrevious = false;
+    direction = 0;
+    profileNumber = 0;
+    spans.clear();
+    spans.reserve(1024);
+    gaps = missing = duplicates = reversals = 0;
+    lastWarning = unwarned = 0;
+}
+
+void GapDetector::check(const Profile& profile) {
+    if (havePrevious) {
+        Go2Int64 step = profile.encoder - previousEncoder;
+        Go2UInt64 elapsed = profile.timestamp > previousTimestamp ? profile.timestamp - previousTimestamp : 0;
+        if (spacing.encoderStep > 0) {
+            // Frame timing isn't regular under an encoder trigger, so only the encoder says whether it's a duplicate
+            Go2Int64 distance = std::abs(step);
+            if (distance == 0) {
+                flag(DUPLICATE_PROFILE, profile, 0);
+            } else {
+                int stepDirection = step > 0 ? 1 : -1;
+                if (direction != 0 && stepDirection != direction) {
+                    flag(ENCODER_REVERSAL, profile, 0);
+                }
+                direction = stepDirection;
+                if (distance > GAP_TOLERANCE*spacing.encoderStep) {
+                    Go2UInt64 steps = static_cast<Go2UInt64>(static_cast<double>(distance)/spacing.encoderStep + 0.5);
+                    flag(MISSING_PROFILES, profile, steps - 1);
+                }
+            }
+        } else if (spacing.framePeriod > 0 && profile.timestamp != 0) {
+            if (profile.timestamp == previousTimestamp) {
+                flag(DUPLICATE_PROFILE, profile, 0);
+            } else if (elapsed > GAP_TOLERANCE*spacing.framePeriod) {
+                Go2UInt64 periods = static_cast<Go2UInt64>(static_cast<double>(elapsed)/spacing.framePeriod + 0.5);
+                flag(MISSING_PROFILES, profile, periods - 1);
+            }
+        }
+    }
+    havePrevious = true;
+    previousEncoder = profile.encoder;
+    previousTimestamp = profile.timestamp;
+    profileNumber++;
+}
+
+// Counts and keeps the span, warning at most once per GAP_WARNING_INTERVAL
+void GapDetector::flag(GapType type, const Profile& profile, Go2UInt64 lost) {
+    switch (type) {
+        case MISSING_PROFILES:
+            increment(gaps, 1);
+            increment(missing, lost);
+            break;
+        case DUPLICATE_PROFILE:
+            increment(duplicates, 1);
+            break;
+        case ENCODER_REVERSAL:
+            increment(reversals, 1);
+    }
+    if (spans.size() < GAP_SPAN_LIMIT) {
+        GapSpan span;
+        span.type = type;
+        span.profile = profileNumber;
+        span.encoderFrom = previousEncoder;
+        span.encoderTo = profile.encoder;
+        span.timestampFrom = previousTimestamp;
+        span.timestampTo = profile.timestamp;
+        span.missing = lost;
+        spans.push_back(span);
+    }
+    Go2UInt64 now = monotonicMicroseconds();
+    if (lastWarning != 0 && now - lastWarning < GAP_WARNING_INTERVAL) {
+        unwarned++;
+        return;
+    }
+    lastWarning = now;
+    std::cerr << "<< ";
+    switch (type) {
+        case MISSING_PROFILES:
+            std::cerr << "About " << lost << " profile(s) missing";
+            break;
+        case DUPLICATE_PROFILE:
+            std::cerr << "Duplicate profile";
+            break;
+        case ENCODER_REVERSAL:
+            std::cerr << "Encoder reversed";
+    }
+    std::cerr << " at Y = " << position(profile.encoder) << " mm (profile " << profileNumber << ")";
+    if (unwarned > 0) {
+        std::cerr << ", " << unwarned << " more since the last warning";
+        unwarned = 0;
+    }
+    std::cerr << " >>" << std::endl;
+}
+
+bool GapDetector::save(const std::string& filename) const {
+    std::ofstream fidout(filename.c_str());
+    fidout << "# type, profile, encoder from, encoder to, Y from [mm], Y to [mm], timestamp from [us], timestamp to [us], missing profiles\n";
+    for (size_t i=0; i<spans.size(); i++) {
+        const GapSpan& span = spans[i];
+        switch (span.type) {
+            case MISSING_PROFILES:
+                fidout << "missing";
+                break;
+            case DUPLICATE_PROFILE:
+                fidout << "duplicate";
+                break;
+            case ENCODER_REVERSAL:
+                fidout << "reversal";
+        }
+        fidout << "," << span.profile << "," << span.encoderFrom << "," << span.encoderTo
+               << "," << position(span.encoderFrom) << "," << position(span.encoderTo)
+               << "," << span.timestampFrom << "," << span.timestampTo << "," << span.missing << "\n";
+    }
+    if (gapCount() + duplicateCount() + reversalCount() > spans.size()) {
+        fidout << "# " << gapCount() + duplicateCount() + reversalCount() - spans.size() << " more not listed\n";
+    }
+    fidout.flush();
+    return static_cast<bool>(fidout);
+}
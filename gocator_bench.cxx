@@ -0,0 +1,590 @@
+/* gocator_bench - acquisition throughput benchmark (make bench)
+
+Usage: gocator_bench [--profiles n] [--duration s] [--json results.json] [--folder path]
+
+First checks every range conversion path the CPU supports against the scalar
+loop (bit-for-bit, aborting on any difference) and times each of them.
+Then two passes for each output mode and Gocator 20x0 profile width:
+  * conversion - formats synthetic profiles and writes them as fast as possible,
+    reporting points/s, profiles/s, bytes, heap allocations in the steady state
+    and p50/p99 per-profile latency (format + any block write it triggered)
+  * pipeline - runs the full receive/convert/write pipeline against the
+    synthetic source at 300-5000 Hz and reports whether it kept up
+Every host-side filter (outlier rejection, gap filling, median/mean/Wiener
+smoothing along X and Y) is checked against the scalar loop on each path the
+same way and timed per profile.
+Also times the always-on stage instrumentation (two clock reads and a
+histogram update), which the pipeline pays once per profile and per block,
+and counts heap allocations in the receive loop once its pools are warm -
+any at all fail the benchmark, as they would at every frame.
+Results are also written as JSON so they can be compared between releases.
+*/
+#include "recordingpipeline.h"
+#include "profilesource.h"
+#include "profilewriter.h"
+#include "csvwriter.h"
+#include "outputfile.h"
+#include "rangeconvert.h"
+#include "rangefilter.h"
+#include "histogram.h"
+
+#include <boost/atomic.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace opts = boost::program_options;
+namespace filesystem = boost::filesystem;
+
+// Every heap allocation in the process goes through here so the
+// benchmark can count them.  Kept out of line so the compiler doesn't pair
+// the inlined malloc/free with new/delete and warn.
+static boost::atomic<Go2UInt64> allocationCount(0);
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocationCount.fetch_add(1, boost::memory_order_relaxed);
+    void* memory = malloc(size ? size : 1);
+    if (memory == NULL) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+__attribute__((noinline)) void* operator new[](size_t size) {
+    return operator new(size);
+}
+__attribute__((noinline)) void operator delete(void* memory) throw() {
+    free(memory);
+}
+__attribute__((noinline)) void operator delete[](void* memory) throw() {
+    free(memory);
+}
+__attribute__((noinline)) void operator delete(void* memory, size_t) throw() {
+    free(memory);
+}
+__attribute__((noinline)) void operator delete[](void* memory, size_t) throw() {
+    free(memory);
+}
+
+static const unsigned int profileWidths[] = {640, 1280};
+static const double frameRates[] = {300, 1000, 2500, 5000};
+
+typedef struct conversionResult {
+    std::string format;
+    unsigned int width;
+    Go2UInt64 profiles, points, bytes, allocations;
+    double seconds, p50, p99; // latencies in microseconds
+} ConversionResult;
+
+typedef struct kernelResult {
+    std::string path;
+    double doublePointsPerSecond, floatPointsPerSecond;
+} KernelResult;
+
+typedef struct filterResult {
+    std::string name, path;
+    double microseconds; // per 1280-point profile
+} FilterResult;
+
+typedef struct pipelineResult {
+    std::string format;
+    unsigned int width;
+    double frameRate, achievedRate;
+    PipelineStats stats;
+} PipelineResult;
+
+OutputSettings outputSettings(OutputFormat format) {
+    OutputSettings settings;
+    settings.format = format;
+    settings.xPrecision = settings.yPrecision = settings.zPrecision = CSV_DEFAULT_PRECISION;
+    return settings;
+}
+
+SyntheticSettings syntheticSettings(unsigned int width, double frameRate, Go2UInt64 profileCount) {
+    SyntheticSettings settings;
+    settings.width = width;
+    settings.frameRate = frameRate;
+    settings.invalidRatio = 0.02;
+    settings.encoderStep = 10;
+    settings.profileCount = profileCount;
+    settings.lostRatio = 0;
+    return settings;
+}
+
+ScanInfo benchInfo() {
+    ScanInfo info;
+    info.comment = "gocator_bench";
+    info.startingEncoder = 0;
+    info.encoderResolution = 0.01;
+    return info;
+}
+
+double percentile(std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction*(sorted.size()-1) + 0.5);
+    return sorted[index];
+}
+
+// Compares two arrays bit for bit
+template<typename T> bool identical(const std::vector<T>& a, const std::vector<T>& b, size_t count) {
+    return count == 0 || memcmp(&a[0], &b[0], count*sizeof(T)) == 0;
+}
+
+// Runs convertRanges and compactRanges on the active path
+template<typename T> unsigned int runKernels(const std::vector<short>& ranges, unsigned int count, T xOffset,
+                                             std::vector<T>& x, std::vector<T>& z, std::vector<unsigned char>& valid,
+                                             std::vector<T>& packedX, std::vector<T>& packedZ) {
+    convertRanges(&ranges[0], count, xOffset, T(0.0125), T(20.0), T(0.00125), &x[0], &z[0], &valid[0]);
+    return compactRanges(&ranges[0], count, xOffset, T(0.0125), T(20.0), T(0.00125), &packedX[0], &packedZ[0]);
+}
+
+// Checks one path against the scalar loop over assorted widths and dropout patterns
+template<typename T> bool verifyPath(ConversionPath path) {
+    std::vector<short> ranges(1300);
+    std::vector<T> x(1300), z(1300), packedX(1300), packedZ(1300);
+    std::vector<T> refX(1300), refZ(1300), refPackedX(1300), refPackedZ(1300);
+    std::vector<unsigned char> valid(1300/8+1), refValid(1300/8+1);
+    Go2UInt32 seed = 12345;
+    for (unsigned int count=0; count<=1300; count += (count < 40 ? 1 : 97)) {
+        for (unsigned int i=0; i<count; i++) {
+            seed = seed*1103515245u + 12345u;
+            ranges[i] = (seed >> 16) % 5 == 0 ? static_cast<short>(INVALID_RANGE_16BIT) : static_cast<short>(seed >> 8);
+        }
+        if (count == 0) {
+            continue;
+        }
+        useConversionPath(SCALAR_PATH);
+        unsigned int refPacked = runKernels(ranges, count, T(-8.0), refX, refZ, refValid, refPackedX, refPackedZ);
+        useConversionPath(path);
+        unsigned int packed = runKernels(ranges, count, T(-8.0), x, z, valid, packedX, packedZ);
+        if (packed != refPacked || !identical(x, refX, count) || !identical(z, refZ, count) ||
+            !identical(valid, refValid, (count+7)/8) ||
+            !identical(packedX, refPackedX, packed) || !identical(packedZ, refPackedZ, packed)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Points per second through compactRanges on the active path
+template<typename T> double timeKernel(const std::vector<short>& ranges, Go2UInt64 repeats) {
+    std::vector<T> x(ranges.size()), z(ranges.size());
+    unsigned int total = 0;
+    Go2UInt64 start = monotonicMicroseconds();
+    for (Go2UInt64 i=0; i<repeats; i++) {
+        total += compactRanges(&ranges[0], ranges.size(), T(-8.0), T(0.0125), T(20.0), T(0.00125), &x[0], &z[0]);
+    }
+    double seconds = (monotonicMicroseconds() - start)/1e6;
+    return total > 0 && seconds > 0 ? ranges.size()*repeats/seconds : 0;
+}
+
+// Verifies and times every conversion path this CPU supports
+bool benchKernels(Go2UInt64 repeats, std::vector<KernelResult>& results) {
+    Profile profile;
+    SyntheticProfileSource source(syntheticSettings(1280, 0, 0));
+    source.start();
+    source.receive(RECEIVE_TIMEOUT);
+    source.profileAt(0, profile);
+    // The profile only borrows its ranges from the source's batch
+    std::vector<short> ranges(profile.rangeData(), profile.rangeData() + profile.width());
+    bool ok = true;
+    for (int path=SCALAR_PATH; path<=bestConversionPath(); path++) {
+        ConversionPath current = static_cast<ConversionPath>(path);
+        if (!verifyPath<double>(current) || !verifyPath<float>(current)) {
+            std::cerr << "<< " << conversionPathName(current) << " conversion differs from scalar >>" << std::endl;
+            ok = false;
+            continue;
+        }
+        useConversionPath(current);
+        KernelResult result;
+        result.path = conversionPathName(current);
+        result.doublePointsPerSecond = timeKernel<double>(ranges, repeats);
+        result.floatPointsPerSecond = timeKernel<float>(ranges, repeats);
+        results.push_back(result);
+    }
+    useConversionPath(bestConversionPath());
+    return ok;
+}
+
+RangeFilterSettings filterSettings(double zLow, double zHigh, unsigned int gapFill,
+                                   SmoothingMethod xMethod, unsigned int xWindow,
+                                   SmoothingMethod yMethod, unsigned int yWindow) {
+    RangeFilterSettings settings;
+    settings.zLow = zLow;
+    settings.zHigh = zHigh;
+    settings.gapFill = gapFill;
+    settings.xMethod = xMethod;
+    settings.xWindow = xWindow;
+    settings.yMethod = yMethod;
+    settings.yWindow = yWindow;
+    settings.noise = 0;
+    return settings;
+}
+
+// Noisy profiles with dropouts, so the filters have something to do
+std::vector<Profile> noisyProfiles(unsigned int width, size_t count) {
+    std::vector<Profile> profiles(count);
+    Go2UInt32 seed = 2024;
+    for (size_t p=0; p<count; p++) {
+        Profile& profile = profiles[p];
+        profile.encoder = static_cast<Go2Int64>(p)*10;
+        profile.xOffset = -0.5*width*0.02;
+        profile.xResolution = 0.02;
+        profile.zOffset = 20.0;
+        profile.zResolution = 0.001;
+        profile.ranges.resize(width);
+        for (unsigned int i=0; i<width; i++) {
+            seed = seed*1103515245u + 12345u;
+            if ((seed >> 16) % 20 == 0) {
+                profile.ranges[i] = static_cast<short>(INVALID_RANGE_16BIT);
+            } else {
+                int triangle = static_cast<int>(i % 256) - 128;
+                profile.ranges[i] = static_cast<short>(triangle*40 + static_cast<int>((seed >> 8) % 401) - 200);
+            }
+        }
+    }
+    return profiles;
+}
+
+// Filters every profile on the active path, returning all the output ranges
+std::vector<short> runFilter(const RangeFilterSettings& settings, const std::vector<Profile>& profiles) {
+    RangeFilter filter;
+    filter.reset(settings);
+    std::vector<short> out;
+    const Profile* filtered;
+    for (size_t p=0; p<=profiles.size(); p++) {
+        if (p < profiles.size()) {
+            filter.add(profiles[p]);
+        } else {
+            filter.finish();
+        }
+        while ((filtered = filter.next()) != NULL) {
+            out.insert(out.end(), filtered->ranges.begin(), filtered->ranges.end());
+        }
+    }
+    return out;
+}
+
+// Checks every filter on every path against the scalar loop, then times
+// them on the best path
+bool benchFilters(Go2UInt64 repeats, std::vector<FilterResult>& results) {
+    const char* names[] = {"reject+fill", "median x5", "median x15", "mean x15", "wiener x15",
+                           "median y5", "mean y15", "wiener y15"};
+    RangeFilterSettings settings[] = {
+        filterSettings(16.0, 24.0, 3, SMOOTH_NONE, 1, SMOOTH_NONE, 1),
+        filterSettings(0, 0, 0, SMOOTH_MEDIAN, 5, SMOOTH_NONE, 1),
+        filterSettings(0, 0, 0, SMOOTH_MEDIAN, 15, SMOOTH_NONE, 1),
+        filterSettings(0, 0, 0, SMOOTH_MEAN, 15, SMOOTH_NONE, 1),
+        filterSettings(0, 0, 0, SMOOTH_WIENER, 15, SMOOTH_NONE, 1),
+        filterSettings(0, 0, 0, SMOOTH_NONE, 1, SMOOTH_MEDIAN, 5),
+        filterSettings(0, 0, 0, SMOOTH_NONE, 1, SMOOTH_MEAN, 15),
+        filterSettings(0, 0, 0, SMOOTH_NONE, 1, SMOOTH_WIENER, 15)
+    };
+    size_t filterCount = sizeof(settings)/sizeof(settings[0]);
+    bool ok = true;
+    // Odd widths leave work for the scalar tail
+    unsigned int widths[] = {1280, 1283};
+    for (size_t w=0; w<2; w++) {
+        std::vector<Profile> profiles = noisyProfiles(widths[w], 40);
+        for (size_t f=0; f<filterCount; f++) {
+            useConversionPath(SCALAR_PATH);
+            std::vector<short> reference = runFilter(settings[f], profiles);
+            for (int path=SSE2_PATH; path<=bestConversionPath(); path++) {
+                useConversionPath(static_cast<ConversionPath>(path));
+                if (runFilter(settings[f], profiles) != reference) {
+                    std::cerr << "<< " << conversionPathName(static_cast<ConversionPath>(path)) << " " << names[f]
+                              << " filter differs from scalar >>" << std::endl;
+                    ok = false;
+                }
+            }
+        }
+    }
+    useConversionPath(bestConversionPath());
+    std::vector<Profile> profiles = noisyProfiles(1280, 64);
+    for (size_t f=0; f<filterCount; f++) {
+        RangeFilter filter;
+        filter.reset(settings[f]);
+        Go2UInt64 start = monotonicNanoseconds();
+        for (Go2UInt64 i=0; i<repeats; i++) {
+            filter.add(profiles[i % profiles.size()]);
+            while (filter.next() != NULL) {
+            }
+        }
+        FilterResult result;
+        result.name = names[f];
+        result.path = conversionPathName(bestConversionPath());
+        result.microseconds = repeats > 0 ? (monotonicNanoseconds() - start)/1e3/repeats : 0;
+        results.push_back(result);
+    }
+    return ok;
+}
+
+// Formats and writes profiles on one thread as fast as possible
+ConversionResult benchConversion(OutputFormat format, unsigned int width, Go2UInt64 profileCount,
+                                 const std::string& filename) {
+    ConversionResult result;
+    result.width = width;
+    result.profiles = profileCount;
+    result.points = 0;
+    SyntheticProfileSource source(syntheticSettings(width, 0, 0));
+    source.start();
+    // Pre-generate so only formatting and writing are timed
+    std::vector<Profile> profiles(256);
+    for (size_t i=0; i<profiles.size(); ) {
+        unsigned int count = source.receive(RECEIVE_TIMEOUT);
+        for (unsigned int j=0; j<count && i<profiles.size(); j++, i++) {
+            source.profileAt(j, profiles[i]);
+        }
+    }
+    std::vector<double> latencies;
+    latencies.reserve(profileCount);
+    boost::shared_ptr<ProfileWriter> writer(createProfileWriter(outputSettings(format)));
+    result.format = writer->getFormatName();
+    filesystem::remove(filename);
+    OutputFile fidout;
+    fidout.open(filename);
+    std::string block;
+    block.reserve(2*OUTPUT_BLOCK_SIZE);
+    writer->writeHeader(benchInfo(), block);
+    // First pass over the profiles warms up the writer's buffers
+    for (size_t i=0; i<profiles.size(); i++) {
+        writer->writeProfile(profiles[i], block);
+    }
+    block.clear();
+    Go2UInt64 allocationsBefore = allocationCount.load();
+    Go2UInt64 start = monotonicMicroseconds();
+    for (Go2UInt64 i=0; i<profileCount; i++) {
+        Profile& profile = profiles[i % profiles.size()];
+        profile.encoder = static_cast<Go2Int64>(i)*10;
+        Go2UInt64 before = monotonicMicroseconds();
+        writer->writeProfile(profile, block);
+        if (block.size() >= OUTPUT_BLOCK_SIZE) {
+            fidout.write(block);
+            block.clear();
+        }
+        latencies.push_back(static_cast<double>(monotonicMicroseconds() - before));
+        const short* ranges = profile.rangeData();
+        for (size_t k=0; k<profile.width(); k++) {
+            if (ranges[k] != static_cast<short>(INVALID_RANGE_16BIT)) {
+                result.points++;
+            }
+        }
+    }
+    writer->writeFooter(block);
+    fidout.write(block);
+    fidout.close();
+    result.seconds = (monotonicMicroseconds() - start)/1e6;
+    result.allocations = allocationCount.load() - allocationsBefore;
+    result.bytes = fidout.bytesWritten();
+    std::sort(latencies.begin(), latencies.end());
+    result.p50 = percentile(latencies, 0.50);
+    result.p99 = percentile(latencies, 0.99);
+    filesystem::remove(filename);
+    return result;
+}
+
+// Nanoseconds per timed stage: clock before and after plus a histogram record
+double benchInstrumentation(Go2UInt64 repeats) {
+    Histogram histogram;
+    Go2UInt64 start = monotonicNanoseconds();
+    for (Go2UInt64 i=0; i<repeats; i++) {
+        Go2UInt64 stageStart = monotonicNanoseconds();
+        histogram.record(monotonicNanoseconds() - stageStart);
+    }
+    return static_cast<double>(monotonicNanoseconds() - start)/repeats;
+}
+
+// Heap allocations receiving profileCount profiles after every pooled batch
+// and Profile has been through the loop once.  Profiles are taken off the
+// queue and recycled as soon as each batch is in, as the conversion thread would.
+Go2UInt64 benchReceiveAllocations(unsigned int width, Go2UInt64 profileCount) {
+    SyntheticProfileSource source(syntheticSettings(width, 0, 0));
+    ProfileQueue queue(PROFILE_QUEUE_DEPTH);
+    source.start();
+    Go2UInt64 warmup = 2*(BATCH_POOL_DEPTH + PROFILE_QUEUE_DEPTH);
+    Go2UInt64 received = 0;
+    Go2UInt64 allocationsBefore = 0;
+    bool warm = false;
+    while (received < warmup + profileCount) {
+        if (!warm && received >= warmup) {
+            allocationsBefore = allocationCount.load();
+            warm = true;
+        }
+        received += queue.receiveBatch(source);
+        Profile* profile = NULL;
+        while (queue.take(profile)) {
+            queue.recycle(profile);
+        }
+    }
+    return allocationCount.load() - allocationsBefore;
+}
+
+// Runs the threaded pipeline against the synthetic source at a fixed frame rate
+PipelineResult benchPipeline(OutputFormat format, unsigned int width, double frameRate, double duration,
+                             const std::string& filename) {
+    PipelineResult result;
+    result.width = width;
+    result.frameRate = frameRate;
+    Go2UInt64 profileCount = static_cast<Go2UInt64>(frameRate*duration);
+    SyntheticProfileSource source(syntheticSettings(width, frameRate, profileCount));
+    boost::shared_ptr<ProfileWriter> writer(createProfileWriter(outputSettings(format)));
+    result.format = writer->getFormatName();
+    filesystem::remove(filename);
+    OutputFile fidout;
+    fidout.open(filename);
+    Go2UInt64 start = monotonicMicroseconds();
+    {
+        RecordingPipeline pipeline(fidout, *writer, benchInfo());
+        source.start();
+        pipeline.start();
+        pipeline.run(source);
+        pipeline.finish();
+        result.stats = pipeline.stats();
+    }
+    double seconds = (monotonicMicroseconds() - start)/1e6;
+    result.achievedRate = seconds > 0 ? result.stats.written/seconds : 0;
+    fidout.close();
+    filesystem::remove(filename);
+    return result;
+}
+
+void writeJson(std::ostream& os, const std::vector<KernelResult>& kernels, double instrumentation,
+               Go2UInt64 receiveAllocations, const std::vector<FilterResult>& filters,
+               const std::vector<ConversionResult>& conversions, const std::vector<PipelineResult>& pipelines) {
+    os << "{\n  \"instrumentation_ns\": " << instrumentation << ",\n";
+    os << "  \"receive_allocations\": " << receiveAllocations << ",\n";
+    os << "  \"kernel\": [\n";
+    for (size_t i=0; i<kernels.size(); i++) {
+        const KernelResult& r = kernels[i];
+        os << "    {\"path\": \"" << r.path << "\", \"double_points_per_second\": " << r.doublePointsPerSecond
+           << ", \"float_points_per_second\": " << r.floatPointsPerSecond << "}"
+           << (i+1 < kernels.size() ? ",\n" : "\n");
+    }
+    os << "  ],\n  \"filter\": [\n";
+    for (size_t i=0; i<filters.size(); i++) {
+        const FilterResult& r = filters[i];
+        os << "    {\"filter\": \"" << r.name << "\", \"path\": \"" << r.path
+           << "\", \"us_per_profile\": " << r.microseconds << "}"
+           << (i+1 < filters.size() ? ",\n" : "\n");
+    }
+    os << "  ],\n  \"conversion\": [\n";
+    for (size_t i=0; i<conversions.size(); i++) {
+        const ConversionResult& r = conversions[i];
+        os << "    {\"format\": \"" << r.format << "\", \"width\": " << r.width
+           << ", \"profiles\": " << r.profiles << ", \"points\": " << r.points
+           << ", \"seconds\": " << r.seconds
+           << ", \"points_per_second\": " << r.points/r.seconds
+           << ", \"profiles_per_second\": " << r.profiles/r.seconds
+           << ", \"bytes_written\": " << r.bytes << ", \"allocations\": " << r.allocations
+           << ", \"latency_p50_us\": " << r.p50 << ", \"latency_p99_us\": " << r.p99 << "}"
+           << (i+1 < conversions.size() ? ",\n" : "\n");
+    }
+    os << "  ],\n  \"pipeline\": [\n";
+    for (size_t i=0; i<pipelines.size(); i++) {
+        const PipelineResult& r = pipelines[i];
+        os << "    {\"format\": \"" << r.format << "\", \"width\": " << r.width
+           << ", \"frame_rate\": " << r.frameRate << ", \"achieved_rate\": " << r.achievedRate
+           << ", \"received\": " << r.stats.received << ", \"written\": " << r.stats.written
+           << ", \"dropped\": " << r.stats.dropped << ", \"bytes_written\": " << r.stats.bytesWritten
+           << ", \"profile_queue_high_water\": " << r.stats.profileHighWater
+           << ", \"block_queue_high_water\": " << r.stats.blockHighWater << "}"
+           << (i+1 < pipelines.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    opts::options_description opt_desc("Available options");
+    opt_desc.add_options()
+        ("profiles,n", opts::value<Go2UInt64>()->default_value(5000), "profiles per conversion run")
+        ("duration,d", opts::value<double>()->default_value(1.0), "seconds per pipeline run (0 to skip)")
+        ("json,j", opts::value<std::string>()->default_value("bench_results.json"), "machine-readable results")
+        ("folder", opts::value<std::string>(), "folder for scratch output (default system temp)")
+        ("help,h", "display basic help information")
+    ;
+    opts::variables_map cmdline;
+    opts::store(opts::parse_command_line(argc, argv, opt_desc), cmdline);
+    opts::notify(cmdline);
+    if (cmdline.count("help")) {
+        std::cout << opt_desc << std::endl;
+        return 1;
+    }
+    filesystem::path folder = cmdline.count("folder") ? filesystem::path(cmdline["folder"].as<std::string>())
+                                                      : filesystem::temp_directory_path();
+    std::string scratch = (folder / "gocator_bench.out").string();
+    Go2UInt64 profileCount = cmdline["profiles"].as<Go2UInt64>();
+    double duration = cmdline["duration"].as<double>();
+    OutputFormat formats[] = {CSV, BINARY, COMPRESSED};
+
+    std::vector<KernelResult> kernels;
+    std::vector<FilterResult> filters;
+    std::vector<ConversionResult> conversions;
+    std::vector<PipelineResult> pipelines;
+    std::cout << "conversion path  double points/s  float points/s" << std::endl;
+    if (!benchKernels(profileCount, kernels)) {
+        return 1;
+    }
+    for (size_t k=0; k<kernels.size(); k++) {
+        std::cout << kernels[k].path << "\t\t " << kernels[k].doublePointsPerSecond
+                  << "\t  " << kernels[k].floatPointsPerSecond << std::endl;
+    }
+    std::cout << "\nfilter       path    us/profile (1280 points)" << std::endl;
+    if (!benchFilters(profileCount, filters)) {
+        return 1;
+    }
+    for (size_t f=0; f<filters.size(); f++) {
+        std::cout << filters[f].name << "\t" << (filters[f].name.size() < 8 ? "\t" : "") << filters[f].path
+                  << "\t" << filters[f].microseconds << std::endl;
+    }
+    double instrumentation = benchInstrumentation(1000000);
+    std::cout << "\nstage instrumentation  " << instrumentation << " ns per timing" << std::endl;
+    Go2UInt64 receiveAllocations = benchReceiveAllocations(profileWidths[0], profileCount);
+    std::cout << "receive loop  " << receiveAllocations << " allocations in " << profileCount << " profiles" << std::endl;
+    if (receiveAllocations > 0) {
+        std::cerr << "<< Receive loop allocates in the steady state, aborting >>" << std::endl;
+        return 1;
+    }
+    std::cout << std::endl;
+    std::cout << "format  width   points/s    profiles/s  MB written  allocs  p50 [us]  p99 [us]" << std::endl;
+    for (size_t f=0; f<sizeof(formats)/sizeof(formats[0]); f++) {
+        for (size_t w=0; w<sizeof(profileWidths)/sizeof(profileWidths[0]); w++) {
+            ConversionResult r = benchConversion(formats[f], profileWidths[w], profileCount, scratch);
+            conversions.push_back(r);
+            std::ostringstream line;
+            line.precision(4);
+            line << r.format << "\t" << r.width << "\t" << r.points/r.seconds << "\t" << r.profiles/r.seconds
+                 << "\t" << r.bytes/1048576.0 << "\t" << r.allocations << "\t" << r.p50 << "\t" << r.p99;
+            std::cout << line.str() << std::endl;
+        }
+    }
+    if (duration > 0) {
+        std::cout << "\nformat  width   rate [Hz]  achieved  dropped  queue high-water" << std::endl;
+        for (size_t f=0; f<sizeof(formats)/sizeof(formats[0]); f++) {
+            for (size_t w=0; w<sizeof(profileWidths)/sizeof(profileWidths[0]); w++) {
+                for (size_t r=0; r<sizeof(frameRates)/sizeof(frameRates[0]); r++) {
+                    PipelineResult p = benchPipeline(formats[f], profileWidths[w], frameRates[r], duration, scratch);
+                    pipelines.push_back(p);
+                    std::ostringstream line;
+                    line.precision(5);
+                    line << p.format << "\t" << p.width << "\t" << p.frameRate << "\t" << p.achievedRate
+                         << "\t" << p.stats.dropped << "\t" << p.stats.profileHighWater;
+                    std::cout << line.str() << std::endl;
+                }
+            }
+        }
+    }
+    std::string jsonFilename = cmdline["json"].as<std::string>();
+    std::ofstream json(jsonFilename.c_str());
+    writeJson(json, kernels, instrumentation, receiveAllocations, filters, conversions, pipelines);
+    std::cout << "\nResults written to '" << jsonFilename << "'" << std::endl;
+    return 0;
+}
@@ -0,0 +1,75 @@
+/* gocator_client - sends requests to a gocator_encoder scan server
+
+Usage: gocator_client [--socket path] [--time] start <output> [comment ...]
+       gocator_client [--socket path] [--time] stop|status|configure|shutdown
+Sends one request (see include/scanserver.h) to a server started with
+'gocator_encoder --serve' and prints its reply.  The output file is passed
+on as an absolute path, since the server may be running in another folder.
+Exits with 0 if the server replied "ok", 1 otherwise.
+*/
+#include "scansocket.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace opts = boost::program_options;
+namespace filesystem = boost::filesystem;
+
+int main(int argc, char* argv[]) {
+    opts::options_description opt_desc("Available options");
+    opt_desc.add_options()
+        ("request", opts::value<std::vector<std::string> >(), "request and its arguments")
+        ("socket,s", opts::value<std::string>()->default_value(SCAN_SERVER_SOCKET), "server socket")
+        ("time,t", "print the request's round trip time")
+        ("help,h", "display basic help information")
+    ;
+    opts::positional_options_description positional;
+    positional.add("request", -1);
+    opts::variables_map cmdline;
+    opts::store(opts::command_line_parser(argc, argv).options(opt_desc).positional(positional).run(), cmdline);
+    opts::notify(cmdline);
+    if (cmdline.count("help") || !cmdline.count("request")) {
+        std::cout << "Usage: gocator_client [options] start <output> [comment] | stop | status | configure | shutdown\n"
+                  << opt_desc << std::endl;
+        return 1;
+    }
+    std::vector<std::string> words = cmdline["request"].as<std::vector<std::string> >();
+    if (words[0] == "start") {
+        if (words.size() < 2) {
+            std::cerr << "<< start needs an output file, aborting >>" << std::endl;
+            return 1;
+        }
+        words[1] = filesystem::absolute(words[1]).string();
+    }
+    std::string request;
+    for (size_t i=0; i<words.size(); i++) {
+        if (words[i].find('\n') != std::string::npos) {
+            std::cerr << "<< Requests are a single line, aborting >>" << std::endl;
+            return 1;
+        }
+        request += (i > 0 ? " " : "") + words[i];
+    }
+    std::string socketPath = cmdline["socket"].as<std::string>();
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    ScanSocket server;
+    if (!server.connect(socketPath)) {
+        std::cerr << "<< Unable to reach a scan server at '" << socketPath << "': " << strerror(errno)
+                  << " >>" << std::endl;
+        return 1;
+    }
+    std::string reply;
+    if (!server.writeLine(request) || !server.readLine(reply)) {
+        std::cerr << "<< Scan server at '" << socketPath << "' didn't reply >>" << std::endl;
+        return 1;
+    }
+    double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds()/1e6;
+    std::cout << reply << std::endl;
+    if (cmdline.count("time")) {
+        std::cout << "<< Round trip " << seconds*1000 << " ms >>" << std::endl;
+    }
+    return reply.compare(0, 2, "ok") == 0 ? 0 : 1;
+}
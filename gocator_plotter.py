@@ -19,6 +19,10 @@ import scipy.signal
 import os.path
 import sys
 import fileinput
+try:
+    import gocatorscan
+except ImportError: # _gocatorscan not built (make python) - CSV scans only
+    gocatorscan = None
 
 widget_margin = 3 # Default margin around widgets
 ctrl_pct = 1.0 # Default to 100% resizing factor for controls
@@ -26,6 +30,39 @@ lbl_pct = 0.25 # Default to 25% resizing factor for labels
 sizer_flags = wx.ALL | wx.EXPAND # Default resizing flags for controls
 lblsizer_flags = wx.ALIGN_CENTRE_VERTICAL | wx.ALL # Default resizing flags for labels
 
+def is_filtered(data_fname):
+    """Returns True if the scan's header comment says it was filtered on the way to disk."""
+    if gocatorscan is not None and gocatorscan.is_scan(data_fname):
+        return gocatorscan.Scan(data_fname).is_filtered()
+    with open(data_fname) as fidin:
+        for line in fidin:
+            if not line.startswith('#'):
+                break
+            if '[filtered:' in line:
+                return True
+    return False
+
+def read_heightmap(hmap_fname):
+    """Reads a height map written alongside a scan (gocator_encoder --heightmap), returning
+    X, Y, Z grids of cell centres with empty cells masked."""
+    with open(hmap_fname, 'rb') as fidin:
+        header = np.fromfile(fidin, dtype=np.dtype([('magic', 'S8'), ('version', '<u4'), ('aggregation', '<u4'),
+                                                     ('columns', '<u4'), ('rows', '<u4'),
+                                                     ('x0', '<f8'), ('y0', '<f8'),
+                                                     ('cell_x', '<f8'), ('cell_y', '<f8')]), count=1)
+        if len(header) != 1 or header['magic'][0] != b'GO2HMAP' or header['version'][0] != 1:
+            raise IOError("Not a height map: {0}".format(hmap_fname))
+        columns = int(header['columns'][0])
+        rows = int(header['rows'][0])
+        z = np.fromfile(fidin, dtype='<f4', count=columns*rows)
+        if z.size != columns*rows:
+            raise IOError("Truncated height map: {0}".format(hmap_fname))
+    xi = header['x0'][0] + (np.arange(columns) + 0.5)*header['cell_x'][0]
+    yi = header['y0'][0] + (np.arange(rows) + 0.5)*header['cell_y'][0]
+    X, Y = np.meshgrid(xi, yi)
+    Z = np.ma.masked_invalid(z.reshape(rows, columns))
+    return X, Y, Z
+
 class FileDropTarget(wx.FileDropTarget):
 
     def __init__(self, window):
@@ -183,18 +220,27 @@ class UI(wx.Frame):
         self.axes.grid(True)
         try:
             wx.BeginBusyCursor()
-            x, y, z = self.get_data(data_fname)
+            hmap_fname = data_fname + '.hmap'
             if self.plot_pointcloud_mnui.IsChecked():
                 # Plot a point cloud
+                x, y, z = self.get_data(data_fname)
                 self.axes.plot(x, y, z, c=self.point_color, linestyle='', marker=',', rasterized=True)
             else:
-                xi = np.linspace(min(x), max(x), num=100)
-                yi = np.linspace(min(y), max(y), num=100)
-                X, Y = np.meshgrid(xi, yi)
-                Z = griddata(x, y, z, xi, yi)
+                if os.path.exists(hmap_fname):
+                    # Already gridded while recording - roughly 100x100 cells are plotted, as below
+                    X, Y, Z = read_heightmap(hmap_fname)
+                    rstride = max(1, Z.shape[0] // 100)
+                    cstride = max(1, Z.shape[1] // 100)
+                else:
+                    x, y, z = self.get_data(data_fname)
+                    xi = np.linspace(min(x), max(x), num=100)
+                    yi = np.linspace(min(y), max(y), num=100)
+                    X, Y = np.meshgrid(xi, yi)
+                    Z = griddata(x, y, z, xi, yi)
+                    rstride = cstride = 1
                 if self.plot_surface_mnui.IsChecked():
                     # Interpolate a surface from the point cloud to plot
-                    surf = self.axes.plot_surface(X, Y, Z, rstride=3, cstride=3, cmap=cm.get_cmap('spectral'), 
+                    surf = self.axes.plot_surface(X, Y, Z, rstride=3*rstride, cstride=3*cstride, cmap=cm.get_cmap('spectral'), 
                                               linewidth=1, antialiased=True)
                     colorbar = self.figure.colorbar(surf)
                     colorbar.set_label("Z Position [mm]")
@@ -202,7 +248,7 @@ class UI(wx.Frame):
                     # Interpolate a wireframe surface from the point cloud to plot
                     # Uses a higher resolution presentation than the surface - surface tends to bog down
                     # on some systems with stride set to 1
-                    surf = self.axes.plot_wireframe(X, Y, Z, rstride=1, cstride=1, color=self.point_color,
+                    surf = self.axes.plot_wireframe(X, Y, Z, rstride=rstride, cstride=cstride, color=self.point_color,
                                               linewidth=1, antialiased=True)
                 self.axes.set_zlim3d(np.min(Z), np.max(Z))
             self.axes.set_xlabel('X Position [mm]')
@@ -229,9 +275,14 @@ class UI(wx.Frame):
             wx.EndBusyCursor()
 
     def get_data(self, data_fname):
-        """Reads the specified data file, optionally filtering the data before returning it as X,Y,Z."""
-        x, y, z = np.genfromtxt(data_fname, delimiter=",", unpack=True)
-        if not self.plotrawdata.IsChecked():
+        """Reads the specified data file, optionally filtering the data before returning it as X,Y,Z.
+        Scans already filtered while recording (or with scanfilter) are returned as-is.
+        Binary and compressed scans are read in place with gocatorscan, if it's built."""
+        if gocatorscan is not None:
+            x, y, z = gocatorscan.read_xyz(data_fname)
+        else:
+            x, y, z = np.genfromtxt(data_fname, delimiter=",", unpack=True)
+        if not self.plotrawdata.IsChecked() and not is_filtered(data_fname):
             xi = x[z>-20]
             yi = y[z>-20]
             zi = scipy.signal.wiener(z[z>-20], mysize=15, noise=1)
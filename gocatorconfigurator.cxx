@@ -1,6 +1,7 @@
 #include "gocatorconfigurator.h"
 
 namespace opts = boost::program_options;
+namespace filesystem = boost::filesystem;
 
 // Case insensitive char comparison, courtesy C++ Cookbook
 inline bool compareChars(char a, char b) {
@@ -12,204 +13,261 @@ bool compareStrings(const std::string& s1, const std::string& s2) {
             std::equal(s1.begin(), s1.end(), s2.begin(), compareChars));
 }
 
-// Returns the device serial number from the config file
-Go2UInt32 GocatorConfigurator::deviceID(std::string& configFile) {
-    Go2UInt32 deviceID;
-    std::ifstream fidin;
-    fidin.open(configFile.c_str());
-    if (fidin.is_open()) {
-        opts::options_description opt_desc("Available options");
-        opt_desc.add_options()
-            ("System.device_id", opts::value<Go2UInt32>()->default_value(0000000), "Device Serial Number");
-        opts::variables_map config;
-        opts::store(opts::parse_config_file(fidin, opt_desc, true), config);
-        opts::notify(config);
-        deviceID = config["System.device_id"].as<Go2UInt32>();
-    }
-    return deviceID;  
+// Reports a bad setting and aborts the load
+static void configError(const std::string& configFile, const std::string& message) {
+    std::cerr << "<< Error in configuration file '" << configFile << "': " << message << " >>" << std::endl;
+    throw std::runtime_error(message);
 }
 
-// Returns a configured encoder from the specified configuration file
-Encoder GocatorConfigurator::configuredEncoder(std::string& configFile) {
-    Encoder configuredEncoder;
-    std::ifstream fidin;
-    fidin.open(configFile.c_str());
-    if (fidin.is_open()) {
-        opts::options_description opt_desc("Available options");
-        opt_desc.add_options()
-            ("Encoder.model", opts::value<std::string>()->default_value("<unspecified>"), "Make/model of encoder")
-            ("Encoder.resolution", opts::value<double>()->default_value(0), "Resolution of encoder [mm per 'tick']")
-            ("Encoder.travel_threshold", opts::value<double>()->default_value(0), "Desired trigger threshold [mm]")
-            ("Encoder.travel_direction", opts::value<std::string>()->default_value("bidirectional"), "Trigger direction");
-        opts::variables_map config;
-        opts::store(opts::parse_config_file(fidin, opt_desc, true), config);
-        opts::notify(config);
-        configuredEncoder.modelName = config["Encoder.model"].as<std::string>();
-        configuredEncoder.resolution = config["Encoder.resolution"].as<double>();
-        assert(configuredEncoder.resolution > 0);
-    }
-    return configuredEncoder;
+// Reads a true/false setting
+static bool configuredFlag(const std::string& configFile, const std::string& key, const std::string& value) {
+    if (compareStrings(value, "true")) {
+        return true;
+    } else if (!compareStrings(value, "false")) {
+        configError(configFile, key + " must be 'true' or 'false', not '" + value + "'");
+    }
+    return false;
 }
 
-// Configures trigger for the specified GocatorControl
-Trigger* GocatorConfigurator::configuredTrigger(std::string& configFile) {
-    std::ifstream fidin;
-    fidin.open(configFile.c_str());
-    if (fidin.is_open()) {
-        opts::options_description opt_desc("Available options");
-        opt_desc.add_options()
-            ("Trigger.type", opts::value<std::string>()->default_value("Time"), "Type of trigger")
-            ("Trigger.frame_rate", opts::value<double>()->default_value(0), "Frame rate of time trigger [Hz]")
-            ("Trigger.travel_threshold", opts::value<double>()->default_value(0), "Desired trigger threshold [mm]")
-            ("Trigger.travel_direction", opts::value<std::string>()->default_value("bidirectional"), "Trigger direction")
-            ("Trigger.enable_gate", opts::value<std::string>()->default_value("false"), "Enable trigger gates");
-        opts::variables_map config;
-        opts::store(opts::parse_config_file(fidin, opt_desc, true), config);
-        opts::notify(config);
-        std::string triggerType = config["Trigger.type"].as<std::string>();
-        if (compareStrings(triggerType, "encoder")) {
-            EncoderTrigger trig;                
-            trig.setTravelThreshold(config["Trigger.travel_threshold"].as<double>());
-            std::string travel_direction = config["Trigger.travel_direction"].as<std::string>();
-            enum TravelDirection travel_dir;
-            if (compareStrings(travel_direction, "forward")) {
-                travel_dir = FORWARD;
-            } else if (compareStrings(travel_direction, "backward")) {
-                travel_dir = BACKWARD;
-            } else {
-                travel_dir = BIDIRECTIONAL;
-            }
-            trig.setTravelDirection(travel_dir);
-            bool enableGate = false;
-            if (compareStrings(config["Trigger.enable_gate"].as<std::string>(), "true")) {
-                enableGate = true;
-            }
-            trig.setTriggerGate(enableGate);
-            return new EncoderTrigger(trig);
-        } else if (compareStrings(triggerType, "Input")) {
-            InputTrigger trig;
-            bool enableGate = false;
-            if (compareStrings(config["Trigger.enable_gate"].as<std::string>(), "true")) {
-                enableGate = true;
-            }
-            trig.setTriggerGate(enableGate);
-            return new InputTrigger(trig);
-        } else if (compareStrings(triggerType, "Software")) {
-            SoftwareTrigger trig;
-            bool enableGate = false;
-            if (compareStrings(config["Trigger.enable_gate"].as<std::string>(), "true")) {
-                enableGate = true;
-            }
-            trig.setTriggerGate(enableGate);
-            return new SoftwareTrigger(trig);
-        } else { // default to time triggering
-            TimeTrigger trig;
-            trig.setFrameRate(config["Trigger.frame_rate"].as<double>());
-            bool enableGate = false;
-            if (compareStrings(config["Trigger.enable_gate"].as<std::string>(), "true")) {
-                enableGate = true;
-            }
-            trig.setTriggerGate(enableGate);
-            return new TimeTrigger(trig);
-        }
+static Go2IPAddress configuredAddress(const std::string& configFile, const std::string& key, const std::string& value) {
+    Go2IPAddress address;
+    if (Go2IPAddress_Parse(reinterpret_cast<const signed char*>(value.c_str()), &address) != GO2_OK) {
+        configError(configFile, key + " '" + value + "' is not an IP address");
     }
-    return NULL;
+    return address;
 }
 
-// Returns a Go2AddressInfo (Ethernet connection) from the config file
-GocatorAddress GocatorConfigurator::configuredNetworkConnection(std::string& configFile) {
-    GocatorAddress GoAddress;
-    Go2AddressInfo configuredAddress;
-    std::ifstream fidin;
-    fidin.open(configFile.c_str());
-    if (fidin.is_open()) {
-        opts::options_description opt_desc("Available options");
-        opt_desc.add_options()
-            ("Network.reconfigure", opts::value<std::string>()->default_value("false"), "Reconfigure?")
-            ("Network.use_dhcp", opts::value<std::string>()->default_value("false"), "Use DHCP?")
-            ("Network.address", opts::value<std::string>()->default_value("192.168.1.10"), "IP Address")
-            ("Network.subnet_mask", opts::value<std::string>()->default_value("255.255.255.0"), "Subnet Mask")
-            ("Network.gateway", opts::value<std::string>()->default_value("0.0.0.0"), "Gateway");
-        opts::variables_map config;
-        opts::store(opts::parse_config_file(fidin, opt_desc, true), config);
-        opts::notify(config);
-        std::string reconfigureAddress = config["Network.reconfigure"].as<std::string>();
-        GoAddress.reconfigure = compareStrings(reconfigureAddress, "true");
-        std::string useDHCP = config["Network.use_dhcp"].as<std::string>();
-        if(compareStrings(useDHCP, "true")) {
-            configuredAddress.useDhcp = true;
-        } else {
-            configuredAddress.useDhcp = false;
-        }
-        std::string networkAddress = config["Network.address"].as<std::string>();
-        Go2IPAddress_Parse(reinterpret_cast<const signed char*>(networkAddress.c_str()), &configuredAddress.address);
-        std::string netMask = config["Network.subnet_mask"].as<std::string>();
-        Go2IPAddress_Parse(reinterpret_cast<const signed char*>(netMask.c_str()), &configuredAddress.mask);
-        std::string gateway = config["Network.gateway"].as<std::string>();
-        Go2IPAddress_Parse(reinterpret_cast<const signed char*>(gateway.c_str()), &configuredAddress.gateway);
-    }
-    GoAddress.addr = configuredAddress;
-    return GoAddress;
+// A filter window of 0 (or less) disables the filter
+static void configuredWindow(double window, bool& enabled, Go2Double& size) {
+    enabled = window > 0;
+    size = enabled ? window : 0;
 }
 
-// Returns the filtration options from the config file
-GocatorFilter GocatorConfigurator::configuredFilter(std::string& configFile) {
-    GocatorFilter filter;
+// Reads and checks every section of the configuration file in one pass
+ScanConfig GocatorConfigurator::load(const std::string& configFile) {
     std::ifstream fidin;
     fidin.open(configFile.c_str());
-    if (fidin.is_open()) {
-        opts::options_description opt_desc("Available options");
-        opt_desc.add_options()
-            ("Filtering.scanner_resolution", opts::value<std::string>()->default_value("medium"), "Sampling Resolution")
-            ("Filtering.xgap_fill", opts::value<double>()->default_value(0), "Horizontal gap filling")
-            ("Filtering.ygap_fill", opts::value<double>()->default_value(0), "Vertical gap filling")
-            ("Filtering.xsmooth", opts::value<double>()->default_value(0), "Horizontal signal averaging")
-            ("Filtering.ysmooth", opts::value<double>()->default_value(0), "Vertical signal averaging");
-        opts::variables_map config;
-        opts::store(opts::parse_config_file(fidin, opt_desc, true), config);
-        opts::notify(config);
-        std::string resolution = config["Filtering.scanner_resolution"].as<std::string>();
-        if(compareStrings(resolution, "low")) {
-            filter.sampling = GO2_RESAMPLING_TYPE_MAX_SPEED;
-        } else if (compareStrings(resolution, "high")) {
-            filter.sampling = GO2_RESAMPLING_TYPE_MAX_RES;
-        } else {
-            filter.sampling = GO2_RESAMPLING_TYPE_BALANCED;
+    if (!fidin.is_open()) {
+        configError(configFile, "unable to open file");
+    }
+    opts::options_description opt_desc("Available options");
+    opt_desc.add_options()
+        ("System.device_id", opts::value<Go2UInt32>()->default_value(0000000), "Device Serial Number")
+        ("System.device_ids", opts::value<std::string>()->default_value(""), "Device Serial Numbers")
+        ("Network.reconfigure", opts::value<std::string>()->default_value("false"), "Reconfigure?")
+        ("Network.use_dhcp", opts::value<std::string>()->default_value("false"), "Use DHCP?")
+        ("Network.address", opts::value<std::string>()->default_value("192.168.1.10"), "IP Address")
+        ("Network.subnet_mask", opts::value<std::string>()->default_value("255.255.255.0"), "Subnet Mask")
+        ("Network.gateway", opts::value<std::string>()->default_value("0.0.0.0"), "Gateway")
+        ("Encoder.model", opts::value<std::string>()->default_value("<unspecified>"), "Make/model of encoder")
+        ("Encoder.resolution", opts::value<double>()->default_value(0), "Resolution of encoder [mm per 'tick']")
+        ("Trigger.type", opts::value<std::string>()->default_value("Time"), "Type of trigger")
+        ("Trigger.frame_rate", opts::value<double>()->default_value(0), "Frame rate of time trigger [Hz]")
+        ("Trigger.travel_threshold", opts::value<double>()->default_value(0), "Desired trigger threshold [mm]")
+        ("Trigger.travel_direction", opts::value<std::string>()->default_value("bidirectional"), "Trigger direction")
+        ("Trigger.enable_gate", opts::value<std::string>()->default_value("false"), "Enable trigger gates")
+        ("Filtering.scanner_resolution", opts::value<std::string>()->default_value("medium"), "Sampling Resolution")
+        ("Filtering.xgap_fill", opts::value<double>()->default_value(0), "Horizontal gap filling")
+        ("Filtering.ygap_fill", opts::value<double>()->default_value(0), "Vertical gap filling")
+        ("Filtering.xsmooth", opts::value<double>()->default_value(0), "Horizontal signal averaging")
+        ("Filtering.ysmooth", opts::value<double>()->default_value(0), "Vertical signal averaging")
+        ("Output.x_min", opts::value<double>()->default_value(0), "Lowest X recorded [mm]")
+        ("Output.x_max", opts::value<double>()->default_value(0), "Highest X recorded [mm]")
+        ("Output.z_min", opts::value<double>()->default_value(0), "Lowest Z recorded [mm]")
+        ("Output.z_max", opts::value<double>()->default_value(0), "Highest Z recorded [mm]")
+        ("Output.x_step", opts::value<unsigned int>()->default_value(1), "Record every nth point along X")
+        ("Output.y_step", opts::value<unsigned int>()->default_value(1), "Record every nth profile")
+        ("Output.merge_duplicates", opts::value<std::string>()->default_value("false"), "Merge profiles with the same encoder count");
+    opts::variables_map settings;
+    try {
+        opts::parsed_options parsed = opts::parse_config_file(fidin, opt_desc, true);
+        for (size_t i=0; i<parsed.options.size(); i++) {
+            if (parsed.options[i].unregistered) {
+                std::cerr << "<< Ignoring unknown setting '" << parsed.options[i].string_key 
+                          << "' in '" << configFile << "' >>" << std::endl;
+            }
         }
+        opts::store(parsed, settings);
+        opts::notify(settings);
+    } catch (const opts::error& ex) {
+        configError(configFile, ex.what());
+    }
+
+    ScanConfig config;
+    config.filename = configFile;
+
+    // System
+    std::string idList = settings["System.device_ids"].as<std::string>();
+    std::replace(idList.begin(), idList.end(), ',', ' ');
+    std::istringstream ids(idList);
+    Go2UInt32 id;
+    while (ids >> id) {
+        config.deviceIDs.push_back(id);
+    }
+    if (!ids.eof()) {
+        configError(configFile, "System.device_ids must be a list of serial numbers, not '" + idList + "'");
+    }
+    if (config.deviceIDs.empty()) {
+        config.deviceIDs.push_back(settings["System.device_id"].as<Go2UInt32>());
+    }
+
+    // Network
+    config.network.reconfigure = configuredFlag(configFile, "Network.reconfigure", settings["Network.reconfigure"].as<std::string>());
+    config.network.addr.useDhcp = configuredFlag(configFile, "Network.use_dhcp", settings["Network.use_dhcp"].as<std::string>());
+    config.network.addr.address = configuredAddress(configFile, "Network.address", settings["Network.address"].as<std::string>());
+    config.network.addr.mask = configuredAddress(configFile, "Network.subnet_mask", settings["Network.subnet_mask"].as<std::string>());
+    config.network.addr.gateway = configuredAddress(configFile, "Network.gateway", settings["Network.gateway"].as<std::string>());
 
-        double xgap = config["Filtering.xgap_fill"].as<double>();
-        if (xgap > 0) {
-            filter.xGapWindow = xgap;
-            filter.xGap = true;
-        } else {
-            filter.xGapWindow = 0;
-            filter.xGap = false;
+    // Encoder
+    config.encoder.modelName = settings["Encoder.model"].as<std::string>();
+    config.encoder.resolution = settings["Encoder.resolution"].as<double>();
+    if (!(config.encoder.resolution > 0)) {
+        configError(configFile, "Encoder.resolution must be greater than 0 mm/tick");
+    }
+
+    // Trigger
+    std::string triggerType = settings["Trigger.type"].as<std::string>();
+    if (compareStrings(triggerType, "encoder")) {
+        config.trigger.type = ENCODER_TRIGGER;
+    } else if (compareStrings(triggerType, "input")) {
+        config.trigger.type = INPUT_TRIGGER;
+    } else if (compareStrings(triggerType, "software")) {
+        config.trigger.type = SOFTWARE_TRIGGER;
+    } else if (compareStrings(triggerType, "time")) {
+        config.trigger.type = TIME_TRIGGER;
+    } else {
+        configError(configFile, "Trigger.type must be 'encoder', 'time', 'input' or 'software', not '" + triggerType + "'");
+    }
+    config.trigger.gate = configuredFlag(configFile, "Trigger.enable_gate", settings["Trigger.enable_gate"].as<std::string>());
+    config.trigger.frameRate = settings["Trigger.frame_rate"].as<double>();
+    config.trigger.travelThreshold = settings["Trigger.travel_threshold"].as<double>();
+    std::string travelDirection = settings["Trigger.travel_direction"].as<std::string>();
+    if (compareStrings(travelDirection, "forward")) {
+        config.trigger.direction = FORWARD;
+    } else if (compareStrings(travelDirection, "backward")) {
+        config.trigger.direction = BACKWARD;
+    } else if (compareStrings(travelDirection, "bidirectional")) {
+        config.trigger.direction = BIDIRECTIONAL;
+    } else {
+        configError(configFile, "Trigger.travel_direction must be 'forward', 'backward' or 'bidirectional', not '" + travelDirection + "'");
+    }
+
+    // Filtering
+    std::string resolution = settings["Filtering.scanner_resolution"].as<std::string>();
+    if (compareStrings(resolution, "low")) {
+        config.filter.sampling = GO2_RESAMPLING_TYPE_MAX_SPEED;
+    } else if (compareStrings(resolution, "high")) {
+        config.filter.sampling = GO2_RESAMPLING_TYPE_MAX_RES;
+    } else if (compareStrings(resolution, "medium")) {
+        config.filter.sampling = GO2_RESAMPLING_TYPE_BALANCED;
+    } else {
+        configError(configFile, "Filtering.scanner_resolution must be 'low', 'medium' or 'high', not '" + resolution + "'");
+    }
+    configuredWindow(settings["Filtering.xgap_fill"].as<double>(), config.filter.xGap, config.filter.xGapWindow);
+    configuredWindow(settings["Filtering.ygap_fill"].as<double>(), config.filter.yGap, config.filter.yGapWindow);
+    configuredWindow(settings["Filtering.xsmooth"].as<double>(), config.filter.xSmooth, config.filter.xSmoothWindow);
+    configuredWindow(settings["Filtering.ysmooth"].as<double>(), config.filter.ySmooth, config.filter.ySmoothWindow);
+
+    // Output
+    config.reduction.xLow = settings["Output.x_min"].as<double>();
+    config.reduction.xHigh = settings["Output.x_max"].as<double>();
+    config.reduction.zLow = settings["Output.z_min"].as<double>();
+    config.reduction.zHigh = settings["Output.z_max"].as<double>();
+    if (config.reduction.xLow > config.reduction.xHigh) {
+        configError(configFile, "Output.x_min must be less than Output.x_max");
+    }
+    if (config.reduction.zLow > config.reduction.zHigh) {
+        configError(configFile, "Output.z_min must be less than Output.z_max");
+    }
+    config.reduction.xStep = settings["Output.x_step"].as<unsigned int>();
+    config.reduction.yStep = settings["Output.y_step"].as<unsigned int>();
+    if (config.reduction.xStep < 1 || config.reduction.yStep < 1) {
+        configError(configFile, "Output.x_step and Output.y_step must be at least 1");
+    }
+    config.reduction.mergeDuplicates = configuredFlag(configFile, "Output.merge_duplicates",
+                                                      settings["Output.merge_duplicates"].as<std::string>());
+    return config;
+}
+
+// Creates the configured trigger, to be set on a GocatorControl
+Trigger* GocatorConfigurator::configuredTrigger(const ScanConfig& config) {
+    Trigger* trig = NULL;
+    switch (config.trigger.type) {
+        case ENCODER_TRIGGER: {
+            EncoderTrigger* encoderTrigger = new EncoderTrigger();
+            encoderTrigger->setTravelThreshold(config.trigger.travelThreshold);
+            encoderTrigger->setTravelDirection(config.trigger.direction);
+            trig = encoderTrigger;
+            break;
         }
-        double ygap = config["Filtering.ygap_fill"].as<double>();
-        if (ygap > 0) {
-            filter.yGapWindow = ygap;
-            filter.yGap = true;
-        } else {
-            filter.yGapWindow = 0;
-            filter.yGap = false;
+        case INPUT_TRIGGER:
+            trig = new InputTrigger();
+            break;
+        case SOFTWARE_TRIGGER:
+            trig = new SoftwareTrigger();
+            break;
+        case TIME_TRIGGER:
+        default: {
+            TimeTrigger* timeTrigger = new TimeTrigger();
+            timeTrigger->setFrameRate(config.trigger.frameRate);
+            trig = timeTrigger;
         }
+    }
+    trig->setTriggerGate(config.trigger.gate);
+    return trig;
+}
 
-        double xsmooth = config["Filtering.xsmooth"].as<double>();
-        if (xsmooth > 0) {
-            filter.xSmoothWindow = xsmooth;
-            filter.xSmooth = true;
-        } else {
-            filter.xSmoothWindow = 0;
-            filter.xSmooth = false;
-        }
-        double ysmooth = config["Filtering.ysmooth"].as<double>();
-        if (ysmooth > 0) {
-            filter.ySmoothWindow = ysmooth;
-            filter.ySmooth = true;
-        } else {
-            filter.ySmoothWindow = 0;
-            filter.ySmooth = false;
+ConfigWatcher::ConfigWatcher(const std::string& configFile, bool verboseFlag):
+filename(configFile), verbose(verboseFlag) {
+    config.reset(new ScanConfig(GocatorConfigurator::load(filename)));
+    modified = filesystem::last_write_time(filename);
+}
+
+void ConfigWatcher::watch(unsigned int intervalMilliseconds) {
+    if (!watcher.joinable()) {
+        watcher = boost::thread(&ConfigWatcher::poll, this, intervalMilliseconds);
+    }
+}
+
+void ConfigWatcher::stop() {
+    if (watcher.joinable()) {
+        watcher.interrupt();
+        watcher.join();
+    }
+}
+
+bool ConfigWatcher::reload() {
+    std::time_t lastModified;
+    try {
+        lastModified = filesystem::last_write_time(filename);
+    } catch (filesystem::filesystem_error &err) {
+        // Editors often replace the file - try again next time
+        return false;
+    }
+    if (lastModified == modified) {
+        return false;
+    }
+    modified = lastModified;
+    try {
+        boost::shared_ptr<const ScanConfig> updated(new ScanConfig(GocatorConfigurator::load(filename)));
+        boost::atomic_store(&config, updated);
+    } catch (std::runtime_error &err) {
+        std::cerr << "<< Keeping previous configuration >>" << std::endl;
+        return false;
+    }
+    if (verbose) {
+        std::cout << "<< Reloaded configuration from '" << filename << "' >>" << std::endl;
+    }
+    return true;
+}
+
+// Watcher thread - checks the file for changes until interrupted
+void ConfigWatcher::poll(unsigned int intervalMilliseconds) {
+    try {
+        while (true) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(intervalMilliseconds));
+            reload();
         }
+    } catch (boost::thread_interrupted &err) {
     }
-    return filter; 
-}
\ No newline at end of file
+}
@@ -5,101 +5,75 @@ namespace posixtime = boost::posix_time;
 // Configures Gocator 20x0 to use an attached encoder.
 void GocatorControl::configureEncoder(Encoder& encoder) {
     lme = encoder;
-    std::string SetTriggerResponse = getResponseString("Go2System_SetTriggerSource", 
-                                           Go2System_SetTriggerSource(sys.getSystem(), GO2_TRIGGER_SOURCE_ENCODER));
-    if (verbose) {
-        std::cout << SetTriggerResponse << std::endl;
-    }
- 
-    std::string SetResolutionResponse = getResponseString("Go2System_SetTravelResolution", 
-                                              Go2System_SetTravelResolution(sys.getSystem(), lme.resolution));
-    if (verbose) {
-        std::cout << SetResolutionResponse << std::endl;
-    }
+    sys.getState().setTriggerSource(GO2_TRIGGER_SOURCE_ENCODER);
+    sys.getState().setTravelResolution(lme.resolution);
     resetEncoder();
 }
 
-// Configures Gocator's filtration
+// Limits a filter window to what the sensor accepts
+static Go2Double clampWindow(Go2Double window, Go2Double minimum, Go2Double maximum) {
+    if (window > maximum) {
+        return maximum;
+    } else if (window < minimum) {
+        return minimum;
+    }
+    return window;
+}
+
+// Configures Gocator's filtration (window limits depend on the resampling
+// type, so they're read after it has been sent)
 void GocatorControl::configureFilter(GocatorFilter& filter) {
-    std::string setSamplingResponse = getResponseString("Go2System_SetXResamplingType", 
-                                                        Go2System_SetXResamplingType(sys.getSystem(), filter.sampling));
-    std::string setHGapFillResponse = getResponseString("Go2System_SetXGapFillingEnabled",
-                                                        Go2System_SetXGapFillingEnabled(sys.getSystem(), filter.xGap));
-    if (filter.xGap) {
-        Go2Double hGap;
-        Go2Double hGapMax = Go2System_XGapFillingWindowMax(sys.getSystem());
-        Go2Double hGapMin = Go2System_XGapFillingWindowMin(sys.getSystem());
-        if (filter.xGap > hGapMax) {
-            hGap = hGapMax;
-        } else if (filter.xGap < hGapMin) {
-            hGap = hGapMin;
-        }
-        setHGapFillResponse = Go2System_SetXGapFillingWindow(sys.getSystem(), hGap);
+    Go2System go2system = sys.getSystem();
+    SensorState& state = sys.getState();
+    state.setXResampling(filter.sampling);
+    if (filter.xGap || filter.yGap || filter.xSmooth || filter.ySmooth) {
+        refused += state.commit();
     }
-    if (verbose) {
-        std::cout << setHGapFillResponse << std::endl;
+    state.setXGapFilling(filter.xGap);
+    if (filter.xGap) {
+        state.setXGapWindow(clampWindow(filter.xGapWindow, Go2System_XGapFillingWindowMin(go2system),
+                                        Go2System_XGapFillingWindowMax(go2system)));
     }
-
-    std::string setVGapFillResponse = getResponseString("Go2System_SetYGapFillingEnabled",
-                                                        Go2System_SetYGapFillingEnabled(sys.getSystem(), filter.yGap));
+    state.setYGapFilling(filter.yGap);
     if (filter.yGap) {
-        Go2Double vGap;
-        Go2Double vGapMax = Go2System_YGapFillingWindowMax(sys.getSystem());
-        Go2Double vGapMin = Go2System_YGapFillingWindowMin(sys.getSystem());
-        if (filter.yGap > vGapMax) {
-            vGap = vGapMax;
-        } else if (filter.xGap < vGapMin) {
-            vGap = vGapMin;
-        }
-        setVGapFillResponse = Go2System_SetYGapFillingWindow(sys.getSystem(), vGap);
+        state.setYGapWindow(clampWindow(filter.yGapWindow, Go2System_YGapFillingWindowMin(go2system),
+                                        Go2System_YGapFillingWindowMax(go2system)));
     }
-    if (verbose) {
-        std::cout << setVGapFillResponse << std::endl;
-    }
-
-
-    std::string setHSmoothResponse = getResponseString("Go2System_SetXSmoothingEnabled",
-                                                            Go2System_SetXSmoothingEnabled(sys.getSystem(), filter.xSmooth));
+    state.setXSmoothing(filter.xSmooth);
     if (filter.xSmooth) {
-        Go2Double hSmooth;
-        Go2Double hSmoothMax = Go2System_XSmoothingWindowMax(sys.getSystem());
-        Go2Double hSmoothMin = Go2System_XSmoothingWindowMin(sys.getSystem());
-        if (filter.xSmooth > hSmoothMax) {
-            hSmooth = hSmoothMax;
-        } else if (filter.xSmooth < hSmoothMin) {
-            hSmooth = hSmoothMin;
-        }
-        setHSmoothResponse = Go2System_SetXSmoothingWindow(sys.getSystem(), hSmooth);
+        state.setXSmoothWindow(clampWindow(filter.xSmoothWindow, Go2System_XSmoothingWindowMin(go2system),
+                                           Go2System_XSmoothingWindowMax(go2system)));
     }
-    if (verbose) {
-        std::cout << setHSmoothResponse << std::endl;
-    }
-
-    std::string setVSmoothResponse = getResponseString("Go2System_SetYSmoothingEnabled",
-                                                                Go2System_SetYSmoothingEnabled(sys.getSystem(), filter.ySmooth));
+    state.setYSmoothing(filter.ySmooth);
     if (filter.ySmooth) {
-        Go2Double vSmooth;
-        Go2Double vSmoothMax = Go2System_YSmoothingWindowMax(sys.getSystem());
-        Go2Double vSmoothMin = Go2System_YSmoothingWindowMin(sys.getSystem());
-        if (filter.ySmooth > vSmoothMax) {
-            vSmooth = vSmoothMax;
-        } else if (filter.ySmooth < vSmoothMin) {
-            vSmooth = vSmoothMin;
-        }
-        setVSmoothResponse = Go2System_SetYSmoothingWindow(sys.getSystem(), vSmooth);
-    }
-    if (verbose) {
-        std::cout << setVSmoothResponse << std::endl;
+        state.setYSmoothWindow(clampWindow(filter.ySmoothWindow, Go2System_YSmoothingWindowMin(go2system),
+                                           Go2System_YSmoothingWindowMax(go2system)));
     }
 }
 
+// Sends whatever staged settings the sensor doesn't already have
+bool GocatorControl::applySettings() {
+    refused += sys.getState().commit();
+    if (refused > 0) {
+        refused = 0;
+        std::cerr << "<< Gocator didn't accept every setting, see above >>" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 // Turns the laser on to allow positioning prior to beginning a scan
-void GocatorControl::targetOn() {
-    Go2System_SetTriggerSource(sys.getSystem(), GO2_TRIGGER_SOURCE_TIME);
+bool GocatorControl::targetOn() {
+    sys.getState().setTriggerSource(GO2_TRIGGER_SOURCE_TIME);
+    if (sys.getState().commit() > 0) {
+        std::cerr << "<< Gocator refused the time trigger, not turning the laser on >>" << std::endl;
+        return false;
+    }
     std::string StartResponse = getResponseString("Go2System_Start",Go2System_Start(sys.getSystem()));
     if (verbose) {
         std::cout << StartResponse << std::endl;
     }
+    return true;
 }
 
 // Turns the laser off
@@ -120,79 +94,87 @@ void GocatorControl::recordProfile(std::string& outputFilename) {
     recordProfile(outputFilename, msgString);
 }
     
-// Records range profiles to disk as comma-delimited ASCII.
+// Records range profiles to disk in the configured output format
+// (comma-delimited ASCII by default).
 // The specified string is written into the header of the data file.
 void GocatorControl::recordProfile(std::string& outputFilename, std::string& commentString) {
+    LiveProfileSource source(sys.getSystem(), verbose);
+    recordProfile(source, outputFilename, commentString);
+}
+
+// Records profiles from the specified source until the source is finished,
+// a stop condition is met or the thread is interrupted.  With segments set,
+// outputFilename only names the segments, the gaps file and the statistics.
+void GocatorControl::recordProfile(ProfileSource& source, std::string& outputFilename, std::string& commentString) {
     try {
         filesystem::remove(outputFilename.c_str());
+        filesystem::remove((outputFilename + SCAN_INDEX_EXTENSION).c_str());
+        filesystem::remove((outputFilename + GAP_EXTENSION).c_str());
+        filesystem::remove((outputFilename + HEIGHTMAP_EXTENSION).c_str());
     } catch (filesystem::filesystem_error &err) {
         std::cerr << "<< Unable to overwrite '" << outputFilename << ",' appending >>" << std::endl;
     }
-    std::ofstream fidout;
-    fidout.open(outputFilename.c_str(), std::ios_base::app);
-    if (!fidout.is_open()) {
+    OutputFile fidout;
+    boost::shared_ptr<SegmentedOutput> segmented;
+    if (segmentsEnabled(segments)) {
+        segmented.reset(new SegmentedOutput(outputFilename, segments, verbose));
+        if (!segmented->open(fidout)) {
+            std::cerr << "<< Unable to start recording segments of '" << outputFilename << "', aborting >>" << std::endl;
+            throw std::runtime_error("Unable to write to output");
+        }
+    } else if (!fidout.open(outputFilename)) {
         std::cerr << "<< Unable to open/write to output file '" << outputFilename << "', aborting >>" << std::endl;
         throw std::runtime_error("Unable to write to output");
     }
-    fidout << "# File format: X Position [mm], Y Position [mm], Z Range [mm]" << std::endl;
-    fidout << "# " << commentString << std::endl;
-    Go2ProfileData data = GO2_NULL;
-    Go2Data dataItem;
-    Go2Int64 encoderCounter;
-    unsigned int itemCount = 0;
-    std::string StartResponse = getResponseString("Go2System_Start",Go2System_Start(sys.getSystem()));
-    if (verbose) {
-        std::cout << StartResponse << std::endl;
-    }
-    Go2Status returnCode = Go2System_ConnectData(sys.getSystem(), GO2_NULL, GO2_NULL);
-    if (verbose) {
-        std::cout << getResponseString("Go2System_ConnectData", returnCode) << std::endl;
-    }
-    if (returnCode != GO2_OK) {
-        std::cerr << "\n<< Initialization failed, aborting >>" << std::endl;
-        throw std::runtime_error("Gocator 20x0 initialization failed");
-    }
-    try {
-        while(true) {
-            boost::this_thread::interruption_point();
-            Go2Status returnCode = Go2System_ReceiveData(sys.getSystem(), RECEIVE_TIMEOUT, &data);
-            if (returnCode == GO2_OK) {
-        		// Disable thread interruption
-		        boost::this_thread::disable_interruption di;
-                itemCount = Go2Data_ItemCount(data);
-                // number of ticks of encoder
-                encoderCounter = Go2Data_Encoder(data);
-                for (unsigned int j=0; j<itemCount; j++) {
-                    dataItem = Go2Data_ItemAt(data, j);
-                    short* profileData = Go2ProfileData_Ranges(dataItem);
-                    unsigned int profilePointCount = Go2ProfileData_Width(dataItem);
-                    double XResolution = Go2ProfileData_XResolution(dataItem);
-                    double ZResolution = Go2ProfileData_ZResolution(dataItem);
-                    double XOffset = Go2ProfileData_XOffset(dataItem);
-                    double ZOffset = Go2ProfileData_ZOffset(dataItem);
-                    
-                    for(unsigned int arrayIndex=0;arrayIndex<profilePointCount; ++arrayIndex) {
-                        if (profileData[arrayIndex] != INVALID_RANGE_16BIT) {
-                            fidout << XOffset+XResolution*arrayIndex << "," << (encoderCounter-startingEncoderReading)*lme.resolution << "," << ZOffset+ZResolution*profileData[arrayIndex] << std::endl << std::flush;
-                        } else {
-                            if (verbose) {
-                                std::cout << "Invalid reading, skipped." << std::endl;
-                            }
-                        }
-                    }
-                    std::string freeDataResponse = getResponseString("Go2Data_Destroy", Go2Data_Destroy(data));
-                    if (verbose) {
-                        std::cout << freeDataResponse << std::endl;
-                    }
-                }
-		        boost::this_thread::restore_interruption ri(di);
-            }
+    source.start();
+    // This thread only receives; conversion and disk writes happen in the pipeline
+    ScanInfo info;
+    info.comment = commentString;
+    info.startingEncoder = startingEncoderReading;
+    info.encoderResolution = lme.resolution;
+    boost::shared_ptr<ProfileWriter> writer(createProfileWriter(output));
+    RecordingPipeline pipeline(fidout, *writer, info, verbose);
+    pipeline.setGapDetection(spacing);
+    pipeline.setReduction(reduction);
+    pipeline.setFilter(rangeFilter);
+    pipeline.setHeightMap(heightMap);
+    pipeline.setSegments(segmented.get());
+    pipeline.setStopConditions(stopSettings);
+    StatsReporter reporter(pipeline, statsInterval);
+    pipeline.start();
+    if (statsInterval > 0) {
+        reporter.start();
+    }
+    pipeline.run(source);
+    source.stop();
+    pipeline.finish();
+    reporter.stop();
+    if (segmented) {
+        segmented->finish();
+    }
+    fidout.close();
+    if (fidout.fail()) {
+        std::cerr << "<< Encountered error writing to '" << outputFilename << ",' data may have been lost.\n" << std::endl;
+    }
+    if (!pipeline.saveIndex(outputFilename)) {
+        std::cerr << "<< Unable to write index for '" << outputFilename << "' >>" << std::endl;
+    }
+    if (!pipeline.saveGaps(outputFilename)) {
+        std::cerr << "<< Unable to write frame gaps for '" << outputFilename << "' >>" << std::endl;
+    } else if (!pipeline.getGaps().getSpans().empty()) {
+        std::cout << "<< Frame gaps written to '" << outputFilename << GAP_EXTENSION << "' >>" << std::endl;
+    }
+    if (!pipeline.saveHeightMap(outputFilename)) {
+        std::cerr << "<< Unable to write height map for '" << outputFilename << "' >>" << std::endl;
+    }
+    std::cout << "<< Source: " << source.getSourceName() << " >>" << std::endl;
+    pipeline.report(std::cout);
+    if (statsInterval > 0) {
+        std::string statsFilename = outputFilename + ".stats.json";
+        if (reporter.writeJson(statsFilename)) {
+            std::cout << "<< Recording statistics written to '" << statsFilename << "' >>" << std::endl;
+        } else {
+            std::cerr << "<< Unable to write recording statistics to '" << statsFilename << "' >>" << std::endl;
         }
-    } catch (boost::thread_interrupted &err) {
-        fidout.flush();
-        fidout.close();
-        if (fidout.fail()) {
-            std::cerr << "<< Encountered error writing to '" << outputFilename << ",' data may have been lost.\n" << std::endl;
-        }
-    } 
+    }
 }
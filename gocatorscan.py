@@ -0,0 +1,142 @@
+#!/usr/bin/env python
+
+"""gocatorscan.py - reads recorded binary and compressed scans straight into NumPy
+
+A binary scan is memory-mapped (read-only, shared) by the _gocatorscan
+extension - build it with 'make python' - and every array here is a view of
+the mapping: opening a scan only walks its record headers, and processes
+reading the same scan share its pages.  A compressed scan is decoded once
+when opened.  CSV scans can't be mapped; read_xyz() reads the columnar
+scans csv2col converts them to, and falls back to np.genfromtxt for CSV.
+
+scan = gocatorscan.Scan('scan.bin')
+for run in scan.runs:
+    run.ranges      # (profiles, width) int16 view, INVALID_RANGE where there was no reading
+scan.profiles       # encoder, timestamp, geometry, width and offset of every profile
+x, y, z = scan.xyz()
+"""
+
+import numpy as np
+
+import _gocatorscan
+
+INVALID_RANGE = _gocatorscan.INVALID_RANGE
+PROFILE_DTYPE = np.dtype({'names': [field[0] for field in _gocatorscan.PROFILE_FIELDS],
+                          'formats': [field[1] for field in _gocatorscan.PROFILE_FIELDS],
+                          'offsets': [field[2] for field in _gocatorscan.PROFILE_FIELDS],
+                          'itemsize': _gocatorscan.PROFILE_SIZE})
+SCAN_MAGICS = (b'GO2SCAN\0', b'GO2ZSCN\0')
+COLUMNAR_MAGIC = b'GO2COLS\0'
+
+class Run(object):
+    """Consecutive profiles sharing width and geometry.  ranges is a read-only
+    (profiles, width) int16 view of the scan; rows are generally not aligned."""
+
+    def __init__(self, scan, first_profile, profiles, width, offset, stride,
+                 x_offset, x_resolution, z_offset, z_resolution):
+        self.first_profile = first_profile
+        self.profiles = profiles
+        self.width = width
+        self.x_offset = x_offset
+        self.x_resolution = x_resolution
+        self.z_offset = z_offset
+        self.z_resolution = z_resolution
+        self.ranges = np.ndarray(shape=(profiles, width), dtype='<i2', buffer=scan, offset=offset,
+                                 strides=(stride, 2))
+
+    def x(self):
+        """X position [mm] of each column"""
+        return self.x_offset + self.x_resolution*np.arange(self.width)
+
+    def z(self):
+        """Z [mm] of every point, NaN where there was no reading"""
+        z = self.z_offset + self.z_resolution*self.ranges
+        z[self.ranges == INVALID_RANGE] = np.nan
+        return z
+
+class Scan(object):
+    """A recorded binary or compressed scan, see the module notes."""
+
+    def __init__(self, fname):
+        self.fname = fname
+        self._scan = _gocatorscan.Scan(fname)
+        self.comment = self._scan.comment
+        self.encoder_resolution = self._scan.encoder_resolution
+        self.starting_encoder = self._scan.starting_encoder
+        self.mapped = self._scan.mapped
+        self.profiles = np.frombuffer(self._scan.table(), dtype=PROFILE_DTYPE)
+        self.runs = [Run(self._scan, *run) for run in self._scan.runs()]
+
+    def __len__(self):
+        return len(self.profiles)
+
+    def is_filtered(self):
+        """Returns True if the scan was filtered on the way to disk (or with scanfilter)."""
+        return '[filtered:' in self.comment
+
+    def y(self):
+        """Y position [mm] of each profile"""
+        return (self.profiles['encoder'] - self.starting_encoder)*self.encoder_resolution
+
+    def ranges(self, number):
+        """Read-only int16 view of one profile's ranges"""
+        profile = self.profiles[number]
+        return np.ndarray(shape=(int(profile['width']),), dtype='<i2', buffer=self._scan,
+                          offset=int(profile['offset']))
+
+    def xyz(self):
+        """X, Y, Z [mm] of every valid point in scan order, as scan2csv writes them"""
+        y = self.y()
+        xs, ys, zs = [], [], []
+        for run in self.runs:
+            valid = run.ranges != INVALID_RANGE
+            rows, columns = np.nonzero(valid)
+            xs.append(run.x()[columns])
+            ys.append(y[run.first_profile + rows])
+            zs.append(run.z_offset + run.z_resolution*run.ranges[valid])
+        if not xs:
+            return np.empty(0), np.empty(0), np.empty(0)
+        return np.concatenate(xs), np.concatenate(ys), np.concatenate(zs)
+
+def is_scan(fname):
+    """Returns True if fname is a binary or compressed scan rather than CSV."""
+    with open(fname, 'rb') as fidin:
+        return fidin.read(8) in SCAN_MAGICS
+
+def read_columns(fname):
+    """Returns the header and X, Y, Z [mm] of a columnar scan from csv2col
+    (format in include/columnarscan.h)."""
+    with open(fname, 'rb') as fidin:
+        magic, version, header_length = np.fromfile(fidin, dtype=np.dtype([('magic', 'S8'), ('version', '<u4'),
+                                                                          ('header', '<u4')]), count=1)[0]
+        if magic != COLUMNAR_MAGIC.rstrip(b'\0') or version != 1:
+            raise IOError("Not a columnar scan: {0}".format(fname))
+        header = fidin.read(header_length).decode('utf-8', 'replace')
+        xs, ys, zs = [], [], []
+        while True:
+            counts = np.fromfile(fidin, dtype='<u4', count=1)
+            if len(counts) != 1:
+                raise IOError("Truncated columnar scan: {0}".format(fname))
+            points = int(counts[0])
+            if points == 0:
+                break
+            profiles = int(np.fromfile(fidin, dtype='<u4', count=1)[0])
+            y = np.fromfile(fidin, dtype='<f8', count=profiles)
+            profile_points = np.fromfile(fidin, dtype='<u4', count=profiles)
+            xs.append(np.fromfile(fidin, dtype='<f4', count=points))
+            zs.append(np.fromfile(fidin, dtype='<f4', count=points))
+            if len(zs[-1]) != points:
+                raise IOError("Truncated columnar scan: {0}".format(fname))
+            ys.append(np.repeat(y, profile_points))
+    if not xs:
+        return header, np.empty(0), np.empty(0), np.empty(0)
+    return header, np.concatenate(xs).astype(np.float64), np.concatenate(ys), np.concatenate(zs).astype(np.float64)
+
+def read_xyz(fname):
+    """Returns X, Y, Z [mm] of the valid points of a binary, compressed, columnar or CSV scan."""
+    if is_scan(fname):
+        return Scan(fname).xyz()
+    with open(fname, 'rb') as fidin:
+        if fidin.read(8) == COLUMNAR_MAGIC:
+            return read_columns(fname)[1:]
+    return np.genfromtxt(fname, delimiter=",", unpack=True)
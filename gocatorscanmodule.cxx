@@ -0,0 +1,234 @@
+/* _gocatorscan - Python access to recorded binary and compressed scans
+
+Wraps MappedScan (include/mappedscan.h) for gocatorscan.py.  A Scan exports
+its ranges through the buffer protocol and table() exports the per-profile
+table, so NumPy arrays over either are views of the mapped file rather than
+copies.  Written against the plain C API, so it builds without NumPy's
+headers; see setup.py.
+*/
+#include <Python.h>
+#include "mappedscan.h"
+
+#include <cstddef>
+
+#if PY_MAJOR_VERSION >= 3
+#define TEXT(s) PyUnicode_FromString(s)
+#else
+#define TEXT(s) PyString_FromString(s)
+#endif
+
+typedef struct {
+    PyObject_HEAD
+    MappedScan* scan;
+} ScanObject;
+
+// Keeps its Scan alive for as long as anything views the profile table
+typedef struct {
+    PyObject_HEAD
+    ScanObject* owner;
+} TableObject;
+
+static PyTypeObject ScanType = {PyVarObject_HEAD_INIT(NULL, 0) "_gocatorscan.Scan"};
+static PyTypeObject TableType = {PyVarObject_HEAD_INIT(NULL, 0) "_gocatorscan.Table"};
+static PyBufferProcs scanBuffer, tableBuffer;
+static char nothing[1]; // Exported in place of an empty scan
+
+static int exportBytes(PyObject* exporter, Py_buffer* view, const void* data, size_t size, int flags) {
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "scans are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    return PyBuffer_FillInfo(view, exporter, size > 0 ? const_cast<void*>(data) : nothing,
+                             static_cast<Py_ssize_t>(size), 1, flags);
+}
+
+static int Scan_init(ScanObject* self, PyObject* args, PyObject* kwds) {
+    const char* filename;
+    if (!PyArg_ParseTuple(args, "s", &filename)) {
+        return -1;
+    }
+    MappedScan* opened;
+    try {
+        opened = new MappedScan(filename);
+    } catch (std::exception& err) {
+        PyErr_SetString(PyExc_IOError, err.what());
+        return -1;
+    }
+    delete self->scan;
+    self->scan = opened;
+    return 0;
+}
+
+static void Scan_dealloc(ScanObject* self) {
+    delete self->scan;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static bool opened(ScanObject* self) {
+    if (self->scan == NULL) {
+        PyErr_SetString(PyExc_ValueError, "scan is not open");
+        return false;
+    }
+    return true;
+}
+
+static int Scan_getbuffer(ScanObject* self, Py_buffer* view, int flags) {
+    if (!opened(self)) {
+        view->obj = NULL;
+        return -1;
+    }
+    return exportBytes(reinterpret_cast<PyObject*>(self), view, self->scan->data(), self->scan->size(), flags);
+}
+
+static PyObject* Scan_table(ScanObject* self, PyObject* unused) {
+    if (!opened(self)) {
+        return NULL;
+    }
+    TableObject* table = PyObject_New(TableObject, &TableType);
+    if (table != NULL) {
+        Py_INCREF(self);
+        table->owner = self;
+    }
+    return reinterpret_cast<PyObject*>(table);
+}
+
+static PyObject* Scan_runs(ScanObject* self, PyObject* unused) {
+    if (!opened(self)) {
+        return NULL;
+    }
+    const std::vector<MappedRun>& runs = self->scan->getRuns();
+    PyObject* list = PyList_New(runs.size());
+    for (size_t i=0; list != NULL && i<runs.size(); i++) {
+        const MappedRun& run = runs[i];
+        PyObject* item = Py_BuildValue("(KKIKKdddd)", run.firstProfile, run.profiles, run.width, run.offset,
+                                       run.stride, run.xOffset, run.xResolution, run.zOffset, run.zResolution);
+        if (item == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+static PyObject* Scan_info(ScanObject* self, void* field) {
+    if (!opened(self)) {
+        return NULL;
+    }
+    const ScanInfo& info = self->scan->getInfo();
+    switch (reinterpret_cast<size_t>(field)) {
+        case 0:
+            return PyLong_FromUnsignedLongLong(self->scan->profileCount());
+        case 1:
+            return PyFloat_FromDouble(info.encoderResolution);
+        case 2:
+            return PyLong_FromLongLong(info.startingEncoder);
+        case 3:
+            return PyUnicode_DecodeUTF8(info.comment.data(), info.comment.size(), "replace");
+        case 4:
+            return PyBool_FromLong(self->scan->isCompressed());
+        default:
+            return PyBool_FromLong(self->scan->isMapped());
+    }
+}
+
+static PyMethodDef scanMethods[] = {
+    {"table", reinterpret_cast<PyCFunction>(Scan_table), METH_NOARGS,
+     "Per-profile table (see PROFILE_FIELDS), exported through the buffer protocol"},
+    {"runs", reinterpret_cast<PyCFunction>(Scan_runs), METH_NOARGS,
+     "Runs of evenly spaced profiles sharing width and geometry, as (first profile, profiles, width, "
+     "byte offset, byte stride, x offset, x resolution, z offset, z resolution)"},
+    {NULL}
+};
+
+static PyGetSetDef scanInfo[] = {
+    {const_cast<char*>("profile_count"), reinterpret_cast<getter>(Scan_info), NULL, NULL, reinterpret_cast<void*>(0)},
+    {const_cast<char*>("encoder_resolution"), reinterpret_cast<getter>(Scan_info), NULL, NULL, reinterpret_cast<void*>(1)},
+    {const_cast<char*>("starting_encoder"), reinterpret_cast<getter>(Scan_info), NULL, NULL, reinterpret_cast<void*>(2)},
+    {const_cast<char*>("comment"), reinterpret_cast<getter>(Scan_info), NULL, NULL, reinterpret_cast<void*>(3)},
+    {const_cast<char*>("compressed"), reinterpret_cast<getter>(Scan_info), NULL, NULL, reinterpret_cast<void*>(4)},
+    {const_cast<char*>("mapped"), reinterpret_cast<getter>(Scan_info), NULL, NULL, reinterpret_cast<void*>(5)},
+    {NULL}
+};
+
+static void Table_dealloc(TableObject* self) {
+    Py_XDECREF(self->owner);
+    PyObject_Del(self);
+}
+
+static int Table_getbuffer(TableObject* self, Py_buffer* view, int flags) {
+    const std::vector<MappedProfile>& profiles = self->owner->scan->getProfiles();
+    return exportBytes(reinterpret_cast<PyObject*>(self), view, profiles.empty() ? NULL : &profiles[0],
+                       profiles.size()*sizeof(MappedProfile), flags);
+}
+
+// Adds PROFILE_FIELDS - (name, NumPy type, offset) for each MappedProfile field - and PROFILE_SIZE
+static bool addProfileLayout(PyObject* module) {
+    PyObject* fields = Py_BuildValue("((Nsn)(Nsn)(Nsn)(Nsn)(Nsn)(Nsn)(Nsn)(Nsn))",
+        TEXT("encoder"), "<i8", static_cast<Py_ssize_t>(offsetof(MappedProfile, encoder)),
+        TEXT("timestamp"), "<u8", static_cast<Py_ssize_t>(offsetof(MappedProfile, timestamp)),
+        TEXT("x_offset"), "<f8", static_cast<Py_ssize_t>(offsetof(MappedProfile, xOffset)),
+        TEXT("x_resolution"), "<f8", static_cast<Py_ssize_t>(offsetof(MappedProfile, xResolution)),
+        TEXT("z_offset"), "<f8", static_cast<Py_ssize_t>(offsetof(MappedProfile, zOffset)),
+        TEXT("z_resolution"), "<f8", static_cast<Py_ssize_t>(offsetof(MappedProfile, zResolution)),
+        TEXT("width"), "<u4", static_cast<Py_ssize_t>(offsetof(MappedProfile, width)),
+        TEXT("offset"), "<u8", static_cast<Py_ssize_t>(offsetof(MappedProfile, offset)));
+    return fields != NULL && PyModule_AddObject(module, "PROFILE_FIELDS", fields) == 0 &&
+           PyModule_AddIntConstant(module, "PROFILE_SIZE", sizeof(MappedProfile)) == 0 &&
+           PyModule_AddIntConstant(module, "INVALID_RANGE", static_cast<short>(INVALID_RANGE_16BIT)) == 0;
+}
+
+static const char moduleDoc[] = "Zero-copy access to recorded Gocator scans, see gocatorscan.py";
+
+static PyObject* createModule() {
+    scanBuffer.bf_getbuffer = reinterpret_cast<getbufferproc>(Scan_getbuffer);
+    ScanType.tp_basicsize = sizeof(ScanObject);
+    ScanType.tp_flags = Py_TPFLAGS_DEFAULT;
+#if PY_MAJOR_VERSION < 3
+    ScanType.tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+#endif
+    ScanType.tp_doc = "Scan(filename) - a binary scan mapped read-only, or a compressed scan decoded once";
+    ScanType.tp_new = PyType_GenericNew;
+    ScanType.tp_init = reinterpret_cast<initproc>(Scan_init);
+    ScanType.tp_dealloc = reinterpret_cast<destructor>(Scan_dealloc);
+    ScanType.tp_methods = scanMethods;
+    ScanType.tp_getset = scanInfo;
+    ScanType.tp_as_buffer = &scanBuffer;
+    tableBuffer.bf_getbuffer = reinterpret_cast<getbufferproc>(Table_getbuffer);
+    TableType.tp_basicsize = sizeof(TableObject);
+    TableType.tp_flags = ScanType.tp_flags;
+    TableType.tp_doc = "Profile table of a Scan";
+    TableType.tp_dealloc = reinterpret_cast<destructor>(Table_dealloc);
+    TableType.tp_as_buffer = &tableBuffer;
+    if (PyType_Ready(&ScanType) < 0 || PyType_Ready(&TableType) < 0) {
+        return NULL;
+    }
+#if PY_MAJOR_VERSION >= 3
+    static PyModuleDef moduleDef = {PyModuleDef_HEAD_INIT, "_gocatorscan", moduleDoc, -1, NULL};
+    PyObject* module = PyModule_Create(&moduleDef);
+#else
+    PyObject* module = Py_InitModule3("_gocatorscan", NULL, moduleDoc);
+#endif
+    if (module == NULL) {
+        return NULL;
+    }
+    Py_INCREF(&ScanType);
+    if (PyModule_AddObject(module, "Scan", reinterpret_cast<PyObject*>(&ScanType)) != 0 || !addProfileLayout(module)) {
+#if PY_MAJOR_VERSION >= 3
+        Py_DECREF(module);
+#endif
+        return NULL;
+    }
+    return module;
+}
+
+#if PY_MAJOR_VERSION >= 3
+PyMODINIT_FUNC PyInit__gocatorscan(void) {
+    return createModule();
+}
+#else
+PyMODINIT_FUNC init_gocatorscan(void) {
+    createModule();
+}
+#endif
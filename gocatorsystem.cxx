@@ -1,5 +1,11 @@
 #include "gocatorsystem.h"
 
+#define MAX_SENSORS 10
+#define DEVICE_CACHE_HEADER "# Gocator device cache: serial dhcp address mask gateway"
+
+static boost::once_flag apiInitialized = BOOST_ONCE_INIT;
+static Go2Status apiInitializeStatus = GO2_OK;
+
 GocatorSystem::~GocatorSystem() {
     delete(password);
     if (sys!=0) {
@@ -15,35 +21,64 @@ GocatorSystem::~GocatorSystem() {
     }
 }
 
+void GocatorSystem::startApi() {
+    apiInitializeStatus = Go2Api_Initialize();
+}
+
+void GocatorSystem::initializeApi() {
+    boost::call_once(&GocatorSystem::startApi, apiInitialized);
+}
+
+// Initializes the Go2 API if required and returns every device it can find
+std::vector<DiscoveredDevice> GocatorSystem::discover(bool verboseFlag) {
+    initializeApi();
+    if (verboseFlag) {
+        std::cout << getResponseString("Go2API_Initialize", apiInitializeStatus) << std::endl;
+    }
+    Go2UInt32* deviceIDs[MAX_SENSORS];
+    Go2AddressInfo* deviceAddresses[MAX_SENSORS];
+    Go2UInt32 numDevices = 0;
+    std::string DiscoverResponse = getResponseString("Go2System_Discover", 
+                                                     Go2System_Discover(deviceIDs, deviceAddresses, &numDevices));
+    if (verboseFlag) {
+        std::cout << DiscoverResponse << std::endl;
+    }
+    std::vector<DiscoveredDevice> devices;
+    for (unsigned int i=0;i<numDevices;i++) {
+        DiscoveredDevice device;
+        device.id = *deviceIDs[i];
+        device.address = *deviceAddresses[i];
+        devices.push_back(device);
+        Go2Free((void *)deviceIDs[i]);
+        Go2Free((void *)deviceAddresses[i]);
+    }
+    return devices;
+}
+
 // Initializes specified Gocator device
 // If reconfigureAddress is true, ensure the device is using the 
 // specified IP Address and reset as necessary.
 void GocatorSystem::init(Go2UInt32 deviceID, Go2AddressInfo desiredNetworkAddress, bool reconfigureAddress) {
-    int MAX_SENSORS = 10;
-    std::string InitializeResponse, ConstructResponse, DiscoverResponse, SetAddressResponse, ConnectResponse, LoginResponse;
-    InitializeResponse = getResponseString("Go2API_Initialize", Go2Api_Initialize());
+    init(deviceID, discover(verbose), desiredNetworkAddress, reconfigureAddress);
+}
+
+// Initializes specified Gocator device from a previous discovery
+void GocatorSystem::init(Go2UInt32 deviceID, const std::vector<DiscoveredDevice>& devices, 
+                         Go2AddressInfo desiredNetworkAddress, bool reconfigureAddress) {
+    std::string ConstructResponse, SetAddressResponse, ConnectResponse, LoginResponse;
+    initializeApi();
+    state.forget();
     ConstructResponse = getResponseString("Go2System_Construct", Go2System_Construct(&sys));
     bool foundDevice = false, resetIP = false;
     /* Look for the requested device - if found and its address doesn't match the desired,
     reset and reconnect. */
-    Go2UInt32* deviceIDs[MAX_SENSORS];
-    Go2AddressInfo* deviceAddresses[MAX_SENSORS];
-    Go2UInt32 numDevices;
-    DiscoverResponse = getResponseString("Go2System_Discover", 
-                                         Go2System_Discover(deviceIDs, deviceAddresses, &numDevices));
-    if (verbose) {
-        std::cout << DiscoverResponse << std::endl;
-    }
-    unsigned int i;
-    Go2UInt32* currentDevice;
-    for(i=0;i<numDevices;i++) {
-        currentDevice = deviceIDs[i];
-        if (*currentDevice==deviceID) {
+    for(unsigned int i=0;i<devices.size();i++) {
+        if (devices[i].id==deviceID) {
             if(reconfigureAddress) {
                 if (verbose) {
                     std::cout << "<< Verifying system IP address >>" << std::endl;
                 }
-                Go2AddressInfo* deviceAddress = deviceAddresses[i];
+                const Go2AddressInfo* deviceAddress = &devices[i].address;
                 if(deviceAddress->useDhcp!=desiredNetworkAddress.useDhcp ||
                    deviceAddress->address!=desiredNetworkAddress.address ||
                    deviceAddress->mask!=desiredNetworkAddress.mask ||
@@ -69,10 +104,6 @@ void GocatorSystem::init(Go2UInt32 deviceID, Go2AddressInfo desiredNetworkAddres
             break;
         }    
     }
-    for (i=0;i<numDevices;i++) {
-        Go2Free((void *)deviceIDs[i]);
-        Go2Free((void *)deviceAddresses[i]);
-    }
     if (!foundDevice) {
         std::cerr << "\n<< Unable to detect device #" << deviceID << ", aborting >>" << std::endl;
         throw std::runtime_error("Device not found");
@@ -88,9 +119,185 @@ void GocatorSystem::init(Go2UInt32 deviceID, Go2AddressInfo desiredNetworkAddres
     }
     LoginResponse = getResponseString("Go2System_Login", Go2System_Login(sys, user, password));
     if (verbose) {
-        std::cout << InitializeResponse << std::endl;
         std::cout << ConstructResponse << std::endl;
         std::cout << ConnectResponse << std::endl;
         std::cout << LoginResponse << std::endl;
     }
-}
\ No newline at end of file
+}
+
+// Initializes specified Gocator device, skipping discovery if the cache knows it.
+// Like the discovered path, the system is always reached at the desired address;
+// the cache only stands in for discovery's word that the device is there.
+void GocatorSystem::init(Go2UInt32 deviceID, SystemStartup& startup,
+                         Go2AddressInfo desiredNetworkAddress, bool reconfigureAddress) {
+    DiscoveredDevice device;
+    startup.wait();
+    bool cached = startup.useCache() && startup.getCache().find(deviceID, device) &&
+                  (!reconfigureAddress || sameAddress(device.address, desiredNetworkAddress));
+    if (cached && connectCached(deviceID, desiredNetworkAddress.address, startup)) {
+        return;
+    }
+    if (cached && verbose) {
+        std::cout << "<< Cached device #" << deviceID << " didn't answer, discovering >>" << std::endl;
+    }
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+    bool discoveredBefore = startup.discovered();
+    const std::vector<DiscoveredDevice>& devices = startup.getDevices();
+    init(deviceID, devices, desiredNetworkAddress, reconfigureAddress);
+    startup.addTime(discoveredBefore ? "connect" : "discover+connect",
+                    (boost::posix_time::microsec_clock::local_time() - start).total_microseconds()/1e6);
+    for (unsigned int i=0;i<devices.size();i++) {
+        if (devices[i].id==deviceID) {
+            device = devices[i];
+            if (reconfigureAddress) {
+                device.address = desiredNetworkAddress;
+            }
+            if (startup.getCache().enabled() && !startup.getCache().update(device)) {
+                std::cerr << "<< Unable to update device cache >>" << std::endl;
+            }
+            break;
+        }
+    }
+}
+
+// Returns false, leaving no system behind, if the device doesn't answer at address
+bool GocatorSystem::connectCached(Go2UInt32 deviceID, Go2IPAddress address, SystemStartup& startup) {
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+    state.forget();
+    Go2Status status = Go2System_Construct(&sys);
+    if (verbose) {
+        std::cout << getResponseString("Go2System_Construct", status) << std::endl;
+    }
+    if (status == GO2_OK) {
+        status = Go2System_Connect(sys, address);
+        if (verbose) {
+            std::cout << getResponseString("Go2System_Connect", status) << std::endl;
+        }
+    }
+    boost::posix_time::ptime connected = boost::posix_time::microsec_clock::local_time();
+    if (status == GO2_OK) {
+        status = Go2System_Login(sys, user, password);
+        if (verbose) {
+            std::cout << getResponseString("Go2System_Login", status) << std::endl;
+        }
+    }
+    if (status != GO2_OK) {
+        if (sys != 0) {
+            Go2System_Destroy(sys);
+            sys = 0;
+        }
+        return false;
+    }
+    boost::posix_time::ptime loggedIn = boost::posix_time::microsec_clock::local_time();
+    startup.addTime("discovery skipped", 0);
+    startup.addTime("connect", (connected - start).total_microseconds()/1e6);
+    startup.addTime("login", (loggedIn - connected).total_microseconds()/1e6);
+    return true;
+}
+
+DeviceCache::DeviceCache(const std::string& cacheFilename): filename(cacheFilename) {
+    if (filename.empty()) {
+        return;
+    }
+    std::ifstream cacheFile(filename.c_str());
+    std::string line;
+    while (std::getline(cacheFile, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        DiscoveredDevice device;
+        if (fields >> device.id >> device.address.useDhcp >> device.address.address
+                   >> device.address.mask >> device.address.gateway) {
+            devices.push_back(device);
+        }
+    }
+}
+
+bool DeviceCache::find(Go2UInt32 id, DiscoveredDevice& device) const {
+    for (unsigned int i=0;i<devices.size();i++) {
+        if (devices[i].id == id) {
+            device = devices[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Written to a temporary file and renamed, so a crash never leaves half a cache
+bool DeviceCache::update(const DiscoveredDevice& device) {
+    bool found = false;
+    for (unsigned int i=0;i<devices.size();i++) {
+        if (devices[i].id == device.id) {
+            devices[i] = device;
+            found = true;
+        }
+    }
+    if (!found) {
+        devices.push_back(device);
+    }
+    std::string temporary = filename + ".tmp";
+    std::ofstream cacheFile(temporary.c_str());
+    cacheFile << DEVICE_CACHE_HEADER << std::endl;
+    for (unsigned int i=0;i<devices.size();i++) {
+        cacheFile << devices[i].id << " " << devices[i].address.useDhcp << " " << devices[i].address.address
+                  << " " << devices[i].address.mask << " " << devices[i].address.gateway << std::endl;
+    }
+    cacheFile.close();
+    if (cacheFile.fail()) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return std::rename(temporary.c_str(), filename.c_str()) == 0;
+}
+
+SystemStartup::SystemStartup(const std::string& cacheFilename, bool verboseFlag, bool forceDiscovery):
+cache(cacheFilename), verbose(verboseFlag), rediscover(forceDiscovery),
+start(boost::posix_time::microsec_clock::local_time()), haveDevices(false) {
+    background = boost::thread(&SystemStartup::run, this, !useCache() || cache.empty());
+}
+
+// Background thread - the API, plus discovery when there's nothing cached to connect to
+void SystemStartup::run(bool discover) {
+    boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+    GocatorSystem::initializeApi();
+    boost::posix_time::ptime initialized = boost::posix_time::microsec_clock::local_time();
+    times.push_back(std::make_pair(std::string("api"), (initialized - begin).total_microseconds()/1e6));
+    if (discover) {
+        devices = GocatorSystem::discover(verbose);
+        haveDevices = true;
+        times.push_back(std::make_pair(std::string("discovery"),
+                        (boost::posix_time::microsec_clock::local_time() - initialized).total_microseconds()/1e6));
+    }
+}
+
+void SystemStartup::wait() {
+    if (background.joinable()) {
+        background.join();
+    }
+}
+
+const std::vector<DiscoveredDevice>& SystemStartup::getDevices() {
+    wait();
+    if (!haveDevices) {
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+        devices = GocatorSystem::discover(verbose);
+        haveDevices = true;
+        addTime("discovery", (boost::posix_time::microsec_clock::local_time() - begin).total_microseconds()/1e6);
+    }
+    return devices;
+}
+
+double SystemStartup::elapsed() const {
+    return (boost::posix_time::microsec_clock::local_time() - start).total_microseconds()/1e6;
+}
+
+void SystemStartup::report(std::ostream& os) const {
+    os << "<< Startup " << std::fixed << std::setprecision(3) << elapsed() << " s:";
+    for (unsigned int i=0;i<times.size();i++) {
+        os << (i > 0 ? "," : "") << " " << times[i].first << " " << times[i].second << " s";
+    }
+    os << " >>" << std::endl;
+    os.unsetf(std::ios_base::floatfield);
+    os << std::setprecision(6);
+}
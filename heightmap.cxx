@@ -0,0 +1,229 @@
+#include "heightmap.h"
+
+HeightMap::HeightMap():firstColumn(0), firstRow(0), columnCount(0), rowCapacity(0), rowBegin(0), rowEnd(0),
+mappedOffset(0), mappedResolution(0), mappedFirstColumn(0) {
+    settings.cellX = settings.cellY = 0;
+    settings.aggregation = HEIGHT_MEAN;
+}
+
+void HeightMap::reset(const ScanInfo& scanInfo, const HeightMapSettings& heightMapSettings) {
+    info = scanInfo;
+    settings = heightMapSettings;
+    firstColumn = firstRow = 0;
+    columnCount = rowCapacity = 0;
+    rowBegin = rowEnd = 0;
+    values.clear();
+    counts.clear();
+    columnOf.clear();
+}
+
+void HeightMap::add(const Profile& profile) {
+    size_t width = profile.width();
+    if (!enabled() || width == 0) {
+        return;
+    }
+    double y = (profile.encoder - info.startingEncoder)*info.encoderResolution;
+    Go2Int64 row = static_cast<Go2Int64>(std::floor(y/settings.cellY));
+    double xFirst = profile.xOffset;
+    double xLast = profile.xOffset + (width - 1)*profile.xResolution;
+    Go2Int64 columnLow = static_cast<Go2Int64>(std::floor(std::min(xFirst, xLast)/settings.cellX));
+    Go2Int64 columnHigh = static_cast<Go2Int64>(std::floor(std::max(xFirst, xLast)/settings.cellX));
+    if (columnCount == 0 || row < firstRow || row >= firstRow + static_cast<Go2Int64>(rowCapacity) ||
+        columnLow < firstColumn || columnHigh >= firstColumn + static_cast<Go2Int64>(columnCount)) {
+        grow(row, columnLow, columnHigh);
+    }
+    if (columnOf.size() != width || profile.xOffset != mappedOffset || profile.xResolution != mappedResolution ||
+        firstColumn != mappedFirstColumn) {
+        mapColumns(profile);
+    }
+    if (empty()) {
+        rowBegin = row;
+        rowEnd = row + 1;
+    } else {
+        rowBegin = std::min(rowBegin, row);
+        rowEnd = std::max(rowEnd, row + 1);
+    }
+    size_t stored = static_cast<size_t>(row - firstRow);
+    switch (settings.aggregation) {
+        case HEIGHT_MIN:
+            accumulate<HEIGHT_MIN>(profile, stored);
+            break;
+        case HEIGHT_MAX:
+            accumulate<HEIGHT_MAX>(profile, stored);
+            break;
+        case HEIGHT_MEAN:
+            accumulate<HEIGHT_MEAN>(profile, stored);
+            break;
+        case HEIGHT_LAST:
+            accumulate<HEIGHT_LAST>(profile, stored);
+    }
+}
+
+void HeightMap::mapColumns(const Profile& profile) {
+    size_t width = profile.width();
+    columnOf.resize(width);
+    for (size_t i=0; i<width; i++) {
+        double x = profile.xOffset + i*profile.xResolution;
+        columnOf[i] = static_cast<Go2UInt32>(static_cast<Go2Int64>(std::floor(x/settings.cellX)) - firstColumn);
+    }
+    mappedOffset = profile.xOffset;
+    mappedResolution = profile.xResolution;
+    mappedFirstColumn = firstColumn;
+}
+
+// Folds one profile's points into a stored row.  Neighbouring points mostly
+// share a cell, so each run of them is combined first and the cell updated
+// once per run.  Empty cells hold NaN, which fails every comparison, so the
+// first run always lands.
+template<HeightAggregation A>
+void HeightMap::accumulate(const Profile& profile, size_t row) {
+    float* cells = &values[row*columnCount];
+    Go2UInt32* cellCounts = A == HEIGHT_MEAN ? &counts[row*columnCount] : NULL;
+    const short* ranges = profile.rangeData();
+    size_t width = profile.width();
+    float zOffset = static_cast<float>(profile.zOffset);
+    float zResolution = static_cast<float>(profile.zResolution);
+    size_t i = 0;
+    while (i < width) {
+        if (ranges[i] == static_cast<short>(INVALID_RANGE_16BIT)) {
+            i++;
+            continue;
+        }
+        Go2UInt32 column = columnOf[i];
+        short runValue = ranges[i];
+        Go2Int64 runSum = 0;
+        Go2UInt32 runCount = 0;
+        for (; i<width && columnOf[i] == column; i++) {
+            short range = ranges[i];
+            if (range == static_cast<short>(INVALID_RANGE_16BIT)) {
+                continue;
+            }
+            if (A == HEIGHT_MIN) {
+                runValue = zResolution >= 0 ? std::min(runValue, range) : std::max(runValue, range);
+            } else if (A == HEIGHT_MAX) {
+                runValue = zResolution >= 0 ? std::max(runValue, range) : std::min(runValue, range);
+            } else if (A == HEIGHT_MEAN) {
+                runSum += range;
+                runCount++;
+            } else {
+                runValue = range;
+            }
+        }
+        float& cell = cells[column];
+        if (A == HEIGHT_MEAN) {
+            float runMean = zOffset + zResolution*(static_cast<float>(runSum)/runCount);
+            Go2UInt32 n = cellCounts[column] += runCount;
+            cell = n == runCount ? runMean : cell + (runMean - cell)*(static_cast<float>(runCount)/n);
+        } else {
+            float value = zOffset + zResolution*runValue;
+            if (A == HEIGHT_MIN) {
+                if (!(cell <= value)) {
+                    cell = value;
+                }
+            } else if (A == HEIGHT_MAX) {
+                if (!(cell >= value)) {
+                    cell = value;
+                }
+            } else {
+                cell = value;
+            }
+        }
+    }
+}
+
+// Re-lays the grid out so the row and columns fit, leaving room to grow
+// further in the direction the scan is heading
+void HeightMap::grow(Go2Int64 row, Go2Int64 columnLow, Go2Int64 columnHigh) {
+    Go2Int64 newFirstColumn = columnLow, newColumnEnd = columnHigh + 1;
+    Go2Int64 newFirstRow = row - HEIGHTMAP_ROW_SLACK, newRowEnd = row + HEIGHTMAP_ROW_SLACK + 1;
+    if (columnCount > 0) {
+        newFirstColumn = std::min(newFirstColumn, firstColumn);
+        newColumnEnd = std::max(newColumnEnd, firstColumn + static_cast<Go2Int64>(columnCount));
+        // At least double the rows so a long scan only re-lays out a few times
+        Go2Int64 extra = std::max(static_cast<Go2Int64>(rowCapacity), static_cast<Go2Int64>(HEIGHTMAP_ROW_SLACK));
+        newFirstRow = std::min(firstRow, row < firstRow ? row - extra : firstRow);
+        newRowEnd = std::max(firstRow + static_cast<Go2Int64>(rowCapacity),
+                             row >= firstRow + static_cast<Go2Int64>(rowCapacity) ? row + extra + 1 : row + 1);
+    }
+    size_t newColumnCount = static_cast<size_t>(newColumnEnd - newFirstColumn);
+    size_t newRowCapacity = static_cast<size_t>(newRowEnd - newFirstRow);
+    std::vector<float> newValues(newColumnCount*newRowCapacity, std::numeric_limits<float>::quiet_NaN());
+    std::vector<Go2UInt32> newCounts;
+    if (settings.aggregation == HEIGHT_MEAN) {
+        newCounts.assign(newColumnCount*newRowCapacity, 0);
+    }
+    if (!empty()) {
+        size_t columnShift = static_cast<size_t>(firstColumn - newFirstColumn);
+        for (Go2Int64 r=rowBegin; r<rowEnd; r++) {
+            size_t from = static_cast<size_t>(r - firstRow)*columnCount;
+            size_t to = static_cast<size_t>(r - newFirstRow)*newColumnCount + columnShift;
+            std::copy(values.begin() + from, values.begin() + from + columnCount, newValues.begin() + to);
+            if (!counts.empty()) {
+                std::copy(counts.begin() + from, counts.begin() + from + columnCount, newCounts.begin() + to);
+            }
+        }
+    }
+    values.swap(newValues);
+    counts.swap(newCounts);
+    firstColumn = newFirstColumn;
+    firstRow = newFirstRow;
+    columnCount = newColumnCount;
+    rowCapacity = newRowCapacity;
+}
+
+template<typename T> static void append(std::string& block, const T& value) {
+    block.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+bool HeightMap::save(const std::string& filename) const {
+    std::string header;
+    header.append(HEIGHTMAP_MAGIC, sizeof(HEIGHTMAP_MAGIC));
+    append(header, static_cast<Go2UInt32>(HEIGHTMAP_VERSION));
+    append(header, static_cast<Go2UInt32>(settings.aggregation));
+    append(header, static_cast<Go2UInt32>(columns()));
+    append(header, static_cast<Go2UInt32>(rows()));
+    append(header, xOrigin());
+    append(header, yOrigin());
+    append(header, settings.cellX);
+    append(header, settings.cellY);
+    std::ofstream fidout(filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    fidout.write(header.data(), header.size());
+    if (!empty()) {
+        // Stored rows are contiguous - only the ones holding data are written
+        const float* first = &values[static_cast<size_t>(rowBegin - firstRow)*columnCount];
+        fidout.write(reinterpret_cast<const char*>(first), rows()*columnCount*sizeof(float));
+    }
+    return static_cast<bool>(fidout);
+}
+
+template<typename T> static bool read(std::istream& fidin, T& value) {
+    return static_cast<bool>(fidin.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool HeightMap::load(const std::string& filename) {
+    std::ifstream fidin(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    char magic[sizeof(HEIGHTMAP_MAGIC)];
+    Go2UInt32 version, aggregation, columnTotal, rowTotal;
+    double x0, y0;
+    if (!fidin.read(magic, sizeof(magic)) || memcmp(magic, HEIGHTMAP_MAGIC, sizeof(HEIGHTMAP_MAGIC)) != 0 ||
+        !read(fidin, version) || version != HEIGHTMAP_VERSION || !read(fidin, aggregation) ||
+        aggregation > HEIGHT_LAST || !read(fidin, columnTotal) || !read(fidin, rowTotal) ||
+        !read(fidin, x0) || !read(fidin, y0) || !read(fidin, settings.cellX) || !read(fidin, settings.cellY) ||
+        settings.cellX <= 0 || settings.cellY <= 0) {
+        return false;
+    }
+    settings.aggregation = static_cast<HeightAggregation>(aggregation);
+    firstColumn = static_cast<Go2Int64>(std::floor(x0/settings.cellX + 0.5));
+    firstRow = rowBegin = static_cast<Go2Int64>(std::floor(y0/settings.cellY + 0.5));
+    rowEnd = rowBegin + rowTotal;
+    columnCount = columnTotal;
+    rowCapacity = rowTotal;
+    values.resize(columnCount*rowCapacity);
+    counts.clear();
+    if (!values.empty() && !fidin.read(reinterpret_cast<char*>(&values[0]), values.size()*sizeof(float))) {
+        values.clear();
+        rowEnd = rowBegin;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#include "histogram.h"
+
+Histogram::Histogram():count(0), sum(0), max(0) {
+    for (unsigned int i=0; i<HISTOGRAM_BUCKETS; i++) {
+        buckets[i].store(0, boost::memory_order_relaxed);
+    }
+}
+
+HistogramSnapshot Histogram::snapshot() const {
+    HistogramSnapshot current;
+    for (unsigned int i=0; i<HISTOGRAM_BUCKETS; i++) {
+        current.buckets[i] = buckets[i].load(boost::memory_order_relaxed);
+    }
+    current.count = count.load(boost::memory_order_relaxed);
+    current.sum = sum.load(boost::memory_order_relaxed);
+    current.max = max.load(boost::memory_order_relaxed);
+    return current;
+}
+
+Go2UInt64 percentile(const HistogramSnapshot& snapshot, double fraction) {
+    Go2UInt64 total = 0;
+    for (unsigned int i=0; i<HISTOGRAM_BUCKETS; i++) {
+        total += snapshot.buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    Go2UInt64 rank = static_cast<Go2UInt64>(fraction*total);
+    if (rank >= total) {
+        rank = total - 1;
+    }
+    Go2UInt64 seen = 0;
+    for (unsigned int i=0; i<HISTOGRAM_BUCKETS; i++) {
+        seen += snapshot.buckets[i];
+        if (seen > rank) {
+            if (i == 0) {
+                return 0;
+            }
+            // Never report more than was actually seen
+            Go2UInt64 upper = i < 64 ? (static_cast<Go2UInt64>(1) << i) - 1 : snapshot.max;
+            return upper < snapshot.max ? upper : snapshot.max;
+        }
+    }
+    return snapshot.max;
+}
+
+HistogramSnapshot difference(const HistogramSnapshot& later, const HistogramSnapshot& earlier) {
+    HistogramSnapshot interval;
+    for (unsigned int i=0; i<HISTOGRAM_BUCKETS; i++) {
+        interval.buckets[i] = later.buckets[i] - earlier.buckets[i];
+    }
+    interval.count = later.count - earlier.count;
+    interval.sum = later.sum - earlier.sum;
+    interval.max = later.max;
+    return interval;
+}
+
+void writeJson(std::ostream& os, const HistogramSnapshot& snapshot) {
+    os << "{\"count\": " << snapshot.count
+       << ", \"mean\": " << (snapshot.count > 0 ? static_cast<double>(snapshot.sum)/snapshot.count : 0)
+       << ", \"max\": " << snapshot.max
+       << ", \"p50\": " << percentile(snapshot, 0.50)
+       << ", \"p90\": " << percentile(snapshot, 0.90)
+       << ", \"p99\": " << percentile(snapshot, 0.99)
+       << ", \"p999\": " << percentile(snapshot, 0.999)
+       << ", \"buckets\": [";
+    // Trailing empty buckets are left off
+    unsigned int used = HISTOGRAM_BUCKETS;
+    while (used > 0 && snapshot.buckets[used-1] == 0) {
+        used--;
+    }
+    for (unsigned int i=0; i<used; i++) {
+        os << (i > 0 ? ", " : "") << snapshot.buckets[i];
+    }
+    os << "]}";
+}
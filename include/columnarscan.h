@@ -0,0 +1,90 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Columnar scan (<scan>.cols), written by csv2col from x,y,z CSV scans, host byte order:
+//     char[8]  "GO2COLS\0"
+//     uint32   format version
+//     uint32   header length, followed by the CSV's leading '#' lines as they were
+// followed by blocks of consecutive points, each
+//     uint32   point count
+//     uint32   profile count - runs of points with the same Y
+//     double   Y [mm] of each profile
+//     uint32   points in each profile
+//     float    X [mm] of each point
+//     float    Z [mm] of each point
+// and a block with a point count of 0 followed by
+//     uint64   total profiles (summed over the blocks), total points
+// A profile may be split across two blocks.  Single precision holds the 6
+// significant digits of the original CSV scans and the 4 decimal places
+// gocator_encoder writes for any X or Z under a metre.
+#define COLUMNAR_MAGIC "GO2COLS"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_EXTENSION ".cols"
+
+// One block of a columnar scan
+typedef struct columnBlock {
+    std::vector<double> y; // Per profile
+    std::vector<Go2UInt32> profilePoints; // Per profile
+    std::vector<float> x, z; // Per point
+    void clear() {
+        y.clear();
+        profilePoints.clear();
+        x.clear();
+        z.clear();
+    }
+    size_t points() const {return x.size();}
+    size_t profiles() const {return y.size();}
+    // Adds a point, starting a new profile if Y changed
+    void add(double xValue, double yValue, double zValue) {
+        if (y.empty() || y.back() != yValue) {
+            y.push_back(yValue);
+            profilePoints.push_back(0);
+        }
+        profilePoints.back()++;
+        x.push_back(static_cast<float>(xValue));
+        z.push_back(static_cast<float>(zValue));
+    }
+} ColumnBlock;
+
+// Appends the file header, a block, or the end of the scan
+void writeColumnarHeader(const std::string& header, std::string& out);
+void writeColumnBlock(const ColumnBlock& block, std::string& out);
+void writeColumnarFooter(Go2UInt64 profiles, Go2UInt64 points, std::string& out);
+
+// Reads a columnar scan back a block at a time.
+// ColumnarScanReader reader(filename); // throws std::runtime_error
+// ColumnBlock block;
+// while (reader.next(block)) {...}
+// reader.complete(); // false if the scan was cut short
+class ColumnarScanReader {
+public:
+    ColumnarScanReader(const std::string& filename);
+    const std::string& getHeader() const {return header;}
+    bool next(ColumnBlock& block);
+    // Whether the end of the scan was reached and its totals match
+    bool complete() const {return finished;}
+    Go2UInt64 profileCount() const {return profiles;}
+    Go2UInt64 pointCount() const {return points;}
+private:
+    template<typename T> bool read(T& value) {
+        return static_cast<bool>(fidin.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+    template<typename T> bool read(std::vector<T>& values, size_t count) {
+        values.resize(count);
+        return count == 0 || static_cast<bool>(fidin.read(reinterpret_cast<char*>(&values[0]), count*sizeof(T)));
+    }
+
+    std::string filename;
+    std::ifstream fidin;
+    std::string header;
+    bool finished;
+    Go2UInt64 profiles, points;
+};
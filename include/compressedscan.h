@@ -0,0 +1,80 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilewriter.h"
+#include "scanformat.h"
+#include "profilesource.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#define CHUNK_PROFILES 256 // Profiles per independently compressed chunk
+#define COMPRESSION_LEVEL 1 // zlib level - the residuals don't gain much from slower levels
+#define COMPRESSION_MAX_THREADS 4 // Upper limit on compression workers
+
+// A chunk of residual-coded profiles on its way through the compressors
+typedef struct compressedChunk {
+    std::string raw, packed;
+    Go2UInt32 profiles;
+    Go2UInt64 firstProfile;
+    Go2Int64 minEncoder, maxEncoder;
+    double cpuSeconds; // Compression time on the worker's CPU
+    bool ready;
+} CompressedChunk;
+
+// Writes the compressed scan format described in scanformat.h.
+// The conversion thread residual-codes each profile into the current chunk;
+// full chunks are deflated by a pool of worker threads and handed back in
+// order, so compression runs in parallel with receiving and conversion.
+// If every chunk is still being compressed the conversion thread waits,
+// which backs up into the profile queue rather than growing memory.
+class CompressedProfileWriter:public BinaryProfileWriter {
+public:
+    CompressedProfileWriter(unsigned int threads=defaultThreads());
+    virtual ~CompressedProfileWriter();
+    void writeHeader(const ScanInfo& info, std::string& block);
+    void writeProfile(const Profile& profile, std::string& block);
+    void writeFooter(std::string& block);
+    // Profiles are buffered, so the pipeline's offsets don't apply - the chunk index replaces the side index
+    bool indexable() {return false;}
+    std::string getFormatName() {
+        return std::string("Compressed");
+    }
+    void report(std::ostream& os);
+    static unsigned int defaultThreads();
+private:
+    void submit();
+    // Appends finished chunks in order, waiting until at least 'until' have been appended
+    void collect(std::string& block, Go2UInt64 until);
+    void compress();
+    static double threadCpuSeconds();
+
+    unsigned int threadCount;
+    std::vector<CompressedChunk> chunks;
+    Go2UInt64 filled, emitted; // Chunks handed to the workers / appended to the output
+    std::vector<size_t> jobs;
+    bool stopping;
+    boost::mutex lock;
+    boost::condition_variable jobAvailable, chunkReady;
+    boost::thread_group workers;
+
+    std::vector<short> previous;
+    Go2UInt64 profileNumber, offset;
+    std::vector<ScanIndexEntry> index; // Where each chunk landed in the current file
+
+    // Statistics, for the whole recording
+    Go2UInt64 rawBytes, packedBytes, chunksWritten, waits;
+    double cpuSeconds, maxCpuSeconds;
+    Go2UInt64 startTime, finishTime;
+};
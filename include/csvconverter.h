@@ -0,0 +1,110 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "columnarscan.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#define CSV_CHUNK_SIZE (16*1048576) // Bytes of CSV per task; bigger files are split at line ends
+#define CSV_NUMBER_MAX 64 // Longest number handed to strtod_l [characters]
+
+// Parses a decimal number such as -12.8, 20 or 1.5e-05 and moves p past it.
+// No locale and no strtod for the usual case - up to 19 significant digits
+// with a power of ten within 1e22 is one correctly rounded multiply or
+// divide; anything else goes to strtod_l in the C locale.
+bool parseNumber(const char*& p, const char* end, double& value);
+// Parses a whole "x,y,z" line (blanks allowed around the values, no newline)
+bool parseXyz(const char* p, const char* lineEnd, double& x, double& y, double& z);
+
+// How one CSV scan's conversion went
+typedef struct conversionResult {
+    std::string input, output;
+    Go2UInt64 bytes, profiles, points;
+    Go2UInt64 badLines; // Not x,y,z - skipped
+    bool ok;
+    std::string error;
+} ConversionResult;
+
+// Converts x,y,z CSV scans - gocator_encoder's or the original recorder's -
+// to columnar scans (columnarscan.h) on a pool of workers.  Each file is cut
+// into tasks of about CSV_CHUNK_SIZE bytes at line ends and the tasks are
+// dealt round-robin to per-worker queues; a worker that runs dry steals from
+// the others, so a few huge files and many small ones keep every core busy.
+// Files are mapped rather than read.  Each task becomes one block, and
+// whichever worker finishes the next block of a file in order writes it
+// and any finished ones after it.  The CSV's leading '#' lines become the
+// columnar header; '#' lines further in are skipped.
+// CsvConverter converter(threads);
+// converter.add(input, output); // every file
+// converter.run();
+// converter.report(std::cout);
+class CsvConverter {
+    public:
+        CsvConverter(unsigned int threads=defaultThreads(), size_t chunkSize=CSV_CHUNK_SIZE);
+        void add(const std::string& input, const std::string& output);
+        // Converts every file added, returns false if any failed
+        bool run();
+        void report(std::ostream& os);
+        const std::vector<ConversionResult>& getResults() const {return results;}
+        static unsigned int defaultThreads();
+    private:
+        // The lines starting between begin and end of one file
+        typedef struct conversionTask {
+            size_t file;
+            Go2UInt64 chunk;
+            size_t begin, end;
+        } ConversionTask;
+        typedef struct parsedChunk {
+            ColumnBlock block;
+            std::string header;
+            Go2UInt64 badLines;
+            std::string error;
+        } ParsedChunk;
+        // Where a file's conversion is up to
+        typedef struct fileState {
+            Go2UInt64 chunks, written;
+            bool opened; // Output created, so it's removed if the conversion fails
+            std::map<Go2UInt64, boost::shared_ptr<ParsedChunk> > finished; // Waiting for earlier chunks
+            std::ofstream fidout;
+            std::string pending;
+            boost::mutex lock;
+        } FileState;
+        typedef struct workerQueue {
+            std::deque<ConversionTask> tasks;
+            boost::mutex lock;
+        } WorkerQueue;
+
+        void work(unsigned int worker);
+        bool nextTask(unsigned int worker, ConversionTask& task);
+        void parse(const ConversionTask& task, ParsedChunk& parsed);
+        void parseLines(const char* begin, const char* end, const char* fileEnd, bool atStart, ParsedChunk& parsed);
+        void store(const ConversionTask& task, const boost::shared_ptr<ParsedChunk>& parsed);
+
+        unsigned int threadCount;
+        size_t chunkBytes;
+        std::vector<ConversionResult> results;
+        boost::scoped_array<FileState> files;
+        boost::scoped_array<WorkerQueue> queues;
+        double seconds;
+};
@@ -0,0 +1,42 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilewriter.h"
+#include "rangeconvert.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define CSV_MAX_PRECISION 9 // Most decimal places the fixed formatter will write
+#define CSV_MAX_FIELD 32 // Longest formatted value including sign and point [bytes]
+
+// Writes value with exactly `precision` decimal places (rounding half away
+// from zero) and returns the number of characters written.  No locale, no
+// iostream; the same value and precision always produce the same bytes.
+// out must have room for CSV_MAX_FIELD characters.
+int formatFixed(double value, int precision, char* out);
+
+// Comma-delimited x,y,z ASCII, one line per valid point.
+// Each profile is converted with compactRanges, formatted into a reusable
+// buffer and appended to the block in one go; Y is formatted once per
+// profile rather than once per point.
+class CsvWriter:public ProfileWriter {
+public:
+    CsvWriter(int xDecimals=CSV_DEFAULT_PRECISION, int yDecimals=CSV_DEFAULT_PRECISION,
+              int zDecimals=CSV_DEFAULT_PRECISION);
+    void writeHeader(const ScanInfo& info, std::string& block);
+    void writeProfile(const Profile& profile, std::string& block);
+    std::string getFormatName() {
+        return std::string("CSV");
+    }
+protected:
+    ScanInfo scan;
+    int xPrecision, yPrecision, zPrecision;
+    std::vector<char> buffer;
+    std::vector<double> x, z;
+};
@@ -0,0 +1,86 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+
+#include <cstddef>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/lockfree/queue.hpp>
+
+#define BATCH_POOL_DEPTH 256 // Received batches that can be in use at once
+
+class BatchPool;
+
+// One received batch, shared by every Profile that borrows ranges from it
+typedef struct dataBatch {
+    Go2Data data; // Batch from Go2System_ReceiveData, GO2_NULL for generated batches
+    std::vector<short> ranges; // Ranges of generated batches, kept allocated between uses
+    boost::atomic<unsigned int> references;
+    BatchPool* pool;
+} DataBatch;
+
+// Counted reference to a pooled DataBatch.  When the last reference is
+// dropped - by the source, or by whichever thread finished with the last
+// profile - the pool frees what the batch holds (exactly once) and the batch
+// becomes available again.  Copying and dropping references never allocates.
+class BatchRef {
+    public:
+        BatchRef():batch(NULL) {}
+        BatchRef(const BatchRef& other):batch(other.batch) {
+            if (batch != NULL) {
+                batch->references.fetch_add(1, boost::memory_order_relaxed);
+            }
+        }
+        ~BatchRef() {reset();}
+        BatchRef& operator=(const BatchRef& other) {
+            if (other.batch != NULL) {
+                other.batch->references.fetch_add(1, boost::memory_order_relaxed);
+            }
+            reset();
+            batch = other.batch;
+            return *this;
+        }
+        inline void reset();
+        DataBatch* get() const {return batch;}
+        bool empty() const {return batch == NULL;}
+    private:
+        friend class BatchPool;
+        explicit BatchRef(DataBatch* pooled):batch(pooled) {}
+        DataBatch* batch;
+};
+
+// Fixed set of DataBatches handed out by the receive thread and given back
+// from any thread, without locks or allocation.  Generated batches keep
+// their buffers; see ReceivedBatchPool for batches from the sensor.
+// BatchPool pool;
+// BatchRef batch = pool.acquire(); // empty if every batch is still in use
+// profile.borrow(batch, ranges, width); // as many profiles as need it
+// batch.reset(); // recycled once the profiles are done with it too
+// Every reference must be dropped before the pool is destroyed.
+class BatchPool {
+    public:
+        BatchPool(size_t depth=BATCH_POOL_DEPTH);
+        virtual ~BatchPool() {}
+        BatchRef acquire();
+        size_t capacity() const {return count;}
+    protected:
+        // Frees what the batch holds before it is reused
+        virtual void clear(DataBatch& batch) {}
+    private:
+        friend class BatchRef;
+        void recycle(DataBatch* batch);
+
+        size_t count;
+        boost::scoped_array<DataBatch> batches;
+        boost::lockfree::queue<DataBatch*, boost::lockfree::fixed_sized<true> > freeBatches;
+};
+
+inline void BatchRef::reset() {
+    if (batch != NULL && batch->references.fetch_sub(1, boost::memory_order_release) == 1) {
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        batch->pool->recycle(batch);
+    }
+    batch = NULL;
+}
@@ -0,0 +1,79 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilewriter.h"
+#include "profilesource.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+
+#define GAP_TOLERANCE 1.5 // A step this many times the expected spacing means profiles are missing
+#define GAP_SPAN_LIMIT 65536 // Gaps kept for the gaps file; later ones are only counted
+#define GAP_WARNING_INTERVAL 1000000 // Shortest time between gap warnings [us]
+#define GAP_EXTENSION ".gaps.csv"
+
+// How far apart consecutive profiles should be.  Either may be 0 (unknown);
+// encoder spacing is used when known since frame timing isn't regular
+// under an encoder trigger.
+typedef struct gapSettings {
+    Go2Int64 encoderStep; // Expected encoder ticks between profiles
+    Go2UInt64 framePeriod; // Expected time between profiles [us]
+} GapSettings;
+
+enum GapType {MISSING_PROFILES, DUPLICATE_PROFILE, ENCODER_REVERSAL};
+
+// One problem between two consecutive profiles
+typedef struct gapSpan {
+    GapType type;
+    Go2UInt64 profile; // Number of the profile after the gap
+    Go2Int64 encoderFrom, encoderTo;
+    Go2UInt64 timestampFrom, timestampTo;
+    Go2UInt64 missing; // Estimated profiles lost (MISSING_PROFILES only)
+} GapSpan;
+
+// Checks each profile against the one before it for lost frames (the encoder
+// or clock moved further than one trigger), duplicates (it didn't move at
+// all) and reversals of the encoder's direction.
+// Runs on the conversion thread, so it costs the receive loop nothing;
+// counters can be read from any thread while recording.
+// GapDetector gaps;
+// gaps.reset(scanInfo, settings);
+// gaps.check(profile); // every profile, in order
+// gaps.save(scanFilename + GAP_EXTENSION);
+class GapDetector {
+    public:
+        GapDetector();
+        void reset(const ScanInfo& info, const GapSettings& settings);
+        void check(const Profile& profile);
+        bool enabled() const {return spacing.encoderStep > 0 || spacing.framePeriod > 0;}
+        Go2UInt64 gapCount() const {return gaps.load(boost::memory_order_relaxed);}
+        Go2UInt64 missingCount() const {return missing.load(boost::memory_order_relaxed);}
+        Go2UInt64 duplicateCount() const {return duplicates.load(boost::memory_order_relaxed);}
+        Go2UInt64 reversalCount() const {return reversals.load(boost::memory_order_relaxed);}
+        const std::vector<GapSpan>& getSpans() const {return spans;}
+        // Writes every span as CSV, returns false on error
+        bool save(const std::string& filename) const;
+    private:
+        void flag(GapType type, const Profile& profile, Go2UInt64 lost);
+        static void increment(boost::atomic<Go2UInt64>& counter, Go2UInt64 amount) {
+            counter.store(counter.load(boost::memory_order_relaxed) + amount, boost::memory_order_relaxed);
+        }
+        double position(Go2Int64 encoder) const {return (encoder - info.startingEncoder)*info.encoderResolution;}
+
+        ScanInfo info;
+        GapSettings spacing;
+        bool havePrevious;
+        Go2Int64 previousEncoder;
+        Go2UInt64 previousTimestamp;
+        int direction;
+        Go2UInt64 profileNumber;
+        std::vector<GapSpan> spans;
+        boost::atomic<Go2UInt64> gaps, missing, duplicates, reversals;
+        Go2UInt64 lastWarning, unwarned;
+};
@@ -4,19 +4,82 @@ extern "C" {
 }
 #include "gocatorcontrol.h"
 #include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <algorithm>
+#include <ctime>
+#include <fstream>
 #include <string>
+#include <sstream>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#define CONFIG_POLL_INTERVAL 1000 // How often ConfigWatcher checks the config file [ms]
+
+enum TriggerType {TIME_TRIGGER, ENCODER_TRIGGER, INPUT_TRIGGER, SOFTWARE_TRIGGER};
 
 typedef struct gocatorAddress {
     Go2AddressInfo addr;
     bool reconfigure;
 } GocatorAddress;
 
+typedef struct triggerSettings {
+    TriggerType type;
+    bool gate; // Only trigger while the digital input is high
+    double frameRate; // Time trigger [Hz]
+    double travelThreshold; // Encoder trigger [mm]
+    TravelDirection direction; // Encoder trigger
+} TriggerSettings;
+
+// Everything in the configuration file, read and checked in one pass
+typedef struct scanConfig {
+    std::string filename;
+    std::vector<Go2UInt32> deviceIDs; // System.device_ids, or just System.device_id
+    GocatorAddress network;
+    Encoder encoder;
+    TriggerSettings trigger;
+    GocatorFilter filter;
+    ReductionSettings reduction; // Output section
+} ScanConfig;
+
+// Reads the configuration file.
+// ScanConfig config = GocatorConfigurator::load(configFile);
+// boost::shared_ptr<Trigger> trigger(GocatorConfigurator::configuredTrigger(config));
+// Invalid settings are reported and thrown as std::runtime_error.
 class GocatorConfigurator {
 public:
-    static Go2UInt32 deviceID(std::string& configFile);
-    static Encoder configuredEncoder(std::string& configFile);
-    static Trigger* configuredTrigger(std::string& configFile);
-    static GocatorAddress configuredNetworkConnection(std::string& configFile);
-    static GocatorFilter configuredFilter(std::string& configFile);
-};
\ No newline at end of file
+    static ScanConfig load(const std::string& configFile);
+    static Trigger* configuredTrigger(const ScanConfig& config);
+};
+
+// Keeps the latest valid configuration for a long-running process.
+// The file is only parsed when its modification time changes; readers take
+// a snapshot with current() once per scan, so a scan never sees a
+// half-updated config and never waits on a parse.  An invalid edit is
+// reported and the previous configuration stays in place.
+// ConfigWatcher watcher(configFile);
+// watcher.watch();
+// boost::shared_ptr<const ScanConfig> config = watcher.current();
+class ConfigWatcher {
+public:
+    ConfigWatcher(const std::string& configFile, bool verboseFlag=false);
+    virtual ~ConfigWatcher() {stop();}
+    // Polls the file on a background thread
+    void watch(unsigned int intervalMilliseconds=CONFIG_POLL_INTERVAL);
+    void stop();
+    // Re-reads the file if it has changed; returns true if a new config was swapped in.
+    // Call either this (e.g. between scans) or watch(), not both.
+    bool reload();
+    boost::shared_ptr<const ScanConfig> current() const {return boost::atomic_load(&config);}
+private:
+    void poll(unsigned int intervalMilliseconds);
+
+    std::string filename;
+    bool verbose;
+    boost::shared_ptr<const ScanConfig> config;
+    std::time_t modified;
+    boost::thread watcher;
+};
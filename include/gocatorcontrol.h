@@ -4,6 +4,9 @@ extern "C" {
 }
 #include "go2response.h"
 #include "gocatorsystem.h"
+#include "recordingpipeline.h"
+#include "statsreporter.h"
+#include "profilesource.h"
 
 #include <fstream>
 #include <ios>
@@ -15,8 +18,6 @@ extern "C" {
 #include <boost/thread/thread.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
-#define RECEIVE_TIMEOUT 100000
-#define INVALID_RANGE_16BIT 0x8000
 
 enum TravelDirection {BIDIRECTIONAL, FORWARD, BACKWARD};
 
@@ -34,19 +35,77 @@ typedef struct gocatorFilter {
 // Controls the specified GocatorSystem.
 class GocatorControl {
     public:
-        GocatorControl(GocatorSystem& go2system, bool verboseFlag=false):sys(go2system), verbose(verboseFlag) {}
+        GocatorControl(GocatorSystem& go2system, bool verboseFlag=false):
+        sys(go2system), verbose(verboseFlag), refused(0), statsInterval(0) {
+            output.format = CSV;
+            output.xPrecision = output.yPrecision = output.zPrecision = CSV_DEFAULT_PRECISION;
+            spacing.encoderStep = 0;
+            spacing.framePeriod = 0;
+            heightMap.cellX = heightMap.cellY = 0;
+            heightMap.aggregation = HEIGHT_MEAN;
+            rangeFilter.zLow = rangeFilter.zHigh = 0;
+            rangeFilter.gapFill = 0;
+            rangeFilter.xMethod = rangeFilter.yMethod = SMOOTH_NONE;
+            rangeFilter.xWindow = rangeFilter.yWindow = 1;
+            rangeFilter.noise = 0;
+            reduction = noReduction();
+            segments.bytes = segments.profiles = segments.preallocate = 0;
+            segments.distance = segments.seconds = 0;
+            stopSettings.profiles = 0;
+            stopSettings.distance = stopSettings.seconds = 0;
+        }
+        // configureEncoder(), configureFilter() and Trigger::set() only stage
+        // their settings; applySettings() sends the ones that changed
         void configureEncoder(Encoder& encoder);
         void configureFilter(GocatorFilter& filter);
-        void targetOn();
+        // Returns false if the sensor refused or didn't keep any setting,
+        // including any configureFilter() had to send early
+        bool applySettings();
+        // Returns false (and leaves the laser off) if the sensor refused the time trigger
+        bool targetOn();
         void targetOff();
         void recordProfile(std::string& outputFilename);
         void recordProfile(std::string& outputFilename, std::string& commentString);
+        void recordProfile(ProfileSource& source, std::string& outputFilename, std::string& commentString);
         Go2System& getSystem() {return sys.getSystem();}
+        SensorState& getState() {return sys.getState();}
         Encoder& getEncoder() {return lme;}
         void resetEncoder() {Go2System_GetEncoder(sys.getSystem(), &startingEncoderReading);}
+        Go2Int64 getStartingEncoder() {return startingEncoderReading;}
+        // Uses the encoder without configuring the sensor (e.g. for replayed scans)
+        void setEncoder(Encoder& encoder, Go2Int64 startingEncoder) {
+            lme = encoder;
+            startingEncoderReading = startingEncoder;
+        }
+        void setOutputSettings(OutputSettings& settings) {output = settings;}
+        // Print recording statistics every intervalSeconds and save them to
+        // <output>.stats.json at the end (0 - off)
+        void setStatsInterval(double intervalSeconds) {statsInterval = intervalSeconds;}
+        // Spacing the trigger should produce between profiles, used to spot lost frames
+        void setExpectedSpacing(const GapSettings& settings) {spacing = settings;}
+        GapSettings getExpectedSpacing() {return spacing;}
+        // Build a height map next to the output while recording (cell size 0 - off)
+        void setHeightMap(const HeightMapSettings& settings) {heightMap = settings;}
+        // Filter profiles on the host before they are written (see RangeFilter)
+        void setRangeFilter(const RangeFilterSettings& settings) {rangeFilter = settings;}
+        // Crop and decimate profiles before anything else is done with them (see ProfileReducer)
+        void setReduction(const ReductionSettings& settings) {reduction = settings;}
+        // Record to a series of segment files instead of one (no limits - off)
+        void setSegments(const SegmentSettings& settings) {segments = settings;}
+        // End the recording by itself once any limit is reached
+        void setStopConditions(const StopSettings& limits) {stopSettings = limits;}
     private:
         GocatorSystem& sys;
         bool verbose;
+        unsigned int refused; // Settings refused or not kept since the last applySettings()
+        double statsInterval;
+        GapSettings spacing;
+        HeightMapSettings heightMap;
+        RangeFilterSettings rangeFilter;
+        ReductionSettings reduction;
+        SegmentSettings segments;
+        StopSettings stopSettings;
+        OutputSettings output;
         Encoder lme;
         Go2Int64 startingEncoderReading;
 };
@@ -55,7 +114,8 @@ class GocatorControl {
 
 class Trigger {
 public:
-    virtual Go2Status set(GocatorControl& controller)=0;
+    // Stages the trigger settings, see GocatorControl::applySettings()
+    virtual void set(GocatorControl& controller)=0;
     void setTriggerGate(bool enabled) {
         useTriggerGate = enabled;
     }
@@ -69,9 +129,9 @@ protected:
 // Software trigger
 class SoftwareTrigger:public Trigger {
 public:
-    Go2Status set(GocatorControl& controller) {
-        Go2System_EnableTriggerGate(controller.getSystem(), useTriggerGate);
-        return Go2System_SetTriggerSource(controller.getSystem(), triggerSource);
+    void set(GocatorControl& controller) {
+        controller.getState().setTriggerGate(useTriggerGate);
+        controller.getState().setTriggerSource(triggerSource);
     }
     std::string getTriggerType() {
         return std::string ("Software");
@@ -82,9 +142,9 @@ protected:
 
 // Digital input trigger
 class InputTrigger:public Trigger {
-    Go2Status set(GocatorControl& controller) {
-        Go2System_EnableTriggerGate(controller.getSystem(), useTriggerGate);
-        return Go2System_SetTriggerSource(controller.getSystem(), triggerSource);
+    void set(GocatorControl& controller) {
+        controller.getState().setTriggerGate(useTriggerGate);
+        controller.getState().setTriggerSource(triggerSource);
     }
     std::string getTriggerType() {
         return std::string("Digital Input");;
@@ -96,7 +156,7 @@ protected:
 // Time trigger
 class TimeTrigger:public Trigger {
 public:
-    Go2Status set(GocatorControl& controller) {
+    void set(GocatorControl& controller) {
         Go2System sys = controller.getSystem();
         double minFrameRate = Go2System_FrameRateMin(sys);
         double maxFrameRate = Go2System_FrameRateMax(sys);
@@ -105,9 +165,13 @@ public:
         } else if (frameRate>maxFrameRate) {
             frameRate = maxFrameRate;
         }
-        Go2System_SetFrameRate(sys, frameRate);
-        Go2System_EnableTriggerGate(controller.getSystem(), useTriggerGate);
-        return Go2System_SetTriggerSource(controller.getSystem(), triggerSource);    
+        controller.getState().setFrameRate(frameRate);
+        GapSettings spacing;
+        spacing.encoderStep = 0;
+        spacing.framePeriod = frameRate > 0 ? static_cast<Go2UInt64>(1e6/frameRate) : 0;
+        controller.setExpectedSpacing(spacing);
+        controller.getState().setTriggerGate(useTriggerGate);
+        controller.getState().setTriggerSource(triggerSource);
     }
     void setFrameRate(double framesPerSecond) {frameRate=framesPerSecond;}
     std::string getTriggerType() {
@@ -123,16 +187,20 @@ protected:
 // Encoder Trigger
 class EncoderTrigger:public Trigger {
 public:
-    Go2Status set(GocatorControl& controller) {
+    void set(GocatorControl& controller) {
         Encoder encoder = controller.getEncoder();
         if (travel_threshold < encoder.resolution || 
             travel_threshold <= 0) {
             travel_threshold = encoder.resolution;
         }
-        Go2System_SetEncoderPeriod(controller.getSystem(), travel_threshold);
-        Go2System_SetEncoderTriggerMode(controller.getSystem(), travel_direction);
-        Go2System_EnableTriggerGate(controller.getSystem(), useTriggerGate);
-        return Go2System_SetTriggerSource(controller.getSystem(), triggerSource);
+        controller.getState().setEncoderPeriod(travel_threshold);
+        GapSettings spacing;
+        spacing.encoderStep = static_cast<Go2Int64>(travel_threshold/encoder.resolution + 0.5);
+        spacing.framePeriod = 0;
+        controller.setExpectedSpacing(spacing);
+        controller.getState().setEncoderTriggerMode(travel_direction);
+        controller.getState().setTriggerGate(useTriggerGate);
+        controller.getState().setTriggerSource(triggerSource);
     }
     void setTravelThreshold(double threshold) {travel_threshold=threshold;}
     void setTravelDirection(TravelDirection direction) {
@@ -3,27 +3,109 @@ extern "C" {
     #include "Go2.h"
 }
 #include "go2response.h"
+#include "sensorstate.h"
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <stdexcept>
 #include <cstring>
+#include <utility>
+#include <vector>
+#include <boost/thread/once.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#define DEVICE_CACHE_FILE "gocator_encoder.cache" // Default device cache, in the current folder
+
+// A Gocator found by Go2System_Discover
+typedef struct discoveredDevice {
+    Go2UInt32 id;
+    Go2AddressInfo address;
+} DiscoveredDevice;
+
+// How long each step of bringing a system up took [s]
+typedef std::vector<std::pair<std::string, double> > StartupTimes;
+
+// Remembers the devices found and the address each is set to, so the next
+// run can connect straight away instead of waiting on Go2System_Discover.
+// One line per device (serial number, DHCP flag, address, mask, gateway as
+// Go2IPAddress values); delete the file to force a discovery.
+// DeviceCache cache(filename); // empty filename - no cache
+// if (cache.find(deviceID, device)) {...}
+// cache.update(device); // saves the file
+class DeviceCache {
+    public:
+        DeviceCache(const std::string& cacheFilename="");
+        bool enabled() const {return !filename.empty();}
+        bool empty() const {return devices.empty();}
+        bool find(Go2UInt32 id, DiscoveredDevice& device) const;
+        // Adds or replaces the device and saves the cache, returns false on error
+        bool update(const DiscoveredDevice& device);
+    private:
+        std::string filename;
+        std::vector<DiscoveredDevice> devices;
+};
+
+// Initializes the Go2 API on a background thread as soon as it's created,
+// and discovers devices too if the cache has nothing in it, so that work
+// overlaps whatever the caller does next (reading its configuration, say).
+// SystemStartup startup(cacheFilename, verbose);
+// ...
+// go2system.init(deviceID, startup, address, reconfigure);
+class SystemStartup {
+    public:
+        // forceDiscovery - discover even if the cache has the device (cache is still updated)
+        SystemStartup(const std::string& cacheFilename=DEVICE_CACHE_FILE, bool verboseFlag=false,
+                      bool forceDiscovery=false);
+        virtual ~SystemStartup() {wait();}
+        DeviceCache& getCache() {return cache;}
+        // Whether cached addresses may be used without discovering first
+        bool useCache() const {return cache.enabled() && !rediscover;}
+        // Discovery results, discovering now if that didn't happen in the background
+        const std::vector<DiscoveredDevice>& getDevices();
+        bool discovered() const {return haveDevices;}
+        // Waits for the background work
+        void wait();
+        const StartupTimes& getTimes() const {return times;}
+        void addTime(const std::string& step, double seconds) {times.push_back(std::make_pair(step, seconds));}
+        // Seconds since the startup began
+        double elapsed() const;
+        // One line summing up where the time went
+        void report(std::ostream& os) const;
+    private:
+        void run(bool discover);
+
+        DeviceCache cache;
+        bool verbose, rediscover;
+        boost::posix_time::ptime start;
+        std::vector<DiscoveredDevice> devices;
+        bool haveDevices;
+        StartupTimes times;
+        boost::thread background;
+};
 
 // Creates and initializes a Gocator 20x0 system.
 // GocatorSystem go2system();
 // go2system.init(deviceSerialNumber);
 // Return the created and logged-in system: go2system.getSystem();
+// Several systems can share one discovery:
+// std::vector<DiscoveredDevice> devices = GocatorSystem::discover();
+// go2system.init(deviceSerialNumber, devices, devices[i].address);
 class GocatorSystem {
     public:
         GocatorSystem(std::string& pword, Go2User go2user, bool verboseFlag=false):
-        user(go2user), sys(0), verbose(verboseFlag) {
+        user(go2user), sys(0), verbose(verboseFlag), state(sys, verboseFlag) {
             setPassword(pword);
         }
         GocatorSystem(std::string& pword, bool verboseFlag=false):
-        user(GO2_USER_ADMIN), sys(0), verbose(verboseFlag) {
+        user(GO2_USER_ADMIN), sys(0), verbose(verboseFlag), state(sys, verboseFlag) {
             setPassword(pword);
         }
         GocatorSystem(bool verboseFlag=false):
-        user(GO2_USER_ADMIN), sys(0), verbose(verboseFlag) {
+        user(GO2_USER_ADMIN), sys(0), verbose(verboseFlag), state(sys, verboseFlag) {
             password = new Go2Char();
         }
         virtual ~GocatorSystem();
@@ -31,12 +113,29 @@ class GocatorSystem {
         void init(Go2UInt32 deviceID, 
                   Go2AddressInfo desiredNetworkAddress=defaultGocatorAddress(),
                   bool reconfigureAddress=false);
+        void init(Go2UInt32 deviceID, const std::vector<DiscoveredDevice>& devices,
+                  Go2AddressInfo desiredNetworkAddress=defaultGocatorAddress(),
+                  bool reconfigureAddress=false);
+        // Connects straight to the device's cached address, only discovering
+        // if it isn't cached, doesn't answer or has to be readdressed; the
+        // cache is brought up to date and each step timed in startup
+        void init(Go2UInt32 deviceID, SystemStartup& startup,
+                  Go2AddressInfo desiredNetworkAddress=defaultGocatorAddress(),
+                  bool reconfigureAddress=false);
+        // Initializes the Go2 API (once per process) and lists the attached devices
+        static std::vector<DiscoveredDevice> discover(bool verboseFlag=false);
+        // Initializes the Go2 API if that hasn't been done yet
+        static void initializeApi();
         Go2User getUser() {
             return user;
         }
         Go2System& getSystem() {
             return sys;
         }
+        // The sensor's settings as last read or sent, for pushing only changes
+        SensorState& getState() {
+            return state;
+        }
         void setPassword(std::string& pword) {
             delete(password);
             password = new Go2Char(pword.length() + 1);
@@ -44,6 +143,12 @@ class GocatorSystem {
         }
 
     private:
+        static void startApi();
+        bool connectCached(Go2UInt32 deviceID, Go2IPAddress address, SystemStartup& startup);
+        static bool sameAddress(const Go2AddressInfo& first, const Go2AddressInfo& second) {
+            return first.useDhcp == second.useDhcp && first.address == second.address &&
+                   first.mask == second.mask && first.gateway == second.gateway;
+        }
         static Go2AddressInfo defaultGocatorAddress() {
             Go2IPAddress defaultMask, defaultGateway;
             Go2IPAddress_Parse(reinterpret_cast<const signed char*>("255.255.255.0"), &defaultMask);
@@ -59,4 +164,5 @@ class GocatorSystem {
     Go2Char* password;
     Go2System sys;
     bool verbose;
+    SensorState state;
 };
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilewriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Height map written next to a scan as <scan>.hmap (host byte order):
+//     char[8]  "GO2HMAP\0"
+//     uint32   format version
+//     uint32   aggregation (0 min, 1 max, 2 mean, 3 last)
+//     uint32   columns, rows
+//     double   X and Y of the low corner of the first cell [mm]
+//     double   cell width in X and Y [mm]
+//     float    z[rows][columns], NaN where no point fell in the cell
+// Cell (row, column) covers X from x0+column*cellX and Y from y0+row*cellY.
+#define HEIGHTMAP_MAGIC "GO2HMAP"
+#define HEIGHTMAP_VERSION 1
+#define HEIGHTMAP_EXTENSION ".hmap"
+#define HEIGHTMAP_ROW_SLACK 256 // Rows added beyond what's needed whenever the map grows
+
+enum HeightAggregation {HEIGHT_MIN, HEIGHT_MAX, HEIGHT_MEAN, HEIGHT_LAST};
+
+typedef struct heightMapSettings {
+    double cellX, cellY; // Cell size [mm], 0 - no height map
+    HeightAggregation aggregation; // How the points falling in one cell are combined
+} HeightMapSettings;
+
+// Regular grid of Z built one profile at a time while recording, so the scan
+// can be displayed or measured without interpolating scattered points.
+// The grid grows in Y as the scan does (either way, for bidirectional
+// encoders) and in X if the field of view changes.
+// HeightMap map;
+// map.reset(scanInfo, settings);
+// map.add(profile); // every profile
+// map.save(scanFilename + HEIGHTMAP_EXTENSION);
+class HeightMap {
+    public:
+        HeightMap();
+        void reset(const ScanInfo& info, const HeightMapSettings& settings);
+        bool enabled() const {return settings.cellX > 0 && settings.cellY > 0;}
+        void add(const Profile& profile);
+        bool empty() const {return rowEnd <= rowBegin;}
+        size_t columns() const {return columnCount;}
+        size_t rows() const {return empty() ? 0 : static_cast<size_t>(rowEnd - rowBegin);}
+        double xOrigin() const {return firstColumn*settings.cellX;}
+        double yOrigin() const {return rowBegin*settings.cellY;}
+        // Z of a cell [mm], NaN if it is empty
+        float at(size_t row, size_t column) const {
+            return values[(row + rowBegin - firstRow)*columnCount + column];
+        }
+        bool save(const std::string& filename) const;
+        bool load(const std::string& filename);
+        const HeightMapSettings& getSettings() const {return settings;}
+    private:
+        template<HeightAggregation A> void accumulate(const Profile& profile, size_t row);
+        void grow(Go2Int64 row, Go2Int64 columnLow, Go2Int64 columnHigh);
+        void mapColumns(const Profile& profile);
+
+        ScanInfo info;
+        HeightMapSettings settings;
+        Go2Int64 firstColumn, firstRow; // Cell indices (X/cellX, Y/cellY) of the first stored column and row
+        size_t columnCount, rowCapacity;
+        Go2Int64 rowBegin, rowEnd; // Rows holding data
+        std::vector<float> values;
+        std::vector<Go2UInt32> counts; // Points per cell, mean only
+        // Column of each point for the current X geometry, worked out once
+        // rather than per point
+        std::vector<Go2UInt32> columnOf;
+        double mappedOffset, mappedResolution;
+        Go2Int64 mappedFirstColumn;
+};
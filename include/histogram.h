@@ -0,0 +1,49 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include <iostream>
+#include <boost/atomic.hpp>
+
+#define HISTOGRAM_BUCKETS 48 // Bucket b > 0 holds values from 2^(b-1) to 2^b - 1; the last also holds anything larger
+
+// A copy of a Histogram's counts at one moment
+typedef struct histogramSnapshot {
+    Go2UInt64 buckets[HISTOGRAM_BUCKETS];
+    Go2UInt64 count, sum, max;
+} HistogramSnapshot;
+
+// Upper bound of the bucket holding the given fraction (0-1) of the values
+Go2UInt64 percentile(const HistogramSnapshot& snapshot, double fraction);
+// Counts recorded between two snapshots (max is the later snapshot's)
+HistogramSnapshot difference(const HistogramSnapshot& later, const HistogramSnapshot& earlier);
+// {"count": n, "mean": x, "max": x, "p50": x, ..., "buckets": [...]}
+void writeJson(std::ostream& os, const HistogramSnapshot& snapshot);
+
+// Fixed power-of-two buckets, cheap enough to record every profile.
+// Only one thread may record() (the stage that owns it), so the counters
+// need no read-modify-write; any other thread may take a snapshot() at any
+// time and sees each counter whole, if not all of them from the same instant.
+class Histogram {
+public:
+    Histogram();
+    void record(Go2UInt64 value) {
+        unsigned int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+        if (bucket >= HISTOGRAM_BUCKETS) {
+            bucket = HISTOGRAM_BUCKETS - 1;
+        }
+        increment(buckets[bucket], 1);
+        increment(count, 1);
+        increment(sum, value);
+        if (value > max.load(boost::memory_order_relaxed)) {
+            max.store(value, boost::memory_order_relaxed);
+        }
+    }
+    HistogramSnapshot snapshot() const;
+private:
+    static void increment(boost::atomic<Go2UInt64>& counter, Go2UInt64 amount) {
+        counter.store(counter.load(boost::memory_order_relaxed) + amount, boost::memory_order_relaxed);
+    }
+    boost::atomic<Go2UInt64> buckets[HISTOGRAM_BUCKETS];
+    boost::atomic<Go2UInt64> count, sum, max;
+};
@@ -0,0 +1,85 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilewriter.h"
+#include "scanformat.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Where one profile of a MappedScan is
+typedef struct mappedProfile {
+    Go2Int64 encoder;
+    Go2UInt64 timestamp; // 0 in version 1 binary scans
+    double xOffset, xResolution, zOffset, zResolution;
+    Go2UInt32 width;
+    Go2UInt64 offset; // Byte offset of the ranges from MappedScan::data()
+} MappedProfile;
+
+// Consecutive profiles with the same width and geometry whose ranges are
+// evenly spaced, so they can be read as one profiles x width array of int16
+// with a row stride of `stride` bytes
+typedef struct mappedRun {
+    Go2UInt64 firstProfile, profiles;
+    Go2UInt32 width;
+    Go2UInt64 offset, stride; // Bytes from MappedScan::data()
+    double xOffset, xResolution, zOffset, zResolution;
+} MappedRun;
+
+// Opens a recorded scan for reading in place.  A binary scan is mapped
+// read-only and shared, so opening only walks the record headers and the
+// ranges stay where they are in the page cache - several processes reading
+// the same scan share its pages.  A compressed scan has to be decoded, once,
+// into memory owned by the MappedScan; the layout is the same either way.
+// Ranges in a binary scan follow odd-sized record headers and are generally
+// not 2-byte aligned, so copy them out (read()) rather than cast data().
+// MappedScan scan(filename); // throws std::runtime_error
+// for each run in scan.getRuns(): rows of run.width ranges at
+//     scan.data() + run.offset + i*run.stride
+// CSV scans can't be mapped.
+class MappedScan {
+public:
+    MappedScan(const std::string& filename);
+    ~MappedScan();
+    const ScanInfo& getInfo() const {return info;}
+    bool isCompressed() const {return compressed;}
+    // Whether data() is the file itself rather than decoded ranges
+    bool isMapped() const {return mapping != NULL;}
+    Go2UInt64 profileCount() const {return profiles.size();}
+    const std::vector<MappedProfile>& getProfiles() const {return profiles;}
+    const std::vector<MappedRun>& getRuns() const {return runs;}
+    const char* data() const {
+        if (mapping != NULL) {
+            return mapping;
+        }
+        return decoded.empty() ? NULL : reinterpret_cast<const char*>(&decoded[0]);
+    }
+    size_t size() const {return mapping != NULL ? mappedSize : decoded.size()*sizeof(short);}
+    // Copies profile `number` into a Profile
+    void read(Go2UInt64 number, Profile& profile) const;
+    double position(Go2Int64 encoder) const {return (encoder - info.startingEncoder)*info.encoderResolution;}
+private:
+    MappedScan(const MappedScan&);
+    MappedScan& operator=(const MappedScan&);
+    void map();
+    void walkRecords(size_t position, Go2UInt32 version);
+    void decode();
+    void addProfile(const MappedProfile& profile);
+
+    std::string filename;
+    ScanInfo info;
+    bool compressed;
+    char* mapping;
+    size_t mappedSize;
+    std::vector<short> decoded;
+    std::vector<MappedProfile> profiles;
+    std::vector<MappedRun> runs;
+};
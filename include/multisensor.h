@@ -0,0 +1,95 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "gocatorsystem.h"
+#include "gocatorcontrol.h"
+#include "profilequeue.h"
+#include "profilesource.h"
+#include "recordingpipeline.h"
+
+#include <pthread.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#define MERGE_WINDOW 50000 // Longest a profile waits on a quiet sensor before it is merged anyway [us]
+
+// Records from several Gocators at once.
+// Discovery and API initialization happen once for all sensors; each sensor
+// then gets its own receive thread pinned to its own core.  Profiles are
+// written either to one file per sensor (the serial number is added to the
+// filename) or to a single file merged in encoder order.
+// MultiSensorRecorder recorder(verbose);
+// recorder.connect(deviceIDs, startup); // discovers through the startup
+// recorder.configure(encoder, trigger, filter);
+// recorder.record(outputFilename, comment); // until the thread is interrupted
+class MultiSensorRecorder {
+    public:
+        MultiSensorRecorder(bool verboseFlag=false):
+        verbose(verboseFlag), merge(false), receiving(false) {
+            output.format = CSV;
+            output.xPrecision = output.yPrecision = output.zPrecision = CSV_DEFAULT_PRECISION;
+            heightMap.cellX = heightMap.cellY = 0;
+            heightMap.aggregation = HEIGHT_MEAN;
+            rangeFilter.zLow = rangeFilter.zHigh = 0;
+            rangeFilter.gapFill = 0;
+            rangeFilter.xMethod = rangeFilter.yMethod = SMOOTH_NONE;
+            rangeFilter.xWindow = rangeFilter.yWindow = 1;
+            rangeFilter.noise = 0;
+            reduction = noReduction();
+        }
+        // Discovery comes from the startup (whatever it found in the background, or discovering now)
+        void connect(const std::vector<Go2UInt32>& deviceIDs, SystemStartup& startup);
+        // Returns false if any sensor didn't accept every setting
+        bool configure(Encoder& encoder, Trigger& trigger, GocatorFilter& filter);
+        void setOutputSettings(OutputSettings& settings) {output = settings;}
+        void setMerged(bool merged) {merge = merged;}
+        // One height map per output file (cell size 0 - off)
+        void setHeightMap(const HeightMapSettings& settings) {heightMap = settings;}
+        // Host-side filtering per output file.  Merged files interleave the
+        // sensors, so smoothing along Y only sees one sensor's profile at a time.
+        void setRangeFilter(const RangeFilterSettings& settings) {rangeFilter = settings;}
+        void setReduction(const ReductionSettings& settings) {reduction = settings;}
+        void record(std::string& outputFilename, std::string& commentString);
+        size_t sensorCount() const {return sensors.size();}
+    private:
+        typedef struct sensor {
+            Go2UInt32 id;
+            boost::shared_ptr<GocatorSystem> system;
+            boost::shared_ptr<GocatorControl> control;
+            boost::shared_ptr<LiveProfileSource> source;
+            boost::shared_ptr<ProfileQueue> queue; // Merged output only
+            boost::shared_ptr<OutputFile> file; // Per-sensor output only
+            boost::shared_ptr<ProfileWriter> writer;
+            boost::shared_ptr<RecordingPipeline> pipeline;
+        } Sensor;
+
+        void recordSeparately(std::string& outputFilename, std::string& commentString);
+        void recordMerged(std::string& outputFilename, std::string& commentString);
+        void mergeProfiles(RecordingPipeline& pipeline, Go2Int64 referenceEncoder);
+        void startSources();
+        void stopSources();
+        void waitForInterrupt(boost::thread_group& receivers);
+        void report(std::ostream& os);
+        static void pin(boost::thread* thread, unsigned int core);
+        static std::string sensorFilename(const std::string& outputFilename, Go2UInt32 id);
+        static void openOutput(OutputFile& file, const std::string& outputFilename);
+        static void idle() {boost::this_thread::sleep(boost::posix_time::microseconds(200));}
+
+        bool verbose;
+        bool merge;
+        OutputSettings output;
+        HeightMapSettings heightMap;
+        RangeFilterSettings rangeFilter;
+        ReductionSettings reduction;
+        std::vector<Sensor> sensors;
+        boost::atomic<bool> receiving;
+};
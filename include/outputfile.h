@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Unbuffered output file for large pre-formatted blocks.
+// Each block goes straight to write(2) - no iostream, no extra copy.
+class OutputFile {
+    public:
+        OutputFile():fd(-1), failed(false), written(0), reserved(false) {}
+        virtual ~OutputFile() {close();}
+        // Opens the file for appending, creating it if required
+        bool open(const std::string& filename);
+        bool isOpen() const {return fd >= 0;}
+        // Writes the whole buffer, returns false (and remembers the failure) on error
+        bool write(const char* data, size_t length);
+        bool write(const std::string& block) {return write(block.data(), block.size());}
+        // Allocates disk space for the next bytes up front without changing the file's
+        // size, so appends don't wait on the filesystem for blocks; whatever isn't
+        // used is given back on close.  Returns false if the filesystem can't.
+        bool reserve(unsigned long long bytes);
+        void close();
+        bool fail() const {return failed;}
+        unsigned long long bytesWritten() const {return written;}
+    private:
+        int fd;
+        bool failed;
+        unsigned long long written;
+        bool reserved;
+};
@@ -0,0 +1,47 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "databatch.h"
+
+#include <cstddef>
+#include <vector>
+
+#define INVALID_RANGE_16BIT 0x8000
+
+// A single range profile out of a Go2Data batch.  The ranges are either
+// copied into `ranges` or borrowed from the batch they arrived in, which
+// stays alive until the profile lets go of it; read them with rangeData()
+// and width() rather than `ranges` unless the profile was filled by copying.
+typedef struct gocatorProfile {
+    Go2Int64 encoder; // Encoder count when the profile was triggered
+    Go2UInt64 timestamp; // When the frame was captured [us, sensor clock for live data, host monotonic clock for synthetic]
+    double xOffset, xResolution; // X position of range i is xOffset+xResolution*i [mm]
+    double zOffset, zResolution; // Z of a range r is zOffset+zResolution*r [mm]
+    std::vector<short> ranges; // Raw ranges, INVALID_RANGE_16BIT where there was no reading
+    BatchRef batch; // Batch the ranges are borrowed from, empty if they were copied
+    const short* borrowedRanges;
+    unsigned int borrowedWidth;
+
+    gocatorProfile():encoder(0), timestamp(0), xOffset(0), xResolution(0), zOffset(0), zResolution(0),
+    borrowedRanges(NULL), borrowedWidth(0) {}
+    const short* rangeData() const {
+        if (borrowedRanges != NULL) {
+            return borrowedRanges;
+        }
+        return ranges.empty() ? NULL : &ranges[0];
+    }
+    size_t width() const {return borrowedRanges != NULL ? borrowedWidth : ranges.size();}
+    // Points at ranges inside a batch instead of copying them (an empty batch borrows nothing)
+    void borrow(const BatchRef& from, const short* data, unsigned int count) {
+        batch = from;
+        borrowedRanges = from.empty() ? NULL : data;
+        borrowedWidth = from.empty() ? 0 : count;
+    }
+    // Lets go of any borrowed batch
+    void release() {
+        batch.reset();
+        borrowedRanges = NULL;
+        borrowedWidth = 0;
+    }
+} Profile;
@@ -0,0 +1,55 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilesource.h"
+#include "ringbuffer.h"
+#include "histogram.h"
+
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+#define RECEIVE_TIMEOUT 100000
+
+// Fixed pool of Profiles passed from one producer thread to one consumer
+// thread without locks or allocation.  The producer acquires an empty
+// Profile, fills it and submits it; the consumer takes it and recycles it
+// once done.  When the consumer falls behind the pool runs dry and acquire()
+// returns NULL - the profile is counted as dropped instead of blocking the
+// producer.  Recycling a Profile lets go of any batch it borrowed from.
+class ProfileQueue {
+    public:
+        ProfileQueue(size_t depth);
+
+        // Producer side
+        Profile* acquire();
+        void submit(Profile* profile);
+        // Receives from the (started) source until it finishes, stop is set or the thread is interrupted
+        void receive(ProfileSource& source, const boost::atomic<bool>* stop=NULL);
+        // Receives one batch and queues its profiles, returns how many were received
+        unsigned int receiveBatch(ProfileSource& source);
+
+        // Consumer side
+        bool take(Profile*& profile) {return pending.pop(profile);}
+        void recycle(Profile* profile) {
+            profile->release();
+            available.push(profile);
+        }
+
+        size_t capacity() const {return pending.capacity();}
+        size_t highWaterMark() const {return pending.highWaterMark();}
+        Go2UInt64 receivedCount() const {return received.load(boost::memory_order_relaxed);}
+        Go2UInt64 droppedCount() const {return dropped.load(boost::memory_order_relaxed);}
+        // Receive thread timings, see receive()
+        const Histogram& receiveWait() const {return waits;}
+        const Histogram& batchSize() const {return batches;}
+        Go2UInt64 timeoutCount() const {return timeouts.load(boost::memory_order_relaxed);}
+    private:
+        std::vector<Profile> profiles;
+        RingBuffer<Profile*> available, pending;
+        boost::atomic<Go2UInt64> received, dropped;
+        Histogram waits, batches; // Nanoseconds until a batch arrived, profiles per batch
+        boost::atomic<Go2UInt64> timeouts; // Receives that timed out without data
+};
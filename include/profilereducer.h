@@ -0,0 +1,82 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// How much of each profile, and how many profiles, a recording keeps
+typedef struct reductionSettings {
+    double xLow, xHigh; // Only points with X in this window [mm], no window unless xLow < xHigh
+    double zLow, zHigh; // Points with Z outside this window [mm] are dropped, no window unless zLow < zHigh
+    unsigned int xStep; // Every xStep-th point along X, 1 - all
+    unsigned int yStep; // Every yStep-th profile, 1 - all
+    bool mergeDuplicates; // Average consecutive profiles with the same encoder count into one
+} ReductionSettings;
+
+// Settings that keep everything
+inline ReductionSettings noReduction() {
+    ReductionSettings settings;
+    settings.xLow = settings.xHigh = settings.zLow = settings.zHigh = 0;
+    settings.xStep = settings.yStep = 1;
+    settings.mergeDuplicates = false;
+    return settings;
+}
+
+// Shrinks profiles before anything else is done with them.  The X window
+// and step become a range of indices and the Z window a range of raw
+// values once per profile, so the points themselves are only copied and
+// compared as integers; the kept points are an ordinary narrower profile
+// (X offset moved to the first, X resolution times the step) that every
+// output format can write.  Points kept along X fall on multiples of the
+// step, so columns line up between profiles.
+// Merging averages the raw ranges of back-to-back profiles that share an
+// encoder count (e.g. bidirectional travel turning round), so the last
+// profile is held back until the next one or finish():
+// ProfileReducer reducer;
+// reducer.reset(settings);
+// reducer.add(profile);
+// while ((reduced = reducer.next()) != NULL) write(*reduced);
+// reducer.finish(); // end of scan, then next() again
+class ProfileReducer {
+    public:
+        ProfileReducer():merged(0), skipped(0), pointsIn(0), pointsOut(0), sequence(0), held(false), ready(false) {
+            settings = noReduction();
+        }
+        void reset(const ReductionSettings& reductionSettings);
+        bool enabled() const;
+        void add(const Profile& profile);
+        // Releases the profile held back for merging
+        void finish();
+        // Next reduced profile or NULL, valid until the next call
+        const Profile* next();
+        // e.g. "reduced: X 10 to 40 mm, every 2nd point, every 4th profile"
+        std::string describe() const;
+        Go2UInt64 mergedCount() const {return merged;}
+        Go2UInt64 skippedCount() const {return skipped;}
+        // Points offered and kept, for the fraction of the data written
+        Go2UInt64 pointsOffered() const {return pointsIn;}
+        Go2UInt64 pointsKept() const {return pointsOut;}
+        const ReductionSettings& getSettings() const {return settings;}
+    private:
+        void crop(const Profile& profile, Profile& reduced);
+        void startMerge(const Profile& profile);
+        void merge(const Profile& profile);
+        void release(Profile& profile);
+        static bool sameGeometry(const Profile& a, const Profile& b);
+
+        ReductionSettings settings;
+        Go2UInt64 merged, skipped, pointsIn, pointsOut;
+        Go2UInt64 sequence; // Profiles released so far, for the Y step
+        Profile cropped, pending, output;
+        std::vector<Go2Int64> sums; // Per point totals of the profiles being merged
+        std::vector<Go2UInt32> counts;
+        unsigned int mergedProfiles; // Profiles in sums
+        bool held; // pending holds a profile
+        bool ready; // output holds a profile not yet taken
+};
@@ -0,0 +1,146 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "go2response.h"
+#include "profile.h"
+#include "databatch.h"
+#include "scanformat.h"
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <time.h>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// Microseconds on the host's monotonic clock
+inline Go2UInt64 monotonicMicroseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<Go2UInt64>(now.tv_sec)*1000000 + now.tv_nsec/1000;
+}
+
+// Nanoseconds on the host's monotonic clock, for timing the recording stages
+inline Go2UInt64 monotonicNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<Go2UInt64>(now.tv_sec)*1000000000 + now.tv_nsec;
+}
+
+// Where the recording pipeline gets its profiles from.
+// Profiles arrive in batches, mirroring Go2System_ReceiveData:
+// unsigned int count = source.receive(timeout);
+// for (i=0; i<count; i++) source.profileAt(i, profile);
+// source.release();
+class ProfileSource {
+public:
+    virtual ~ProfileSource() {}
+    virtual void start()=0;
+    virtual void stop()=0;
+    // Waits up to timeout microseconds for the next batch, returns the
+    // number of profiles in it (0 on timeout)
+    virtual unsigned int receive(Go2UInt64 timeout)=0;
+    // Fills in profile `index` of the current batch (its ranges may be
+    // borrowed from the batch, see Profile)
+    virtual void profileAt(unsigned int index, Profile& profile)=0;
+    // Done with the current batch
+    virtual void release()=0;
+    // True once a finite source has nothing left to give
+    virtual bool finished() {return false;}
+    // True if the source will finish on its own
+    virtual bool bounded() {return false;}
+    virtual std::string getSourceName()=0;
+};
+
+// Batches from Go2System_ReceiveData, destroyed once nothing uses them
+class ReceivedBatchPool:public BatchPool {
+protected:
+    void clear(DataBatch& batch);
+};
+
+// Profiles from a connected Gocator.
+// Profiles borrow their ranges from the received Go2Data rather than copying
+// them; the batch is destroyed once the source and every profile are done
+// with it.  Only if every pooled batch is still in use are ranges copied.
+class LiveProfileSource:public ProfileSource {
+public:
+    LiveProfileSource(Go2System& go2system, bool verboseFlag=false):
+    sys(go2system), data(GO2_NULL), verbose(verboseFlag) {}
+    virtual ~LiveProfileSource() {release();}
+    void start();
+    void stop();
+    unsigned int receive(Go2UInt64 timeout);
+    void profileAt(unsigned int index, Profile& profile);
+    void release();
+    std::string getSourceName() {
+        return std::string("Gocator");
+    }
+private:
+    Go2System& sys;
+    ReceivedBatchPool pool;
+    BatchRef batch; // Current batch if pooled
+    Go2Data data; // Current batch
+    Go2Int64 encoderCounter;
+    Go2UInt64 timestamp; // Sensor's timestamp of the current batch [us]
+    bool verbose;
+};
+
+// Streams a previously recorded binary scan.
+// speed is a multiple of the original rate; 0 replays as fast as possible
+// (as do scans recorded without timestamps).
+class ReplayProfileSource:public ProfileSource {
+public:
+    ReplayProfileSource(const std::string& filename, double speed=1.0);
+    const ScanInfo& getInfo() {return reader.getInfo();}
+    void start();
+    void stop() {}
+    unsigned int receive(Go2UInt64 timeout);
+    void profileAt(unsigned int index, Profile& profile);
+    void release() {}
+    bool finished() {return exhausted;}
+    bool bounded() {return true;}
+    std::string getSourceName() {
+        return std::string("Replay");
+    }
+private:
+    ScanReader reader;
+    double replaySpeed;
+    Profile nextProfile;
+    bool exhausted;
+    Go2UInt64 replayStart, firstTimestamp;
+};
+
+// Settings for generated profiles
+typedef struct syntheticSettings {
+    unsigned int width; // Points per profile
+    double frameRate; // Profiles per second, 0 for as fast as possible
+    double invalidRatio; // Fraction of points reported as INVALID_RANGE_16BIT
+    Go2Int64 encoderStep; // Encoder ticks between profiles
+    Go2UInt64 profileCount; // Profiles to generate, 0 for no limit
+    double lostRatio; // Fraction of frames the simulated sensor loses (their encoder counts and timestamps are skipped)
+} SyntheticSettings;
+
+// Generates a moving surface with an encoder ramp so the recording path can
+// be exercised without a sensor.  The output is deterministic.  Batches are
+// pooled and their ranges borrowed the same way as LiveProfileSource's.
+class SyntheticProfileSource:public ProfileSource {
+public:
+    SyntheticProfileSource(const SyntheticSettings& syntheticSettings);
+    void start();
+    void stop() {}
+    unsigned int receive(Go2UInt64 timeout);
+    void profileAt(unsigned int index, Profile& profile);
+    void release() {batch.reset();}
+    bool finished() {return settings.profileCount > 0 && generated >= settings.profileCount;}
+    bool bounded() {return settings.profileCount > 0;}
+    std::string getSourceName() {
+        return std::string("Synthetic");
+    }
+private:
+    SyntheticSettings settings;
+    Go2UInt64 generated, batchStart, startTime, lost;
+    Go2UInt32 invalidThreshold, lostThreshold;
+    BatchPool pool;
+    BatchRef batch; // Generated ranges for the current batch, borrowed like a live sensor's
+};
@@ -0,0 +1,46 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include <iostream>
+#include <string>
+
+#define OUTPUT_BLOCK_SIZE 262144 // Target size of a formatted output block [bytes]
+
+#define CSV_DEFAULT_PRECISION 4 // Decimal places per axis unless told otherwise
+
+enum OutputFormat {CSV, BINARY, COMPRESSED};
+
+// How recorded profiles are written to disk
+typedef struct outputSettings {
+    OutputFormat format;
+    int xPrecision, yPrecision, zPrecision; // CSV decimal places per axis
+} OutputSettings;
+
+// Details about a scan that every output format records in its header
+typedef struct scanInfo {
+    std::string comment; // Free-form comment line
+    Go2Int64 startingEncoder; // Encoder count at Y=0
+    double encoderResolution; // Resolution of encoder (mm/"tick")
+} ScanInfo;
+
+// Formats a scan into blocks of bytes for the recording pipeline.
+// Writers only append to the supplied block - getting the block onto disk
+// is up to the caller.
+class ProfileWriter {
+public:
+    virtual ~ProfileWriter() {}
+    virtual void writeHeader(const ScanInfo& info, std::string& block)=0;
+    virtual void writeProfile(const Profile& profile, std::string& block)=0;
+    // Called once after the last profile, e.g. to flush buffered data or write an index
+    virtual void writeFooter(std::string& block) {}
+    // Whether each profile starts in the file where it was appended to the block
+    virtual bool indexable() {return true;}
+    virtual std::string getFormatName()=0;
+    // Format-specific end-of-scan statistics
+    virtual void report(std::ostream& os) {}
+};
+
+// Returns a new writer for the requested output format
+ProfileWriter* createProfileWriter(const OutputSettings& settings);
@@ -0,0 +1,53 @@
+#pragma once
+#include "profile.h"
+
+// Vectorized range-to-XYZ conversion shared by every output format and filter.
+// X of point i is xOffset+xResolution*i and Z of range r is zOffset+zResolution*r,
+// evaluated exactly as written (no fused multiply-add) so every path gives
+// bit-identical results to the scalar loop.  The float versions do the
+// arithmetic in single precision.
+//
+// The validity mask has one bit per point, bit (i%8) of byte i/8, set where
+// the range is not INVALID_RANGE_16BIT; it needs (count+7)/8 bytes.
+
+enum ConversionPath {SCALAR_PATH, SSE2_PATH, AVX2_PATH};
+
+// Fastest path this CPU supports (detected once)
+ConversionPath bestConversionPath();
+// Forces a path, e.g. to compare against the scalar loop.  Paths the CPU
+// doesn't support fall back to the best one that it does.
+void useConversionPath(ConversionPath path);
+ConversionPath currentConversionPath();
+const char* conversionPathName(ConversionPath path);
+
+// Converts every point, marking the invalid ones in the mask
+void convertRanges(const short* ranges, unsigned int count,
+                   double xOffset, double xResolution, double zOffset, double zResolution,
+                   double* x, double* z, unsigned char* valid);
+void convertRanges(const short* ranges, unsigned int count,
+                   float xOffset, float xResolution, float zOffset, float zResolution,
+                   float* x, float* z, unsigned char* valid);
+
+// Converts only the valid points, packing them to the front of x and z
+// (which must still have room for count points).  Returns the number written.
+unsigned int compactRanges(const short* ranges, unsigned int count,
+                           double xOffset, double xResolution, double zOffset, double zResolution,
+                           double* x, double* z);
+unsigned int compactRanges(const short* ranges, unsigned int count,
+                           float xOffset, float xResolution, float zOffset, float zResolution,
+                           float* x, float* z);
+
+// Convenience overloads taking the geometry from a Profile
+inline unsigned int compactRanges(const Profile& profile, double* x, double* z) {
+    if (profile.width() == 0) {
+        return 0;
+    }
+    return compactRanges(profile.rangeData(), profile.width(),
+                         profile.xOffset, profile.xResolution, profile.zOffset, profile.zResolution, x, z);
+}
+inline void convertRanges(const Profile& profile, double* x, double* z, unsigned char* valid) {
+    if (profile.width() > 0) {
+        convertRanges(profile.rangeData(), profile.width(),
+                      profile.xOffset, profile.xResolution, profile.zOffset, profile.zResolution, x, z, valid);
+    }
+}
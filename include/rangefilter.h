@@ -0,0 +1,89 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "rangeconvert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define FILTER_MAX_WINDOW 31 // Widest smoothing window along X or Y
+
+enum SmoothingMethod {SMOOTH_NONE, SMOOTH_MEDIAN, SMOOTH_MEAN, SMOOTH_WIENER};
+
+// What a RangeFilter does to each profile, in this order
+typedef struct rangeFilterSettings {
+    double zLow, zHigh; // Points with Z outside this window [mm] are dropped, no window unless zLow < zHigh
+    unsigned int gapFill; // Longest run of missing points along X filled in by interpolation, 0 - none
+    SmoothingMethod xMethod, yMethod;
+    unsigned int xWindow; // Points along X, odd
+    unsigned int yWindow; // Profiles along Y, odd
+    double noise; // Wiener noise variance [mm^2], 0 - the mean local variance of each profile
+} RangeFilterSettings;
+
+// Cleans up profiles as they are recorded, working on the raw ranges so the
+// output is still an ordinary scan (and marked as filtered in its comment).
+// Smoothing never brings back a missing point - only gap filling does - and
+// windows only ever take in valid points; at the ends of a profile or scan
+// they are cut short rather than padded.
+// Smoothing along Y holds back half a window of profiles, so after each
+// add() and after finish() take every profile that is ready:
+// RangeFilter filter;
+// filter.reset(settings);
+// filter.add(profile);
+// while ((filtered = filter.next()) != NULL) write(*filtered);
+// filter.finish(); // end of scan, then next() again
+// The median, mean and Wiener kernels run on the conversion path picked in
+// rangeconvert.h and match the scalar loop bit for bit.
+class RangeFilter {
+    public:
+        RangeFilter();
+        void reset(const RangeFilterSettings& settings);
+        bool enabled() const;
+        void add(const Profile& profile);
+        // Releases the profiles held back for smoothing along Y
+        void finish();
+        // Next filtered profile or NULL, valid until the next call
+        const Profile* next();
+        // e.g. "filtered: Z 10-40 mm, gaps to 3 points filled, median of 5 along X"
+        std::string describe() const;
+        Go2UInt64 rejectedCount() const {return rejected;}
+        Go2UInt64 filledCount() const {return filled;}
+        const RangeFilterSettings& getSettings() const {return settings;}
+    private:
+        void filterProfile(Profile& profile);
+        void rejectOutliers(Profile& profile);
+        void fillGaps(short* ranges, size_t width);
+        void smoothX(short* ranges, size_t width, double zResolution);
+        bool sameGeometry(const Profile& a, const Profile& b) const;
+        Profile& nextOutput();
+        void emitY(Go2UInt64 center);
+        void accumulateY(const std::vector<short>& ranges, double sign);
+        void drainY();
+
+        RangeFilterSettings settings;
+        bool smoothingY;
+        Go2UInt64 rejected, filled;
+        // Profiles held for smoothing along Y, by sequence number modulo the window
+        std::vector<Profile> window;
+        Go2UInt64 first, last, emitted; // Sequence numbers: oldest held, next to add, next to emit
+        // Running totals per column over the profiles in the Y window (mean and Wiener)
+        std::vector<double> ySum, ySquares, yCount, zeros;
+        // Filtered profiles waiting to be taken
+        std::vector<Profile> outputs;
+        Go2UInt64 produced, consumed;
+        // Scratch for smoothing along X
+        std::vector<short> padded, original;
+        std::vector<double> prefixSum, prefixSquares, prefixCount;
+        std::vector<const short*> rows;
+};
+
+// Reads a smoothing option given as "method:window", e.g. "median:5" or "wiener:15"
+bool parseSmoothing(const std::string& text, SmoothingMethod& method, unsigned int& window);
+// Reads a Z window given as "low,high" [mm]
+bool parseZWindow(const std::string& text, RangeFilterSettings& settings);
@@ -0,0 +1,173 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilewriter.h"
+#include "outputfile.h"
+#include "ringbuffer.h"
+#include "profilequeue.h"
+#include "profilesource.h"
+#include "scanformat.h"
+#include "histogram.h"
+#include "gapdetector.h"
+#include "heightmap.h"
+#include "rangefilter.h"
+#include "profilereducer.h"
+#include "segmentedoutput.h"
+
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#define PROFILE_QUEUE_DEPTH 4096 // Profiles buffered between receive and conversion
+#define BLOCK_QUEUE_DEPTH 64 // Formatted blocks buffered between conversion and writing
+#define SEGMENT_QUEUE_DEPTH 4 // Segment boundaries the writer hasn't reached yet
+
+// When a recording ends by itself; each is 0 for no limit
+typedef struct stopSettings {
+    Go2UInt64 profiles; // Profiles written, counted after reduction and filtering
+    double distance; // Y travel from the first profile [mm]
+    double seconds; // Time since recording started
+} StopSettings;
+
+// Counters for a recording, see RecordingPipeline::stats()
+typedef struct pipelineStats {
+    Go2UInt64 received, dropped, written, bytesWritten;
+    size_t profileQueueDepth, profileHighWater;
+    size_t blockQueueDepth, blockHighWater;
+    Go2UInt64 blockWaits; // Times the conversion thread waited for the writer to free a block
+    Go2UInt64 gaps, missing, duplicates, reversals;
+    Go2UInt64 segments; // Started so far, 0 if the recording isn't segmented
+} PipelineStats;
+
+// Moves profiles from the receive thread to disk.
+// The receive thread only copies ranges into a pooled Profile and submits it;
+// a conversion thread formats profiles into blocks with a ProfileWriter and a
+// writer thread puts the blocks on disk, so disk stalls no longer hold up
+// Go2System_ReceiveData.  The conversion thread also indexes where each
+// profile lands in the file, checks for missing or duplicated frames and
+// can reduce and filter the profiles and build a height map as it goes.
+// With segments set, the conversion thread ends each segment's file (footer,
+// index, height map) and starts the next one's in the same stream of blocks;
+// the writer thread switches files once it has written up to the boundary.
+// RecordingPipeline pipeline(outputFile, writer, scanInfo);
+// pipeline.setGapDetection(spacing); // optional
+// pipeline.setReduction(reduction); // optional
+// pipeline.setFilter(filterSettings); // optional
+// pipeline.setHeightMap(cells); // optional
+// pipeline.setSegments(&segmentedOutput); // optional
+// pipeline.setStopConditions(limits); // optional
+// pipeline.start();
+// pipeline.run(source); // or pipeline.acquire() / pipeline.submit(profile)
+// pipeline.finish();
+class RecordingPipeline {
+    public:
+        RecordingPipeline(OutputFile& output, ProfileWriter& profileWriter, const ScanInfo& scanInfo,
+                          bool verboseFlag=false, size_t queueDepth=PROFILE_QUEUE_DEPTH);
+        virtual ~RecordingPipeline();
+
+        void start();
+        // Receive thread - returns an empty Profile to fill, or NULL if the
+        // pipeline is full (the profile is counted as dropped).
+        Profile* acquire() {return profiles.acquire();}
+        void submit(Profile* profile) {profiles.submit(profile);}
+        // Receives from the (started) source until it finishes, a stop condition
+        // is met or the thread is interrupted
+        void run(ProfileSource& source) {profiles.receive(source, &stopping);}
+        // Drains everything that was submitted and stops the worker threads
+        void finish();
+        PipelineStats stats() const;
+        void report(std::ostream& os);
+        Go2UInt64 droppedCount() const {return profiles.droppedCount();}
+        // Per-stage timings, safe to read while recording
+        const ProfileQueue& receiveStage() const {return profiles;}
+        const Histogram& conversionTime() const {return conversions;} // Nanoseconds per profile
+        const Histogram& writeTime() const {return writes;} // Nanoseconds per block
+        // Profile numbers and Y positions to file offsets, once finished (empty if the format can't be indexed)
+        const ScanIndex& getIndex() const {return index;}
+        // Writes the index next to the scan, if there is one
+        bool saveIndex(const std::string& scanFilename) const;
+        // Expected spacing between profiles, set before start(); no checks without it
+        void setGapDetection(const GapSettings& settings) {gapSettings = settings;}
+        const GapDetector& getGaps() const {return gaps;}
+        // Writes the gaps file next to the scan, if anything was found
+        bool saveGaps(const std::string& scanFilename) const;
+        // Cropping and decimation applied to every profile before anything
+        // else, set before start(); the scan's comment notes what was done
+        void setReduction(const ReductionSettings& settings) {reducer.reset(settings);}
+        const ProfileReducer& getReducer() const {return reducer;}
+        // Filtering applied to every profile before it is written, set
+        // before start(); the scan's comment notes what was done
+        void setFilter(const RangeFilterSettings& settings) {filter.reset(settings);}
+        const RangeFilter& getFilter() const {return filter;}
+        // Height map cell size and aggregation, set before start(); no map without it
+        void setHeightMap(const HeightMapSettings& settings) {heightMapSettings = settings;}
+        const HeightMap& getHeightMap() const {return heightMap;}
+        // Writes the height map next to the scan, if one was built
+        bool saveHeightMap(const std::string& scanFilename) const;
+        // Splits the recording into segments, set before start() with the first
+        // segment open as the output; each segment then gets its own index and
+        // height map and the save functions above do nothing
+        void setSegments(SegmentedOutput* segmentedOutput) {segments = segmentedOutput;}
+        // Ends the recording once any limit is reached, set before start()
+        void setStopConditions(const StopSettings& limits) {stopSettings = limits;}
+        // Why the recording ended by itself, empty if it didn't (safe to read once finished)
+        const std::string& stopReason() const {return stoppedBy;}
+    private:
+        // Where the writer thread closes a segment
+        typedef struct segmentEnd {
+            boost::shared_ptr<FinishedSegment> segment;
+            bool last; // No segment follows
+        } SegmentEnd;
+
+        void convert();
+        void pass(const Profile& profile, std::string*& block);
+        void store(const Profile& profile, std::string*& block);
+        void write();
+        ScanInfo segmentInfo() const;
+        bool segmentFull(const Profile& profile, Go2UInt64 bytes) const;
+        void endSegment(std::string*& block, bool last);
+        bool checkStop(const Profile* profile);
+        // Takes a free block if there isn't one already, waiting on the writer thread if need be
+        void takeBlock(std::string*& block);
+        static void idle() {boost::this_thread::sleep(boost::posix_time::microseconds(200));}
+
+        OutputFile& out;
+        ProfileWriter& format;
+        ScanInfo info;
+        bool verbose;
+        ProfileQueue profiles;
+        std::vector<std::string> blocks;
+        RingBuffer<std::string*> freeBlocks, pendingBlocks;
+        boost::atomic<bool> receiving, converting;
+        boost::atomic<Go2UInt64> converted, bytesWritten, blockWaits;
+        Histogram conversions, writes;
+        ScanIndex index;
+        GapSettings gapSettings;
+        GapDetector gaps;
+        ProfileReducer reducer;
+        RangeFilter filter;
+        HeightMapSettings heightMapSettings;
+        HeightMap heightMap;
+        Go2UInt64 handedOff; // Bytes of the current segment passed to the writer thread
+        SegmentedOutput* segments;
+        RingBuffer<SegmentEnd> segmentEnds;
+        boost::atomic<Go2UInt64> segmentNumber;
+        Go2UInt64 segmentProfiles, segmentStart; // Profiles and start time [us] of the current segment
+        Go2Int64 segmentEncoder; // Encoder count of the segment's first profile
+        StopSettings stopSettings;
+        boost::atomic<bool> stopping; // A stop condition was met
+        std::string stoppedBy;
+        Go2UInt64 startTime; // [us]
+        Go2UInt64 accepted; // Profiles taken for recording
+        bool travelled; // The last profile reached the stop distance
+        Go2Int64 firstEncoder;
+        boost::thread converter, writer;
+};
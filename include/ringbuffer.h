@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <boost/atomic.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+// Bounded lock-free single-producer/single-consumer queue.
+// Keeps track of its high-water mark so the recording pipeline can report it.
+template<typename T>
+class RingBuffer {
+    public:
+        RingBuffer(size_t capacity):ring(capacity), cap(capacity), highWater(0) {}
+        // Producer side - returns false if the ring is full
+        bool push(const T& item) {
+            if (!ring.push(item)) {
+                return false;
+            }
+            size_t depth = cap - ring.write_available();
+            if (depth > highWater.load(boost::memory_order_relaxed)) {
+                highWater.store(depth, boost::memory_order_relaxed);
+            }
+            return true;
+        }
+        // Consumer side - returns false if the ring is empty
+        bool pop(T& item) {return ring.pop(item);}
+        size_t capacity() const {return cap;}
+        size_t highWaterMark() const {return highWater.load(boost::memory_order_relaxed);}
+    private:
+        boost::lockfree::spsc_queue<T> ring;
+        size_t cap;
+        boost::atomic<size_t> highWater;
+};
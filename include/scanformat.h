@@ -0,0 +1,189 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilewriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+
+// Compact binary scan format (all values in host byte order, little-endian on x86).
+// File header:
+//     char[8]  "GO2SCAN\0"
+//     uint32   format version
+//     double   encoder resolution [mm/tick]
+//     int64    starting encoder count
+//     uint32   comment length, followed by the comment bytes
+// Each profile record:
+//     uint8    flags - SCAN_RECORD_GEOMETRY if the geometry follows
+//     int64    encoder count
+//     uint64   capture timestamp [us] (version 2 onwards)
+//     double   XOffset, XResolution, ZOffset, ZResolution (only if flagged)
+//     uint32   width
+//     int16    ranges[width], INVALID_RANGE_16BIT kept as-is
+// Geometry is only repeated when it changes from the previous profile.
+//
+// Compressed scan (see compressedscan.h):
+//     char[8]  "GO2ZSCN\0"
+//     uint32   format version
+//     double, int64, uint32 + comment as above
+//     uint32   profiles per chunk
+// followed by independently zlib-compressed chunks:
+//     uint32   profile count (0 marks the chunk index)
+//     uint32   uncompressed size
+//     uint32   compressed size, followed by the compressed bytes
+// A chunk holds profile records as above, except that geometry always
+// starts each chunk and the ranges are stored as 16-bit residuals: each
+// point less the point to its left, and - if SCAN_RECORD_PREDICTED is set -
+// less the same difference in the previous profile.  All low bytes of the
+// residuals come before all high bytes.
+// The chunk index follows the last chunk:
+//     uint32   0
+//     uint64   chunk count
+//     per chunk: uint64 file offset, uint64 first profile number,
+//                uint32 profile count, int64 lowest and highest encoder count
+//     uint64   file offset of the chunk index
+//     char[8]  "GO2ZIDX\0"
+//
+// Side index, written next to CSV and binary scans as <scan>.idx:
+//     char[8]  "GO2SIDX\0"
+//     uint32   format version
+//     uint32   profiles per entry
+//     double   encoder resolution [mm/tick]
+//     int64    starting encoder count
+//     uint64   entry count
+//     per entry: uint64 first profile number, uint32 profile count,
+//                uint64 file offset of the first profile,
+//                int64 lowest and highest encoder count,
+//                double XOffset, XResolution, ZOffset, ZResolution of the first profile
+// Profiles are numbered from 0 in the order they were recorded.
+#define SCAN_MAGIC "GO2SCAN"
+#define SCAN_VERSION 2
+#define SCAN_RECORD_GEOMETRY 0x01
+#define SCAN_RECORD_PREDICTED 0x02
+#define COMPRESSED_SCAN_MAGIC "GO2ZSCN"
+#define COMPRESSED_SCAN_VERSION 1
+#define COMPRESSED_INDEX_MAGIC "GO2ZIDX"
+#define SCAN_INDEX_MAGIC "GO2SIDX"
+#define SCAN_INDEX_VERSION 1
+#define SCAN_INDEX_EXTENSION ".idx"
+#define SCAN_INDEX_INTERVAL 64 // Profiles per side index entry
+
+// Writes the raw 16-bit ranges, about 2 bytes per point instead of ~25
+class BinaryProfileWriter:public ProfileWriter {
+public:
+    BinaryProfileWriter():haveGeometry(false) {}
+    void writeHeader(const ScanInfo& info, std::string& block);
+    void writeProfile(const Profile& profile, std::string& block);
+    std::string getFormatName() {
+        return std::string("Binary");
+    }
+protected:
+    // Appends the record up to (and including) the width
+    void writeRecordHeader(const Profile& profile, Go2Byte flags, std::string& block);
+    bool haveGeometry;
+    double xOffset, xResolution, zOffset, zResolution;
+};
+
+// A run of consecutive profiles and where it starts in the file
+typedef struct scanIndexEntry {
+    Go2UInt64 firstProfile;
+    Go2UInt32 profiles;
+    Go2UInt64 offset;
+    Go2Int64 minEncoder, maxEncoder;
+    double xOffset, xResolution, zOffset, zResolution; // Geometry of the first profile
+} ScanIndexEntry;
+
+// Maps profile numbers and Y positions to file offsets.
+// ScanIndex index;
+// index.reset(scanInfo);
+// index.add(profile, offset); // for every profile, in order
+// index.save(scanFilename + SCAN_INDEX_EXTENSION);
+class ScanIndex {
+public:
+    ScanIndex(Go2UInt32 profilesPerEntry=SCAN_INDEX_INTERVAL);
+    void reset(const ScanInfo& info);
+    void add(const Profile& profile, Go2UInt64 offset);
+    void add(const ScanIndexEntry& entry) {entries.push_back(entry);}
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+    // Entries that may hold profiles between y0 and y1 [mm] / profile numbers first to last
+    std::vector<ScanIndexEntry> findY(double y0, double y1) const;
+    std::vector<ScanIndexEntry> findProfiles(Go2UInt64 first, Go2UInt64 last) const;
+    const std::vector<ScanIndexEntry>& getEntries() const {return entries;}
+    bool empty() const {return entries.empty();}
+    // Y position [mm] of an encoder count
+    double position(Go2Int64 encoder) const {return (encoder - startingEncoder)*resolution;}
+private:
+    Go2UInt32 interval;
+    double resolution;
+    Go2Int64 startingEncoder;
+    std::vector<ScanIndexEntry> entries;
+};
+
+// Appends a scan file header
+void writeScanHeader(const char* magic, Go2UInt32 version, const ScanInfo& info, std::string& block);
+
+// Reads a binary or compressed scan back one profile at a time.
+// ScanReader reader(filename);
+// reader.selectY(y0, y1); // optional, uses the scan's index to skip the rest
+// Profile profile;
+// while (reader.next(profile)) {...}
+class ScanReader {
+public:
+    ScanReader(const std::string& filename);
+    const ScanInfo& getInfo() {return info;}
+    bool next(Profile& profile);
+    Go2UInt64 profileCount() {return count;}
+    // Number of the profile last returned by next()
+    Go2UInt64 profileNumber() {return recordNumber - 1;}
+    bool isCompressed() {return compressed;}
+    // Limits next() to profiles between y0 and y1 [mm] or with numbers first to last
+    // (inclusive), starting from the beginning of the scan.  Returns false if the
+    // scan has no index, in which case the whole scan is read and filtered.
+    bool selectY(double y0, double y1);
+    bool selectProfiles(Go2UInt64 first, Go2UInt64 last);
+    double position(Go2Int64 encoder) {return (encoder - info.startingEncoder)*info.encoderResolution;}
+private:
+    // Reads from the file
+    template<typename T> bool readFile(T& value) {
+        return static_cast<bool>(fidin.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+    // Reads from the file or, for compressed scans, the current chunk
+    template<typename T> bool read(T& value) {
+        return readBytes(reinterpret_cast<char*>(&value), sizeof(T));
+    }
+    bool readBytes(char* data, size_t length);
+    bool nextChunk();
+    bool readResiduals(Go2Byte flags, Profile& profile);
+    bool nextRecord(Profile& profile);
+    bool loadIndex(ScanIndex& index);
+    bool select(const std::vector<ScanIndexEntry>& entries, bool indexed);
+    void seek(const ScanIndexEntry& entry);
+    bool selected(const Profile& profile);
+
+    std::string filename;
+    std::ifstream fidin;
+    ScanInfo info;
+    Go2UInt32 version;
+    Go2UInt64 count, recordNumber;
+    double xOffset, xResolution, zOffset, zResolution;
+    std::streamoff dataOffset;
+    bool compressed;
+    std::string packed, chunk;
+    size_t chunkPosition;
+    std::vector<short> previous;
+    // Selection
+    bool filterY, filterProfiles, indexed;
+    double yFrom, yTo;
+    Go2UInt64 firstProfile, lastProfile;
+    std::vector<ScanIndexEntry> selection;
+    size_t nextEntry;
+    Go2UInt32 entryProfiles;
+};
@@ -0,0 +1,104 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "mappedscan.h"
+#include "columnarscan.h"
+#include "csvconverter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+
+#define RENDER_INVALID_Z -32.768 // What INVALID_RANGE_16BIT becomes in CSV scans with the default geometry
+#define RENDER_BAND_ROWS 16 // Image rows per tile
+#define RENDER_MARGIN_LEFT 64 // Room for the Y extents
+#define RENDER_MARGIN_RIGHT 88 // Colour bar and the Z extents
+#define RENDER_MARGIN_TOP 12
+#define RENDER_MARGIN_BOTTOM 28 // X extents
+#define RENDER_BAR_WIDTH 16
+#define RENDER_MIN_PLOT 16 // Smallest plot area either way [pixels]
+
+// How a scan is drawn
+typedef struct renderSettings {
+    unsigned int width, height; // Whole image [pixels]
+    double zLow, zHigh; // Colour scale [mm], from each scan's own range unless zLow < zHigh
+    bool ppm; // Binary PPM rather than PNG
+} RenderSettings;
+
+// Valid points of a scan [mm]
+typedef struct scanPoints {
+    std::vector<float> x, y, z;
+    void add(double xValue, double yValue, double zValue) {
+        x.push_back(static_cast<float>(xValue));
+        y.push_back(static_cast<float>(yValue));
+        z.push_back(static_cast<float>(zValue));
+    }
+    size_t size() const {return x.size();}
+} ScanPoints;
+
+// Reads every valid point of a binary, compressed, columnar or CSV scan, leaving out
+// INVALID_RANGE_16BIT ranges and RENDER_INVALID_Z; throws std::runtime_error
+void loadScanPoints(const std::string& filename, ScanPoints& points);
+
+// Rasterizes a scan straight to a height-coded image, Y up, with a colour
+// bar and the X, Y and Z extents along the edges - in place of a scatter
+// plot of every point.  Each pixel is coloured by the mean Z of the points
+// landing in it; pixels without points stay white.  The points are binned
+// by tile (a band of RENDER_BAND_ROWS rows) in parallel and the tiles are
+// then shared out between the threads.
+// ScanRenderer renderer(settings, threads);
+// renderer.render(points);
+// renderer.save(filename);
+class ScanRenderer {
+    public:
+        ScanRenderer(const RenderSettings& renderSettings, unsigned int threads=1);
+        void render(const ScanPoints& points);
+        // PNG or PPM as set, false on error
+        bool save(const std::string& filename) const;
+        const std::vector<Go2Byte>& getPixels() const {return image;} // RGB, row by row from the top
+        unsigned int plotWidth() const {return settings.width - RENDER_MARGIN_LEFT - RENDER_MARGIN_RIGHT;}
+        unsigned int plotHeight() const {return settings.height - RENDER_MARGIN_TOP - RENDER_MARGIN_BOTTOM;}
+        static void parallelFor(size_t count, unsigned int threads, const boost::function<void (size_t)>& body);
+    private:
+        // A point's place in the plot area and its Z
+        typedef struct binnedPoint {
+            Go2UInt32 pixel;
+            float z;
+        } BinnedPoint;
+
+        void findExtents(const ScanPoints& points);
+        void locate(const ScanPoints& points, size_t slice, size_t slices);
+        void bin(const ScanPoints& points, size_t slice, size_t slices);
+        void drawBand(size_t band);
+        void drawFrame();
+        void colour(double z, Go2Byte* rgb) const;
+        void fill(int x0, int y0, int x1, int y1, const Go2Byte* rgb);
+        void drawText(int x, int y, const std::string& text, bool alignRight);
+        bool savePng(std::ofstream& fidout) const;
+
+        RenderSettings settings;
+        unsigned int threadCount;
+        std::vector<Go2Byte> image;
+        double xLow, xHigh, yLow, yHigh, zLow, zHigh;
+        size_t bands;
+        std::vector<Go2UInt32> pixelOf; // Plot pixel of each point
+        std::vector<std::vector<size_t> > binStarts; // Per slice of points, where each band's points go
+        std::vector<size_t> bandStarts; // Where each band's points start in binned
+        std::vector<BinnedPoint> binned;
+};
+
+// Reads an image size given as "widthxheight"
+bool parseImageSize(const std::string& text, RenderSettings& settings);
@@ -0,0 +1,72 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "gocatorcontrol.h"
+#include "gocatorconfigurator.h"
+#include "profilesource.h"
+#include "scansocket.h"
+
+#include <csignal>
+#include <locale>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#define SCAN_SERVER_POLL 100 // How often the server checks for a stop signal while idle [ms]
+#define SCAN_CLIENT_IDLE 2000 // A client that sends nothing for this long is disconnected [ms]
+
+// Keeps one logged-in sensor between scans and records whenever a client
+// asks, so a scan costs a request rather than a login and a settings push.
+// Requests (one line each, see ScanSocket; gocator_client sends them):
+//     start <output> [comment]  record to output until stopped
+//     stop                      end the recording and wait for its files
+//     status                    idle, recording or finished (ended by a stop limit)
+//     configure                 re-read the config file and push it to the sensor
+//     shutdown                  stop recording and exit
+// Clients are served one at a time, so one that goes quiet for
+// SCAN_CLIENT_IDLE is disconnected to let the next one in.
+// The config file is also re-read at each start, and the settings pushed
+// again only if it has changed.  With setStandIn() generated profiles stand
+// in for the sensor, so the server can be run without hardware.
+// ScanServer server(control, watcher);
+// if (server.listen(socketPath)) server.run(stopSignal);
+class ScanServer {
+    public:
+        ScanServer(GocatorControl& gocatorControl, ConfigWatcher& configWatcher, bool verboseFlag=false):
+        control(gocatorControl), config(configWatcher), verbose(verboseFlag), live(true), running(false) {}
+        virtual ~ScanServer() {stopRecording();}
+        // Record synthetic profiles instead of the sensor's
+        void setStandIn(const SyntheticSettings& settings) {standIn = settings; live = false;}
+        bool listen(const std::string& socketPath) {return socket.listen(socketPath);}
+        // Serves requests until shutdown or stopRequested is set (e.g. by a signal handler)
+        void run(const volatile std::sig_atomic_t& stopRequested);
+    private:
+        // Carries out one request, returns false on shutdown
+        bool handle(const std::string& request, std::string& reply);
+        std::string start(const std::string& outputFilename, const std::string& commentString);
+        std::string stop();
+        std::string status();
+        std::string configure();
+        // Pushes the configuration to the sensor (or just the encoder to the stand-in)
+        void apply(const ScanConfig& scanConfig);
+        void stopRecording();
+        void record(std::string outputFilename, std::string commentString);
+        double recordingSeconds() const;
+
+        GocatorControl& control;
+        ConfigWatcher& config;
+        bool verbose, live;
+        SyntheticSettings standIn;
+        ScanSocket socket;
+        boost::thread recorder;
+        mutable boost::mutex lock; // Guards running and failure, set by the recording thread
+        bool running;
+        std::string failure; // Why the last recording ended early, empty if it didn't
+        std::string output;
+        boost::posix_time::ptime started;
+};
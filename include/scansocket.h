@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SCAN_SERVER_SOCKET "/tmp/gocator_encoder.sock" // Default scan server socket
+#define SCAN_MAX_REQUEST 4096 // Longest request or reply line [bytes]
+
+// One line of text each way over a Unix domain socket - the scan server's
+// whole protocol.  A request is a command and its arguments separated by
+// spaces; the reply starts with "ok" or "error".
+// ScanSocket client;
+// if (client.connect(path) && client.writeLine("start scan.bin")) client.readLine(reply);
+class ScanSocket {
+    public:
+        ScanSocket():fd(-1), expired(false) {}
+        explicit ScanSocket(int descriptor):fd(descriptor), expired(false) {}
+        virtual ~ScanSocket() {close();}
+        // Binds and listens at path, replacing a stale socket file
+        bool listen(const std::string& path);
+        // Waits up to timeout milliseconds for a client; false on timeout or error
+        bool accept(ScanSocket& client, int timeoutMilliseconds);
+        bool connect(const std::string& path);
+        // Sends line and a newline
+        bool writeLine(const std::string& line);
+        // Reads up to the next newline (not included), false if the peer closed first or
+        // nothing arrived for timeout milliseconds (-1 - no limit; see timedOut()).  Part
+        // of a line read before a timeout is kept for the next call.
+        bool readLine(std::string& line, int timeoutMilliseconds=-1);
+        // The last readLine() gave up waiting rather than the peer closing
+        bool timedOut() const {return expired;}
+        bool isOpen() const {return fd >= 0;}
+        void close();
+    private:
+        ScanSocket(const ScanSocket&);
+        ScanSocket& operator=(const ScanSocket&);
+        static bool address(const std::string& path, struct sockaddr_un& addr);
+
+        int fd;
+        std::string path; // Removed on close if this end is listening
+        std::string pending; // Read past the last line
+        bool expired;
+};
@@ -0,0 +1,174 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilereducer.h"
+#include "scanformat.h"
+#include "outputfile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#define SORT_DEFAULT_MEMORY 256 // Default RAM for profiles being sorted [MB]
+#define SORT_MAX_FAN_IN 64 // Runs merged at once - more take extra merge passes
+#define SORT_MIN_READ_BUFFER 65536 // Read buffer per run being merged [bytes]
+#define SORT_MAX_READ_BUFFER 4194304
+#define SORT_RUN_EXTENSION ".run"
+
+// What happens to profiles with the same encoder count (the same Y)
+enum DuplicatePolicy {
+    DUPLICATES_KEEP, // Keep them all, in the order they were recorded
+    DUPLICATES_LAST, // Keep the one recorded last
+    DUPLICATES_AVERAGE // Average their ranges (profiles with different geometry are kept)
+};
+
+typedef struct sortSettings {
+    Go2UInt64 memory; // Bytes of profiles held at once, across every run being sorted
+    unsigned int threads; // Runs sorted and merged at once
+    DuplicatePolicy duplicates;
+    std::string tempFolder; // Where runs are written, each removed once merged
+} SortSettings;
+
+// 'keep', 'last' or 'average'
+bool parseDuplicatePolicy(const std::string& name, DuplicatePolicy& policy);
+std::string duplicatePolicyName(DuplicatePolicy policy);
+
+// A profile and where it came in the recording, which orders profiles
+// with the same encoder count and keeps the sort stable
+typedef struct sortedProfile {
+    Go2UInt64 sequence;
+    Profile profile;
+} SortedProfile;
+
+// Orders profiles by Y, then by when they were recorded.  Y follows the
+// encoder resolution's sign, so a negative resolution sorts by falling count.
+class YOrder {
+    public:
+        YOrder(bool descendingEncoder=false):descending(descendingEncoder) {}
+        bool operator()(const SortedProfile& a, const SortedProfile& b) const {
+            if (a.profile.encoder != b.profile.encoder) {
+                return descending ? a.profile.encoder > b.profile.encoder : a.profile.encoder < b.profile.encoder;
+            }
+            return a.sequence < b.sequence;
+        }
+    private:
+        bool descending;
+};
+
+// Writes a sorted run: per profile, the sequence number, encoder,
+// timestamp, geometry (four doubles), width (UInt32) and raw ranges, in
+// host byte order - runs never outlive the sort that wrote them.
+class SortRunWriter {
+    public:
+        SortRunWriter(const std::string& runFilename);
+        void add(const SortedProfile& sorted);
+        // Returns false if anything couldn't be written
+        bool close();
+    private:
+        std::string block;
+        OutputFile fidout;
+        bool opened;
+};
+
+// Reads back a run written by SortRunWriter
+class SortRun {
+    public:
+        SortRun(const std::string& runFilename, size_t bufferSize);
+        // Reads the next record into current, false at the end of the run
+        bool next();
+        const std::string& getFilename() const {return filename;}
+        SortedProfile current;
+    private:
+        std::string filename;
+        std::vector<char> buffer;
+        std::ifstream fidin;
+};
+
+// Puts a scan in Y order with bounded memory, for bidirectional or reverse
+// travel where profiles are recorded out of order.  The reader fills a run
+// of profiles while a pool of threads sorts earlier runs and writes them to
+// temporary files; the runs are then merged with a heap, SORT_MAX_FAN_IN at
+// a time (in parallel, over extra passes, for very long scans), and the last
+// merge resolves duplicate encoder counts on its way out.  A scan that fits
+// in one run is sorted in memory (in slices, one per thread, then merged)
+// without touching the disk.
+// ScanSorter sorter(settings);
+// sorter.sort(reader, boost::bind(&write, _1)); // write(const Profile&) in Y order
+// sorter.report(std::cout);
+class ScanSorter {
+    public:
+        ScanSorter(const SortSettings& sortSettings);
+        // Removes any runs left behind by a failed sort
+        virtual ~ScanSorter();
+        // Sorts whatever the reader has left, throwing std::runtime_error if a run can't be written or read
+        void sort(ScanReader& reader, boost::function<void (const Profile&)> write);
+        // e.g. "sorted by Y, duplicates averaged"
+        std::string describe() const;
+        void report(std::ostream& os) const;
+        Go2UInt64 profilesRead() const {return read;}
+        Go2UInt64 profilesWritten() const {return written;}
+        Go2UInt64 runCount() const {return runsWritten;}
+        Go2UInt64 duplicateCount() const {return duplicates;}
+        bool wasOrdered() const {return ordered;}
+    private:
+        typedef std::vector<SortedProfile> Run;
+        typedef boost::shared_ptr<Run> RunPtr;
+
+        // Hands the run being filled to the workers, waiting if they all have one
+        void submit(RunPtr& run);
+        void sortRuns();
+        void writeRun(Run& run, const std::string& runFilename);
+        // Sorts a run in memory across the threads
+        void sortInMemory(Run& run);
+        // Merges the runs in order, passing each profile to emit
+        void merge(const std::vector<std::string>& runFilenames, size_t bufferSize,
+                   boost::function<void (const SortedProfile&)> emit);
+        // Merges groups of runs into longer runs until one merge can take them all
+        void mergePasses();
+        void mergeGroups(const std::vector<std::vector<std::string> >& groups, const std::vector<std::string>& merged);
+        void mergeGroup(const std::vector<std::string>& group, const std::string& mergedFilename, size_t bufferSize);
+        size_t readBuffer(size_t mergedRuns) const;
+        // Applies the duplicate policy on the way out
+        void resolve(const SortedProfile& sorted);
+        void flush();
+        std::string nextRunFilename();
+        void fail(const std::string& message);
+
+        SortSettings settings;
+        YOrder order;
+        Go2UInt64 runBytes; // Memory for each run
+        std::string runPrefix;
+        std::vector<std::string> runs; // Sorted runs on disk
+        Go2UInt64 nextRun;
+
+        std::vector<RunPtr> jobs;
+        unsigned int busy; // Runs with the workers
+        bool stopping;
+        std::string error;
+        boost::mutex lock;
+        boost::condition_variable jobAvailable, jobDone;
+
+        boost::function<void (const Profile&)> output;
+        ProfileReducer averager;
+        Profile last;
+        bool holding;
+
+        Go2UInt64 read, written, submitted, runsWritten, passes, duplicates;
+        bool ordered; // The input was already in Y order
+        double seconds;
+};
@@ -0,0 +1,98 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "outputfile.h"
+#include "scanformat.h"
+#include "heightmap.h"
+
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#define SEGMENT_DIGITS 5 // Zero-padded segment number in the filename
+#define SEGMENT_HANDOFF_DEPTH 8 // Finished segments waiting to be handed off before the writer waits
+
+// When to close one segment of a recording and start the next.  Each limit
+// is 0 for none; the first one reached starts a new segment.
+typedef struct segmentSettings {
+    Go2UInt64 bytes; // Segment size [bytes]
+    Go2UInt64 profiles; // Profiles per segment
+    double distance; // Y travel per segment [mm]
+    double seconds; // Recording time per segment
+    Go2UInt64 preallocate; // Disk space reserved when a segment is opened [bytes], 0 - none
+    std::string completedFolder; // Finished segments are moved here, empty - left in place
+} SegmentSettings;
+
+// Whether any of the limits is set
+inline bool segmentsEnabled(const SegmentSettings& settings) {
+    return settings.bytes > 0 || settings.profiles > 0 || settings.distance > 0 || settings.seconds > 0;
+}
+
+// A closed segment and what goes next to it
+typedef struct finishedSegment {
+    std::string filename;
+    Go2UInt64 number, profiles, bytes;
+    ScanIndex index; // Empty if the format can't be indexed
+    boost::shared_ptr<HeightMap> heightMap; // NULL if none was built
+} FinishedSegment;
+
+// Splits a recording into a series of complete scans - profile.csv is
+// recorded as profile_seg00001.csv, profile_seg00002.csv... - each with its
+// own header, index and height map, so nothing about a recording grows
+// with its length.  The pipeline's writer thread switches files; closed
+// segments are queued to a hand-off thread that writes their index and
+// height map and moves them into the completed folder, so a slow disk
+// operation never holds up the writer.  Moving files is a rename, so the
+// completed folder should be on the same filesystem.
+// SegmentedOutput segments(outputFilename, settings);
+// segments.open(file); // first segment
+// segments.next(file, finished); // writer thread, at each segment boundary
+// segments.close(file, finished); // last segment
+// segments.finish(); // waits for the hand-offs
+class SegmentedOutput {
+    public:
+        SegmentedOutput(const std::string& outputFilename, const SegmentSettings& segmentSettings,
+                        bool verboseFlag=false);
+        virtual ~SegmentedOutput() {finish();}
+        const SegmentSettings& getSettings() const {return settings;}
+        // Opens the first segment, returns false on error
+        bool open(OutputFile& file);
+        // Closes the current segment, hands it off and opens the next one
+        bool next(OutputFile& file, boost::shared_ptr<FinishedSegment> finished);
+        // Closes and hands off the last segment
+        void close(OutputFile& file, boost::shared_ptr<FinishedSegment> finished);
+        // Waits until every closed segment has been handed off
+        void finish();
+        // profile.csv -> profile_seg00003.csv
+        std::string segmentFilename(Go2UInt64 number) const;
+        const std::string& currentFilename() const {return current;}
+        Go2UInt64 segmentCount() const {return number;}
+        Go2UInt64 handedOffCount() const;
+        Go2UInt64 failedCount() const;
+    private:
+        bool openSegment(OutputFile& file);
+        void closeSegment(OutputFile& file, boost::shared_ptr<FinishedSegment> finished);
+        void handOff();
+        void complete(const FinishedSegment& segment);
+        bool move(const std::string& filename);
+
+        std::string baseFilename;
+        SegmentSettings settings;
+        bool verbose;
+        Go2UInt64 number;
+        std::string current;
+        std::deque<boost::shared_ptr<FinishedSegment> > closed;
+        Go2UInt64 completed, failed;
+        bool stopping;
+        mutable boost::mutex lock;
+        boost::condition_variable changed;
+        boost::thread handOffThread;
+};
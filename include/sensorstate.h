@@ -0,0 +1,153 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "go2response.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+enum PushResult {NOT_STAGED, ALREADY_SET, SENT, REFUSED};
+
+// One sensor setting, its Go2 getter and setter, and what we know of it.
+// The sensor's value is read back the first time the setting is wanted and
+// remembered after that, so only a value that differs is ever sent.  The
+// sensor may round a number to what it supports; that is reported and kept,
+// and asking for the same number again isn't sent again.
+template <typename T>
+class SensorSetting {
+    public:
+        typedef T (*Getter)(Go2System);
+        typedef Go2Status (*Setter)(Go2System, T);
+        SensorSetting(const char* settingName, Getter getter, Setter setter):
+        name(settingName), get(getter), set(setter), known(false), pending(false), sent(false), adjusted(false) {}
+        void want(T value) {desired = value; pending = true;}
+        void forget() {known = pending = sent = adjusted = false;}
+        // Sends the wanted value if the sensor doesn't already have it
+        PushResult push(Go2System sys, bool verbose);
+        // Reads the value back if it was just sent, false if the sensor didn't keep it
+        // (a rounded number counts as kept)
+        bool verify(Go2System sys);
+        const char* getName() const {return name;}
+    private:
+        static bool same(Go2Double first, Go2Double second) {
+            return std::fabs(first - second) <= 1e-9*std::max(1.0, std::fabs(second));
+        }
+        template <typename U>
+        static bool same(U first, U second) {return first == second;}
+        // Whether a value the sensor changed can still be used (numbers it rounded)
+        static bool adjustable(Go2Double) {return true;}
+        template <typename U>
+        static bool adjustable(U) {return false;}
+
+        const char* name;
+        Getter get;
+        Setter set;
+        T current, desired;
+        T asked; // What the sensor adjusted to current
+        bool known, pending, sent, adjusted;
+};
+
+template <typename T>
+PushResult SensorSetting<T>::push(Go2System sys, bool verbose) {
+    if (!pending) {
+        return NOT_STAGED;
+    }
+    pending = false;
+    if (!known) {
+        current = get(sys);
+        known = true;
+    }
+    if (same(current, desired) || (adjusted && same(asked, desired))) {
+        return ALREADY_SET;
+    }
+    Go2Status status = set(sys, desired);
+    if (verbose) {
+        std::cout << getResponseString(std::string("Go2System_Set") + name, status) << std::endl;
+    }
+    if (status != GO2_OK) {
+        known = false;
+        return REFUSED;
+    }
+    current = desired;
+    sent = true;
+    adjusted = false;
+    return SENT;
+}
+
+template <typename T>
+bool SensorSetting<T>::verify(Go2System sys) {
+    if (!sent) {
+        return true;
+    }
+    sent = false;
+    T actual = get(sys);
+    bool kept = same(actual, current);
+    if (!kept && adjustable(actual)) {
+        // Enough digits to show the rounding
+        std::ostringstream values;
+        values << std::setprecision(12) << actual << " (asked for " << current << ")";
+        std::cerr << "<< Sensor adjusted " << name << " to " << values.str() << " >>" << std::endl;
+        asked = current;
+        adjusted = kept = true;
+    } else if (!kept) {
+        std::cerr << "<< Sensor has " << name << " " << actual << " rather than " << current << " >>" << std::endl;
+    }
+    current = actual;
+    return kept;
+}
+
+// What we've told the sensor, so reconfiguring only sends what changed.
+// Settings are staged with the set...() calls and sent together by commit(),
+// which skips any the sensor already has and reads back the ones it sends;
+// a setting staged twice before a commit is only sent once.
+// SensorState state(go2system); // go2system is only read at commit()
+// state.setTriggerSource(GO2_TRIGGER_SOURCE_ENCODER);
+// state.setTravelResolution(0.005);
+// if (state.commit() != 0) ... // settings the sensor refused or didn't keep
+class SensorState {
+    public:
+        SensorState(Go2System& go2system, bool verboseFlag=false);
+        void setVerbose(bool verboseFlag) {verbose = verboseFlag;}
+        void setTriggerSource(Go2TriggerSource source) {triggerSource.want(source);}
+        void setTriggerGate(Go2Bool enabled) {triggerGate.want(enabled);}
+        void setTravelResolution(Go2Double resolution) {travelResolution.want(resolution);}
+        void setFrameRate(Go2Double rate) {frameRate.want(rate);}
+        void setEncoderPeriod(Go2Double period) {encoderPeriod.want(period);}
+        void setEncoderTriggerMode(Go2EncoderTriggerMode mode) {encoderTriggerMode.want(mode);}
+        void setXResampling(Go2ResamplingType type) {xResampling.want(type);}
+        void setXGapFilling(Go2Bool enabled) {xGap.want(enabled);}
+        void setXGapWindow(Go2Double window) {xGapWindow.want(window);}
+        void setYGapFilling(Go2Bool enabled) {yGap.want(enabled);}
+        void setYGapWindow(Go2Double window) {yGapWindow.want(window);}
+        void setXSmoothing(Go2Bool enabled) {xSmooth.want(enabled);}
+        void setXSmoothWindow(Go2Double window) {xSmoothWindow.want(window);}
+        void setYSmoothing(Go2Bool enabled) {ySmooth.want(enabled);}
+        void setYSmoothWindow(Go2Double window) {ySmoothWindow.want(window);}
+        // Sends the staged settings that differ from the sensor's and verifies them,
+        // returns how many the sensor refused or didn't keep
+        unsigned int commit();
+        // Forgets everything known about the sensor (e.g. after it has been reset)
+        void forget();
+        // Settings sent and found already set, over every commit
+        unsigned int sentCount() const {return sent;}
+        unsigned int skippedCount() const {return skipped;}
+    private:
+        template <typename T>
+        void push(SensorSetting<T>& setting, unsigned int& failures);
+
+        Go2System& sys;
+        bool verbose;
+        unsigned int sent, skipped;
+        SensorSetting<Go2TriggerSource> triggerSource;
+        SensorSetting<Go2Bool> triggerGate;
+        SensorSetting<Go2Double> travelResolution, frameRate, encoderPeriod;
+        SensorSetting<Go2EncoderTriggerMode> encoderTriggerMode;
+        SensorSetting<Go2ResamplingType> xResampling;
+        SensorSetting<Go2Bool> xGap, yGap, xSmooth, ySmooth;
+        SensorSetting<Go2Double> xGapWindow, yGapWindow, xSmoothWindow, ySmoothWindow;
+};
@@ -0,0 +1,51 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "recordingpipeline.h"
+#include "histogram.h"
+#include "profilesource.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// Watches a recording: prints a one-line summary of the last interval while
+// the pipeline runs and writes a JSON report of the whole scan at the end.
+// Only reads the pipeline's counters, so the recording threads never wait on it.
+// StatsReporter reporter(pipeline, 1.0);
+// reporter.start();
+// ...
+// pipeline.finish();
+// reporter.stop();
+// reporter.writeJson(filename);
+class StatsReporter {
+    public:
+        StatsReporter(const RecordingPipeline& recordingPipeline, double intervalSeconds=1.0, std::ostream& output=std::cout);
+        virtual ~StatsReporter() {stop();}
+        void start();
+        void stop();
+        bool writeJson(const std::string& filename);
+        void writeJson(std::ostream& json);
+    private:
+        typedef struct stageSnapshot {
+            Go2UInt64 time; // [ns]
+            PipelineStats pipeline;
+            Go2UInt64 timeouts;
+            HistogramSnapshot receiveWait, batchSize, conversion, write;
+        } StageSnapshot;
+
+        StageSnapshot snapshot() const;
+        void run();
+        void printLine(const StageSnapshot& current, const StageSnapshot& previous);
+        static std::string formatNanoseconds(Go2UInt64 nanoseconds);
+
+        const RecordingPipeline& pipeline;
+        double interval;
+        std::ostream& os;
+        StageSnapshot first;
+        boost::thread reporter;
+};
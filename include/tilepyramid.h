@@ -0,0 +1,170 @@
+#pragma once
+extern "C" {
+    #include "Go2.h"
+}
+#include "profile.h"
+#include "profilewriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// Level-of-detail tile pyramid (<scan>.tiles), host byte order:
+//     char[8]  "GO2TILE\0"
+//     uint32   format version
+//     uint32   tile size (cells per side)
+//     uint32   level count
+//     double   level 0 cell width in X and Y [mm]; each level's cells are twice the size of the last
+// followed by the tiles, each
+//     uint32   level
+//     int32    tile column, tile row
+//     uint32   compressed size, followed by the zlib-compressed cells
+// A tile holds three planes of size*size floats in row order - lowest, highest
+// and mean Z [mm] - with NaN for empty cells.  Cell (i, j) of tile (column, row)
+// at level n covers X from (column*size + i)*cellX*2^n and Y from
+// (row*size + j)*cellY*2^n.  Tiles without points are left out.
+// The directory follows the last tile:
+//     uint64   tile count
+//     per tile: uint32 level, int32 column, int32 row, uint64 file offset, uint32 compressed size
+//     uint64   file offset of the directory
+//     char[8]  "GO2TIDX\0"
+#define TILE_MAGIC "GO2TILE"
+#define TILE_VERSION 1
+#define TILE_INDEX_MAGIC "GO2TIDX"
+#define TILE_EXTENSION ".tiles"
+#define TILE_SIZE 256 // Cells per tile side
+#define TILE_MAX_LEVELS 24
+#define TILE_COMPRESSION_LEVEL 1
+#define TILE_MAX_THREADS 4 // Upper limit on compression workers
+
+// Where one tile is in a pyramid file
+typedef struct tileEntry {
+    Go2UInt32 level;
+    Go2Int32 column, row;
+    Go2UInt64 offset;
+    Go2UInt32 size; // Compressed bytes
+} TileEntry;
+
+// One tile's cells, see the file format above
+typedef struct tile {
+    Go2UInt32 level;
+    Go2Int32 column, row;
+    std::vector<float> low, high, mean;
+} Tile;
+
+// Builds a pyramid from profiles in scan order in one pass.  Only one band
+// (a row of tiles) per level is held in memory; when the scan moves on to
+// the next band the finished one is handed to a pool of workers to compress
+// tile by tile and merged 2x2 into the level above.  Profiles that go back
+// into a band already written are skipped - sort the scan by Y first if
+// it reverses a lot.  Levels are added until the scan is no wider than a tile.
+// TilePyramidBuilder builder(filename, cell);
+// builder.start(scanInfo);
+// builder.add(profile); // every profile
+// builder.finish();
+class TilePyramidBuilder {
+    public:
+        // A cell size of 0 takes the X resolution of the first profile
+        TilePyramidBuilder(const std::string& filename, double cellX=0, double cellY=0,
+                           Go2UInt32 tileSize=TILE_SIZE, unsigned int threads=defaultThreads());
+        virtual ~TilePyramidBuilder();
+        bool start(const ScanInfo& info);
+        void add(const Profile& profile);
+        // Writes the remaining bands and the directory, returns false on error
+        bool finish();
+        void report(std::ostream& os);
+        static unsigned int defaultThreads();
+    private:
+        // One row of tiles at one level
+        typedef struct tileBand {
+            Go2Int64 band; // Tile row
+            bool active;
+            Go2Int64 firstColumn; // Cell column of the band's first column, a multiple of the tile size
+            size_t columns;
+            std::vector<float> low, high;
+            std::vector<double> sum;
+            std::vector<Go2UInt32> count;
+        } TileBand;
+        typedef struct tileJob {
+            Tile cells;
+            std::string packed;
+            bool ready;
+        } TileJob;
+
+        void setup(const Profile& profile);
+        void flush(size_t level);
+        void activate(size_t level, Go2Int64 band);
+        bool written(Go2Int64 band) const;
+        void queueTiles(const TileBand& band, size_t level);
+        void submit();
+        void collect(Go2UInt64 until);
+        void compress();
+        static Go2Int64 floorDiv(Go2Int64 value, Go2Int64 divisor) {
+            Go2Int64 quotient = value/divisor;
+            return (value % divisor != 0 && (value < 0) != (divisor < 0)) ? quotient - 1 : quotient;
+        }
+
+        std::string outputFilename;
+        std::ofstream fidout;
+        ScanInfo info;
+        double cellX, cellY;
+        Go2UInt32 size;
+        bool configured;
+        std::vector<TileBand> levels;
+        std::vector<std::set<Go2Int64> > writtenBands; // Bands already flushed, per level
+        std::vector<Go2Int32> columnOf; // Band column of each point for the current X geometry
+        double mappedOffset, mappedResolution;
+        size_t mappedWidth;
+
+        unsigned int threadCount;
+        std::vector<TileJob> jobs;
+        Go2UInt64 filled, emitted;
+        std::vector<size_t> pending;
+        bool stopping;
+        boost::mutex lock;
+        boost::condition_variable jobAvailable, jobReady;
+        boost::thread_group workers;
+
+        Go2UInt64 offset;
+        std::vector<TileEntry> directory;
+        Go2UInt64 profiles, skipped, clipped, rawBytes, packedBytes;
+        bool failed;
+};
+
+// Reads tiles back from a pyramid file by level and region.
+// TilePyramid pyramid;
+// pyramid.open(filename);
+// std::vector<TileEntry> entries = pyramid.findTiles(level, x0, y0, x1, y1);
+// Tile tile;
+// pyramid.readTile(entries[i], tile);
+class TilePyramid {
+    public:
+        TilePyramid():size(0), levelCount(0), cellX(0), cellY(0) {}
+        bool open(const std::string& filename);
+        Go2UInt32 tileSize() const {return size;}
+        Go2UInt32 levels() const {return levelCount;}
+        // Cell size at a level [mm]
+        double cellWidth(Go2UInt32 level) const {return std::ldexp(cellX, level);}
+        double cellHeight(Go2UInt32 level) const {return std::ldexp(cellY, level);}
+        // Tiles at a level that overlap X from x0 to x1 and Y from y0 to y1 [mm]
+        std::vector<TileEntry> findTiles(Go2UInt32 level, double x0, double y0, double x1, double y1) const;
+        const std::vector<TileEntry>& getTiles() const {return directory;}
+        bool readTile(const TileEntry& entry, Tile& tile);
+    private:
+        std::ifstream fidin;
+        Go2UInt32 size, levelCount;
+        double cellX, cellY;
+        std::vector<TileEntry> directory;
+        std::string packed;
+};
@@ -8,21 +8,47 @@ extern "C" {
 #include "gocatorsystem.h"
 #include "gocatorcontrol.h"
 #include "gocatorconfigurator.h"
+#include "multisensor.h"
+#include "scanserver.h"
+#include "csvwriter.h"
 
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/thread/thread.hpp>
 #include <algorithm>
 #include <cctype>
+#include <csignal>
+#include <cstdio>
 #include <iostream>
 #include <string>
 
 namespace opts = boost::program_options;
 namespace filesystem = boost::filesystem;
 
-// Interrupts and joins specified thread on user input
-// TODO - replace user input with timeout as per PM's suggestion - ?
+// Set by SIGINT/SIGTERM in unattended recordings
+static volatile std::sig_atomic_t stopSignal = 0;
+static bool unattended = false;
+
+extern "C" void requestStop(int) {
+    stopSignal = 1;
+}
+
+// Interrupts and joins specified thread on user input or, when recording
+// unattended, once it ends by itself or SIGINT/SIGTERM arrives
 void wait(boost::thread& threadToClose) {
+    if (unattended) {
+        std::signal(SIGINT, requestStop);
+        std::signal(SIGTERM, requestStop);
+        std::cout << "Recording unattended, send SIGINT or SIGTERM to stop." << std::endl;
+        while (!threadToClose.timed_join(boost::posix_time::milliseconds(100))) {
+            if (stopSignal) {
+                threadToClose.interrupt();
+                threadToClose.join();
+                break;
+            }
+        }
+        return;
+    }
     char character;
     std::cout << "Press any key + Enter to stop recording." << std::endl;
     std::cin >> character;
@@ -30,27 +56,135 @@ void wait(boost::thread& threadToClose) {
     threadToClose.join();
 }
 // Thread wrapper to run profile recording
+typedef void (GocatorControl::*RecordToFile)(std::string&);
+typedef void (GocatorControl::*RecordWithComment)(std::string&, std::string&);
+typedef void (GocatorControl::*RecordFromSource)(ProfileSource&, std::string&, std::string&);
 void recordProfile(GocatorControl& control, std::string& outputFilename, std::string& commentString) {
-    boost::thread thd(boost::bind(&GocatorControl::recordProfile, control, outputFilename, commentString));
+    boost::thread thd(boost::bind(static_cast<RecordWithComment>(&GocatorControl::recordProfile), 
+                                  control, outputFilename, commentString));
     wait(thd);
 }
 void recordProfile(GocatorControl& control, std::string& outputFilename) {
-    boost::thread thd(boost::bind(&GocatorControl::recordProfile, control, outputFilename));
+    boost::thread thd(boost::bind(static_cast<RecordToFile>(&GocatorControl::recordProfile), control, outputFilename));
+    wait(thd);
+}
+// Sources that end on their own are simply run to completion
+void recordProfile(GocatorControl& control, ProfileSource& source, std::string& outputFilename, std::string& commentString) {
+    boost::thread thd(boost::bind(static_cast<RecordFromSource>(&GocatorControl::recordProfile), 
+                                  control, boost::ref(source), outputFilename, commentString));
+    if (source.bounded() && !unattended) {
+        thd.join();
+    } else {
+        wait(thd);
+    }
+}
+void recordProfile(MultiSensorRecorder& recorder, std::string& outputFilename, std::string& commentString) {
+    boost::thread thd(boost::bind(&MultiSensorRecorder::record, boost::ref(recorder), outputFilename, commentString));
     wait(thd);
 }
 
+// Reads CSV decimal places given as either "n" (all axes) or "x,y,z"
+bool parsePrecision(const std::string& precision, OutputSettings& output) {
+    int x, y, z;
+    char trailing;
+    if (sscanf(precision.c_str(), "%d,%d,%d%c", &x, &y, &z, &trailing) == 3) {
+        output.xPrecision = x;
+        output.yPrecision = y;
+        output.zPrecision = z;
+    } else if (sscanf(precision.c_str(), "%d%c", &x, &trailing) == 1) {
+        output.xPrecision = output.yPrecision = output.zPrecision = x;
+    } else {
+        return false;
+    }
+    return output.xPrecision >= 0 && output.xPrecision <= CSV_MAX_PRECISION &&
+           output.yPrecision >= 0 && output.yPrecision <= CSV_MAX_PRECISION &&
+           output.zPrecision >= 0 && output.zPrecision <= CSV_MAX_PRECISION;
+}
+
+// Reads height map cell sizes given as either "size" (square cells) or "x,y" [mm]
+bool parseCellSize(const std::string& cells, HeightMapSettings& heightMap) {
+    double x, y;
+    char trailing;
+    if (sscanf(cells.c_str(), "%lf,%lf%c", &x, &y, &trailing) == 2) {
+        heightMap.cellX = x;
+        heightMap.cellY = y;
+    } else if (sscanf(cells.c_str(), "%lf%c", &x, &trailing) == 1) {
+        heightMap.cellX = heightMap.cellY = x;
+    } else {
+        return false;
+    }
+    return heightMap.cellX > 0 && heightMap.cellY > 0;
+}
+
+// Reads the segment and stop limits, returns false if any is negative
+bool parseLimits(const opts::variables_map& cmdline, SegmentSettings& segments, StopSettings& stopSettings) {
+    double segmentMegabytes = cmdline["segment-size"].as<double>();
+    double preallocateMegabytes = cmdline["preallocate"].as<double>();
+    segments.profiles = cmdline["segment-profiles"].as<Go2UInt64>();
+    segments.distance = cmdline["segment-distance"].as<double>();
+    segments.seconds = cmdline["segment-time"].as<double>();
+    stopSettings.profiles = cmdline["stop-profiles"].as<Go2UInt64>();
+    stopSettings.distance = cmdline["stop-distance"].as<double>();
+    stopSettings.seconds = cmdline["stop-time"].as<double>();
+    if (segmentMegabytes < 0 || preallocateMegabytes < 0 || segments.distance < 0 || segments.seconds < 0 ||
+        stopSettings.distance < 0 || stopSettings.seconds < 0) {
+        return false;
+    }
+    segments.bytes = static_cast<Go2UInt64>(segmentMegabytes*1048576);
+    segments.preallocate = static_cast<Go2UInt64>(preallocateMegabytes*1048576);
+    if (cmdline.count("completed")) {
+        segments.completedFolder = cmdline["completed"].as<std::string>();
+    }
+    return true;
+}
+
+// Keeps the sensor (or stand-in) for scans requested over socketPath until
+// a shutdown request, SIGINT or SIGTERM
+int serve(GocatorControl& control, const std::string& configFilename, const std::string& socketPath,
+          bool verbose, const SyntheticSettings* standIn=NULL) {
+    ConfigWatcher watcher(configFilename, verbose);
+    ScanServer server(control, watcher, verbose);
+    if (standIn != NULL) {
+        server.setStandIn(*standIn);
+    }
+    if (!server.listen(socketPath)) {
+        std::cerr << "<< Unable to listen at '" << socketPath << "': " << strerror(errno) << ", aborting >>" << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    std::cout << "Serving scan requests at '" << socketPath << "', send SIGINT or SIGTERM to stop." << std::endl;
+    server.run(stopSignal);
+    return 0;
+}
 
 // Turn the laser on to allow positioning before the profiling
-void target(GocatorControl& control) {
-    control.targetOn();
+int target(GocatorControl& control) {
+    if (!control.targetOn()) {
+        return 1;
+    }
     char character2;
     std::cout << "Move the laser into position.  Press any key + Enter when complete." << std::endl;
     std::cin >> character2;
     control.targetOff();
+    return 0;
 }
 
-// Usage: gocator_encoder [--output outputfile] [--config configfile]
+// Usage: gocator_encoder [--output outputfile] [--config configfile] [--format csv|binary|compressed]
+//                        [--replay scanfile | --synthetic] [--merge] [--stats [seconds]]
+//                        [--heightmap size|x,y [--aggregate min|max|mean|last]]
+//                        [--reject low,high] [--fill n] [--smooth-x method:n] [--smooth-y method:n] [--noise mm^2]
+//                        [--unattended] [--segment-size MB] [--segment-profiles n] [--segment-distance mm]
+//                        [--segment-time s] [--preallocate MB] [--completed folder]
+//                        [--stop-profiles n] [--stop-distance mm] [--stop-time s]
+//                        [--cache file] [--discover] [--serve [socket]]
 // If not specified, writes X,Y,Z data to file 'profile.csv' in current folder.
+// With any segment limit the scan is split into profile_seg00001.csv,
+// profile_seg00002.csv... and runs unattended until a stop limit or signal.
+// With --serve it stays logged in and records whenever gocator_client asks.
+// If the config file lists several device_ids, each sensor is recorded to
+// its own file (e.g. 'profile_8710.csv') unless --merge is given.
+// Binary and compressed scans can be converted to X,Y,Z with scan2csv.
 int main(int argc, char* argv[]) {
     std::cout << "Gocator 20x0 Profiler" << std::endl;
     std::cout << "Chris R. Coughlin (TRI/Austin, Inc.)" << std::endl;
@@ -60,6 +194,38 @@ int main(int argc, char* argv[]) {
         ("config,c", opts::value<std::string>()->default_value("gocator_encoder.cfg"), "configuration file")
         ("target,t", "enable laser for targeting prior to profiling")
         ("message,m", opts::value<std::string>(), "set comments for data output header")
+        ("format,f", opts::value<std::string>()->default_value("csv"), "output format: 'csv' (x,y,z text), 'binary' (raw ranges) or 'compressed' (zlib-compressed ranges)")
+        ("precision,p", opts::value<std::string>()->default_value("4"), "CSV decimal places, either 'n' or 'x,y,z'")
+        ("replay", opts::value<std::string>(), "record from a binary or compressed scan instead of the sensor")
+        ("speed", opts::value<double>()->default_value(1.0), "replay speed as a multiple of the original rate (0 - as fast as possible)")
+        ("synthetic", "record generated profiles instead of using the sensor")
+        ("width", opts::value<unsigned int>()->default_value(1280), "synthetic points per profile")
+        ("rate", opts::value<double>()->default_value(1000), "synthetic profiles per second (0 - as fast as possible)")
+        ("invalid", opts::value<double>()->default_value(0.01), "synthetic fraction of invalid points")
+        ("profiles", opts::value<Go2UInt64>()->default_value(0), "synthetic profiles to generate (0 - until stopped)")
+        ("lost", opts::value<double>()->default_value(0), "synthetic fraction of frames lost before they reach the recorder")
+        ("heightmap", opts::value<std::string>(), "also build a height map with 'size' or 'x,y' mm cells, saved next to the output")
+        ("aggregate", opts::value<std::string>()->default_value("mean"), "height map cell value: 'min', 'max', 'mean' or 'last'")
+        ("reject", opts::value<std::string>(), "drop points with Z outside 'low,high' mm before writing")
+        ("fill", opts::value<unsigned int>()->default_value(0), "fill gaps of up to n missing points along X by interpolation")
+        ("smooth-x", opts::value<std::string>(), "smooth along X with 'median:n', 'mean:n' or 'wiener:n' (n odd, points)")
+        ("smooth-y", opts::value<std::string>(), "smooth along Y with 'median:n', 'mean:n' or 'wiener:n' (n odd, profiles)")
+        ("noise", opts::value<double>()->default_value(0), "Wiener noise variance in mm^2 (0 - estimated per profile)")
+        ("stats", opts::value<double>()->implicit_value(1.0), "print recording statistics every n seconds (default 1) and save them as JSON next to the output")
+        ("merge", "with several sensors, write one file in encoder order instead of one file per sensor")
+        ("unattended", "record until a stop limit is reached or SIGINT/SIGTERM arrives rather than waiting for a key")
+        ("segment-size", opts::value<double>()->default_value(0), "start a new output segment every n MB (0 - no limit)")
+        ("segment-profiles", opts::value<Go2UInt64>()->default_value(0), "start a new output segment every n profiles (0 - no limit)")
+        ("segment-distance", opts::value<double>()->default_value(0), "start a new output segment every n mm of travel (0 - no limit)")
+        ("segment-time", opts::value<double>()->default_value(0), "start a new output segment every n seconds (0 - no limit)")
+        ("preallocate", opts::value<double>()->default_value(0), "disk space to reserve for each segment in MB (default the segment size)")
+        ("completed", opts::value<std::string>(), "folder finished segments are moved to (same filesystem)")
+        ("stop-profiles", opts::value<Go2UInt64>()->default_value(0), "stop after n profiles are written (0 - no limit)")
+        ("stop-distance", opts::value<double>()->default_value(0), "stop after n mm of travel (0 - no limit)")
+        ("stop-time", opts::value<double>()->default_value(0), "stop after n seconds (0 - no limit)")
+        ("cache", opts::value<std::string>()->default_value(DEVICE_CACHE_FILE), "file remembering sensors between runs so they can be connected without discovery ('' - none)")
+        ("discover", "discover the sensor even if it's cached")
+        ("serve", opts::value<std::string>()->implicit_value(SCAN_SERVER_SOCKET), "stay connected and record scans requested with gocator_client over a Unix socket (default " SCAN_SERVER_SOCKET ")")
         ("help,h", "display basic help information")
         ("verbose,v", "display additional messages")
     ;
@@ -80,8 +246,89 @@ int main(int argc, char* argv[]) {
     if (cmdline.count("output")) {
         outputFilename = cmdline["output"].as<std::string>();
     }
+    OutputSettings output;
+    output.format = CSV;
+    std::string formatName = cmdline["format"].as<std::string>();
+    if (formatName == "binary") {
+        output.format = BINARY;
+    } else if (formatName == "compressed") {
+        output.format = COMPRESSED;
+    } else if (formatName != "csv") {
+        std::cerr << "<< Unknown output format '" << formatName << ",' aborting >>" << std::endl;
+        return 1;
+    }
+    if (!parsePrecision(cmdline["precision"].as<std::string>(), output)) {
+        std::cerr << "<< Precision must be 'n' or 'x,y,z' with 0-" << CSV_MAX_PRECISION << " decimal places, aborting >>" << std::endl;
+        return 1;
+    }
+    HeightMapSettings heightMap;
+    heightMap.cellX = heightMap.cellY = 0;
+    heightMap.aggregation = HEIGHT_MEAN;
+    if (cmdline.count("heightmap") && !parseCellSize(cmdline["heightmap"].as<std::string>(), heightMap)) {
+        std::cerr << "<< Height map cell size must be 'size' or 'x,y' in mm, aborting >>" << std::endl;
+        return 1;
+    }
+    std::string aggregation = cmdline["aggregate"].as<std::string>();
+    if (aggregation == "min") {
+        heightMap.aggregation = HEIGHT_MIN;
+    } else if (aggregation == "max") {
+        heightMap.aggregation = HEIGHT_MAX;
+    } else if (aggregation == "last") {
+        heightMap.aggregation = HEIGHT_LAST;
+    } else if (aggregation != "mean") {
+        std::cerr << "<< Unknown height map aggregation '" << aggregation << ",' aborting >>" << std::endl;
+        return 1;
+    }
+    RangeFilterSettings rangeFilter;
+    rangeFilter.zLow = rangeFilter.zHigh = 0;
+    rangeFilter.gapFill = cmdline["fill"].as<unsigned int>();
+    rangeFilter.xMethod = rangeFilter.yMethod = SMOOTH_NONE;
+    rangeFilter.xWindow = rangeFilter.yWindow = 1;
+    rangeFilter.noise = cmdline["noise"].as<double>();
+    if (cmdline.count("reject") && !parseZWindow(cmdline["reject"].as<std::string>(), rangeFilter)) {
+        std::cerr << "<< Z window must be 'low,high' in mm with low < high, aborting >>" << std::endl;
+        return 1;
+    }
+    if ((cmdline.count("smooth-x") &&
+         !parseSmoothing(cmdline["smooth-x"].as<std::string>(), rangeFilter.xMethod, rangeFilter.xWindow)) ||
+        (cmdline.count("smooth-y") &&
+         !parseSmoothing(cmdline["smooth-y"].as<std::string>(), rangeFilter.yMethod, rangeFilter.yWindow))) {
+        std::cerr << "<< Smoothing must be 'median:n', 'mean:n' or 'wiener:n' with n odd, 3-"
+                  << FILTER_MAX_WINDOW << ", aborting >>" << std::endl;
+        return 1;
+    }
+    double statsInterval = 0;
+    if (cmdline.count("stats")) {
+        statsInterval = cmdline["stats"].as<double>();
+    }
+    SegmentSettings segments;
+    StopSettings stopSettings;
+    if (!parseLimits(cmdline, segments, stopSettings)) {
+        std::cerr << "<< Segment and stop limits can't be negative, aborting >>" << std::endl;
+        return 1;
+    }
+    if (segments.preallocate == 0) {
+        segments.preallocate = segments.bytes;
+    }
+    if (!segments.completedFolder.empty() && !filesystem::is_directory(segments.completedFolder)) {
+        std::cerr << "<< Completed segment folder '" << segments.completedFolder << "' doesn't exist, aborting >>" << std::endl;
+        return 1;
+    }
+    unattended = cmdline.count("unattended") > 0 || segmentsEnabled(segments) || stopSettings.profiles > 0 ||
+                 stopSettings.distance > 0 || stopSettings.seconds > 0;
     if (verbose) {
-        std::cout << "Saving profile data to '" << outputFilename << "'" << std::endl;
+        std::cout << "Saving " << formatName << " profile data to '" << outputFilename << "'" << std::endl;
+    }
+
+    if (cmdline.count("serve") && cmdline.count("replay")) {
+        std::cerr << "<< The scan server records from the sensor or --synthetic, not --replay, aborting >>" << std::endl;
+        return 1;
+    }
+
+    // Bring the Go2 API up (and discover, if nothing's cached) while the configuration loads
+    boost::shared_ptr<SystemStartup> startup;
+    if (!cmdline.count("replay") && !cmdline.count("synthetic")) {
+        startup.reset(new SystemStartup(cmdline["cache"].as<std::string>(), verbose, cmdline.count("discover") > 0));
     }
 
     std::string configFilename;
@@ -95,17 +342,116 @@ int main(int argc, char* argv[]) {
     if (verbose) {
         std::cout << "Additional config read from '" << configFilename << "'\n\n" << std::endl;  
     }
+    ScanConfig config;
+    try {
+        config = GocatorConfigurator::load(configFilename);
+    } catch (std::runtime_error &err) {
+        std::cerr << "<< Unable to load configuration from '" << configFilename << ",' aborting >>" << std::endl;
+        return 1;
+    }
     try {
+        // Replayed and synthetic scans don't need a sensor
+        if (cmdline.count("replay") || cmdline.count("synthetic")) {
+            GocatorSystem offline(verbose);
+            GocatorControl control(offline, verbose);
+            control.setOutputSettings(output);
+            control.setStatsInterval(statsInterval);
+            control.setHeightMap(heightMap);
+            control.setRangeFilter(rangeFilter);
+            control.setReduction(config.reduction);
+            control.setSegments(segments);
+            control.setStopConditions(stopSettings);
+            boost::shared_ptr<ProfileSource> source;
+            std::string messageString;
+            if (cmdline.count("replay")) {
+                ReplayProfileSource* replay = new ReplayProfileSource(cmdline["replay"].as<std::string>(),
+                                                                      cmdline["speed"].as<double>());
+                source.reset(replay);
+                Encoder lme;
+                lme.modelName = "<replayed>";
+                lme.resolution = replay->getInfo().encoderResolution;
+                control.setEncoder(lme, replay->getInfo().startingEncoder);
+                messageString = replay->getInfo().comment;
+            } else {
+                SyntheticSettings settings;
+                settings.width = cmdline["width"].as<unsigned int>();
+                settings.frameRate = cmdline["rate"].as<double>();
+                settings.invalidRatio = cmdline["invalid"].as<double>();
+                settings.encoderStep = 10;
+                settings.profileCount = cmdline["profiles"].as<Go2UInt64>();
+                settings.lostRatio = cmdline["lost"].as<double>();
+                source.reset(new SyntheticProfileSource(settings));
+                Encoder lme = config.encoder;
+                control.setEncoder(lme, 0);
+                GapSettings spacing;
+                spacing.encoderStep = settings.encoderStep;
+                spacing.framePeriod = settings.frameRate > 0 ? static_cast<Go2UInt64>(1e6/settings.frameRate) : 0;
+                control.setExpectedSpacing(spacing);
+                messageString = "Synthetic scan";
+                if (cmdline.count("serve")) {
+                    return serve(control, configFilename, cmdline["serve"].as<std::string>(), verbose, &settings);
+                }
+            }
+            if (cmdline.count("message")) {
+                messageString = cmdline["message"].as<std::string>();
+            }
+            std::cout << "Recording from " << source->getSourceName() << " source..." << std::endl;
+            recordProfile(control, *source, outputFilename, messageString);
+            return 0;
+        }
+
+        // Several sensors share one discovery and record concurrently
+        if (config.deviceIDs.size() > 1) {
+            if (cmdline.count("serve")) {
+                std::cerr << "<< The scan server is for one sensor, aborting >>" << std::endl;
+                return 1;
+            }
+            if (segmentsEnabled(segments) || stopSettings.profiles > 0 || stopSettings.distance > 0 ||
+                stopSettings.seconds > 0) {
+                std::cerr << "<< Segments and stop limits are for one sensor, aborting >>" << std::endl;
+                return 1;
+            }
+            MultiSensorRecorder recorder(verbose);
+            recorder.setOutputSettings(output);
+            recorder.setMerged(cmdline.count("merge") > 0);
+            recorder.setHeightMap(heightMap);
+            recorder.setRangeFilter(rangeFilter);
+            recorder.setReduction(config.reduction);
+            recorder.connect(config.deviceIDs, *startup);
+            Encoder lme = config.encoder;
+            boost::shared_ptr<Trigger> trigger(GocatorConfigurator::configuredTrigger(config));
+            GocatorFilter filtration = config.filter;
+            if (!recorder.configure(lme, *trigger, filtration)) {
+                std::cerr << "<< Not recording with settings a Gocator refused, aborting >>" << std::endl;
+                return 1;
+            }
+            std::string messageString = "Multi-sensor scan";
+            if (cmdline.count("message")) {
+                messageString = cmdline["message"].as<std::string>();
+            }
+            std::cout << "Connected to " << recorder.sensorCount() << " Gocators, monitoring encoder..." << std::endl;
+            recordProfile(recorder, outputFilename, messageString);
+            return 0;
+        }
+
         // Startup and login
         GocatorSystem gocator(verbose);
         GocatorControl control(gocator, verbose);
-        GocatorAddress configuredAddress = GocatorConfigurator::configuredNetworkConnection(configFilename);
-        gocator.init(GocatorConfigurator::deviceID(configFilename), 
-                     configuredAddress.addr, 
-                     configuredAddress.reconfigure);
+        control.setOutputSettings(output);
+        control.setStatsInterval(statsInterval);
+        control.setHeightMap(heightMap);
+        control.setRangeFilter(rangeFilter);
+        control.setReduction(config.reduction);
+        control.setSegments(segments);
+        control.setStopConditions(stopSettings);
+        gocator.init(config.deviceIDs[0], 
+                     *startup,
+                     config.network.addr, 
+                     config.network.reconfigure);
 
         // Configure encoder 
-        Encoder lme = GocatorConfigurator::configuredEncoder(configFilename);
+        boost::posix_time::ptime configureStart = boost::posix_time::microsec_clock::local_time();
+        Encoder lme = config.encoder;
         control.configureEncoder(lme);
         if (verbose) {
             std::cout << "\n<< Using " << lme.modelName << " encoder, ";
@@ -113,7 +459,7 @@ int main(int argc, char* argv[]) {
         }
         
         // Configure trigger
-        boost::shared_ptr<Trigger> trigger(GocatorConfigurator::configuredTrigger(configFilename));
+        boost::shared_ptr<Trigger> trigger(GocatorConfigurator::configuredTrigger(config));
         trigger->set(control);
         if (verbose) {
             std::cout << "<< Triggering: " << trigger->getTriggerType() << ", gate ";
@@ -126,7 +472,7 @@ int main(int argc, char* argv[]) {
         }
 
         // Configure filtration
-        GocatorFilter filtration = GocatorConfigurator::configuredFilter(configFilename);
+        GocatorFilter filtration = config.filter;
         if (verbose) {
             std::cout << "<< Data Processing Settings >>" << std::endl;
             std::cout << "    Resolution:  ";
@@ -170,12 +516,24 @@ int main(int argc, char* argv[]) {
             }
             std::cout << "\n\n" << std::endl;
         }
+        control.configureFilter(filtration);
+        if (!control.applySettings()) {
+            std::cerr << "<< Not recording with settings the Gocator refused, aborting >>" << std::endl;
+            return 1;
+        }
+
+        startup->addTime("configure", (boost::posix_time::microsec_clock::local_time() -
+                                       configureStart).total_microseconds()/1e6);
+        startup->report(std::cout);
 
         // Optionally turn the laser on without recording data - let the
         // user line up the scanner
         if (cmdline.count("target")) {
-            target(control);
-            return 0;
+            return target(control);
+        }
+
+        if (cmdline.count("serve")) {
+            return serve(control, configFilename, cmdline["serve"].as<std::string>(), verbose);
         }
 
         // Output profile  
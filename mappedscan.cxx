@@ -0,0 +1,168 @@
+#include "mappedscan.h"
+
+// Copies a value out of the mapping at `position` and moves past it
+template<typename T> static bool take(const char* mapping, size_t size, size_t& position, T& value) {
+    if (size - position < sizeof(T)) {
+        return false;
+    }
+    memcpy(&value, mapping + position, sizeof(T));
+    position += sizeof(T);
+    return true;
+}
+
+MappedScan::MappedScan(const std::string& scanFilename):filename(scanFilename), compressed(false), mapping(NULL),
+mappedSize(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open scan '" + filename + "'");
+    }
+    struct stat status;
+    char magic[sizeof(SCAN_MAGIC)];
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(magic)) ||
+        pread(fd, magic, sizeof(magic), 0) != static_cast<ssize_t>(sizeof(magic))) {
+        close(fd);
+        throw std::runtime_error("'" + filename + "' is not a binary scan");
+    }
+    if (memcmp(magic, COMPRESSED_SCAN_MAGIC, sizeof(magic)) == 0) {
+        close(fd);
+        compressed = true;
+        decode();
+        return;
+    }
+    if (memcmp(magic, SCAN_MAGIC, sizeof(magic)) != 0) {
+        close(fd);
+        throw std::runtime_error("'" + filename + "' is not a binary scan");
+    }
+    mappedSize = static_cast<size_t>(status.st_size);
+    void* mapped = mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Unable to map '" + filename + "'");
+    }
+    mapping = static_cast<char*>(mapped);
+    try {
+        map();
+    } catch (...) {
+        munmap(mapping, mappedSize);
+        throw;
+    }
+}
+
+MappedScan::~MappedScan() {
+    if (mapping != NULL) {
+        munmap(mapping, mappedSize);
+    }
+}
+
+// Reads the header of a mapped binary scan and finds every record
+void MappedScan::map() {
+    size_t position = sizeof(SCAN_MAGIC);
+    Go2UInt32 version, commentLength;
+    if (!take(mapping, mappedSize, position, version) || version < 1 || version > SCAN_VERSION) {
+        throw std::runtime_error("Unsupported binary scan version in '" + filename + "'");
+    }
+    if (!take(mapping, mappedSize, position, info.encoderResolution) ||
+        !take(mapping, mappedSize, position, info.startingEncoder) ||
+        !take(mapping, mappedSize, position, commentLength) || mappedSize - position < commentLength) {
+        throw std::runtime_error("Truncated header in '" + filename + "'");
+    }
+    info.comment.assign(mapping + position, commentLength);
+    position += commentLength;
+    walkRecords(position, version);
+}
+
+// Steps over the records from `position`, stopping at the end of the file
+// or at a record cut short (a recording that was interrupted)
+void MappedScan::walkRecords(size_t position, Go2UInt32 version) {
+    MappedProfile profile;
+    memset(&profile, 0, sizeof(profile));
+    // Records are ~2.5 kB apart, so the walk touches every page anyway - read ahead
+    madvise(mapping, mappedSize, MADV_SEQUENTIAL);
+    while (position < mappedSize) {
+        Go2Byte flags;
+        take(mapping, mappedSize, position, flags);
+        if (!take(mapping, mappedSize, position, profile.encoder) ||
+            (version >= 2 && !take(mapping, mappedSize, position, profile.timestamp))) {
+            break;
+        }
+        if ((flags & SCAN_RECORD_GEOMETRY) &&
+            (!take(mapping, mappedSize, position, profile.xOffset) ||
+             !take(mapping, mappedSize, position, profile.xResolution) ||
+             !take(mapping, mappedSize, position, profile.zOffset) ||
+             !take(mapping, mappedSize, position, profile.zResolution))) {
+            break;
+        }
+        if (!take(mapping, mappedSize, position, profile.width) ||
+            (mappedSize - position)/sizeof(short) < profile.width) {
+            break;
+        }
+        profile.offset = position;
+        position += profile.width*sizeof(short);
+        addProfile(profile);
+    }
+    madvise(mapping, mappedSize, MADV_NORMAL);
+}
+
+// Compressed scans are decoded in full, ranges back to back
+void MappedScan::decode() {
+    ScanReader reader(filename);
+    info = reader.getInfo();
+    Profile profile;
+    while (reader.next(profile)) {
+        MappedProfile entry;
+        entry.encoder = profile.encoder;
+        entry.timestamp = profile.timestamp;
+        entry.xOffset = profile.xOffset;
+        entry.xResolution = profile.xResolution;
+        entry.zOffset = profile.zOffset;
+        entry.zResolution = profile.zResolution;
+        entry.width = static_cast<Go2UInt32>(profile.width());
+        entry.offset = decoded.size()*sizeof(short);
+        decoded.insert(decoded.end(), profile.rangeData(), profile.rangeData() + profile.width());
+        addProfile(entry);
+    }
+}
+
+void MappedScan::addProfile(const MappedProfile& profile) {
+    profiles.push_back(profile);
+    if (!runs.empty()) {
+        MappedRun& run = runs.back();
+        Go2UInt64 stride = profile.offset - (run.offset + (run.profiles - 1)*run.stride);
+        if (profile.width == run.width && (run.profiles == 1 || stride == run.stride) &&
+            profile.xOffset == run.xOffset && profile.xResolution == run.xResolution &&
+            profile.zOffset == run.zOffset && profile.zResolution == run.zResolution) {
+            run.stride = stride;
+            run.profiles++;
+            return;
+        }
+    }
+    MappedRun run;
+    run.firstProfile = profiles.size() - 1;
+    run.profiles = 1;
+    run.width = profile.width;
+    run.offset = profile.offset;
+    run.stride = profile.width*sizeof(short);
+    run.xOffset = profile.xOffset;
+    run.xResolution = profile.xResolution;
+    run.zOffset = profile.zOffset;
+    run.zResolution = profile.zResolution;
+    runs.push_back(run);
+}
+
+void MappedScan::read(Go2UInt64 number, Profile& profile) const {
+    if (number >= profiles.size()) {
+        throw std::runtime_error("No such profile in '" + filename + "'");
+    }
+    const MappedProfile& entry = profiles[number];
+    profile.encoder = entry.encoder;
+    profile.timestamp = entry.timestamp;
+    profile.xOffset = entry.xOffset;
+    profile.xResolution = entry.xResolution;
+    profile.zOffset = entry.zOffset;
+    profile.zResolution = entry.zResolution;
+    profile.release();
+    profile.ranges.resize(entry.width);
+    if (entry.width > 0) {
+        memcpy(&profile.ranges[0], data() + entry.offset, entry.width*sizeof(short));
+    }
+}
@@ -0,0 +1,286 @@
+#include "multisensor.h"
+namespace filesystem = boost::filesystem;
+
+// Logs in to each of the specified Gocators, using one discovery for all of them
+void MultiSensorRecorder::connect(const std::vector<Go2UInt32>& deviceIDs, SystemStartup& startup) {
+    const std::vector<DiscoveredDevice>& devices = startup.getDevices();
+    for (size_t i=0; i<deviceIDs.size(); i++) {
+        Sensor sensor;
+        sensor.id = deviceIDs[i];
+        sensor.system.reset(new GocatorSystem(verbose));
+        // Sensors keep whatever address they already have - the configured
+        // address can only belong to one of them
+        Go2AddressInfo address;
+        bool found = false;
+        for (size_t j=0; j<devices.size(); j++) {
+            if (devices[j].id == sensor.id) {
+                address = devices[j].address;
+                found = true;
+            }
+        }
+        if (!found) {
+            std::cerr << "<< Unable to find Gocator " << sensor.id << ", aborting >>" << std::endl;
+            throw std::runtime_error("Gocator not found");
+        }
+        sensor.system->init(sensor.id, devices, address, false);
+        sensor.control.reset(new GocatorControl(*sensor.system, verbose));
+        sensor.source.reset(new LiveProfileSource(sensor.system->getSystem(), verbose));
+        sensors.push_back(sensor);
+    }
+}
+
+// Applies the same encoder, trigger and filtration to every sensor
+bool MultiSensorRecorder::configure(Encoder& encoder, Trigger& trigger, GocatorFilter& filter) {
+    bool accepted = true;
+    for (size_t i=0; i<sensors.size(); i++) {
+        if (verbose) {
+            std::cout << "<< Configuring Gocator " << sensors[i].id << " >>" << std::endl;
+        }
+        sensors[i].control->configureEncoder(encoder);
+        trigger.set(*sensors[i].control);
+        sensors[i].control->configureFilter(filter);
+        if (!sensors[i].control->applySettings()) {
+            std::cerr << "<< Gocator " << sensors[i].id << " didn't accept every setting >>" << std::endl;
+            accepted = false;
+        }
+    }
+    return accepted;
+}
+
+// Records from all sensors until the thread is interrupted
+void MultiSensorRecorder::record(std::string& outputFilename, std::string& commentString) {
+    if (merge) {
+        recordMerged(outputFilename, commentString);
+    } else {
+        recordSeparately(outputFilename, commentString);
+    }
+    report(std::cout);
+}
+
+// One file and one pipeline per sensor
+void MultiSensorRecorder::recordSeparately(std::string& outputFilename, std::string& commentString) {
+    for (size_t i=0; i<sensors.size(); i++) {
+        Sensor& sensor = sensors[i];
+        sensor.file.reset(new OutputFile());
+        openOutput(*sensor.file, sensorFilename(outputFilename, sensor.id));
+        ScanInfo info;
+        std::ostringstream comment;
+        comment << commentString << " (Gocator " << sensor.id << ")";
+        info.comment = comment.str();
+        info.startingEncoder = sensor.control->getStartingEncoder();
+        info.encoderResolution = sensor.control->getEncoder().resolution;
+        sensor.writer.reset(createProfileWriter(output));
+        sensor.pipeline.reset(new RecordingPipeline(*sensor.file, *sensor.writer, info, verbose));
+        // Merged profiles interleave sensors, so gaps are only checked per sensor
+        sensor.pipeline->setGapDetection(sensor.control->getExpectedSpacing());
+        sensor.pipeline->setReduction(reduction);
+        sensor.pipeline->setFilter(rangeFilter);
+        sensor.pipeline->setHeightMap(heightMap);
+    }
+    startSources();
+    boost::thread_group receivers;
+    for (size_t i=0; i<sensors.size(); i++) {
+        sensors[i].pipeline->start();
+        boost::thread* receiver = receivers.create_thread(
+            boost::bind(&RecordingPipeline::run, sensors[i].pipeline.get(), boost::ref(*sensors[i].source)));
+        pin(receiver, i);
+    }
+    waitForInterrupt(receivers);
+    stopSources();
+    for (size_t i=0; i<sensors.size(); i++) {
+        sensors[i].pipeline->finish();
+        sensors[i].file->close();
+        if (sensors[i].file->fail()) {
+            std::cerr << "<< Encountered error writing Gocator " << sensors[i].id << " data, data may have been lost >>" << std::endl;
+        }
+        std::string sensorOutput = sensorFilename(outputFilename, sensors[i].id);
+        if (!sensors[i].pipeline->saveIndex(sensorOutput)) {
+            std::cerr << "<< Unable to write index for '" << sensorOutput << "' >>" << std::endl;
+        }
+        if (!sensors[i].pipeline->saveGaps(sensorOutput)) {
+            std::cerr << "<< Unable to write frame gaps for '" << sensorOutput << "' >>" << std::endl;
+        }
+        if (!sensors[i].pipeline->saveHeightMap(sensorOutput)) {
+            std::cerr << "<< Unable to write height map for '" << sensorOutput << "' >>" << std::endl;
+        }
+    }
+}
+
+// One file for all sensors, profiles merged in encoder order
+void MultiSensorRecorder::recordMerged(std::string& outputFilename, std::string& commentString) {
+    OutputFile fidout;
+    openOutput(fidout, outputFilename);
+    ScanInfo info;
+    info.comment = commentString;
+    info.startingEncoder = sensors[0].control->getStartingEncoder();
+    info.encoderResolution = sensors[0].control->getEncoder().resolution;
+    boost::shared_ptr<ProfileWriter> writer(createProfileWriter(output));
+    RecordingPipeline pipeline(fidout, *writer, info, verbose);
+    pipeline.setReduction(reduction);
+    pipeline.setFilter(rangeFilter);
+    pipeline.setHeightMap(heightMap);
+    for (size_t i=0; i<sensors.size(); i++) {
+        sensors[i].queue.reset(new ProfileQueue(PROFILE_QUEUE_DEPTH));
+    }
+    pipeline.start();
+    startSources();
+    receiving = true;
+    boost::thread merger(&MultiSensorRecorder::mergeProfiles, this, boost::ref(pipeline), info.startingEncoder);
+    boost::thread_group receivers;
+    for (size_t i=0; i<sensors.size(); i++) {
+        boost::thread* receiver = receivers.create_thread(
+            boost::bind(&ProfileQueue::receive, sensors[i].queue.get(), boost::ref(*sensors[i].source),
+                        static_cast<const boost::atomic<bool>*>(NULL)));
+        pin(receiver, i);
+    }
+    waitForInterrupt(receivers);
+    stopSources();
+    receiving = false;
+    merger.join();
+    pipeline.finish();
+    fidout.close();
+    if (fidout.fail()) {
+        std::cerr << "<< Encountered error writing to '" << outputFilename << ",' data may have been lost.\n" << std::endl;
+    }
+    if (!pipeline.saveIndex(outputFilename)) {
+        std::cerr << "<< Unable to write index for '" << outputFilename << "' >>" << std::endl;
+    }
+    if (!pipeline.saveHeightMap(outputFilename)) {
+        std::cerr << "<< Unable to write height map for '" << outputFilename << "' >>" << std::endl;
+    }
+    pipeline.report(std::cout);
+}
+
+// Merge thread - repeatedly passes on the waiting profile with the lowest
+// encoder reading (relative to its sensor's starting reading).  A profile is
+// held until every sensor has one waiting, so the output stays in order, but
+// no longer than MERGE_WINDOW in case a sensor has stopped triggering.
+void MultiSensorRecorder::mergeProfiles(RecordingPipeline& pipeline, Go2Int64 referenceEncoder) {
+    size_t sensorCount = sensors.size();
+    std::vector<Profile*> heads(sensorCount, static_cast<Profile*>(NULL));
+    std::vector<Go2UInt64> arrived(sensorCount, 0);
+    std::vector<Go2Int64> offsets(sensorCount);
+    for (size_t i=0; i<sensorCount; i++) {
+        offsets[i] = referenceEncoder - sensors[i].control->getStartingEncoder();
+    }
+    while (true) {
+        bool stillReceiving = receiving.load();
+        size_t waiting = 0;
+        int next = -1;
+        for (size_t i=0; i<sensorCount; i++) {
+            if (heads[i] == NULL && sensors[i].queue->take(heads[i])) {
+                arrived[i] = monotonicMicroseconds();
+            }
+            if (heads[i] != NULL) {
+                waiting++;
+                if (next < 0 || heads[i]->encoder + offsets[i] < heads[next]->encoder + offsets[next]) {
+                    next = static_cast<int>(i);
+                }
+            }
+        }
+        if (next < 0) {
+            if (!stillReceiving) {
+                break;
+            }
+            idle();
+            continue;
+        }
+        if (waiting < sensorCount && stillReceiving &&
+            monotonicMicroseconds() - arrived[next] < MERGE_WINDOW) {
+            idle();
+            continue;
+        }
+        Profile* merged = pipeline.acquire();
+        if (merged != NULL) {
+            Profile& profile = *heads[next];
+            merged->encoder = profile.encoder + offsets[next];
+            merged->timestamp = profile.timestamp;
+            merged->xOffset = profile.xOffset;
+            merged->xResolution = profile.xResolution;
+            merged->zOffset = profile.zOffset;
+            merged->zResolution = profile.zResolution;
+            // Swapping keeps both pools' buffers allocated; borrowed ranges move with their batch
+            merged->ranges.swap(profile.ranges);
+            merged->borrow(profile.batch, profile.borrowedRanges, profile.borrowedWidth);
+            pipeline.submit(merged);
+        }
+        sensors[next].queue->recycle(heads[next]);
+        heads[next] = NULL;
+    }
+}
+
+void MultiSensorRecorder::startSources() {
+    for (size_t i=0; i<sensors.size(); i++) {
+        sensors[i].source->start();
+    }
+}
+
+void MultiSensorRecorder::stopSources() {
+    for (size_t i=0; i<sensors.size(); i++) {
+        sensors[i].source->stop();
+    }
+}
+
+// Sleeps until this thread is interrupted, then stops the receive threads
+void MultiSensorRecorder::waitForInterrupt(boost::thread_group& receivers) {
+    try {
+        while (true) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+        }
+    } catch (boost::thread_interrupted &err) {
+    }
+    receivers.interrupt_all();
+    receivers.join_all();
+}
+
+// Prints each sensor's receive statistics
+void MultiSensorRecorder::report(std::ostream& os) {
+    for (size_t i=0; i<sensors.size(); i++) {
+        os << "<< Gocator " << sensors[i].id << " >>" << std::endl;
+        if (sensors[i].pipeline) {
+            sensors[i].pipeline->report(os);
+        } else if (sensors[i].queue) {
+            os << "    Profiles received:  " << sensors[i].queue->receivedCount() << std::endl;
+            os << "    Profiles dropped (queue overflow):  " << sensors[i].queue->droppedCount() << std::endl;
+            os << "    Profile queue:  depth " << sensors[i].queue->capacity()
+               << ", high-water " << sensors[i].queue->highWaterMark() << std::endl;
+        }
+    }
+}
+
+// Keeps a receive thread on one core so sensors don't compete for the same cache
+void MultiSensorRecorder::pin(boost::thread* thread, unsigned int core) {
+    unsigned int cores = boost::thread::hardware_concurrency();
+    if (cores < 2) {
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core % cores, &cpus);
+    if (pthread_setaffinity_np(thread->native_handle(), sizeof(cpu_set_t), &cpus) != 0) {
+        std::cerr << "<< Unable to pin receive thread to core " << core % cores << " >>" << std::endl;
+    }
+}
+
+// profile.csv -> profile_8710.csv
+std::string MultiSensorRecorder::sensorFilename(const std::string& outputFilename, Go2UInt32 id) {
+    filesystem::path path(outputFilename);
+    std::ostringstream filename;
+    filename << path.stem().string() << "_" << id << path.extension().string();
+    return (path.parent_path() / filename.str()).string();
+}
+
+void MultiSensorRecorder::openOutput(OutputFile& file, const std::string& outputFilename) {
+    try {
+        filesystem::remove(outputFilename.c_str());
+        filesystem::remove((outputFilename + SCAN_INDEX_EXTENSION).c_str());
+        filesystem::remove((outputFilename + GAP_EXTENSION).c_str());
+        filesystem::remove((outputFilename + HEIGHTMAP_EXTENSION).c_str());
+    } catch (filesystem::filesystem_error &err) {
+        std::cerr << "<< Unable to overwrite '" << outputFilename << ",' appending >>" << std::endl;
+    }
+    if (!file.open(outputFilename)) {
+        std::cerr << "<< Unable to open/write to output file '" << outputFilename << "', aborting >>" << std::endl;
+        throw std::runtime_error("Unable to write to output");
+    }
+}
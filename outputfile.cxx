@@ -0,0 +1,59 @@
+#include "outputfile.h"
+
+bool OutputFile::open(const std::string& filename) {
+    close();
+    failed = false;
+    written = 0;
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    return fd >= 0;
+}
+
+bool OutputFile::write(const char* data, size_t length) {
+    if (fd < 0) {
+        failed = true;
+        return false;
+    }
+    while (length > 0) {
+        ssize_t count = ::write(fd, data, length);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = true;
+            return false;
+        }
+        data += count;
+        length -= count;
+        written += count;
+    }
+    return true;
+}
+
+bool OutputFile::reserve(unsigned long long bytes) {
+    if (fd < 0 || bytes == 0) {
+        return false;
+    }
+    off_t end = lseek(fd, 0, SEEK_END);
+    if (end < 0 || fallocate(fd, FALLOC_FL_KEEP_SIZE, end, bytes) != 0) {
+        return false;
+    }
+    reserved = true;
+    return true;
+}
+
+void OutputFile::close() {
+    if (fd >= 0) {
+        if (reserved) {
+            // Truncating to the current size frees the blocks reserved past it
+            off_t end = lseek(fd, 0, SEEK_END);
+            if (end < 0 || ftruncate(fd, end) != 0) {
+                failed = true;
+            }
+            reserved = false;
+        }
+        if (::close(fd) != 0) {
+            failed = true;
+        }
+        fd = -1;
+    }
+}
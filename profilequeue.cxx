@@ -0,0 +1,57 @@
+#include "profilequeue.h"
+
+ProfileQueue::ProfileQueue(size_t depth):
+profiles(depth), available(depth), pending(depth), received(0), dropped(0), timeouts(0) {
+    for (size_t i=0; i<profiles.size(); i++) {
+        available.push(&profiles[i]);
+    }
+}
+
+Profile* ProfileQueue::acquire() {
+    Profile* profile = NULL;
+    if (!available.pop(profile)) {
+        dropped.fetch_add(1, boost::memory_order_relaxed);
+        return NULL;
+    }
+    return profile;
+}
+
+void ProfileQueue::submit(Profile* profile) {
+    received.fetch_add(1, boost::memory_order_relaxed);
+    // Can't fail - the pending ring is as deep as the pool
+    pending.push(profile);
+}
+
+void ProfileQueue::receive(ProfileSource& source, const boost::atomic<bool>* stop) {
+    try {
+        while(!source.finished() && (stop == NULL || !stop->load(boost::memory_order_relaxed))) {
+            boost::this_thread::interruption_point();
+            receiveBatch(source);
+        }
+    } catch (boost::thread_interrupted &err) {
+    }
+}
+
+// Doesn't allocate once the source's batch pool and the Profiles have been used
+unsigned int ProfileQueue::receiveBatch(ProfileSource& source) {
+    Go2UInt64 waitStart = monotonicNanoseconds();
+    unsigned int itemCount = source.receive(RECEIVE_TIMEOUT);
+    if (itemCount == 0) {
+        timeouts.store(timeouts.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+        return 0;
+    }
+    waits.record(monotonicNanoseconds() - waitStart);
+    batches.record(itemCount);
+    // Disable thread interruption
+    boost::this_thread::disable_interruption di;
+    for (unsigned int j=0; j<itemCount; j++) {
+        Profile* profile = acquire();
+        if (profile == NULL) {
+            continue;
+        }
+        source.profileAt(j, *profile);
+        submit(profile);
+    }
+    source.release();
+    return itemCount;
+}
@@ -0,0 +1,219 @@
+#include "profilereducer.h"
+
+static const short invalidRange = static_cast<short>(INVALID_RANGE_16BIT);
+
+void ProfileReducer::reset(const ReductionSettings& reductionSettings) {
+    settings = reductionSettings;
+    settings.xStep = std::max(1u, settings.xStep);
+    settings.yStep = std::max(1u, settings.yStep);
+    merged = skipped = pointsIn = pointsOut = sequence = 0;
+    held = ready = false;
+}
+
+bool ProfileReducer::enabled() const {
+    return settings.xLow < settings.xHigh || settings.zLow < settings.zHigh || settings.xStep > 1 ||
+           settings.yStep > 1 || settings.mergeDuplicates;
+}
+
+void ProfileReducer::add(const Profile& profile) {
+    crop(profile, cropped);
+    if (!settings.mergeDuplicates) {
+        release(cropped);
+        return;
+    }
+    if (held && cropped.encoder == pending.encoder && sameGeometry(cropped, pending)) {
+        merge(cropped);
+        return;
+    }
+    if (held) {
+        finish();
+    }
+    startMerge(cropped);
+}
+
+void ProfileReducer::finish() {
+    if (!held) {
+        return;
+    }
+    held = false;
+    if (mergedProfiles > 1) {
+        // Halves round away from zero
+        for (size_t i=0; i<sums.size(); i++) {
+            Go2Int64 count = counts[i];
+            if (count == 0) {
+                pending.ranges[i] = invalidRange;
+            } else if (sums[i] >= 0) {
+                pending.ranges[i] = static_cast<short>((sums[i] + count/2)/count);
+            } else {
+                pending.ranges[i] = static_cast<short>(-((-sums[i] + count/2)/count));
+            }
+        }
+    }
+    release(pending);
+}
+
+const Profile* ProfileReducer::next() {
+    if (!ready) {
+        return NULL;
+    }
+    ready = false;
+    return &output;
+}
+
+// Copies the points inside the X and Z windows at the X step, comparing raw values only
+void ProfileReducer::crop(const Profile& profile, Profile& reduced) {
+    const short* ranges = profile.rangeData();
+    size_t width = profile.width();
+    pointsIn += width;
+    size_t first = 0, last = width;
+    if (settings.xLow < settings.xHigh && profile.xResolution > 0) {
+        double low = std::ceil((settings.xLow - profile.xOffset)/profile.xResolution);
+        double high = std::floor((settings.xHigh - profile.xOffset)/profile.xResolution);
+        first = low <= 0 ? 0 : static_cast<size_t>(std::min(low, static_cast<double>(width)));
+        last = high < 0 ? 0 : static_cast<size_t>(std::min(high + 1, static_cast<double>(width)));
+    }
+    size_t step = settings.xStep;
+    first = (first + step - 1)/step*step;
+    short zLow = -32767, zHigh = 32767;
+    bool zWindow = settings.zLow < settings.zHigh && profile.zResolution != 0;
+    if (zWindow) {
+        // Same window in raw units as RangeFilter's, so a missing range is never counted
+        double low = (settings.zLow - profile.zOffset)/profile.zResolution;
+        double high = (settings.zHigh - profile.zOffset)/profile.zResolution;
+        if (low > high) {
+            std::swap(low, high);
+        }
+        low = std::max(std::ceil(low), -32767.0);
+        high = std::min(std::floor(high), 32767.0);
+        if (low > 32767.0 || high < -32767.0) {
+            low = 32767.0;
+            high = -32767.0;
+        }
+        zLow = static_cast<short>(low);
+        zHigh = static_cast<short>(high);
+    }
+    reduced.release();
+    reduced.encoder = profile.encoder;
+    reduced.timestamp = profile.timestamp;
+    reduced.xOffset = profile.xOffset + first*profile.xResolution;
+    reduced.xResolution = profile.xResolution*step;
+    reduced.zOffset = profile.zOffset;
+    reduced.zResolution = profile.zResolution;
+    size_t kept = first < last ? (last - first + step - 1)/step : 0;
+    reduced.ranges.resize(kept);
+    if (kept == 0) {
+        return;
+    }
+    short* out = &reduced.ranges[0];
+    if (zWindow) {
+        for (size_t i=first, j=0; j<kept; i+=step, j++) {
+            short range = ranges[i];
+            out[j] = (range < zLow || range > zHigh) ? invalidRange : range;
+        }
+    } else if (step == 1) {
+        std::copy(ranges + first, ranges + last, out);
+    } else {
+        for (size_t i=first, j=0; j<kept; i+=step, j++) {
+            out[j] = ranges[i];
+        }
+    }
+}
+
+void ProfileReducer::startMerge(const Profile& profile) {
+    pending.ranges.swap(cropped.ranges);
+    pending.encoder = profile.encoder;
+    pending.timestamp = profile.timestamp;
+    pending.xOffset = profile.xOffset;
+    pending.xResolution = profile.xResolution;
+    pending.zOffset = profile.zOffset;
+    pending.zResolution = profile.zResolution;
+    mergedProfiles = 1;
+    held = true;
+}
+
+// Folds another profile with the pending one's encoder count into the totals
+void ProfileReducer::merge(const Profile& profile) {
+    size_t width = pending.ranges.size();
+    if (mergedProfiles == 1) {
+        sums.assign(width, 0);
+        counts.assign(width, 0);
+        for (size_t i=0; i<width; i++) {
+            if (pending.ranges[i] != invalidRange) {
+                sums[i] = pending.ranges[i];
+                counts[i] = 1;
+            }
+        }
+    }
+    for (size_t i=0; i<width; i++) {
+        short range = profile.ranges[i];
+        if (range != invalidRange) {
+            sums[i] += range;
+            counts[i]++;
+        }
+    }
+    mergedProfiles++;
+    merged++;
+}
+
+// Passes the profile on unless the Y step skips it
+void ProfileReducer::release(Profile& profile) {
+    if (sequence++ % settings.yStep != 0) {
+        skipped++;
+        return;
+    }
+    pointsOut += profile.ranges.size();
+    output.ranges.swap(profile.ranges);
+    output.encoder = profile.encoder;
+    output.timestamp = profile.timestamp;
+    output.xOffset = profile.xOffset;
+    output.xResolution = profile.xResolution;
+    output.zOffset = profile.zOffset;
+    output.zResolution = profile.zResolution;
+    ready = true;
+}
+
+bool ProfileReducer::sameGeometry(const Profile& a, const Profile& b) {
+    return a.width() == b.width() && a.xOffset == b.xOffset && a.xResolution == b.xResolution &&
+           a.zOffset == b.zOffset && a.zResolution == b.zResolution;
+}
+
+// "2" -> "2nd", "3" -> "3rd", "11" -> "11th"
+static std::string ordinal(unsigned int n) {
+    const char* suffix = "th";
+    if (n % 100 < 11 || n % 100 > 13) {
+        switch (n % 10) {
+            case 1: suffix = "st"; break;
+            case 2: suffix = "nd"; break;
+            case 3: suffix = "rd"; break;
+        }
+    }
+    std::ostringstream text;
+    text << n << suffix;
+    return text.str();
+}
+
+std::string ProfileReducer::describe() const {
+    std::ostringstream description;
+    description << "reduced:";
+    const char* separator = " ";
+    if (settings.xLow < settings.xHigh) {
+        description << separator << "X " << settings.xLow << " to " << settings.xHigh << " mm";
+        separator = ", ";
+    }
+    if (settings.zLow < settings.zHigh) {
+        description << separator << "Z " << settings.zLow << " to " << settings.zHigh << " mm";
+        separator = ", ";
+    }
+    if (settings.xStep > 1) {
+        description << separator << "every " << ordinal(settings.xStep) << " point";
+        separator = ", ";
+    }
+    if (settings.mergeDuplicates) {
+        description << separator << "repeated encoder counts merged";
+        separator = ", ";
+    }
+    if (settings.yStep > 1) {
+        description << separator << "every " << ordinal(settings.yStep) << " profile";
+    }
+    return description.str();
+}
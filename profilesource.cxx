@@ -0,0 +1,236 @@
+#include "profilesource.h"
+
+#define SYNTHETIC_BATCH 16 // Most generated profiles handed over per receive
+
+// Sleeps for the specified number of microseconds
+static void pause(Go2UInt64 microseconds) {
+    boost::this_thread::sleep(boost::posix_time::microseconds(microseconds));
+}
+
+void ReceivedBatchPool::clear(DataBatch& batch) {
+    if (batch.data != GO2_NULL) {
+        if (Go2Data_Destroy(batch.data) != GO2_OK) {
+            std::cerr << "<< Unable to free received data >>" << std::endl;
+        }
+        batch.data = GO2_NULL;
+    }
+}
+
+// Starts the sensor and connects to its data channel
+void LiveProfileSource::start() {
+    std::string StartResponse = getResponseString("Go2System_Start",Go2System_Start(sys));
+    if (verbose) {
+        std::cout << StartResponse << std::endl;
+    }
+    Go2Status returnCode = Go2System_ConnectData(sys, GO2_NULL, GO2_NULL);
+    if (verbose) {
+        std::cout << getResponseString("Go2System_ConnectData", returnCode) << std::endl;
+    }
+    if (returnCode != GO2_OK) {
+        std::cerr << "\n<< Initialization failed, aborting >>" << std::endl;
+        throw std::runtime_error("Gocator 20x0 initialization failed");
+    }
+}
+
+void LiveProfileSource::stop() {
+    release();
+    std::string StopResponse = getResponseString("Go2System_Stop", Go2System_Stop(sys));
+    if (verbose) {
+        std::cout << StopResponse << std::endl;
+    }
+}
+
+unsigned int LiveProfileSource::receive(Go2UInt64 timeout) {
+    release();
+    if (Go2System_ReceiveData(sys, timeout, &data) != GO2_OK) {
+        data = GO2_NULL;
+        return 0;
+    }
+    // When the sensor captured the frame, so network and receive jitter don't look like lost frames
+    timestamp = Go2Data_Timestamp(data);
+    // number of ticks of encoder
+    encoderCounter = Go2Data_Encoder(data);
+    // The pool destroys the batch from here on
+    batch = pool.acquire();
+    if (!batch.empty()) {
+        batch.get()->data = data;
+    }
+    return Go2Data_ItemCount(data);
+}
+
+void LiveProfileSource::profileAt(unsigned int index, Profile& profile) {
+    Go2ProfileData dataItem = Go2Data_ItemAt(data, index);
+    short* profileData = Go2ProfileData_Ranges(dataItem);
+    unsigned int profilePointCount = Go2ProfileData_Width(dataItem);
+    profile.encoder = encoderCounter;
+    profile.timestamp = timestamp;
+    profile.xResolution = Go2ProfileData_XResolution(dataItem);
+    profile.zResolution = Go2ProfileData_ZResolution(dataItem);
+    profile.xOffset = Go2ProfileData_XOffset(dataItem);
+    profile.zOffset = Go2ProfileData_ZOffset(dataItem);
+    if (batch.empty()) {
+        profile.release();
+        profile.ranges.assign(profileData, profileData+profilePointCount);
+    } else {
+        profile.borrow(batch, profileData, profilePointCount);
+    }
+}
+
+// Done with the current batch - it's freed (once) when its profiles are too
+void LiveProfileSource::release() {
+    if (!batch.empty()) {
+        batch.reset();
+    } else if (data != GO2_NULL) {
+        Go2Status freeDataStatus = Go2Data_Destroy(data);
+        if (verbose) {
+            std::cout << getResponseString("Go2Data_Destroy", freeDataStatus) << std::endl;
+        }
+    }
+    data = GO2_NULL;
+}
+
+ReplayProfileSource::ReplayProfileSource(const std::string& filename, double speed):
+reader(filename), replaySpeed(speed), exhausted(false), replayStart(0), firstTimestamp(0) {}
+
+void ReplayProfileSource::start() {
+    exhausted = !reader.next(nextProfile);
+    firstTimestamp = nextProfile.timestamp;
+    replayStart = monotonicMicroseconds();
+}
+
+// Hands over the next recorded profile once it is due
+unsigned int ReplayProfileSource::receive(Go2UInt64 timeout) {
+    if (exhausted) {
+        return 0;
+    }
+    if (replaySpeed > 0 && nextProfile.timestamp > firstTimestamp) {
+        Go2UInt64 due = replayStart + static_cast<Go2UInt64>((nextProfile.timestamp-firstTimestamp)/replaySpeed);
+        Go2UInt64 now = monotonicMicroseconds();
+        if (due > now) {
+            if (due-now > timeout) {
+                pause(timeout);
+                return 0;
+            }
+            pause(due-now);
+        }
+    }
+    return 1;
+}
+
+void ReplayProfileSource::profileAt(unsigned int index, Profile& profile) {
+    profile = nextProfile;
+    exhausted = !reader.next(nextProfile);
+}
+
+SyntheticProfileSource::SyntheticProfileSource(const SyntheticSettings& syntheticSettings):
+settings(syntheticSettings), generated(0), batchStart(0), startTime(0), lost(0) {
+    if (settings.invalidRatio < 0) {
+        settings.invalidRatio = 0;
+    } else if (settings.invalidRatio > 1) {
+        settings.invalidRatio = 1;
+    }
+    invalidThreshold = static_cast<Go2UInt32>(settings.invalidRatio*0xFFFF);
+    // Losing every frame would never produce a profile
+    if (settings.lostRatio < 0) {
+        settings.lostRatio = 0;
+    } else if (settings.lostRatio > 0.5) {
+        settings.lostRatio = 0.5;
+    }
+    lostThreshold = static_cast<Go2UInt32>(settings.lostRatio*0xFFFF);
+}
+
+void SyntheticProfileSource::start() {
+    generated = 0;
+    lost = 0;
+    startTime = monotonicMicroseconds();
+}
+
+// Hands over every profile that is due at the configured frame rate
+unsigned int SyntheticProfileSource::receive(Go2UInt64 timeout) {
+    if (finished()) {
+        return 0;
+    }
+    Go2UInt64 due = SYNTHETIC_BATCH;
+    if (settings.frameRate > 0) {
+        Go2UInt64 elapsed = monotonicMicroseconds() - startTime;
+        Go2UInt64 produced = static_cast<Go2UInt64>(elapsed*settings.frameRate/1e6) + 1;
+        if (produced <= generated) {
+            Go2UInt64 nextDue = static_cast<Go2UInt64>(generated*1e6/settings.frameRate);
+            Go2UInt64 wait = nextDue > elapsed ? nextDue-elapsed : 0;
+            pause(wait < timeout ? wait : timeout);
+            if (wait > timeout) {
+                return 0;
+            }
+            produced = generated + 1;
+        }
+        due = produced - generated;
+    }
+    if (due > SYNTHETIC_BATCH) {
+        due = SYNTHETIC_BATCH;
+    }
+    if (settings.profileCount > 0 && generated+due > settings.profileCount) {
+        due = settings.profileCount - generated;
+    }
+    batchStart = generated;
+    generated += due;
+    batch = pool.acquire();
+    if (!batch.empty()) {
+        // Sized for a full batch every time so the buffer is only allocated once
+        batch.get()->ranges.resize(SYNTHETIC_BATCH*settings.width);
+    }
+    return static_cast<unsigned int>(due);
+}
+
+// Cheap integer hash of a frame number, decides which frames are lost
+static Go2UInt32 frameHash(Go2UInt64 frame) {
+    Go2UInt32 hash = static_cast<Go2UInt32>(frame*2246822519u) ^ 0x5bd1e995u;
+    hash ^= hash >> 15;
+    hash *= 2654435761u;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+// Builds a profile of a slowly drifting wave with a raised step in the middle
+void SyntheticProfileSource::profileAt(unsigned int index, Profile& profile) {
+    Go2UInt64 number = batchStart + index + lost;
+    // Lost frames still advance the encoder and the clock
+    while (lostThreshold > 0 && (frameHash(number) & 0xFFFF) < lostThreshold) {
+        lost++;
+        number++;
+    }
+    unsigned int width = settings.width;
+    profile.encoder = static_cast<Go2Int64>(number)*settings.encoderStep;
+    if (settings.frameRate > 0) {
+        profile.timestamp = startTime + static_cast<Go2UInt64>(number*1e6/settings.frameRate);
+    } else {
+        profile.timestamp = monotonicMicroseconds();
+    }
+    profile.xResolution = 0.02;
+    profile.xOffset = -0.5*width*profile.xResolution;
+    profile.zResolution = 0.001;
+    profile.zOffset = 20.0;
+    short* ranges;
+    if (batch.empty()) {
+        profile.release();
+        profile.ranges.resize(width);
+        ranges = width > 0 ? &profile.ranges[0] : NULL;
+    } else {
+        ranges = width > 0 ? &batch.get()->ranges[index*width] : NULL;
+        profile.borrow(batch, ranges, width);
+    }
+    int drift = static_cast<int>(number % 2000) - 1000;
+    for (unsigned int i=0; i<width; i++) {
+        // Cheap integer hash of (profile, point) decides the dropouts
+        Go2UInt32 hash = static_cast<Go2UInt32>(number*2654435761u) ^ (i*2246822519u);
+        hash ^= hash >> 15;
+        hash *= 2654435761u;
+        hash ^= hash >> 13;
+        if ((hash & 0xFFFF) < invalidThreshold) {
+            ranges[i] = static_cast<short>(INVALID_RANGE_16BIT);
+        } else {
+            int triangle = static_cast<int>(i % 256) - 128;
+            int step = (i > width/3 && i < 2*width/3) ? 4000 : 0;
+            ranges[i] = static_cast<short>(triangle*40 + step + drift);
+        }
+    }
+}
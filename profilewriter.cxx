@@ -0,0 +1,17 @@
+#include "profilewriter.h"
+#include "csvwriter.h"
+#include "scanformat.h"
+#include "compressedscan.h"
+
+// Returns a new writer for the requested output format
+ProfileWriter* createProfileWriter(const OutputSettings& settings) {
+    switch (settings.format) {
+        case BINARY:
+            return new BinaryProfileWriter();
+        case COMPRESSED:
+            return new CompressedProfileWriter();
+        case CSV:
+        default:
+            return new CsvWriter(settings.xPrecision, settings.yPrecision, settings.zPrecision);
+    }
+}
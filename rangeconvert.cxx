@@ -0,0 +1,234 @@
+#include "rangeconvert.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#define COMPACT_CHUNK 256 // Points converted per pass when compacting
+
+static const short invalidRange = static_cast<short>(INVALID_RANGE_16BIT);
+
+// Reference loop, also used for whatever is left over after the vector loops.
+// begin must be a multiple of 8 so it starts a fresh mask byte.
+template<typename T>
+static void convertScalar(const short* ranges, unsigned int begin, unsigned int count, unsigned int first,
+                          T xOffset, T xResolution, T zOffset, T zResolution,
+                          T* x, T* z, unsigned char* valid) {
+    for (unsigned int i=begin; i<count; i++) {
+        if (i%8 == 0) {
+            valid[i/8] = 0;
+        }
+        x[i] = xOffset + xResolution*static_cast<T>(first+i);
+        z[i] = zOffset + zResolution*static_cast<T>(ranges[i]);
+        valid[i/8] |= static_cast<unsigned char>((ranges[i] != invalidRange) << (i%8));
+    }
+}
+
+// Validity bits for 8 ranges
+static inline unsigned char validMask(__m128i ranges) {
+    __m128i invalid = _mm_cmpeq_epi16(ranges, _mm_set1_epi16(invalidRange));
+    return static_cast<unsigned char>(~_mm_movemask_epi8(_mm_packs_epi16(invalid, invalid)) & 0xFF);
+}
+
+// The vector kernels convert 8 points per iteration and return how many
+// points they handled; the caller finishes the rest with convertScalar.
+static unsigned int convertSse2(const short* ranges, unsigned int count, unsigned int first,
+                                double xOffset, double xResolution, double zOffset, double zResolution,
+                                double* x, double* z, unsigned char* valid) {
+    const __m128d xo = _mm_set1_pd(xOffset), xr = _mm_set1_pd(xResolution);
+    const __m128d zo = _mm_set1_pd(zOffset), zr = _mm_set1_pd(zResolution);
+    const __m128d two = _mm_set1_pd(2.0);
+    __m128d index = _mm_set_pd(first+1.0, first+0.0);
+    unsigned int i = 0;
+    for (; i+8<=count; i+=8) {
+        __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges+i));
+        valid[i/8] = validMask(r);
+        // Sign-extend to 32 bits
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(r, r), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(r, r), 16);
+        __m128d r0 = _mm_cvtepi32_pd(lo);
+        __m128d r1 = _mm_cvtepi32_pd(_mm_shuffle_epi32(lo, _MM_SHUFFLE(1,0,3,2)));
+        __m128d r2 = _mm_cvtepi32_pd(hi);
+        __m128d r3 = _mm_cvtepi32_pd(_mm_shuffle_epi32(hi, _MM_SHUFFLE(1,0,3,2)));
+        _mm_storeu_pd(z+i, _mm_add_pd(zo, _mm_mul_pd(zr, r0)));
+        _mm_storeu_pd(z+i+2, _mm_add_pd(zo, _mm_mul_pd(zr, r1)));
+        _mm_storeu_pd(z+i+4, _mm_add_pd(zo, _mm_mul_pd(zr, r2)));
+        _mm_storeu_pd(z+i+6, _mm_add_pd(zo, _mm_mul_pd(zr, r3)));
+        for (unsigned int k=0; k<8; k+=2) {
+            _mm_storeu_pd(x+i+k, _mm_add_pd(xo, _mm_mul_pd(xr, index)));
+            index = _mm_add_pd(index, two);
+        }
+    }
+    return i;
+}
+
+static unsigned int convertSse2(const short* ranges, unsigned int count, unsigned int first,
+                                float xOffset, float xResolution, float zOffset, float zResolution,
+                                float* x, float* z, unsigned char* valid) {
+    const __m128 xo = _mm_set1_ps(xOffset), xr = _mm_set1_ps(xResolution);
+    const __m128 zo = _mm_set1_ps(zOffset), zr = _mm_set1_ps(zResolution);
+    const __m128i four = _mm_set1_epi32(4);
+    __m128i index = _mm_add_epi32(_mm_set1_epi32(first), _mm_set_epi32(3, 2, 1, 0));
+    unsigned int i = 0;
+    for (; i+8<=count; i+=8) {
+        __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges+i));
+        valid[i/8] = validMask(r);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(r, r), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(r, r), 16);
+        _mm_storeu_ps(z+i, _mm_add_ps(zo, _mm_mul_ps(zr, _mm_cvtepi32_ps(lo))));
+        _mm_storeu_ps(z+i+4, _mm_add_ps(zo, _mm_mul_ps(zr, _mm_cvtepi32_ps(hi))));
+        _mm_storeu_ps(x+i, _mm_add_ps(xo, _mm_mul_ps(xr, _mm_cvtepi32_ps(index))));
+        index = _mm_add_epi32(index, four);
+        _mm_storeu_ps(x+i+4, _mm_add_ps(xo, _mm_mul_ps(xr, _mm_cvtepi32_ps(index))));
+        index = _mm_add_epi32(index, four);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int convertAvx2(const short* ranges, unsigned int count, unsigned int first,
+                                double xOffset, double xResolution, double zOffset, double zResolution,
+                                double* x, double* z, unsigned char* valid) {
+    const __m256d xo = _mm256_set1_pd(xOffset), xr = _mm256_set1_pd(xResolution);
+    const __m256d zo = _mm256_set1_pd(zOffset), zr = _mm256_set1_pd(zResolution);
+    const __m256d four = _mm256_set1_pd(4.0);
+    __m256d index = _mm256_set_pd(first+3.0, first+2.0, first+1.0, first+0.0);
+    unsigned int i = 0;
+    for (; i+8<=count; i+=8) {
+        __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges+i));
+        valid[i/8] = validMask(r);
+        __m256i wide = _mm256_cvtepi16_epi32(r);
+        __m256d r0 = _mm256_cvtepi32_pd(_mm256_castsi256_si128(wide));
+        __m256d r1 = _mm256_cvtepi32_pd(_mm256_extracti128_si256(wide, 1));
+        _mm256_storeu_pd(z+i, _mm256_add_pd(zo, _mm256_mul_pd(zr, r0)));
+        _mm256_storeu_pd(z+i+4, _mm256_add_pd(zo, _mm256_mul_pd(zr, r1)));
+        _mm256_storeu_pd(x+i, _mm256_add_pd(xo, _mm256_mul_pd(xr, index)));
+        index = _mm256_add_pd(index, four);
+        _mm256_storeu_pd(x+i+4, _mm256_add_pd(xo, _mm256_mul_pd(xr, index)));
+        index = _mm256_add_pd(index, four);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int convertAvx2(const short* ranges, unsigned int count, unsigned int first,
+                                float xOffset, float xResolution, float zOffset, float zResolution,
+                                float* x, float* z, unsigned char* valid) {
+    const __m256 xo = _mm256_set1_ps(xOffset), xr = _mm256_set1_ps(xResolution);
+    const __m256 zo = _mm256_set1_ps(zOffset), zr = _mm256_set1_ps(zResolution);
+    const __m256i eight = _mm256_set1_epi32(8);
+    __m256i index = _mm256_add_epi32(_mm256_set1_epi32(first), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    unsigned int i = 0;
+    for (; i+8<=count; i+=8) {
+        __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges+i));
+        valid[i/8] = validMask(r);
+        __m256 wide = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(r));
+        _mm256_storeu_ps(z+i, _mm256_add_ps(zo, _mm256_mul_ps(zr, wide)));
+        _mm256_storeu_ps(x+i, _mm256_add_ps(xo, _mm256_mul_ps(xr, _mm256_cvtepi32_ps(index))));
+        index = _mm256_add_epi32(index, eight);
+    }
+    return i;
+}
+
+static ConversionPath detectConversionPath() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2_PATH;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SSE2_PATH;
+    }
+    return SCALAR_PATH;
+}
+
+ConversionPath bestConversionPath() {
+    static const ConversionPath best = detectConversionPath();
+    return best;
+}
+
+static ConversionPath& activeConversionPath() {
+    static ConversionPath active = bestConversionPath();
+    return active;
+}
+
+void useConversionPath(ConversionPath path) {
+    activeConversionPath() = path > bestConversionPath() ? bestConversionPath() : path;
+}
+
+ConversionPath currentConversionPath() {
+    return activeConversionPath();
+}
+
+const char* conversionPathName(ConversionPath path) {
+    switch (path) {
+        case AVX2_PATH:
+            return "AVX2";
+        case SSE2_PATH:
+            return "SSE2";
+        case SCALAR_PATH:
+        default:
+            return "scalar";
+    }
+}
+
+// Runs the active kernel over [0, count), x indices starting at first
+template<typename T>
+static void convertBlock(const short* ranges, unsigned int count, unsigned int first,
+                         T xOffset, T xResolution, T zOffset, T zResolution,
+                         T* x, T* z, unsigned char* valid) {
+    unsigned int done = 0;
+    switch (activeConversionPath()) {
+        case AVX2_PATH:
+            done = convertAvx2(ranges, count, first, xOffset, xResolution, zOffset, zResolution, x, z, valid);
+            break;
+        case SSE2_PATH:
+            done = convertSse2(ranges, count, first, xOffset, xResolution, zOffset, zResolution, x, z, valid);
+            break;
+        case SCALAR_PATH:
+        default:
+            break;
+    }
+    convertScalar(ranges, done, count, first, xOffset, xResolution, zOffset, zResolution, x, z, valid);
+}
+
+// Converts a chunk at a time and packs the valid points down without branching
+template<typename T>
+static unsigned int compactBlock(const short* ranges, unsigned int count,
+                                 T xOffset, T xResolution, T zOffset, T zResolution, T* x, T* z) {
+    T chunkX[COMPACT_CHUNK], chunkZ[COMPACT_CHUNK];
+    unsigned char valid[COMPACT_CHUNK/8];
+    unsigned int written = 0;
+    for (unsigned int start=0; start<count; start+=COMPACT_CHUNK) {
+        unsigned int chunk = count-start < COMPACT_CHUNK ? count-start : COMPACT_CHUNK;
+        convertBlock(ranges+start, chunk, start, xOffset, xResolution, zOffset, zResolution, chunkX, chunkZ, valid);
+        for (unsigned int k=0; k<chunk; k++) {
+            // Always store, only advance past valid points (written <= start+k < count)
+            x[written] = chunkX[k];
+            z[written] = chunkZ[k];
+            written += (valid[k/8] >> (k%8)) & 1;
+        }
+    }
+    return written;
+}
+
+void convertRanges(const short* ranges, unsigned int count,
+                   double xOffset, double xResolution, double zOffset, double zResolution,
+                   double* x, double* z, unsigned char* valid) {
+    convertBlock(ranges, count, 0, xOffset, xResolution, zOffset, zResolution, x, z, valid);
+}
+
+void convertRanges(const short* ranges, unsigned int count,
+                   float xOffset, float xResolution, float zOffset, float zResolution,
+                   float* x, float* z, unsigned char* valid) {
+    convertBlock(ranges, count, 0, xOffset, xResolution, zOffset, zResolution, x, z, valid);
+}
+
+unsigned int compactRanges(const short* ranges, unsigned int count,
+                           double xOffset, double xResolution, double zOffset, double zResolution,
+                           double* x, double* z) {
+    return compactBlock(ranges, count, xOffset, xResolution, zOffset, zResolution, x, z);
+}
+
+unsigned int compactRanges(const short* ranges, unsigned int count,
+                           float xOffset, float xResolution, float zOffset, float zResolution,
+                           float* x, float* z) {
+    return compactBlock(ranges, count, xOffset, xResolution, zOffset, zResolution, x, z);
+}
@@ -0,0 +1,636 @@
+#include "rangefilter.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+
+static const short invalidRange = static_cast<short>(INVALID_RANGE_16BIT);
+
+// Running totals over each point's window, as hi minus lo so smoothing along
+// X can pass prefix sums and smoothing along Y running totals (lo all zero)
+typedef struct windowTotals {
+    const double* sumHi;
+    const double* sumLo;
+    const double* squaresHi;
+    const double* squaresLo;
+    const double* countHi;
+    const double* countLo;
+} WindowTotals;
+
+// The kernels below come in scalar, SSE2 and AVX2 flavours like the ones in
+// rangeconvert.cxx: the vector versions return how many points they handled
+// and the scalar loop finishes the rest.
+
+// Drops valid ranges outside [low, high], returns how many
+static unsigned int rejectScalar(short* ranges, unsigned int begin, unsigned int count, short low, short high) {
+    unsigned int dropped = 0;
+    for (unsigned int i=begin; i<count; i++) {
+        short range = ranges[i];
+        if (range != invalidRange && (range < low || range > high)) {
+            ranges[i] = invalidRange;
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+static unsigned int rejectSse2(short* ranges, unsigned int count, short low, short high, unsigned int& dropped) {
+    const __m128i lo = _mm_set1_epi16(low), hi = _mm_set1_epi16(high), invalid = _mm_set1_epi16(invalidRange);
+    unsigned int i = 0;
+    for (; i+8<=count; i+=8) {
+        __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges+i));
+        __m128i outside = _mm_or_si128(_mm_cmpgt_epi16(lo, r), _mm_cmpgt_epi16(r, hi));
+        outside = _mm_andnot_si128(_mm_cmpeq_epi16(r, invalid), outside);
+        dropped += __builtin_popcount(_mm_movemask_epi8(outside))/2;
+        r = _mm_or_si128(_mm_andnot_si128(outside, r), _mm_and_si128(outside, invalid));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ranges+i), r);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int rejectAvx2(short* ranges, unsigned int count, short low, short high, unsigned int& dropped) {
+    const __m256i lo = _mm256_set1_epi16(low), hi = _mm256_set1_epi16(high), invalid = _mm256_set1_epi16(invalidRange);
+    unsigned int i = 0;
+    for (; i+16<=count; i+=16) {
+        __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ranges+i));
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi16(lo, r), _mm256_cmpgt_epi16(r, hi));
+        outside = _mm256_andnot_si256(_mm256_cmpeq_epi16(r, invalid), outside);
+        dropped += __builtin_popcount(static_cast<unsigned int>(_mm256_movemask_epi8(outside)))/2;
+        r = _mm256_blendv_epi8(r, invalid, outside);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(ranges+i), r);
+    }
+    return i;
+}
+
+static unsigned int rejectRanges(short* ranges, unsigned int count, short low, short high) {
+    unsigned int done = 0, dropped = 0;
+    switch (currentConversionPath()) {
+        case AVX2_PATH:
+            done = rejectAvx2(ranges, count, low, high, dropped);
+            break;
+        case SSE2_PATH:
+            done = rejectSse2(ranges, count, low, high, dropped);
+            break;
+        case SCALAR_PATH:
+        default:
+            break;
+    }
+    return dropped + rejectScalar(ranges, done, count, low, high);
+}
+
+// Lower median of the valid ranges in each column of k rows, missing
+// wherever the centre point is.  The centre is one of the rows, so there is
+// always at least one valid range to take.
+static void medianScalar(const short* const* rows, unsigned int k, const short* center, short* out,
+                         unsigned int begin, unsigned int count) {
+    short values[FILTER_MAX_WINDOW];
+    for (unsigned int i=begin; i<count; i++) {
+        if (center[i] == invalidRange) {
+            out[i] = invalidRange;
+            continue;
+        }
+        unsigned int n = 0;
+        for (unsigned int j=0; j<k; j++) {
+            short range = rows[j][i];
+            if (range != invalidRange) {
+                values[n++] = range;
+            }
+        }
+        std::nth_element(values, values + (n-1)/2, values + n);
+        out[i] = values[(n-1)/2];
+    }
+}
+
+// The vector versions sort each column with an odd-even transposition
+// network.  Missing ranges are the lowest possible value so they sort to the
+// front, and the median of the valid ones is picked out lane by lane at
+// missing + (valid-1)/2.
+static unsigned int medianSse2(const short* const* rows, unsigned int k, const short* center, short* out,
+                               unsigned int count) {
+    __m128i v[FILTER_MAX_WINDOW];
+    const __m128i invalid = _mm_set1_epi16(invalidRange), one = _mm_set1_epi16(1);
+    const __m128i total = _mm_set1_epi16(static_cast<short>(k));
+    unsigned int i = 0;
+    for (; i+8<=count; i+=8) {
+        __m128i missing = _mm_setzero_si128();
+        for (unsigned int j=0; j<k; j++) {
+            v[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j]+i));
+            missing = _mm_sub_epi16(missing, _mm_cmpeq_epi16(v[j], invalid));
+        }
+        for (unsigned int round=0; round<k; round++) {
+            for (unsigned int j=round&1; j+1<k; j+=2) {
+                __m128i low = _mm_min_epi16(v[j], v[j+1]);
+                v[j+1] = _mm_max_epi16(v[j], v[j+1]);
+                v[j] = low;
+            }
+        }
+        __m128i target = _mm_add_epi16(missing, _mm_srai_epi16(_mm_sub_epi16(_mm_sub_epi16(total, missing), one), 1));
+        __m128i median = invalid;
+        for (unsigned int j=0; j<k; j++) {
+            __m128i here = _mm_cmpeq_epi16(target, _mm_set1_epi16(static_cast<short>(j)));
+            median = _mm_or_si128(_mm_andnot_si128(here, median), _mm_and_si128(here, v[j]));
+        }
+        __m128i gone = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(center+i)), invalid);
+        median = _mm_or_si128(_mm_andnot_si128(gone, median), _mm_and_si128(gone, invalid));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out+i), median);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int medianAvx2(const short* const* rows, unsigned int k, const short* center, short* out,
+                               unsigned int count) {
+    __m256i v[FILTER_MAX_WINDOW];
+    const __m256i invalid = _mm256_set1_epi16(invalidRange), one = _mm256_set1_epi16(1);
+    const __m256i total = _mm256_set1_epi16(static_cast<short>(k));
+    unsigned int i = 0;
+    for (; i+16<=count; i+=16) {
+        __m256i missing = _mm256_setzero_si256();
+        for (unsigned int j=0; j<k; j++) {
+            v[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[j]+i));
+            missing = _mm256_sub_epi16(missing, _mm256_cmpeq_epi16(v[j], invalid));
+        }
+        for (unsigned int round=0; round<k; round++) {
+            for (unsigned int j=round&1; j+1<k; j+=2) {
+                __m256i low = _mm256_min_epi16(v[j], v[j+1]);
+                v[j+1] = _mm256_max_epi16(v[j], v[j+1]);
+                v[j] = low;
+            }
+        }
+        __m256i target = _mm256_add_epi16(missing,
+                                          _mm256_srai_epi16(_mm256_sub_epi16(_mm256_sub_epi16(total, missing), one), 1));
+        __m256i median = invalid;
+        for (unsigned int j=0; j<k; j++) {
+            __m256i here = _mm256_cmpeq_epi16(target, _mm256_set1_epi16(static_cast<short>(j)));
+            median = _mm256_blendv_epi8(median, v[j], here);
+        }
+        __m256i gone = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(center+i)), invalid);
+        median = _mm256_blendv_epi8(median, invalid, gone);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out+i), median);
+    }
+    return i;
+}
+
+static void medianRows(const short* const* rows, unsigned int k, const short* center, short* out, unsigned int count) {
+    unsigned int done = 0;
+    switch (currentConversionPath()) {
+        case AVX2_PATH:
+            done = medianAvx2(rows, k, center, out, count);
+            break;
+        case SSE2_PATH:
+            done = medianSse2(rows, k, center, out, count);
+            break;
+        case SCALAR_PATH:
+        default:
+            break;
+    }
+    medianScalar(rows, k, center, out, done, count);
+}
+
+// Window mean, or with wiener set scipy.signal.wiener's estimate: the mean
+// plus (1 - noise/variance) of the point's difference from it, or just the
+// mean where the local variance is no more than the noise.  Missing points
+// stay missing.  Written out step by step so every path rounds the same way.
+static void smoothScalar(bool wiener, const WindowTotals& totals, const short* center, double noise, short* out,
+                         unsigned int begin, unsigned int count) {
+    for (unsigned int i=begin; i<count; i++) {
+        if (center[i] == invalidRange) {
+            out[i] = invalidRange;
+            continue;
+        }
+        double n = totals.countHi[i] - totals.countLo[i];
+        double mean = (totals.sumHi[i] - totals.sumLo[i])/n;
+        double value = mean;
+        if (wiener) {
+            double variance = (totals.squaresHi[i] - totals.squaresLo[i])/n - mean*mean;
+            if (variance > noise) {
+                double gain = 1.0 - noise/variance;
+                value = mean + gain*(static_cast<double>(center[i]) - mean);
+            }
+        }
+        out[i] = static_cast<short>(lrint(value));
+    }
+}
+
+static inline __m128d smoothPairSse2(bool wiener, const WindowTotals& totals, unsigned int i, __m128d x, __m128d noise) {
+    __m128d n = _mm_sub_pd(_mm_loadu_pd(totals.countHi+i), _mm_loadu_pd(totals.countLo+i));
+    __m128d mean = _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(totals.sumHi+i), _mm_loadu_pd(totals.sumLo+i)), n);
+    if (!wiener) {
+        return mean;
+    }
+    __m128d squares = _mm_sub_pd(_mm_loadu_pd(totals.squaresHi+i), _mm_loadu_pd(totals.squaresLo+i));
+    __m128d variance = _mm_sub_pd(_mm_div_pd(squares, n), _mm_mul_pd(mean, mean));
+    __m128d gain = _mm_sub_pd(_mm_set1_pd(1.0), _mm_div_pd(noise, variance));
+    __m128d value = _mm_add_pd(mean, _mm_mul_pd(gain, _mm_sub_pd(x, mean)));
+    __m128d above = _mm_cmpgt_pd(variance, noise);
+    return _mm_or_pd(_mm_and_pd(above, value), _mm_andnot_pd(above, mean));
+}
+
+static unsigned int smoothSse2(bool wiener, const WindowTotals& totals, const short* center, double noise, short* out,
+                               unsigned int count) {
+    const __m128i invalid = _mm_set1_epi16(invalidRange);
+    const __m128d noiseLevel = _mm_set1_pd(noise);
+    unsigned int i = 0;
+    for (; i+4<=count; i+=4) {
+        __m128i c = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(center+i));
+        __m128i wide = _mm_srai_epi32(_mm_unpacklo_epi16(c, c), 16);
+        __m128d x0 = _mm_cvtepi32_pd(wide);
+        __m128d x1 = _mm_cvtepi32_pd(_mm_shuffle_epi32(wide, _MM_SHUFFLE(1,0,3,2)));
+        __m128i v0 = _mm_cvtpd_epi32(smoothPairSse2(wiener, totals, i, x0, noiseLevel));
+        __m128i v1 = _mm_cvtpd_epi32(smoothPairSse2(wiener, totals, i+2, x1, noiseLevel));
+        __m128i smoothed = _mm_packs_epi32(_mm_unpacklo_epi64(v0, v1), _mm_setzero_si128());
+        __m128i gone = _mm_cmpeq_epi16(c, invalid);
+        smoothed = _mm_or_si128(_mm_andnot_si128(gone, smoothed), _mm_and_si128(gone, invalid));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out+i), smoothed);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int smoothAvx2(bool wiener, const WindowTotals& totals, const short* center, double noise, short* out,
+                               unsigned int count) {
+    const __m128i invalid = _mm_set1_epi16(invalidRange);
+    const __m256d noiseLevel = _mm256_set1_pd(noise), one = _mm256_set1_pd(1.0);
+    unsigned int i = 0;
+    for (; i+4<=count; i+=4) {
+        __m128i c = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(center+i));
+        __m256d x = _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(c));
+        __m256d n = _mm256_sub_pd(_mm256_loadu_pd(totals.countHi+i), _mm256_loadu_pd(totals.countLo+i));
+        __m256d mean = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(totals.sumHi+i), _mm256_loadu_pd(totals.sumLo+i)), n);
+        __m256d value = mean;
+        if (wiener) {
+            __m256d squares = _mm256_sub_pd(_mm256_loadu_pd(totals.squaresHi+i), _mm256_loadu_pd(totals.squaresLo+i));
+            __m256d variance = _mm256_sub_pd(_mm256_div_pd(squares, n), _mm256_mul_pd(mean, mean));
+            __m256d gain = _mm256_sub_pd(one, _mm256_div_pd(noiseLevel, variance));
+            __m256d adapted = _mm256_add_pd(mean, _mm256_mul_pd(gain, _mm256_sub_pd(x, mean)));
+            value = _mm256_blendv_pd(mean, adapted, _mm256_cmp_pd(variance, noiseLevel, _CMP_GT_OQ));
+        }
+        __m128i rounded = _mm256_cvtpd_epi32(value);
+        __m128i smoothed = _mm_packs_epi32(rounded, _mm_setzero_si128());
+        smoothed = _mm_blendv_epi8(smoothed, invalid, _mm_cmpeq_epi16(c, invalid));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out+i), smoothed);
+    }
+    return i;
+}
+
+static void smoothPoints(bool wiener, const WindowTotals& totals, const short* center, double noise, short* out,
+                         unsigned int count) {
+    unsigned int done = 0;
+    switch (currentConversionPath()) {
+        case AVX2_PATH:
+            done = smoothAvx2(wiener, totals, center, noise, out, count);
+            break;
+        case SSE2_PATH:
+            done = smoothSse2(wiener, totals, center, noise, out, count);
+            break;
+        case SCALAR_PATH:
+        default:
+            break;
+    }
+    smoothScalar(wiener, totals, center, noise, out, done, count);
+}
+
+// Mean local variance over the valid points, scipy.signal.wiener's default noise
+static double estimateNoise(const WindowTotals& totals, const short* center, unsigned int count) {
+    double variances = 0;
+    unsigned int points = 0;
+    for (unsigned int i=0; i<count; i++) {
+        if (center[i] == invalidRange) {
+            continue;
+        }
+        double n = totals.countHi[i] - totals.countLo[i];
+        double mean = (totals.sumHi[i] - totals.sumLo[i])/n;
+        variances += (totals.squaresHi[i] - totals.squaresLo[i])/n - mean*mean;
+        points++;
+    }
+    return points > 0 ? variances/points : 0;
+}
+
+// Smoothing is only worth doing with a window of at least 3, and the windows must be odd
+static unsigned int oddWindow(SmoothingMethod method, unsigned int window) {
+    if (method == SMOOTH_NONE || window < 3) {
+        return 1;
+    }
+    window = std::min(window, static_cast<unsigned int>(FILTER_MAX_WINDOW));
+    return window | 1;
+}
+
+RangeFilter::RangeFilter():smoothingY(false), rejected(0), filled(0), first(0), last(0), emitted(0),
+produced(0), consumed(0) {
+    settings.zLow = settings.zHigh = 0;
+    settings.gapFill = 0;
+    settings.xMethod = settings.yMethod = SMOOTH_NONE;
+    settings.xWindow = settings.yWindow = 1;
+    settings.noise = 0;
+    outputs.resize(2);
+}
+
+void RangeFilter::reset(const RangeFilterSettings& filterSettings) {
+    settings = filterSettings;
+    settings.xWindow = oddWindow(settings.xMethod, settings.xWindow);
+    settings.yWindow = oddWindow(settings.yMethod, settings.yWindow);
+    if (settings.xWindow == 1) {
+        settings.xMethod = SMOOTH_NONE;
+    }
+    if (settings.yWindow == 1) {
+        settings.yMethod = SMOOTH_NONE;
+    }
+    smoothingY = settings.yMethod != SMOOTH_NONE;
+    rejected = filled = 0;
+    first = last = emitted = 0;
+    produced = consumed = 0;
+    window.assign(smoothingY ? settings.yWindow : 0, Profile());
+    outputs.assign(settings.yWindow + 1, Profile());
+    rows.reserve(FILTER_MAX_WINDOW);
+}
+
+bool RangeFilter::enabled() const {
+    return settings.zLow < settings.zHigh || settings.gapFill > 0 ||
+           settings.xMethod != SMOOTH_NONE || settings.yMethod != SMOOTH_NONE;
+}
+
+// Copies the profile's ranges (it may only be borrowing them) and filters
+// the copy; along Y it waits for half a window of later profiles first
+void RangeFilter::add(const Profile& profile) {
+    Profile* copy;
+    if (smoothingY) {
+        if (last > first && !sameGeometry(profile, window[(last-1) % window.size()])) {
+            drainY();
+        }
+        copy = &window[last % window.size()];
+    } else {
+        copy = &nextOutput();
+    }
+    copy->release();
+    copy->encoder = profile.encoder;
+    copy->timestamp = profile.timestamp;
+    copy->xOffset = profile.xOffset;
+    copy->xResolution = profile.xResolution;
+    copy->zOffset = profile.zOffset;
+    copy->zResolution = profile.zResolution;
+    const short* ranges = profile.rangeData();
+    copy->ranges.assign(ranges, ranges + profile.width());
+    filterProfile(*copy);
+    if (!smoothingY) {
+        return;
+    }
+    if (last == first) {
+        size_t width = copy->ranges.size();
+        if (settings.yMethod != SMOOTH_MEDIAN) {
+            ySum.assign(width, 0);
+            ySquares.assign(width, 0);
+            yCount.assign(width, 0);
+            zeros.assign(width, 0);
+        }
+    }
+    if (settings.yMethod != SMOOTH_MEDIAN) {
+        accumulateY(copy->ranges, 1.0);
+    }
+    last++;
+    while (emitted + settings.yWindow/2 < last) {
+        emitY(emitted);
+        emitted++;
+    }
+}
+
+void RangeFilter::finish() {
+    if (smoothingY) {
+        drainY();
+    }
+}
+
+const Profile* RangeFilter::next() {
+    if (consumed >= produced) {
+        return NULL;
+    }
+    return &outputs[consumed++ % outputs.size()];
+}
+
+Profile& RangeFilter::nextOutput() {
+    return outputs[produced++ % outputs.size()];
+}
+
+void RangeFilter::filterProfile(Profile& profile) {
+    size_t width = profile.ranges.size();
+    if (width == 0) {
+        return;
+    }
+    if (settings.zLow < settings.zHigh) {
+        rejectOutliers(profile);
+    }
+    if (settings.gapFill > 0) {
+        fillGaps(&profile.ranges[0], width);
+    }
+    if (settings.xMethod != SMOOTH_NONE) {
+        smoothX(&profile.ranges[0], width, profile.zResolution);
+    }
+}
+
+// Works out the Z window in this profile's range units and drops what's outside
+void RangeFilter::rejectOutliers(Profile& profile) {
+    if (profile.zResolution == 0) {
+        return;
+    }
+    double low = (settings.zLow - profile.zOffset)/profile.zResolution;
+    double high = (settings.zHigh - profile.zOffset)/profile.zResolution;
+    if (low > high) {
+        std::swap(low, high);
+    }
+    // Clamped so a missing range is always outside and never counted
+    low = std::max(std::ceil(low), -32767.0);
+    high = std::min(std::floor(high), 32767.0);
+    if (low > 32767.0 || high < -32767.0) {
+        low = 32767.0;
+        high = -32767.0;
+    }
+    rejected += rejectRanges(&profile.ranges[0], profile.ranges.size(),
+                             static_cast<short>(low), static_cast<short>(high));
+}
+
+// Interpolates across runs of missing points no longer than gapFill with a
+// valid point at either end
+void RangeFilter::fillGaps(short* ranges, size_t width) {
+    size_t i = 0;
+    while (i < width) {
+        if (ranges[i] != invalidRange) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < width && ranges[i] == invalidRange) {
+            i++;
+        }
+        size_t run = i - start;
+        if (start == 0 || i == width || run > settings.gapFill) {
+            continue;
+        }
+        double left = ranges[start-1], right = ranges[i];
+        for (size_t j=0; j<run; j++) {
+            ranges[start+j] = static_cast<short>(lrint(left + (right - left)*(j + 1)/(run + 1.0)));
+        }
+        filled += run;
+    }
+}
+
+// Pads the profile with missing points so every window is the same shape,
+// then runs the median over shifted copies or the mean/Wiener over prefix sums
+void RangeFilter::smoothX(short* ranges, size_t width, double zResolution) {
+    unsigned int span = settings.xWindow;
+    unsigned int half = span/2;
+    padded.assign(width + 2*half, invalidRange);
+    std::copy(ranges, ranges + width, padded.begin() + half);
+    const short* center = &padded[half];
+    if (settings.xMethod == SMOOTH_MEDIAN) {
+        rows.clear();
+        for (unsigned int j=0; j<span; j++) {
+            rows.push_back(&padded[j]);
+        }
+        medianRows(&rows[0], span, center, ranges, width);
+        return;
+    }
+    size_t total = padded.size();
+    prefixSum.resize(total + 1);
+    prefixSquares.resize(total + 1);
+    prefixCount.resize(total + 1);
+    prefixSum[0] = prefixSquares[0] = prefixCount[0] = 0;
+    for (size_t j=0; j<total; j++) {
+        double range = padded[j] != invalidRange ? padded[j] : 0;
+        prefixSum[j+1] = prefixSum[j] + range;
+        prefixSquares[j+1] = prefixSquares[j] + range*range;
+        prefixCount[j+1] = prefixCount[j] + (padded[j] != invalidRange);
+    }
+    // Point i's window is padded[i, i+span)
+    WindowTotals totals = {&prefixSum[span], &prefixSum[0], &prefixSquares[span], &prefixSquares[0],
+                           &prefixCount[span], &prefixCount[0]};
+    bool wiener = settings.xMethod == SMOOTH_WIENER;
+    double noise = 0;
+    if (wiener) {
+        noise = settings.noise > 0 ? settings.noise/(zResolution*zResolution) : estimateNoise(totals, center, width);
+    }
+    smoothPoints(wiener, totals, center, noise, ranges, width);
+}
+
+bool RangeFilter::sameGeometry(const Profile& a, const Profile& b) const {
+    return a.width() == b.width() && a.xOffset == b.xOffset && a.xResolution == b.xResolution &&
+           a.zOffset == b.zOffset && a.zResolution == b.zResolution;
+}
+
+// Adds (sign 1) or takes away (sign -1) a profile's valid ranges from the Y totals
+void RangeFilter::accumulateY(const std::vector<short>& ranges, double sign) {
+    for (size_t i=0; i<ranges.size(); i++) {
+        if (ranges[i] != invalidRange) {
+            double range = ranges[i];
+            ySum[i] += sign*range;
+            ySquares[i] += sign*range*range;
+            yCount[i] += sign;
+        }
+    }
+}
+
+// Smooths profile `center` across the profiles held either side of it,
+// then lets go of the oldest one the next profile won't need
+void RangeFilter::emitY(Go2UInt64 center) {
+    size_t slots = window.size();
+    unsigned int half = settings.yWindow/2;
+    const Profile& middle = window[center % slots];
+    Profile& out = nextOutput();
+    out.release();
+    out.encoder = middle.encoder;
+    out.timestamp = middle.timestamp;
+    out.xOffset = middle.xOffset;
+    out.xResolution = middle.xResolution;
+    out.zOffset = middle.zOffset;
+    out.zResolution = middle.zResolution;
+    size_t width = middle.ranges.size();
+    out.ranges.resize(width);
+    Go2UInt64 oldest = center >= first + half ? center - half : first;
+    if (width > 0) {
+        if (settings.yMethod == SMOOTH_MEDIAN) {
+            Go2UInt64 newest = std::min(last - 1, center + half);
+            rows.clear();
+            for (Go2UInt64 s=oldest; s<=newest; s++) {
+                rows.push_back(&window[s % slots].ranges[0]);
+            }
+            medianRows(&rows[0], rows.size(), &middle.ranges[0], &out.ranges[0], width);
+        } else {
+            WindowTotals totals = {&ySum[0], &zeros[0], &ySquares[0], &zeros[0], &yCount[0], &zeros[0]};
+            bool wiener = settings.yMethod == SMOOTH_WIENER;
+            double noise = 0;
+            if (wiener) {
+                noise = settings.noise > 0 ? settings.noise/(middle.zResolution*middle.zResolution)
+                                           : estimateNoise(totals, &middle.ranges[0], width);
+            }
+            smoothPoints(wiener, totals, &middle.ranges[0], noise, &out.ranges[0], width);
+        }
+    }
+    if (center >= first + half && settings.yMethod != SMOOTH_MEDIAN) {
+        accumulateY(window[oldest % slots].ranges, -1.0);
+    }
+}
+
+// Emits everything held, with the window cut short at the end
+void RangeFilter::drainY() {
+    while (emitted < last) {
+        emitY(emitted);
+        emitted++;
+    }
+    first = last;
+}
+
+std::string RangeFilter::describe() const {
+    static const char* methodNames[] = {"none", "median", "mean", "Wiener"};
+    std::ostringstream description;
+    description << "filtered:";
+    const char* separator = " ";
+    if (settings.zLow < settings.zHigh) {
+        description << separator << "Z " << settings.zLow << " to " << settings.zHigh << " mm";
+        separator = ", ";
+    }
+    if (settings.gapFill > 0) {
+        description << separator << "gaps up to " << settings.gapFill << " points filled";
+        separator = ", ";
+    }
+    if (settings.xMethod != SMOOTH_NONE) {
+        description << separator << methodNames[settings.xMethod] << " of " << settings.xWindow << " points along X";
+        separator = ", ";
+    }
+    if (settings.yMethod != SMOOTH_NONE) {
+        description << separator << methodNames[settings.yMethod] << " of " << settings.yWindow << " profiles along Y";
+        separator = ", ";
+    }
+    if ((settings.xMethod == SMOOTH_WIENER || settings.yMethod == SMOOTH_WIENER) && settings.noise > 0) {
+        description << separator << "noise " << settings.noise << " mm^2";
+    }
+    return description.str();
+}
+
+bool parseSmoothing(const std::string& text, SmoothingMethod& method, unsigned int& window) {
+    size_t colon = text.find(':');
+    std::string name = text.substr(0, colon);
+    if (name == "median") {
+        method = SMOOTH_MEDIAN;
+    } else if (name == "mean") {
+        method = SMOOTH_MEAN;
+    } else if (name == "wiener") {
+        method = SMOOTH_WIENER;
+    } else {
+        return false;
+    }
+    unsigned int size;
+    char trailing;
+    if (colon == std::string::npos || sscanf(text.c_str() + colon + 1, "%u%c", &size, &trailing) != 1) {
+        return false;
+    }
+    window = size;
+    return window >= 3 && window <= FILTER_MAX_WINDOW && window % 2 == 1;
+}
+
+bool parseZWindow(const std::string& text, RangeFilterSettings& settings) {
+    double low, high;
+    char trailing;
+    if (sscanf(text.c_str(), "%lf,%lf%c", &low, &high, &trailing) != 2 || low >= high) {
+        return false;
+    }
+    settings.zLow = low;
+    settings.zHigh = high;
+    return true;
+}
@@ -0,0 +1,417 @@
+#include "recordingpipeline.h"
+
+RecordingPipeline::RecordingPipeline(OutputFile& output, ProfileWriter& profileWriter, const ScanInfo& scanInfo,
+                                     bool verboseFlag, size_t queueDepth):
+out(output), format(profileWriter), info(scanInfo), verbose(verboseFlag),
+profiles(queueDepth), blocks(BLOCK_QUEUE_DEPTH), freeBlocks(BLOCK_QUEUE_DEPTH), pendingBlocks(BLOCK_QUEUE_DEPTH),
+receiving(false), converting(false), converted(0), bytesWritten(0), blockWaits(0), handedOff(0), segments(NULL),
+segmentEnds(SEGMENT_QUEUE_DEPTH), segmentNumber(0), segmentProfiles(0), segmentStart(0), segmentEncoder(0),
+stopping(false), startTime(0), accepted(0), travelled(false), firstEncoder(0) {
+    for (size_t i=0; i<blocks.size(); i++) {
+        blocks[i].reserve(2*OUTPUT_BLOCK_SIZE);
+        freeBlocks.push(&blocks[i]);
+    }
+    gapSettings.encoderStep = 0;
+    gapSettings.framePeriod = 0;
+    heightMapSettings.cellX = heightMapSettings.cellY = 0;
+    heightMapSettings.aggregation = HEIGHT_MEAN;
+    stopSettings.profiles = 0;
+    stopSettings.distance = stopSettings.seconds = 0;
+}
+
+RecordingPipeline::~RecordingPipeline() {
+    finish();
+}
+
+// Queues the file header and starts the conversion and writer threads
+void RecordingPipeline::start() {
+    std::string* block = NULL;
+    freeBlocks.pop(block);
+    if (reducer.enabled()) {
+        info.comment += " [" + reducer.describe() + "]";
+    }
+    if (filter.enabled()) {
+        info.comment += " [" + filter.describe() + "]";
+    }
+    startTime = segmentStart = monotonicMicroseconds();
+    if (segments != NULL) {
+        segmentNumber = 1;
+    }
+    format.writeHeader(segmentInfo(), *block);
+    index.reset(info);
+    gaps.reset(info, gapSettings);
+    heightMap.reset(info, heightMapSettings);
+    handedOff = block->size();
+    pendingBlocks.push(block);
+    receiving = true;
+    converting = true;
+    converter = boost::thread(&RecordingPipeline::convert, this);
+    writer = boost::thread(&RecordingPipeline::write, this);
+}
+
+void RecordingPipeline::finish() {
+    receiving = false;
+    if (converter.joinable()) {
+        converter.join();
+    }
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+// Conversion thread - formats pending profiles into output blocks
+void RecordingPipeline::convert() {
+    std::string* block = NULL;
+    Profile* profile = NULL;
+    bool checking = gaps.enabled();
+    bool reducing = reducer.enabled();
+    while (true) {
+        bool stillReceiving = receiving.load();
+        if (profiles.take(profile)) {
+            if (checkStop(profile)) {
+                // Anything received after a stop condition was met is left out
+                profiles.recycle(profile);
+                continue;
+            }
+            takeBlock(block);
+            Go2UInt64 conversionStart = monotonicNanoseconds();
+            if (checking) {
+                gaps.check(*profile);
+            }
+            if (reducing) {
+                // Merging holds back the last profile until the next one
+                reducer.add(*profile);
+                profiles.recycle(profile);
+                const Profile* reduced;
+                while ((reduced = reducer.next()) != NULL) {
+                    pass(*reduced, block);
+                }
+            } else {
+                pass(*profile, block);
+                profiles.recycle(profile);
+            }
+            conversions.record(monotonicNanoseconds() - conversionStart);
+        } else {
+            // Nothing waiting - hand off what we have rather than sit on it
+            if (block != NULL && !block->empty()) {
+                handedOff += block->size();
+                pendingBlocks.push(block);
+                block = NULL;
+            }
+            if (!stillReceiving) {
+                break;
+            }
+            checkStop(NULL);
+            idle();
+        }
+    }
+    if (reducing) {
+        reducer.finish();
+        const Profile* reduced;
+        while ((reduced = reducer.next()) != NULL) {
+            pass(*reduced, block);
+        }
+    }
+    if (filter.enabled()) {
+        filter.finish();
+        const Profile* filtered;
+        while ((filtered = filter.next()) != NULL) {
+            store(*filtered, block);
+        }
+    }
+    // Let the format finish off the file
+    if (segments != NULL) {
+        endSegment(block, true);
+    } else {
+        takeBlock(block);
+        format.writeFooter(*block);
+        if (block->empty()) {
+            freeBlocks.push(block);
+        } else {
+            pendingBlocks.push(block);
+        }
+    }
+    converting = false;
+}
+
+// The scan's details as written into the current segment's header
+ScanInfo RecordingPipeline::segmentInfo() const {
+    if (segments == NULL) {
+        return info;
+    }
+    ScanInfo segmentDetails = info;
+    std::ostringstream comment;
+    comment << info.comment << " (segment " << segmentNumber.load() << ")";
+    segmentDetails.comment = comment.str();
+    return segmentDetails;
+}
+
+// Whether the current segment has reached one of its limits, so the profile goes in the next one
+bool RecordingPipeline::segmentFull(const Profile& profile, Go2UInt64 bytes) const {
+    const SegmentSettings& limits = segments->getSettings();
+    if (limits.profiles > 0 && segmentProfiles >= limits.profiles) {
+        return true;
+    }
+    if (limits.bytes > 0 && bytes >= limits.bytes) {
+        return true;
+    }
+    if (limits.distance > 0 &&
+        std::abs(static_cast<double>(profile.encoder - segmentEncoder))*info.encoderResolution >= limits.distance) {
+        return true;
+    }
+    return limits.seconds > 0 && (monotonicMicroseconds() - segmentStart)*1e-6 >= limits.seconds;
+}
+
+// Finishes the current segment's file and, unless it is the last, starts
+// the next one's.  The boundary is queued ahead of the segment's last block
+// so the writer knows where to stop before it gets there.
+void RecordingPipeline::endSegment(std::string*& block, bool last) {
+    takeBlock(block);
+    format.writeFooter(*block);
+    SegmentEnd end;
+    end.segment.reset(new FinishedSegment);
+    end.segment->profiles = segmentProfiles;
+    end.segment->bytes = handedOff + block->size();
+    if (format.indexable()) {
+        end.segment->index = index;
+    }
+    if (heightMap.enabled()) {
+        end.segment->heightMap.reset(new HeightMap(heightMap));
+    }
+    end.last = last;
+    while (!segmentEnds.push(end)) {
+        idle();
+    }
+    if (block->empty()) {
+        freeBlocks.push(block);
+    } else {
+        pendingBlocks.push(block);
+    }
+    block = NULL;
+    if (last) {
+        return;
+    }
+    segmentNumber.fetch_add(1, boost::memory_order_relaxed);
+    segmentProfiles = 0;
+    segmentStart = monotonicMicroseconds();
+    handedOff = 0;
+    takeBlock(block);
+    format.writeHeader(segmentInfo(), *block);
+    index.reset(info);
+    heightMap.reset(info, heightMapSettings);
+}
+
+void RecordingPipeline::takeBlock(std::string*& block) {
+    if (block != NULL || freeBlocks.pop(block)) {
+        return;
+    }
+    blockWaits.fetch_add(1, boost::memory_order_relaxed);
+    while (!freeBlocks.pop(block)) {
+        idle();
+    }
+}
+
+// Checks the stop conditions against the next profile (NULL - when idle,
+// just the limits already reached),
+// returns true once any of them has been met
+bool RecordingPipeline::checkStop(const Profile* profile) {
+    if (stopping.load(boost::memory_order_relaxed)) {
+        return true;
+    }
+    std::ostringstream reason;
+    if (stopSettings.seconds > 0 && (monotonicMicroseconds() - startTime)*1e-6 >= stopSettings.seconds) {
+        reason << stopSettings.seconds << " s recorded";
+    } else if (stopSettings.profiles > 0 && converted.load(boost::memory_order_relaxed) >= stopSettings.profiles) {
+        reason << stopSettings.profiles << " profiles recorded";
+    } else if (travelled) {
+        reason << stopSettings.distance << " mm travelled";
+    }
+    if (reason.str().empty()) {
+        // Idle calls only check the limits already reached
+        if (profile == NULL) {
+            return false;
+        }
+        // The profile that reaches the distance is still recorded
+        if (stopSettings.distance > 0) {
+            if (accepted == 0) {
+                firstEncoder = profile->encoder;
+            }
+            travelled = std::abs(static_cast<double>(profile->encoder - firstEncoder))*info.encoderResolution >=
+                        stopSettings.distance;
+        }
+        accepted++;
+        return false;
+    }
+    stoppedBy = reason.str();
+    stopping = true;
+    return true;
+}
+
+// Filters the profile if asked to, then stores it
+void RecordingPipeline::pass(const Profile& profile, std::string*& block) {
+    if (!filter.enabled()) {
+        store(profile, block);
+        return;
+    }
+    // Smoothing along Y hands back profiles from half a window ago
+    filter.add(profile);
+    const Profile* filtered;
+    while ((filtered = filter.next()) != NULL) {
+        store(*filtered, block);
+    }
+}
+
+// Indexes, formats and maps one profile, handing the block to the writer
+// thread once it is full
+void RecordingPipeline::store(const Profile& profile, std::string*& block) {
+    // Profiles the reducer or filter were still holding when the limit was reached are left out
+    if (stopSettings.profiles > 0 && converted.load(boost::memory_order_relaxed) >= stopSettings.profiles) {
+        return;
+    }
+    takeBlock(block);
+    if (segments != NULL) {
+        // Checked as the next profile arrives, so the last segment is never empty
+        if (segmentProfiles > 0 && segmentFull(profile, handedOff + block->size())) {
+            endSegment(block, false);
+        }
+        if (segmentProfiles == 0) {
+            segmentEncoder = profile.encoder;
+        }
+        segmentProfiles++;
+    }
+    if (format.indexable()) {
+        index.add(profile, handedOff + block->size());
+    }
+    format.writeProfile(profile, *block);
+    if (heightMap.enabled()) {
+        heightMap.add(profile);
+    }
+    converted.fetch_add(1, boost::memory_order_relaxed);
+    if (block->size() >= OUTPUT_BLOCK_SIZE) {
+        handedOff += block->size();
+        pendingBlocks.push(block);
+        block = NULL;
+    }
+}
+
+// Writer thread - puts formatted blocks on disk
+void RecordingPipeline::write() {
+    std::string* block = NULL;
+    SegmentEnd end;
+    bool haveEnd = false;
+    Go2UInt64 segmentBytes = 0; // Handed to the current segment, whether or not the writes worked
+    while (true) {
+        bool stillConverting = converting.load();
+        if (segments != NULL) {
+            if (!haveEnd) {
+                haveEnd = segmentEnds.pop(end);
+            }
+            // Everything up to the boundary is out - switch files before the next segment's blocks
+            if (haveEnd && segmentBytes >= end.segment->bytes) {
+                if (end.last) {
+                    segments->close(out, end.segment);
+                } else {
+                    segments->next(out, end.segment);
+                }
+                end.segment.reset();
+                haveEnd = false;
+                segmentBytes = 0;
+                continue;
+            }
+        }
+        if (pendingBlocks.pop(block)) {
+            Go2UInt64 writeStart = monotonicNanoseconds();
+            out.write(*block);
+            writes.record(monotonicNanoseconds() - writeStart);
+            segmentBytes += block->size();
+            bytesWritten.fetch_add(block->size(), boost::memory_order_relaxed);
+            block->clear();
+            freeBlocks.push(block);
+        } else if (!stillConverting) {
+            break;
+        } else {
+            idle();
+        }
+    }
+}
+
+bool RecordingPipeline::saveIndex(const std::string& scanFilename) const {
+    if (index.empty() || segments != NULL) {
+        return true;
+    }
+    return index.save(scanFilename + SCAN_INDEX_EXTENSION);
+}
+
+bool RecordingPipeline::saveGaps(const std::string& scanFilename) const {
+    if (gaps.getSpans().empty()) {
+        return true;
+    }
+    return gaps.save(scanFilename + GAP_EXTENSION);
+}
+
+bool RecordingPipeline::saveHeightMap(const std::string& scanFilename) const {
+    if (!heightMap.enabled() || segments != NULL) {
+        return true;
+    }
+    return heightMap.save(scanFilename + HEIGHTMAP_EXTENSION);
+}
+
+PipelineStats RecordingPipeline::stats() const {
+    PipelineStats current;
+    current.received = profiles.receivedCount();
+    current.dropped = profiles.droppedCount();
+    current.written = converted.load();
+    current.bytesWritten = bytesWritten.load();
+    current.profileQueueDepth = profiles.capacity();
+    current.profileHighWater = profiles.highWaterMark();
+    current.blockQueueDepth = pendingBlocks.capacity();
+    current.blockHighWater = pendingBlocks.highWaterMark();
+    current.blockWaits = blockWaits.load();
+    current.gaps = gaps.gapCount();
+    current.missing = gaps.missingCount();
+    current.duplicates = gaps.duplicateCount();
+    current.reversals = gaps.reversalCount();
+    current.segments = segmentNumber.load();
+    return current;
+}
+
+// Prints end-of-scan queue statistics
+void RecordingPipeline::report(std::ostream& os) {
+    PipelineStats current = stats();
+    os << "<< Recording summary (" << format.getFormatName() << ") >>" << std::endl;
+    os << "    Profiles received:  " << current.received << std::endl;
+    os << "    Profiles written:  " << current.written << std::endl;
+    os << "    Profiles dropped (queue overflow):  " << current.dropped << std::endl;
+    os << "    Bytes written:  " << current.bytesWritten << std::endl;
+    os << "    Profile queue:  depth " << current.profileQueueDepth
+       << ", high-water " << current.profileHighWater << std::endl;
+    os << "    Block queue:  depth " << current.blockQueueDepth
+       << ", high-water " << current.blockHighWater
+       << ", waits for a free block " << current.blockWaits << std::endl;
+    if (heightMap.enabled()) {
+        os << "    Height map:  " << heightMap.columns() << " x " << heightMap.rows() << " cells of "
+           << heightMap.getSettings().cellX << " x " << heightMap.getSettings().cellY << " mm" << std::endl;
+    }
+    if (reducer.enabled()) {
+        Go2UInt64 offered = reducer.pointsOffered();
+        os << "    Reduction:  " << reducer.describe() << "; " << reducer.pointsKept() << " of " << offered
+           << " points kept (" << (offered > 0 ? 100.0*reducer.pointsKept()/offered : 0) << "%), "
+           << reducer.mergedCount() << " profiles merged, " << reducer.skippedCount() << " skipped" << std::endl;
+    }
+    if (filter.enabled()) {
+        os << "    Filter:  " << filter.describe() << "; " << filter.rejectedCount() << " points rejected, "
+           << filter.filledCount() << " filled" << std::endl;
+    }
+    if (segments != NULL) {
+        os << "    Segments:  " << current.segments << " recorded, " << segments->handedOffCount()
+           << " handed off, " << segments->failedCount() << " failed" << std::endl;
+    }
+    if (!stoppedBy.empty()) {
+        os << "    Stopped:  " << stoppedBy << std::endl;
+    }
+    if (gaps.enabled()) {
+        os << "    Frame gaps:  " << current.gaps << " (about " << current.missing << " profiles missing), "
+           << current.duplicates << " duplicates, " << current.reversals << " reversals" << std::endl;
+    }
+    format.report(os);
+}
@@ -0,0 +1,82 @@
+/* scan2csv - converts a binary or compressed Gocator scan into the comma-delimited x,y,z format
+
+Usage: scan2csv input.scan [output.csv] [decimal places] [y0 y1]
+If no output is specified, writes next to the input with a .csv extension.
+If a Y range [mm] is given, only profiles in that range are converted - with
+the scan's index, only that part of the scan is read.
+*/
+#include "scanformat.h"
+#include "csvwriter.h"
+#include "outputfile.h"
+
+#include <boost/filesystem.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace filesystem = boost::filesystem;
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: scan2csv input.scan [output.csv] [decimal places] [y0 y1]" << std::endl;
+        return 1;
+    }
+    std::string inputFilename(argv[1]);
+    std::string outputFilename;
+    if (argc > 2) {
+        outputFilename = argv[2];
+    } else {
+        outputFilename = filesystem::path(inputFilename).replace_extension(".csv").string();
+    }
+    int precision = CSV_DEFAULT_PRECISION;
+    if (argc > 3) {
+        precision = atoi(argv[3]);
+    }
+    bool selectY = argc > 5;
+    try {
+        ScanReader reader(inputFilename);
+        if (selectY && !reader.selectY(atof(argv[4]), atof(argv[5]))) {
+            std::cerr << "<< No index for '" << inputFilename << ",' reading the whole scan >>" << std::endl;
+        }
+        try {
+            filesystem::remove(outputFilename.c_str());
+            filesystem::remove((outputFilename + SCAN_INDEX_EXTENSION).c_str());
+        } catch (filesystem::filesystem_error &err) {
+            std::cerr << "<< Unable to overwrite '" << outputFilename << ",' appending >>" << std::endl;
+        }
+        OutputFile fidout;
+        if (!fidout.open(outputFilename)) {
+            std::cerr << "<< Unable to open/write to output file '" << outputFilename << "', aborting >>" << std::endl;
+            return 1;
+        }
+        CsvWriter writer(precision, precision, precision);
+        std::string block;
+        block.reserve(OUTPUT_BLOCK_SIZE*2);
+        writer.writeHeader(reader.getInfo(), block);
+        ScanIndex index;
+        index.reset(reader.getInfo());
+        Profile profile;
+        while (reader.next(profile)) {
+            index.add(profile, fidout.bytesWritten() + block.size());
+            writer.writeProfile(profile, block);
+            if (block.size() >= OUTPUT_BLOCK_SIZE) {
+                fidout.write(block);
+                block.clear();
+            }
+        }
+        fidout.write(block);
+        fidout.close();
+        if (fidout.fail()) {
+            std::cerr << "<< Encountered error writing to '" << outputFilename << "' >>" << std::endl;
+            return 1;
+        }
+        if (!index.empty() && !index.save(outputFilename + SCAN_INDEX_EXTENSION)) {
+            std::cerr << "<< Unable to write index for '" << outputFilename << "' >>" << std::endl;
+        }
+        std::cout << "Converted " << reader.profileCount() << " profiles to '" << outputFilename << "'" << std::endl;
+    } catch (std::runtime_error& err) {
+        std::cerr << "<< " << err.what() << " >>" << std::endl;
+        return 1;
+    }
+    return 0;
+}
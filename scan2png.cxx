@@ -0,0 +1,132 @@
+/* scan2png - renders recorded scans to height-coded images
+
+Usage: scan2png [--size WxH] [--z low,high] [--ppm] [--output-folder path] [--threads n] scan [scan ...]
+Reads binary, compressed, columnar (csv2col) or x,y,z CSV scans and writes
+<scan>.png (or .ppm) next to each, or in the output folder: each pixel is
+the mean Z of the points in it, with a colour bar and the X, Y and Z
+extents.  With at least as many scans as threads each thread renders whole
+scans; otherwise the scans are rendered one at a time, tile by tile on
+every thread.
+*/
+#include "scanrenderer.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace opts = boost::program_options;
+namespace filesystem = boost::filesystem;
+
+// One scan in, one image out
+typedef struct renderJob {
+    std::string input, output;
+    Go2UInt64 points;
+    std::string error;
+} RenderJob;
+
+static void renderScan(std::vector<RenderJob>* jobs, const RenderSettings* settings, unsigned int threads,
+                       size_t index) {
+    RenderJob& job = (*jobs)[index];
+    try {
+        ScanPoints points;
+        loadScanPoints(job.input, points);
+        job.points = points.size();
+        ScanRenderer renderer(*settings, threads);
+        renderer.render(points);
+        if (!renderer.save(job.output)) {
+            job.error = "Unable to write '" + job.output + "'";
+        }
+    } catch (std::runtime_error& err) {
+        job.error = err.what();
+    } catch (std::bad_alloc&) {
+        job.error = "Not enough memory for '" + job.input + "'";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    opts::options_description opt_desc("Available options");
+    opt_desc.add_options()
+        ("input", opts::value<std::vector<std::string> >(), "scans to render")
+        ("size,s", opts::value<std::string>()->default_value("1024x768"), "image size in pixels, 'widthxheight'")
+        ("z", opts::value<std::string>(), "colour scale 'low,high' in mm (default each scan's own range)")
+        ("ppm", "write binary PPM rather than PNG")
+        ("output-folder,o", opts::value<std::string>(), "folder for the images (default next to each scan)")
+        ("threads,t", opts::value<unsigned int>()->default_value(boost::thread::hardware_concurrency()),
+         "worker threads")
+        ("help,h", "display basic help information")
+    ;
+    opts::positional_options_description positional;
+    positional.add("input", -1);
+    opts::variables_map cmdline;
+    opts::store(opts::command_line_parser(argc, argv).options(opt_desc).positional(positional).run(), cmdline);
+    opts::notify(cmdline);
+    if (cmdline.count("help") || !cmdline.count("input")) {
+        std::cout << "Usage: scan2png [options] scan [scan ...]\n" << opt_desc << std::endl;
+        return 1;
+    }
+    RenderSettings settings;
+    settings.zLow = settings.zHigh = 0;
+    settings.ppm = cmdline.count("ppm") > 0;
+    if (!parseImageSize(cmdline["size"].as<std::string>(), settings)) {
+        std::cerr << "<< Image size must be 'widthxheight', at least " << RENDER_MARGIN_LEFT + RENDER_MARGIN_RIGHT +
+                     RENDER_MIN_PLOT << "x" << RENDER_MARGIN_TOP + RENDER_MARGIN_BOTTOM + RENDER_MIN_PLOT
+                  << ", aborting >>" << std::endl;
+        return 1;
+    }
+    if (cmdline.count("z")) {
+        std::string z = cmdline["z"].as<std::string>();
+        size_t comma = z.find(',');
+        settings.zLow = atof(z.substr(0, comma).c_str());
+        settings.zHigh = comma != std::string::npos ? atof(z.substr(comma + 1).c_str()) : settings.zLow;
+        if (!(settings.zLow < settings.zHigh)) {
+            std::cerr << "<< Colour scale must be 'low,high' in mm with low < high, aborting >>" << std::endl;
+            return 1;
+        }
+    }
+    filesystem::path folder;
+    if (cmdline.count("output-folder")) {
+        folder = cmdline["output-folder"].as<std::string>();
+        if (!filesystem::is_directory(folder)) {
+            std::cerr << "<< Output folder '" << folder.string() << "' doesn't exist, aborting >>" << std::endl;
+            return 1;
+        }
+    }
+    unsigned int threads = std::max(1u, cmdline["threads"].as<unsigned int>());
+    const std::vector<std::string>& inputs = cmdline["input"].as<std::vector<std::string> >();
+    std::vector<RenderJob> jobs(inputs.size());
+    for (size_t i=0; i<inputs.size(); i++) {
+        filesystem::path output = filesystem::path(inputs[i]).replace_extension(settings.ppm ? ".ppm" : ".png");
+        if (!folder.empty()) {
+            output = folder / output.filename();
+        }
+        jobs[i].input = inputs[i];
+        jobs[i].output = output.string();
+        jobs[i].points = 0;
+    }
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    if (jobs.size() >= threads) {
+        ScanRenderer::parallelFor(jobs.size(), threads, boost::bind(renderScan, &jobs, &settings, 1, _1));
+    } else {
+        for (size_t i=0; i<jobs.size(); i++) {
+            renderScan(&jobs, &settings, threads, i);
+        }
+    }
+    double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds()/1e6;
+    size_t rendered = 0;
+    Go2UInt64 points = 0;
+    for (size_t i=0; i<jobs.size(); i++) {
+        if (!jobs[i].error.empty()) {
+            std::cerr << "<< " << jobs[i].error << " >>" << std::endl;
+            continue;
+        }
+        rendered++;
+        points += jobs[i].points;
+    }
+    std::cout << "Rendered " << rendered << " of " << jobs.size() << " scans (" << points << " points) in "
+              << seconds << " s on " << threads << " threads: " << (seconds > 0 ? rendered/seconds : 0)
+              << " scans/s" << std::endl;
+    return rendered == jobs.size() ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+/* scan2tiles - builds a level-of-detail tile pyramid from a binary or compressed Gocator scan
+
+Usage: scan2tiles input.scan [output.tiles] [cell size mm | x,y] [tile size]
+If no output is specified, writes next to the input with a .tiles extension.
+The cell size defaults to the scan's X resolution and the tile size to 256
+cells per side.  The scan is read once, with only one band of tiles per
+level held in memory, so scans much larger than memory can be tiled.
+*/
+#include "scanformat.h"
+#include "tilepyramid.h"
+
+#include <boost/filesystem.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace filesystem = boost::filesystem;
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: scan2tiles input.scan [output.tiles] [cell size mm | x,y] [tile size]" << std::endl;
+        return 1;
+    }
+    std::string inputFilename(argv[1]);
+    std::string outputFilename;
+    if (argc > 2) {
+        outputFilename = argv[2];
+    } else {
+        outputFilename = filesystem::path(inputFilename).replace_extension(TILE_EXTENSION).string();
+    }
+    double cellX = 0, cellY = 0;
+    if (argc > 3) {
+        std::string cell(argv[3]);
+        size_t comma = cell.find(',');
+        cellX = atof(cell.substr(0, comma).c_str());
+        cellY = comma != std::string::npos ? atof(cell.substr(comma + 1).c_str()) : cellX;
+        if (cellX <= 0 || cellY <= 0) {
+            std::cerr << "<< Cell size must be positive, e.g. 0.1 or 0.05,0.2 >>" << std::endl;
+            return 1;
+        }
+    }
+    Go2UInt32 tileSize = TILE_SIZE;
+    if (argc > 4) {
+        int requested = atoi(argv[4]);
+        if (requested < 2 || requested % 2 != 0) {
+            std::cerr << "<< Tile size must be an even number of cells >>" << std::endl;
+            return 1;
+        }
+        tileSize = static_cast<Go2UInt32>(requested);
+    }
+    try {
+        ScanReader reader(inputFilename);
+        TilePyramidBuilder builder(outputFilename, cellX, cellY, tileSize);
+        if (!builder.start(reader.getInfo())) {
+            return 1;
+        }
+        Profile profile;
+        while (reader.next(profile)) {
+            builder.add(profile);
+        }
+        if (!builder.finish()) {
+            std::cerr << "<< Encountered error writing to '" << outputFilename << "' >>" << std::endl;
+            return 1;
+        }
+        builder.report(std::cout);
+        std::cout << "Tiled " << reader.profileCount() << " profiles to '" << outputFilename << "'" << std::endl;
+    } catch (std::runtime_error& err) {
+        std::cerr << "<< " << err.what() << " >>" << std::endl;
+        return 1;
+    }
+    return 0;
+}
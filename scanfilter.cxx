@@ -0,0 +1,144 @@
+/* scanfilter - filters a recorded binary or compressed Gocator scan
+
+Usage: scanfilter input.scan output.scan [--format binary|compressed|csv] [--reject low,high] [--fill n]
+                  [--smooth-x method:n] [--smooth-y method:n] [--noise mm^2]
+Applies the same filters as gocator_encoder does while recording (see
+include/rangefilter.h) and writes the result as a new scan with an index,
+noting the filtering in its comment.
+*/
+#include "scanformat.h"
+#include "profilewriter.h"
+#include "outputfile.h"
+#include "rangefilter.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+#include <string>
+
+namespace opts = boost::program_options;
+namespace filesystem = boost::filesystem;
+
+int main(int argc, char* argv[]) {
+    opts::options_description opt_desc("Available options");
+    opt_desc.add_options()
+        ("input", opts::value<std::string>(), "binary or compressed scan to filter")
+        ("output", opts::value<std::string>(), "filtered scan")
+        ("format,f", opts::value<std::string>()->default_value("binary"), "output format: 'binary', 'compressed' or 'csv'")
+        ("reject", opts::value<std::string>(), "drop points with Z outside 'low,high' mm")
+        ("fill", opts::value<unsigned int>()->default_value(0), "fill gaps of up to n missing points along X by interpolation")
+        ("smooth-x", opts::value<std::string>(), "smooth along X with 'median:n', 'mean:n' or 'wiener:n' (n odd, points)")
+        ("smooth-y", opts::value<std::string>(), "smooth along Y with 'median:n', 'mean:n' or 'wiener:n' (n odd, profiles)")
+        ("noise", opts::value<double>()->default_value(0), "Wiener noise variance in mm^2 (0 - estimated per profile)")
+        ("help,h", "display basic help information")
+    ;
+    opts::positional_options_description positional;
+    positional.add("input", 1).add("output", 1);
+    opts::variables_map cmdline;
+    opts::store(opts::command_line_parser(argc, argv).options(opt_desc).positional(positional).run(), cmdline);
+    opts::notify(cmdline);
+    if (cmdline.count("help") || !cmdline.count("input") || !cmdline.count("output")) {
+        std::cout << "Usage: scanfilter input.scan output.scan [options]\n" << opt_desc << std::endl;
+        return 1;
+    }
+    std::string inputFilename = cmdline["input"].as<std::string>();
+    std::string outputFilename = cmdline["output"].as<std::string>();
+    OutputSettings output;
+    output.format = BINARY;
+    output.xPrecision = output.yPrecision = output.zPrecision = CSV_DEFAULT_PRECISION;
+    std::string formatName = cmdline["format"].as<std::string>();
+    if (formatName == "compressed") {
+        output.format = COMPRESSED;
+    } else if (formatName == "csv") {
+        output.format = CSV;
+    } else if (formatName != "binary") {
+        std::cerr << "<< Unknown output format '" << formatName << ",' aborting >>" << std::endl;
+        return 1;
+    }
+    RangeFilterSettings settings;
+    settings.zLow = settings.zHigh = 0;
+    settings.gapFill = cmdline["fill"].as<unsigned int>();
+    settings.xMethod = settings.yMethod = SMOOTH_NONE;
+    settings.xWindow = settings.yWindow = 1;
+    settings.noise = cmdline["noise"].as<double>();
+    if (cmdline.count("reject") && !parseZWindow(cmdline["reject"].as<std::string>(), settings)) {
+        std::cerr << "<< Z window must be 'low,high' in mm with low < high, aborting >>" << std::endl;
+        return 1;
+    }
+    if ((cmdline.count("smooth-x") &&
+         !parseSmoothing(cmdline["smooth-x"].as<std::string>(), settings.xMethod, settings.xWindow)) ||
+        (cmdline.count("smooth-y") &&
+         !parseSmoothing(cmdline["smooth-y"].as<std::string>(), settings.yMethod, settings.yWindow))) {
+        std::cerr << "<< Smoothing must be 'median:n', 'mean:n' or 'wiener:n' with n odd, 3-"
+                  << FILTER_MAX_WINDOW << ", aborting >>" << std::endl;
+        return 1;
+    }
+    RangeFilter filter;
+    filter.reset(settings);
+    if (!filter.enabled()) {
+        std::cerr << "<< Nothing to do - give at least one of --reject, --fill, --smooth-x or --smooth-y >>" << std::endl;
+        return 1;
+    }
+    try {
+        ScanReader reader(inputFilename);
+        try {
+            filesystem::remove(outputFilename.c_str());
+            filesystem::remove((outputFilename + SCAN_INDEX_EXTENSION).c_str());
+        } catch (filesystem::filesystem_error &err) {
+            std::cerr << "<< Unable to overwrite '" << outputFilename << ",' appending >>" << std::endl;
+        }
+        OutputFile fidout;
+        if (!fidout.open(outputFilename)) {
+            std::cerr << "<< Unable to open/write to output file '" << outputFilename << "', aborting >>" << std::endl;
+            return 1;
+        }
+        ScanInfo info = reader.getInfo();
+        info.comment += " [" + filter.describe() + "]";
+        boost::shared_ptr<ProfileWriter> writer(createProfileWriter(output));
+        std::string block;
+        block.reserve(OUTPUT_BLOCK_SIZE*2);
+        writer->writeHeader(info, block);
+        ScanIndex index;
+        index.reset(info);
+        bool indexing = writer->indexable();
+        Profile profile;
+        const Profile* filtered;
+        bool reading = true;
+        while (reading) {
+            if (reader.next(profile)) {
+                filter.add(profile);
+            } else {
+                filter.finish();
+                reading = false;
+            }
+            while ((filtered = filter.next()) != NULL) {
+                if (indexing) {
+                    index.add(*filtered, fidout.bytesWritten() + block.size());
+                }
+                writer->writeProfile(*filtered, block);
+                if (block.size() >= OUTPUT_BLOCK_SIZE) {
+                    fidout.write(block);
+                    block.clear();
+                }
+            }
+        }
+        writer->writeFooter(block);
+        fidout.write(block);
+        fidout.close();
+        if (fidout.fail()) {
+            std::cerr << "<< Encountered error writing to '" << outputFilename << "' >>" << std::endl;
+            return 1;
+        }
+        if (!index.empty() && !index.save(outputFilename + SCAN_INDEX_EXTENSION)) {
+            std::cerr << "<< Unable to write index for '" << outputFilename << "' >>" << std::endl;
+        }
+        std::cout << "Filtered " << reader.profileCount() << " profiles to '" << outputFilename << "' ("
+                  << filter.describe() << "; " << filter.rejectedCount() << " points rejected, "
+                  << filter.filledCount() << " filled)" << std::endl;
+    } catch (std::runtime_error& err) {
+        std::cerr << "<< " << err.what() << " >>" << std::endl;
+        return 1;
+    }
+    return 0;
+}
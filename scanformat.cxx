@@ -0,0 +1,413 @@
+#include "scanformat.h"
+
+// Appends a plain value to the block in host byte order
+template<typename T> static void append(std::string& block, const T& value) {
+    block.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeScanHeader(const char* magic, Go2UInt32 version, const ScanInfo& info, std::string& block) {
+    block.append(magic, sizeof(SCAN_MAGIC));
+    append(block, version);
+    append(block, info.encoderResolution);
+    append(block, static_cast<Go2Int64>(info.startingEncoder));
+    append(block, static_cast<Go2UInt32>(info.comment.size()));
+    block += info.comment;
+}
+
+void BinaryProfileWriter::writeHeader(const ScanInfo& info, std::string& block) {
+    writeScanHeader(SCAN_MAGIC, SCAN_VERSION, info, block);
+    haveGeometry = false;
+}
+
+void BinaryProfileWriter::writeProfile(const Profile& profile, std::string& block) {
+    writeRecordHeader(profile, 0, block);
+    if (profile.width() > 0) {
+        block.append(reinterpret_cast<const char*>(profile.rangeData()), profile.width()*sizeof(short));
+    }
+}
+
+void BinaryProfileWriter::writeRecordHeader(const Profile& profile, Go2Byte flags, std::string& block) {
+    bool geometryChanged = !haveGeometry ||
+                           profile.xOffset != xOffset || profile.xResolution != xResolution ||
+                           profile.zOffset != zOffset || profile.zResolution != zResolution;
+    if (geometryChanged) {
+        flags |= SCAN_RECORD_GEOMETRY;
+    }
+    append(block, flags);
+    append(block, static_cast<Go2Int64>(profile.encoder));
+    append(block, static_cast<Go2UInt64>(profile.timestamp));
+    if (geometryChanged) {
+        xOffset = profile.xOffset;
+        xResolution = profile.xResolution;
+        zOffset = profile.zOffset;
+        zResolution = profile.zResolution;
+        haveGeometry = true;
+        append(block, xOffset);
+        append(block, xResolution);
+        append(block, zOffset);
+        append(block, zResolution);
+    }
+    append(block, static_cast<Go2UInt32>(profile.width()));
+}
+
+ScanIndex::ScanIndex(Go2UInt32 profilesPerEntry):
+interval(profilesPerEntry > 0 ? profilesPerEntry : 1), resolution(0), startingEncoder(0) {}
+
+void ScanIndex::reset(const ScanInfo& info) {
+    resolution = info.encoderResolution;
+    startingEncoder = info.startingEncoder;
+    entries.clear();
+    entries.reserve(4096);
+}
+
+// Adds the next profile, which starts at the specified file offset
+void ScanIndex::add(const Profile& profile, Go2UInt64 offset) {
+    if (entries.empty() || entries.back().profiles >= interval) {
+        ScanIndexEntry entry;
+        entry.firstProfile = entries.empty() ? 0 : entries.back().firstProfile + entries.back().profiles;
+        entry.profiles = 0;
+        entry.offset = offset;
+        entry.minEncoder = entry.maxEncoder = profile.encoder;
+        entry.xOffset = profile.xOffset;
+        entry.xResolution = profile.xResolution;
+        entry.zOffset = profile.zOffset;
+        entry.zResolution = profile.zResolution;
+        entries.push_back(entry);
+    }
+    ScanIndexEntry& entry = entries.back();
+    entry.minEncoder = std::min(entry.minEncoder, static_cast<Go2Int64>(profile.encoder));
+    entry.maxEncoder = std::max(entry.maxEncoder, static_cast<Go2Int64>(profile.encoder));
+    entry.profiles++;
+}
+
+bool ScanIndex::save(const std::string& filename) const {
+    std::string block;
+    block.reserve(64 + entries.size()*sizeof(ScanIndexEntry));
+    block.append(SCAN_INDEX_MAGIC, sizeof(SCAN_INDEX_MAGIC));
+    append(block, static_cast<Go2UInt32>(SCAN_INDEX_VERSION));
+    append(block, interval);
+    append(block, resolution);
+    append(block, startingEncoder);
+    append(block, static_cast<Go2UInt64>(entries.size()));
+    for (size_t i=0; i<entries.size(); i++) {
+        const ScanIndexEntry& entry = entries[i];
+        append(block, entry.firstProfile);
+        append(block, entry.profiles);
+        append(block, entry.offset);
+        append(block, entry.minEncoder);
+        append(block, entry.maxEncoder);
+        append(block, entry.xOffset);
+        append(block, entry.xResolution);
+        append(block, entry.zOffset);
+        append(block, entry.zResolution);
+    }
+    std::ofstream fidout(filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    fidout.write(block.data(), block.size());
+    return static_cast<bool>(fidout);
+}
+
+template<typename T> static bool read(std::istream& fidin, T& value) {
+    return static_cast<bool>(fidin.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool ScanIndex::load(const std::string& filename) {
+    std::ifstream fidin(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    char magic[sizeof(SCAN_INDEX_MAGIC)];
+    Go2UInt32 indexVersion;
+    Go2UInt64 entryCount;
+    if (!fidin.read(magic, sizeof(magic)) || memcmp(magic, SCAN_INDEX_MAGIC, sizeof(SCAN_INDEX_MAGIC)) != 0 ||
+        !read(fidin, indexVersion) || indexVersion != SCAN_INDEX_VERSION || !read(fidin, interval) ||
+        !read(fidin, resolution) || !read(fidin, startingEncoder) || !read(fidin, entryCount)) {
+        return false;
+    }
+    entries.resize(entryCount);
+    for (size_t i=0; i<entries.size(); i++) {
+        ScanIndexEntry& entry = entries[i];
+        if (!read(fidin, entry.firstProfile) || !read(fidin, entry.profiles) || !read(fidin, entry.offset) ||
+            !read(fidin, entry.minEncoder) || !read(fidin, entry.maxEncoder) ||
+            !read(fidin, entry.xOffset) || !read(fidin, entry.xResolution) ||
+            !read(fidin, entry.zOffset) || !read(fidin, entry.zResolution)) {
+            entries.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<ScanIndexEntry> ScanIndex::findY(double y0, double y1) const {
+    std::vector<ScanIndexEntry> found;
+    for (size_t i=0; i<entries.size(); i++) {
+        double first = position(entries[i].minEncoder);
+        double last = position(entries[i].maxEncoder);
+        if (std::max(first, last) >= y0 && std::min(first, last) <= y1) {
+            found.push_back(entries[i]);
+        }
+    }
+    return found;
+}
+
+std::vector<ScanIndexEntry> ScanIndex::findProfiles(Go2UInt64 first, Go2UInt64 last) const {
+    std::vector<ScanIndexEntry> found;
+    for (size_t i=0; i<entries.size(); i++) {
+        if (entries[i].firstProfile + entries[i].profiles > first && entries[i].firstProfile <= last) {
+            found.push_back(entries[i]);
+        }
+    }
+    return found;
+}
+
+ScanReader::ScanReader(const std::string& scanFilename):filename(scanFilename), version(0), count(0), recordNumber(0),
+xOffset(0), xResolution(0), zOffset(0), zResolution(0), compressed(false), chunkPosition(0),
+filterY(false), filterProfiles(false), indexed(false), nextEntry(0), entryProfiles(0) {
+    fidin.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!fidin.is_open()) {
+        throw std::runtime_error("Unable to open scan '" + filename + "'");
+    }
+    char magic[sizeof(SCAN_MAGIC)];
+    Go2UInt32 commentLength;
+    if (!fidin.read(magic, sizeof(magic))) {
+        throw std::runtime_error("'" + filename + "' is not a binary scan");
+    }
+    if (memcmp(magic, COMPRESSED_SCAN_MAGIC, sizeof(SCAN_MAGIC)) == 0) {
+        compressed = true;
+    } else if (memcmp(magic, SCAN_MAGIC, sizeof(SCAN_MAGIC)) != 0) {
+        throw std::runtime_error("'" + filename + "' is not a binary scan");
+    }
+    Go2UInt32 latest = compressed ? COMPRESSED_SCAN_VERSION : SCAN_VERSION;
+    if (!readFile(version) || version < 1 || version > latest) {
+        throw std::runtime_error("Unsupported binary scan version in '" + filename + "'");
+    }
+    if (!readFile(info.encoderResolution) || !readFile(info.startingEncoder) || !readFile(commentLength)) {
+        throw std::runtime_error("Truncated header in '" + filename + "'");
+    }
+    info.comment.resize(commentLength);
+    if (commentLength > 0 && !fidin.read(&info.comment[0], commentLength)) {
+        throw std::runtime_error("Truncated header in '" + filename + "'");
+    }
+    Go2UInt32 chunkProfiles;
+    if (compressed && !readFile(chunkProfiles)) {
+        throw std::runtime_error("Truncated header in '" + filename + "'");
+    }
+    dataOffset = fidin.tellg();
+}
+
+bool ScanReader::readBytes(char* data, size_t length) {
+    if (!compressed) {
+        return static_cast<bool>(fidin.read(data, length));
+    }
+    if (chunk.size() - chunkPosition < length) {
+        return false;
+    }
+    memcpy(data, chunk.data() + chunkPosition, length);
+    chunkPosition += length;
+    return true;
+}
+
+// Inflates the next chunk of a compressed scan, returns false at the chunk index
+bool ScanReader::nextChunk() {
+    Go2UInt32 profiles, rawSize, packedSize;
+    if (!readFile(profiles) || profiles == 0 || !readFile(rawSize) || !readFile(packedSize)) {
+        return false;
+    }
+    packed.resize(packedSize);
+    chunk.resize(rawSize);
+    chunkPosition = 0;
+    if (packedSize > 0 && !fidin.read(&packed[0], packedSize)) {
+        return false;
+    }
+    uLongf inflated = rawSize;
+    if (uncompress(reinterpret_cast<Bytef*>(&chunk[0]), &inflated,
+                   reinterpret_cast<const Bytef*>(packed.data()), packedSize) != Z_OK || inflated != rawSize) {
+        throw std::runtime_error("Corrupt chunk in '" + filename + "'");
+    }
+    previous.clear();
+    return true;
+}
+
+// Undoes the residual coding of a compressed record
+bool ScanReader::readResiduals(Go2Byte flags, Profile& profile) {
+    size_t width = profile.ranges.size();
+    if (chunk.size() - chunkPosition < width*sizeof(short)) {
+        return false;
+    }
+    const unsigned char* low = reinterpret_cast<const unsigned char*>(chunk.data() + chunkPosition);
+    const unsigned char* high = low + width;
+    bool predicted = (flags & SCAN_RECORD_PREDICTED) && previous.size() == width;
+    // Unsigned arithmetic - residuals wrap around, invalid ranges included
+    unsigned short left = 0, aboveLeft = 0;
+    for (size_t i=0; i<width; i++) {
+        unsigned short value = static_cast<unsigned short>(low[i] | (high[i] << 8)) + left;
+        if (predicted) {
+            unsigned short above = static_cast<unsigned short>(previous[i]);
+            value += above - aboveLeft;
+            aboveLeft = above;
+        }
+        profile.ranges[i] = static_cast<short>(value);
+        left = value;
+    }
+    chunkPosition += width*sizeof(short);
+    previous.assign(profile.ranges.begin(), profile.ranges.end());
+    return true;
+}
+
+// Reads the next profile, returns false at the end of the scan (or selection).
+// A partial record at the end (e.g. recording was cut off) is ignored.
+bool ScanReader::next(Profile& profile) {
+    while (true) {
+        if (indexed && entryProfiles == 0) {
+            if (nextEntry >= selection.size()) {
+                return false;
+            }
+            seek(selection[nextEntry++]);
+        }
+        if (!nextRecord(profile)) {
+            return false;
+        }
+        if (indexed) {
+            entryProfiles--;
+        }
+        if (selected(profile)) {
+            count++;
+            return true;
+        }
+        // Past the last selected profile number - nothing more to find
+        if (filterProfiles && recordNumber > lastProfile) {
+            return false;
+        }
+    }
+}
+
+bool ScanReader::nextRecord(Profile& profile) {
+    Go2Byte flags;
+    Go2UInt32 width;
+    if (compressed && chunkPosition >= chunk.size() && !nextChunk()) {
+        return false;
+    }
+    if (!read(flags) || !read(profile.encoder)) {
+        return false;
+    }
+    profile.timestamp = 0;
+    if ((compressed || version >= 2) && !read(profile.timestamp)) {
+        return false;
+    }
+    if (flags & SCAN_RECORD_GEOMETRY) {
+        if (!read(xOffset) || !read(xResolution) || !read(zOffset) || !read(zResolution)) {
+            return false;
+        }
+    }
+    if (!read(width)) {
+        return false;
+    }
+    profile.xOffset = xOffset;
+    profile.xResolution = xResolution;
+    profile.zOffset = zOffset;
+    profile.zResolution = zResolution;
+    profile.release();
+    profile.ranges.resize(width);
+    if (compressed) {
+        if (!readResiduals(flags, profile)) {
+            return false;
+        }
+    } else if (width > 0 && !readBytes(reinterpret_cast<char*>(&profile.ranges[0]), width*sizeof(short))) {
+        return false;
+    }
+    recordNumber++;
+    return true;
+}
+
+bool ScanReader::selectY(double y0, double y1) {
+    filterY = true;
+    filterProfiles = false;
+    yFrom = std::min(y0, y1);
+    yTo = std::max(y0, y1);
+    ScanIndex index;
+    bool haveIndex = loadIndex(index);
+    return select(index.findY(yFrom, yTo), haveIndex);
+}
+
+bool ScanReader::selectProfiles(Go2UInt64 first, Go2UInt64 last) {
+    filterY = false;
+    filterProfiles = true;
+    firstProfile = first;
+    lastProfile = last;
+    ScanIndex index;
+    bool haveIndex = loadIndex(index);
+    return select(index.findProfiles(firstProfile, lastProfile), haveIndex);
+}
+
+// Compressed scans carry their chunk index at the end, others have a side index
+bool ScanReader::loadIndex(ScanIndex& index) {
+    if (!compressed) {
+        return index.load(filename + SCAN_INDEX_EXTENSION);
+    }
+    char magic[sizeof(COMPRESSED_INDEX_MAGIC)];
+    Go2UInt64 indexOffset, chunkCount;
+    Go2UInt32 marker;
+    fidin.clear();
+    fidin.seekg(-static_cast<std::streamoff>(sizeof(magic) + sizeof(indexOffset)), std::ios_base::end);
+    if (!readFile(indexOffset) || !fidin.read(magic, sizeof(magic)) ||
+        memcmp(magic, COMPRESSED_INDEX_MAGIC, sizeof(COMPRESSED_INDEX_MAGIC)) != 0) {
+        // Recording was cut off before the index was written
+        return false;
+    }
+    fidin.seekg(indexOffset);
+    if (!readFile(marker) || marker != 0 || !readFile(chunkCount)) {
+        return false;
+    }
+    ScanInfo chunkInfo = info;
+    index.reset(chunkInfo);
+    for (Go2UInt64 i=0; i<chunkCount; i++) {
+        ScanIndexEntry entry;
+        if (!readFile(entry.offset) || !readFile(entry.firstProfile) || !readFile(entry.profiles) ||
+            !readFile(entry.minEncoder) || !readFile(entry.maxEncoder)) {
+            return false;
+        }
+        // Geometry is at the start of every chunk
+        entry.xOffset = entry.xResolution = entry.zOffset = entry.zResolution = 0;
+        index.add(entry);
+    }
+    return true;
+}
+
+// Rewinds to the first selected profile
+bool ScanReader::select(const std::vector<ScanIndexEntry>& entries, bool haveIndex) {
+    indexed = haveIndex;
+    selection = entries;
+    nextEntry = 0;
+    entryProfiles = 0;
+    count = 0;
+    if (!indexed) {
+        ScanIndexEntry start;
+        start.firstProfile = 0;
+        start.profiles = 0;
+        start.offset = dataOffset;
+        start.xOffset = start.xResolution = start.zOffset = start.zResolution = 0;
+        seek(start);
+    }
+    return indexed;
+}
+
+void ScanReader::seek(const ScanIndexEntry& entry) {
+    fidin.clear();
+    fidin.seekg(entry.offset);
+    recordNumber = entry.firstProfile;
+    entryProfiles = entry.profiles;
+    xOffset = entry.xOffset;
+    xResolution = entry.xResolution;
+    zOffset = entry.zOffset;
+    zResolution = entry.zResolution;
+    chunk.clear();
+    chunkPosition = 0;
+    previous.clear();
+}
+
+bool ScanReader::selected(const Profile& profile) {
+    if (filterY) {
+        double y = position(profile.encoder);
+        return y >= yFrom && y <= yTo;
+    }
+    if (filterProfiles) {
+        return profileNumber() >= firstProfile && profileNumber() <= lastProfile;
+    }
+    return true;
+}
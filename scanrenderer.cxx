@@ -0,0 +1,403 @@
+#include "scanrenderer.h"
+
+static bool invalidZ(double z) {
+    return static_cast<float>(z) == static_cast<float>(RENDER_INVALID_Z);
+}
+
+static void loadMapped(const std::string& filename, ScanPoints& points) {
+    MappedScan scan(filename);
+    const std::vector<MappedProfile>& profiles = scan.getProfiles();
+    size_t total = 0;
+    for (size_t i=0; i<profiles.size(); i++) {
+        total += profiles[i].width;
+    }
+    points.x.reserve(total);
+    points.y.reserve(total);
+    points.z.reserve(total);
+    std::vector<short> ranges;
+    for (size_t i=0; i<profiles.size(); i++) {
+        const MappedProfile& profile = profiles[i];
+        // Copied out - ranges in a mapped scan aren't aligned
+        ranges.resize(profile.width);
+        if (profile.width > 0) {
+            memcpy(&ranges[0], scan.data() + profile.offset, profile.width*sizeof(short));
+        }
+        double y = scan.position(profile.encoder);
+        for (size_t j=0; j<ranges.size(); j++) {
+            if (ranges[j] != static_cast<short>(INVALID_RANGE_16BIT)) {
+                points.add(profile.xOffset + j*profile.xResolution, y, profile.zOffset + ranges[j]*profile.zResolution);
+            }
+        }
+    }
+}
+
+static void loadColumnar(const std::string& filename, ScanPoints& points) {
+    ColumnarScanReader reader(filename);
+    ColumnBlock block;
+    while (reader.next(block)) {
+        size_t point = 0;
+        for (size_t p=0; p<block.profiles(); p++) {
+            for (Go2UInt32 i=0; i<block.profilePoints[p]; i++, point++) {
+                if (!invalidZ(block.z[point])) {
+                    points.add(block.x[point], block.y[p], block.z[point]);
+                }
+            }
+        }
+    }
+}
+
+static void loadCsv(const std::string& filename, ScanPoints& points) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Unable to open scan '" + filename + "'");
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    if (size == 0) {
+        close(fd);
+        return;
+    }
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Unable to map '" + filename + "'");
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const char* p = static_cast<const char*>(mapped);
+    const char* end = p + size;
+    while (p < end) {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+        double x, y, z;
+        if (*p != '#' && parseXyz(p, lineEnd, x, y, z) && !invalidZ(z)) {
+            points.add(x, y, z);
+        }
+        p = lineEnd + 1;
+    }
+    munmap(mapped, size);
+}
+
+void loadScanPoints(const std::string& filename, ScanPoints& points) {
+    char magic[sizeof(SCAN_MAGIC)] = {0};
+    std::ifstream fidin(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!fidin.is_open()) {
+        throw std::runtime_error("Unable to open scan '" + filename + "'");
+    }
+    fidin.read(magic, sizeof(magic));
+    fidin.close();
+    if (memcmp(magic, SCAN_MAGIC, sizeof(magic)) == 0 || memcmp(magic, COMPRESSED_SCAN_MAGIC, sizeof(magic)) == 0) {
+        loadMapped(filename, points);
+    } else if (memcmp(magic, COLUMNAR_MAGIC, sizeof(magic)) == 0) {
+        loadColumnar(filename, points);
+    } else {
+        loadCsv(filename, points);
+    }
+}
+
+ScanRenderer::ScanRenderer(const RenderSettings& renderSettings, unsigned int threads):settings(renderSettings),
+threadCount(threads > 0 ? threads : 1), xLow(0), xHigh(0), yLow(0), yHigh(0), zLow(0), zHigh(0), bands(0) {
+    settings.width = std::max(settings.width, static_cast<unsigned int>(RENDER_MARGIN_LEFT + RENDER_MARGIN_RIGHT +
+                                                                        RENDER_MIN_PLOT));
+    settings.height = std::max(settings.height, static_cast<unsigned int>(RENDER_MARGIN_TOP + RENDER_MARGIN_BOTTOM +
+                                                                          RENDER_MIN_PLOT));
+}
+
+static void runBody(boost::atomic<size_t>* next, size_t count, const boost::function<void (size_t)>* body) {
+    size_t index;
+    while ((index = next->fetch_add(1)) < count) {
+        (*body)(index);
+    }
+}
+
+// Calls body(0) to body(count-1) on up to `threads` threads, each taking the next index as it finishes
+void ScanRenderer::parallelFor(size_t count, unsigned int threads, const boost::function<void (size_t)>& body) {
+    if (threads <= 1 || count <= 1) {
+        for (size_t i=0; i<count; i++) {
+            body(i);
+        }
+        return;
+    }
+    boost::atomic<size_t> next(0);
+    boost::thread_group workers;
+    for (size_t i=0; i<std::min<size_t>(threads, count); i++) {
+        workers.create_thread(boost::bind(runBody, &next, count, &body));
+    }
+    workers.join_all();
+}
+
+void ScanRenderer::render(const ScanPoints& points) {
+    image.assign(static_cast<size_t>(settings.width)*settings.height*3, 255);
+    findExtents(points);
+    bands = (plotHeight() + RENDER_BAND_ROWS - 1)/RENDER_BAND_ROWS;
+    size_t slices = threadCount;
+    pixelOf.resize(points.size());
+    binStarts.assign(slices, std::vector<size_t>(bands, 0));
+    parallelFor(slices, threadCount, boost::bind(&ScanRenderer::locate, this, boost::cref(points), _1, slices));
+    // Band by band and within each band slice by slice, so the points keep their order
+    bandStarts.assign(bands + 1, 0);
+    size_t total = 0;
+    for (size_t b=0; b<bands; b++) {
+        bandStarts[b] = total;
+        for (size_t s=0; s<slices; s++) {
+            size_t count = binStarts[s][b];
+            binStarts[s][b] = total;
+            total += count;
+        }
+    }
+    bandStarts[bands] = total;
+    binned.resize(total);
+    parallelFor(slices, threadCount, boost::bind(&ScanRenderer::bin, this, boost::cref(points), _1, slices));
+    parallelFor(bands, threadCount, boost::bind(&ScanRenderer::drawBand, this, _1));
+    drawFrame();
+}
+
+void ScanRenderer::findExtents(const ScanPoints& points) {
+    if (points.size() == 0) {
+        xLow = yLow = zLow = 0;
+        xHigh = yHigh = zHigh = 1;
+    } else {
+        float xMin = points.x[0], xMax = points.x[0], yMin = points.y[0], yMax = points.y[0];
+        float zMin = points.z[0], zMax = points.z[0];
+        for (size_t i=1; i<points.size(); i++) {
+            xMin = std::min(xMin, points.x[i]);
+            xMax = std::max(xMax, points.x[i]);
+            yMin = std::min(yMin, points.y[i]);
+            yMax = std::max(yMax, points.y[i]);
+            zMin = std::min(zMin, points.z[i]);
+            zMax = std::max(zMax, points.z[i]);
+        }
+        xLow = xMin;
+        xHigh = xMax;
+        yLow = yMin;
+        yHigh = yMax;
+        zLow = zMin;
+        zHigh = zMax;
+    }
+    if (settings.zLow < settings.zHigh) {
+        zLow = settings.zLow;
+        zHigh = settings.zHigh;
+    }
+}
+
+// Finds the pixel of each point in one slice and counts them by band
+void ScanRenderer::locate(const ScanPoints& points, size_t slice, size_t slices) {
+    size_t first = points.size()*slice/slices, last = points.size()*(slice + 1)/slices;
+    unsigned int columns = plotWidth(), rows = plotHeight();
+    double xScale = xHigh > xLow ? columns/(xHigh - xLow) : 0;
+    double yScale = yHigh > yLow ? rows/(yHigh - yLow) : 0;
+    std::vector<size_t>& counts = binStarts[slice];
+    for (size_t i=first; i<last; i++) {
+        unsigned int column = std::min(columns - 1, static_cast<unsigned int>((points.x[i] - xLow)*xScale));
+        unsigned int row = std::min(rows - 1, static_cast<unsigned int>((yHigh - points.y[i])*yScale));
+        pixelOf[i] = row*columns + column;
+        counts[row/RENDER_BAND_ROWS]++;
+    }
+}
+
+void ScanRenderer::bin(const ScanPoints& points, size_t slice, size_t slices) {
+    size_t first = points.size()*slice/slices, last = points.size()*(slice + 1)/slices;
+    size_t bandPixels = static_cast<size_t>(plotWidth())*RENDER_BAND_ROWS;
+    std::vector<size_t>& next = binStarts[slice];
+    for (size_t i=first; i<last; i++) {
+        BinnedPoint& point = binned[next[pixelOf[i]/bandPixels]++];
+        point.pixel = pixelOf[i];
+        point.z = points.z[i];
+    }
+}
+
+// Averages the points of one tile and colours its pixels
+void ScanRenderer::drawBand(size_t band) {
+    unsigned int columns = plotWidth();
+    size_t firstRow = band*RENDER_BAND_ROWS;
+    size_t rows = std::min<size_t>(RENDER_BAND_ROWS, plotHeight() - firstRow);
+    size_t firstPixel = firstRow*columns;
+    std::vector<double> sums(rows*columns, 0);
+    std::vector<Go2UInt32> counts(rows*columns, 0);
+    for (size_t i=bandStarts[band]; i<bandStarts[band + 1]; i++) {
+        size_t pixel = binned[i].pixel - firstPixel;
+        sums[pixel] += binned[i].z;
+        counts[pixel]++;
+    }
+    for (size_t row=0; row<rows; row++) {
+        Go2Byte* out = &image[((RENDER_MARGIN_TOP + firstRow + row)*settings.width + RENDER_MARGIN_LEFT)*3];
+        for (size_t column=0; column<columns; column++, out+=3) {
+            size_t pixel = row*columns + column;
+            if (counts[pixel] > 0) {
+                colour(sums[pixel]/counts[pixel], out);
+            }
+        }
+    }
+}
+
+// Viridis, sampled at nine points and interpolated
+void ScanRenderer::colour(double z, Go2Byte* rgb) const {
+    static const Go2Byte map[9][3] = {{68, 1, 84}, {71, 44, 122}, {59, 81, 139}, {44, 113, 142}, {33, 144, 141},
+                                      {39, 173, 129}, {92, 200, 99}, {170, 220, 50}, {253, 231, 37}};
+    double t = zHigh > zLow ? (z - zLow)/(zHigh - zLow) : 0.5;
+    t = std::min(1.0, std::max(0.0, t))*8;
+    size_t i = std::min(static_cast<size_t>(t), static_cast<size_t>(7));
+    double f = t - i;
+    for (int c=0; c<3; c++) {
+        rgb[c] = static_cast<Go2Byte>(map[i][c] + (map[i + 1][c] - map[i][c])*f + 0.5);
+    }
+}
+
+void ScanRenderer::fill(int x0, int y0, int x1, int y1, const Go2Byte* rgb) {
+    for (int y=std::max(0, y0); y<=y1 && y<static_cast<int>(settings.height); y++) {
+        for (int x=std::max(0, x0); x<=x1 && x<static_cast<int>(settings.width); x++) {
+            memcpy(&image[(static_cast<size_t>(y)*settings.width + x)*3], rgb, 3);
+        }
+    }
+}
+
+// 5x7 glyphs for the labels, one row per byte, high bit on the left
+static const Go2Byte* glyph(char c) {
+    static const char characters[] = "0123456789-.+eXYZm[] ";
+    static const Go2Byte glyphs[][7] = {
+        {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+        {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+        {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+        {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+        {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},
+        {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C},
+        {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00}, {0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E},
+        {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, {0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04},
+        {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, {0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11},
+        {0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E}, {0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
+    };
+    const char* found = strchr(characters, c);
+    return glyphs[found != NULL && c != '\0' ? found - characters : sizeof(characters) - 2];
+}
+
+// Black text with its top left (or top right) corner at x, y
+void ScanRenderer::drawText(int x, int y, const std::string& text, bool alignRight) {
+    static const Go2Byte black[3] = {0, 0, 0};
+    if (alignRight) {
+        x -= 6*static_cast<int>(text.size()) - 1;
+    }
+    for (size_t c=0; c<text.size(); c++, x+=6) {
+        const Go2Byte* rows = glyph(text[c]);
+        for (int row=0; row<7; row++) {
+            for (int column=0; column<5; column++) {
+                if (rows[row] & (0x10 >> column)) {
+                    fill(x + column, y + row, x + column, y + row, black);
+                }
+            }
+        }
+    }
+}
+
+static std::string label(double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.2f", value);
+    return std::string(text);
+}
+
+void ScanRenderer::drawFrame() {
+    static const Go2Byte black[3] = {0, 0, 0};
+    int left = RENDER_MARGIN_LEFT, top = RENDER_MARGIN_TOP;
+    int right = left + plotWidth() - 1, bottom = top + plotHeight() - 1;
+    fill(left - 1, top - 1, right + 1, top - 1, black);
+    fill(left - 1, bottom + 1, right + 1, bottom + 1, black);
+    fill(left - 1, top - 1, left - 1, bottom + 1, black);
+    fill(right + 1, top - 1, right + 1, bottom + 1, black);
+    drawText(left - 4, top, label(yHigh), true);
+    drawText(left - 4, bottom - 6, label(yLow), true);
+    drawText(4, (top + bottom)/2 - 3, "Y [mm]", false);
+    drawText(left, bottom + 5, label(xLow), false);
+    drawText(right, bottom + 5, label(xHigh), true);
+    drawText((left + right)/2 - 18, bottom + 16, "X [mm]", false);
+    // Colour bar, high Z at the top
+    int barLeft = right + 12, barRight = barLeft + RENDER_BAR_WIDTH - 1;
+    for (int y=top; y<=bottom; y++) {
+        Go2Byte rgb[3];
+        colour(zHigh - (zHigh - zLow)*(y - top)/std::max(1, bottom - top), rgb);
+        fill(barLeft, y, barRight, y, rgb);
+    }
+    fill(barLeft - 1, top - 1, barRight + 1, top - 1, black);
+    fill(barLeft - 1, bottom + 1, barRight + 1, bottom + 1, black);
+    fill(barLeft - 1, top - 1, barLeft - 1, bottom + 1, black);
+    fill(barRight + 1, top - 1, barRight + 1, bottom + 1, black);
+    drawText(barRight + 5, top, label(zHigh), false);
+    drawText(barRight + 5, bottom - 6, label(zLow), false);
+    drawText(barRight + 5, (top + bottom)/2 - 3, "Z [mm]", false);
+}
+
+static void appendBigEndian(std::string& out, Go2UInt32 value) {
+    char bytes[4] = {static_cast<char>(value >> 24), static_cast<char>(value >> 16), static_cast<char>(value >> 8),
+                     static_cast<char>(value)};
+    out.append(bytes, 4);
+}
+
+static void writeChunk(std::ofstream& fidout, const char* type, const std::string& data) {
+    std::string chunk;
+    appendBigEndian(chunk, static_cast<Go2UInt32>(data.size()));
+    chunk.append(type, 4);
+    chunk += data;
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(chunk.data() + 4), static_cast<uInt>(chunk.size() - 4));
+    appendBigEndian(chunk, static_cast<Go2UInt32>(crc));
+    fidout.write(chunk.data(), chunk.size());
+}
+
+// 8-bit RGB, no filtering, one zlib stream
+bool ScanRenderer::savePng(std::ofstream& fidout) const {
+    static const char signature[8] = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n'};
+    fidout.write(signature, sizeof(signature));
+    std::string header;
+    appendBigEndian(header, settings.width);
+    appendBigEndian(header, settings.height);
+    header += std::string("\x08\x02\x00\x00\x00", 5);
+    writeChunk(fidout, "IHDR", header);
+    size_t stride = settings.width*3;
+    std::string raw;
+    raw.reserve((stride + 1)*settings.height);
+    for (size_t row=0; row<settings.height; row++) {
+        raw += '\0';
+        raw.append(reinterpret_cast<const char*>(&image[row*stride]), stride);
+    }
+    uLongf packedSize = compressBound(raw.size());
+    std::string packed(packedSize, '\0');
+    if (compress2(reinterpret_cast<Bytef*>(&packed[0]), &packedSize, reinterpret_cast<const Bytef*>(raw.data()),
+                  raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return false;
+    }
+    packed.resize(packedSize);
+    writeChunk(fidout, "IDAT", packed);
+    writeChunk(fidout, "IEND", std::string());
+    return true;
+}
+
+bool ScanRenderer::save(const std::string& filename) const {
+    std::ofstream fidout(filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!fidout.is_open() || image.empty()) {
+        return false;
+    }
+    if (settings.ppm) {
+        fidout << "P6\n" << settings.width << " " << settings.height << "\n255\n";
+        fidout.write(reinterpret_cast<const char*>(&image[0]), image.size());
+    } else if (!savePng(fidout)) {
+        return false;
+    }
+    fidout.close();
+    return !fidout.fail();
+}
+
+bool parseImageSize(const std::string& text, RenderSettings& settings) {
+    unsigned int width, height;
+    char separator;
+    std::istringstream parser(text);
+    if (!(parser >> width >> separator >> height) || separator != 'x' || !parser.eof() ||
+        width < RENDER_MARGIN_LEFT + RENDER_MARGIN_RIGHT + RENDER_MIN_PLOT ||
+        height < RENDER_MARGIN_TOP + RENDER_MARGIN_BOTTOM + RENDER_MIN_PLOT) {
+        return false;
+    }
+    settings.width = width;
+    settings.height = height;
+    return true;
+}
@@ -0,0 +1,196 @@
+#include "scanserver.h"
+
+void ScanServer::run(const volatile std::sig_atomic_t& stopRequested) {
+    bool serving = true;
+    while (serving && !stopRequested) {
+        ScanSocket client;
+        if (!socket.accept(client, SCAN_SERVER_POLL)) {
+            continue;
+        }
+        std::string request, reply;
+        int idle = 0;
+        while (serving && !stopRequested) {
+            if (!client.readLine(request, SCAN_SERVER_POLL)) {
+                idle += SCAN_SERVER_POLL;
+                if (!client.timedOut() || idle >= SCAN_CLIENT_IDLE) {
+                    break;
+                }
+                continue;
+            }
+            idle = 0;
+            serving = handle(request, reply);
+            if (verbose) {
+                std::cout << "<< " << request << ": " << reply << " >>" << std::endl;
+            }
+            if (!client.writeLine(reply)) {
+                break;
+            }
+        }
+    }
+    stopRecording();
+    socket.close();
+}
+
+bool ScanServer::handle(const std::string& request, std::string& reply) {
+    std::istringstream words(request);
+    std::string command;
+    words >> command;
+    if (command == "start") {
+        std::string outputFilename, commentString;
+        words >> outputFilename;
+        std::getline(words >> std::ws, commentString);
+        reply = outputFilename.empty() ? "error no output file given" : start(outputFilename, commentString);
+    } else if (command == "stop") {
+        reply = stop();
+    } else if (command == "status") {
+        reply = status();
+    } else if (command == "configure") {
+        reply = configure();
+    } else if (command == "shutdown") {
+        stopRecording();
+        reply = "ok shutting down";
+        return false;
+    } else {
+        reply = "error unknown request '" + command + "'";
+    }
+    return true;
+}
+
+std::string ScanServer::start(const std::string& outputFilename, const std::string& commentString) {
+    if (recorder.joinable()) {
+        boost::lock_guard<boost::mutex> guard(lock);
+        if (running) {
+            return "error already recording '" + output + "'";
+        }
+    }
+    stopRecording();
+    try {
+        if (config.reload()) {
+            apply(*config.current());
+        }
+    } catch (std::runtime_error &err) {
+        return std::string("error ") + err.what();
+    }
+    output = outputFilename;
+    started = boost::posix_time::microsec_clock::local_time();
+    {
+        boost::lock_guard<boost::mutex> guard(lock);
+        running = true;
+        failure.clear();
+    }
+    recorder = boost::thread(&ScanServer::record, this, outputFilename, commentString);
+    return "ok recording '" + outputFilename + "'";
+}
+
+std::string ScanServer::stop() {
+    if (!recorder.joinable()) {
+        return "error not recording";
+    }
+    double seconds = recordingSeconds();
+    bool stopped;
+    {
+        boost::lock_guard<boost::mutex> guard(lock);
+        stopped = running;
+    }
+    stopRecording();
+    boost::lock_guard<boost::mutex> guard(lock);
+    if (!failure.empty()) {
+        return "error '" + output + "' " + failure;
+    }
+    std::ostringstream reply;
+    if (stopped) {
+        reply << "ok stopped '" << output << "' after " << seconds << " s";
+    } else {
+        reply << "ok finished '" << output << "'";
+    }
+    return reply.str();
+}
+
+std::string ScanServer::status() {
+    boost::lock_guard<boost::mutex> guard(lock);
+    if (!recorder.joinable()) {
+        return "ok idle";
+    }
+    std::ostringstream reply;
+    if (running) {
+        reply << "ok recording '" << output << "' for " << recordingSeconds() << " s";
+    } else if (failure.empty()) {
+        reply << "ok finished '" << output << "'";
+    } else {
+        reply << "error '" << output << "' " << failure;
+    }
+    return reply.str();
+}
+
+std::string ScanServer::configure() {
+    {
+        boost::lock_guard<boost::mutex> guard(lock);
+        if (recorder.joinable() && running) {
+            return "error can't configure while recording";
+        }
+    }
+    config.reload();
+    try {
+        apply(*config.current());
+    } catch (std::runtime_error &err) {
+        return std::string("error ") + err.what();
+    }
+    return "ok configured from '" + config.current()->filename + "'";
+}
+
+void ScanServer::apply(const ScanConfig& scanConfig) {
+    control.setReduction(scanConfig.reduction);
+    Encoder lme = scanConfig.encoder;
+    if (!live) {
+        control.setEncoder(lme, 0);
+        return;
+    }
+    control.configureEncoder(lme);
+    boost::shared_ptr<Trigger> trigger(GocatorConfigurator::configuredTrigger(scanConfig));
+    trigger->set(control);
+    GocatorFilter filtration = scanConfig.filter;
+    control.configureFilter(filtration);
+    if (!control.applySettings()) {
+        throw std::runtime_error("Gocator didn't accept every setting");
+    }
+    if (verbose) {
+        std::cout << "<< Configured from '" << scanConfig.filename << "' >>" << std::endl;
+    }
+}
+
+void ScanServer::stopRecording() {
+    if (recorder.joinable()) {
+        recorder.interrupt();
+        recorder.join();
+    }
+}
+
+// Recording thread - one scan, from a fresh source each time
+void ScanServer::record(std::string outputFilename, std::string commentString) {
+    try {
+        boost::shared_ptr<ProfileSource> source;
+        if (live) {
+            control.resetEncoder();
+            source.reset(new LiveProfileSource(control.getSystem(), verbose));
+        } else {
+            source.reset(new SyntheticProfileSource(standIn));
+        }
+        if (commentString.empty()) {
+            std::ostringstream tsStream;
+            boost::posix_time::time_facet* const f = new boost::posix_time::time_facet("%H:%M:%S %Y%b%d");
+            tsStream.imbue(std::locale(tsStream.getloc(), f));
+            tsStream << boost::posix_time::second_clock::local_time();
+            commentString = "Scan Initiated " + tsStream.str();
+        }
+        control.recordProfile(*source, outputFilename, commentString);
+    } catch (std::runtime_error &err) {
+        boost::lock_guard<boost::mutex> guard(lock);
+        failure = err.what();
+    }
+    boost::lock_guard<boost::mutex> guard(lock);
+    running = false;
+}
+
+double ScanServer::recordingSeconds() const {
+    return (boost::posix_time::microsec_clock::local_time() - started).total_microseconds()/1e6;
+}
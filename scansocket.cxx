@@ -0,0 +1,141 @@
+#include "scansocket.h"
+#include <poll.h>
+
+bool ScanSocket::address(const std::string& path, struct sockaddr_un& addr) {
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+bool ScanSocket::listen(const std::string& socketPath) {
+    struct sockaddr_un addr;
+    if (!address(socketPath, addr)) {
+        return false;
+    }
+    close();
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    // A socket file left by a server that's no longer there refuses connections
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0) {
+        if (::connect(probe, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+            ::close(probe);
+            close();
+            errno = EADDRINUSE;
+            return false;
+        }
+        ::close(probe);
+    }
+    ::unlink(socketPath.c_str());
+    if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 4) != 0) {
+        close();
+        return false;
+    }
+    path = socketPath;
+    return true;
+}
+
+bool ScanSocket::accept(ScanSocket& client, int timeoutMilliseconds) {
+    struct pollfd waiting;
+    waiting.fd = fd;
+    waiting.events = POLLIN;
+    if (::poll(&waiting, 1, timeoutMilliseconds) <= 0) {
+        return false;
+    }
+    int accepted = ::accept(fd, NULL, NULL);
+    if (accepted < 0) {
+        return false;
+    }
+    client.close();
+    client.fd = accepted;
+    return true;
+}
+
+bool ScanSocket::connect(const std::string& socketPath) {
+    struct sockaddr_un addr;
+    if (!address(socketPath, addr)) {
+        return false;
+    }
+    close();
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool ScanSocket::writeLine(const std::string& line) {
+    std::string message = line + "\n";
+    size_t sent = 0;
+    while (sent < message.size()) {
+        ssize_t count = ::send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += count;
+    }
+    return true;
+}
+
+bool ScanSocket::readLine(std::string& line, int timeoutMilliseconds) {
+    char buffer[512];
+    size_t end;
+    expired = false;
+    while ((end = pending.find('\n')) == std::string::npos) {
+        if (pending.size() > SCAN_MAX_REQUEST) {
+            return false;
+        }
+        if (timeoutMilliseconds >= 0) {
+            struct pollfd waiting;
+            waiting.fd = fd;
+            waiting.events = POLLIN;
+            int ready = ::poll(&waiting, 1, timeoutMilliseconds);
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready == 0) {
+                expired = true;
+                return false;
+            }
+            if (ready < 0) {
+                return false;
+            }
+        }
+        ssize_t count = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        pending.append(buffer, count);
+    }
+    line = pending.substr(0, end);
+    pending.erase(0, end + 1);
+    return true;
+}
+
+void ScanSocket::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    if (!path.empty()) {
+        ::unlink(path.c_str());
+        path.clear();
+    }
+    pending.clear();
+}
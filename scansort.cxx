@@ -0,0 +1,138 @@
+/* scansort - puts a recorded binary or compressed Gocator scan in Y order
+
+Usage: scansort input.scan output.scan [--format binary|compressed|csv] [--duplicates keep|last|average]
+                [--memory MB] [--threads n] [--temp folder]
+Bidirectional or reverse travel records profiles out of Y order; this writes
+them back out in order (with an index, so Y selection works on the result)
+using no more than --memory for profiles however long the scan is - see
+include/scansorter.h.  Profiles with the same encoder count are all kept,
+reduced to the last one recorded, or averaged, per --duplicates.
+*/
+#include "scanformat.h"
+#include "profilewriter.h"
+#include "outputfile.h"
+#include "scansorter.h"
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <iostream>
+#include <string>
+
+namespace opts = boost::program_options;
+namespace filesystem = boost::filesystem;
+
+// Writes the sorted profiles as they come out of the merge
+typedef struct sortedOutput {
+    OutputFile fidout;
+    boost::shared_ptr<ProfileWriter> writer;
+    std::string block;
+    ScanIndex index;
+    bool indexing;
+
+    void write(const Profile& profile) {
+        if (indexing) {
+            index.add(profile, fidout.bytesWritten() + block.size());
+        }
+        writer->writeProfile(profile, block);
+        if (block.size() >= OUTPUT_BLOCK_SIZE) {
+            fidout.write(block);
+            block.clear();
+        }
+    }
+} SortedOutput;
+
+int main(int argc, char* argv[]) {
+    opts::options_description opt_desc("Available options");
+    opt_desc.add_options()
+        ("input", opts::value<std::string>(), "binary or compressed scan to sort")
+        ("output", opts::value<std::string>(), "sorted scan")
+        ("format,f", opts::value<std::string>()->default_value("binary"), "output format: 'binary', 'compressed' or 'csv'")
+        ("duplicates,d", opts::value<std::string>()->default_value("keep"),
+         "profiles with the same encoder count: 'keep' all, keep the 'last' recorded or 'average' them")
+        ("memory,m", opts::value<unsigned int>()->default_value(SORT_DEFAULT_MEMORY), "RAM for profiles being sorted [MB]")
+        ("threads,t", opts::value<unsigned int>()->default_value(boost::thread::hardware_concurrency()),
+         "runs sorted and merged at once")
+        ("temp", opts::value<std::string>(), "folder for the sorted runs (default - the output's folder)")
+        ("help,h", "display basic help information")
+    ;
+    opts::positional_options_description positional;
+    positional.add("input", 1).add("output", 1);
+    opts::variables_map cmdline;
+    opts::store(opts::command_line_parser(argc, argv).options(opt_desc).positional(positional).run(), cmdline);
+    opts::notify(cmdline);
+    if (cmdline.count("help") || !cmdline.count("input") || !cmdline.count("output")) {
+        std::cout << "Usage: scansort input.scan output.scan [options]\n" << opt_desc << std::endl;
+        return 1;
+    }
+    std::string inputFilename = cmdline["input"].as<std::string>();
+    std::string outputFilename = cmdline["output"].as<std::string>();
+    OutputSettings output;
+    output.format = BINARY;
+    output.xPrecision = output.yPrecision = output.zPrecision = CSV_DEFAULT_PRECISION;
+    std::string formatName = cmdline["format"].as<std::string>();
+    if (formatName == "compressed") {
+        output.format = COMPRESSED;
+    } else if (formatName == "csv") {
+        output.format = CSV;
+    } else if (formatName != "binary") {
+        std::cerr << "<< Unknown output format '" << formatName << ",' aborting >>" << std::endl;
+        return 1;
+    }
+    SortSettings settings;
+    if (!parseDuplicatePolicy(cmdline["duplicates"].as<std::string>(), settings.duplicates)) {
+        std::cerr << "<< Duplicates must be 'keep', 'last' or 'average', aborting >>" << std::endl;
+        return 1;
+    }
+    if (cmdline["memory"].as<unsigned int>() == 0) {
+        std::cerr << "<< Memory must be at least 1 MB, aborting >>" << std::endl;
+        return 1;
+    }
+    settings.memory = static_cast<Go2UInt64>(cmdline["memory"].as<unsigned int>())*1024*1024;
+    settings.threads = cmdline["threads"].as<unsigned int>();
+    if (cmdline.count("temp")) {
+        settings.tempFolder = cmdline["temp"].as<std::string>();
+    } else {
+        settings.tempFolder = filesystem::absolute(outputFilename).parent_path().string();
+    }
+    try {
+        ScanReader reader(inputFilename);
+        try {
+            filesystem::remove(outputFilename.c_str());
+            filesystem::remove((outputFilename + SCAN_INDEX_EXTENSION).c_str());
+        } catch (filesystem::filesystem_error &err) {
+            std::cerr << "<< Unable to overwrite '" << outputFilename << ",' appending >>" << std::endl;
+        }
+        SortedOutput sorted;
+        if (!sorted.fidout.open(outputFilename)) {
+            std::cerr << "<< Unable to open/write to output file '" << outputFilename << "', aborting >>" << std::endl;
+            return 1;
+        }
+        ScanSorter sorter(settings);
+        ScanInfo info = reader.getInfo();
+        info.comment += " [" + sorter.describe() + "]";
+        sorted.writer.reset(createProfileWriter(output));
+        sorted.block.reserve(OUTPUT_BLOCK_SIZE*2);
+        sorted.writer->writeHeader(info, sorted.block);
+        sorted.index.reset(info);
+        sorted.indexing = sorted.writer->indexable();
+        sorter.sort(reader, boost::bind(&SortedOutput::write, &sorted, _1));
+        sorted.writer->writeFooter(sorted.block);
+        sorted.fidout.write(sorted.block);
+        sorted.fidout.close();
+        if (sorted.fidout.fail()) {
+            std::cerr << "<< Encountered error writing to '" << outputFilename << "' >>" << std::endl;
+            return 1;
+        }
+        if (!sorted.index.empty() && !sorted.index.save(outputFilename + SCAN_INDEX_EXTENSION)) {
+            std::cerr << "<< Unable to write index for '" << outputFilename << "' >>" << std::endl;
+        }
+        sorter.report(std::cout);
+    } catch (std::runtime_error& err) {
+        std::cerr << "<< " << err.what() << " >>" << std::endl;
+        return 1;
+    }
+    return 0;
+}
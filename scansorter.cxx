@@ -0,0 +1,473 @@
+#include "scansorter.h"
+#include "profilesource.h"
+namespace filesystem = boost::filesystem;
+
+// Appends a plain value to the block in host byte order
+template<typename T> static void append(std::string& block, const T& value) {
+    block.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+bool parseDuplicatePolicy(const std::string& name, DuplicatePolicy& policy) {
+    if (name == "keep") {
+        policy = DUPLICATES_KEEP;
+    } else if (name == "last") {
+        policy = DUPLICATES_LAST;
+    } else if (name == "average") {
+        policy = DUPLICATES_AVERAGE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string duplicatePolicyName(DuplicatePolicy policy) {
+    switch (policy) {
+        case DUPLICATES_LAST:
+            return "last";
+        case DUPLICATES_AVERAGE:
+            return "average";
+        default:
+            return "keep";
+    }
+}
+
+SortRunWriter::SortRunWriter(const std::string& runFilename) {
+    opened = fidout.open(runFilename);
+    block.reserve(OUTPUT_BLOCK_SIZE*2);
+}
+
+void SortRunWriter::add(const SortedProfile& sorted) {
+    const Profile& profile = sorted.profile;
+    Go2UInt32 width = static_cast<Go2UInt32>(profile.width());
+    append(block, sorted.sequence);
+    append(block, profile.encoder);
+    append(block, profile.timestamp);
+    append(block, profile.xOffset);
+    append(block, profile.xResolution);
+    append(block, profile.zOffset);
+    append(block, profile.zResolution);
+    append(block, width);
+    if (width > 0) {
+        block.append(reinterpret_cast<const char*>(profile.rangeData()), width*sizeof(short));
+    }
+    if (block.size() >= OUTPUT_BLOCK_SIZE) {
+        fidout.write(block);
+        block.clear();
+    }
+}
+
+bool SortRunWriter::close() {
+    if (!opened) {
+        return false;
+    }
+    fidout.write(block);
+    block.clear();
+    fidout.close();
+    return !fidout.fail();
+}
+
+SortRun::SortRun(const std::string& runFilename, size_t bufferSize):filename(runFilename), buffer(bufferSize) {
+    // The buffer has to be in place before the file is opened
+    fidin.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+    fidin.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!fidin.is_open()) {
+        throw std::runtime_error("Unable to open sorted run '" + filename + "'");
+    }
+}
+
+bool SortRun::next() {
+    Profile& profile = current.profile;
+    Go2UInt32 width;
+    if (!fidin.read(reinterpret_cast<char*>(&current.sequence), sizeof(current.sequence))) {
+        return false;
+    }
+    if (!fidin.read(reinterpret_cast<char*>(&profile.encoder), sizeof(profile.encoder)) ||
+        !fidin.read(reinterpret_cast<char*>(&profile.timestamp), sizeof(profile.timestamp)) ||
+        !fidin.read(reinterpret_cast<char*>(&profile.xOffset), sizeof(profile.xOffset)) ||
+        !fidin.read(reinterpret_cast<char*>(&profile.xResolution), sizeof(profile.xResolution)) ||
+        !fidin.read(reinterpret_cast<char*>(&profile.zOffset), sizeof(profile.zOffset)) ||
+        !fidin.read(reinterpret_cast<char*>(&profile.zResolution), sizeof(profile.zResolution)) ||
+        !fidin.read(reinterpret_cast<char*>(&width), sizeof(width))) {
+        throw std::runtime_error("Sorted run '" + filename + "' is truncated");
+    }
+    profile.ranges.resize(width);
+    if (width > 0 && !fidin.read(reinterpret_cast<char*>(&profile.ranges[0]), width*sizeof(short))) {
+        throw std::runtime_error("Sorted run '" + filename + "' is truncated");
+    }
+    return true;
+}
+
+ScanSorter::ScanSorter(const SortSettings& sortSettings):settings(sortSettings), nextRun(0), busy(0),
+stopping(false), holding(false), read(0), written(0), submitted(0), runsWritten(0), passes(0), duplicates(0),
+ordered(true), seconds(0) {
+    if (settings.threads == 0) {
+        settings.threads = 1;
+    }
+    if (settings.tempFolder.empty()) {
+        settings.tempFolder = ".";
+    }
+    // The reader fills one run while each worker sorts and writes another
+    runBytes = std::max(settings.memory/(settings.threads + 1), static_cast<Go2UInt64>(1));
+    runPrefix = (filesystem::path(settings.tempFolder) / filesystem::unique_path("scansort-%%%%-%%%%")).string();
+}
+
+ScanSorter::~ScanSorter() {
+    for (size_t i=0; i<runs.size(); i++) {
+        boost::system::error_code ignored;
+        filesystem::remove(runs[i], ignored);
+    }
+}
+
+void ScanSorter::sort(ScanReader& reader, boost::function<void (const Profile&)> write) {
+    Go2UInt64 start = monotonicMicroseconds();
+    order = YOrder(reader.getInfo().encoderResolution < 0);
+    output = write;
+    holding = false;
+    ReductionSettings merging = noReduction();
+    merging.mergeDuplicates = true;
+    averager.reset(merging);
+    stopping = false;
+    boost::thread_group workers;
+    for (unsigned int i=0; i<settings.threads; i++) {
+        workers.create_thread(boost::bind(&ScanSorter::sortRuns, this));
+    }
+    RunPtr run(new Run());
+    Go2UInt64 bytes = 0;
+    SortedProfile previous;
+    try {
+        while (true) {
+            run->push_back(SortedProfile());
+            SortedProfile& sorted = run->back();
+            if (!reader.next(sorted.profile)) {
+                run->pop_back();
+                break;
+            }
+            sorted.sequence = read++;
+            if (sorted.sequence > 0 && order(sorted, previous)) {
+                ordered = false;
+            }
+            previous.sequence = sorted.sequence;
+            previous.profile.encoder = sorted.profile.encoder;
+            bytes += sizeof(SortedProfile) + sorted.profile.ranges.capacity()*sizeof(short);
+            if (bytes >= runBytes) {
+                submit(run);
+                bytes = 0;
+            }
+        }
+        // Only the last run goes to disk - everything fitting in one run is sorted right here
+        if (submitted > 0 && !run->empty()) {
+            submit(run);
+        }
+    } catch (std::runtime_error& err) {
+        fail(err.what());
+    }
+    {
+        boost::lock_guard<boost::mutex> guard(lock);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    workers.join_all();
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    if (submitted == 0) {
+        sortInMemory(*run);
+        for (size_t i=0; i<run->size(); i++) {
+            resolve((*run)[i]);
+        }
+    } else {
+        run.reset();
+        mergePasses();
+        merge(runs, readBuffer(runs.size()), boost::bind(&ScanSorter::resolve, this, _1));
+        for (size_t i=0; i<runs.size(); i++) {
+            filesystem::remove(runs[i]);
+        }
+        runs.clear();
+    }
+    flush();
+    seconds = (monotonicMicroseconds() - start)/1e6;
+}
+
+// Hands a full run to the workers and starts a new one.  Waits while every
+// worker has a run, so no more than threads + 1 runs are held at once.
+void ScanSorter::submit(RunPtr& run) {
+    {
+        boost::unique_lock<boost::mutex> guard(lock);
+        while (busy + jobs.size() >= settings.threads && error.empty()) {
+            jobDone.wait(guard);
+        }
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+        jobs.push_back(run);
+    }
+    jobAvailable.notify_one();
+    submitted++;
+    run.reset(new Run());
+}
+
+// Worker: sorts runs and writes them out until there are no more
+void ScanSorter::sortRuns() {
+    while (true) {
+        RunPtr run;
+        std::string runFilename;
+        {
+            boost::unique_lock<boost::mutex> guard(lock);
+            while (jobs.empty() && !stopping) {
+                jobAvailable.wait(guard);
+            }
+            if (jobs.empty()) {
+                return;
+            }
+            run = jobs.back();
+            jobs.pop_back();
+            busy++;
+            runFilename = nextRunFilename();
+        }
+        std::sort(run->begin(), run->end(), order);
+        writeRun(*run, runFilename);
+        run.reset();
+        {
+            boost::lock_guard<boost::mutex> guard(lock);
+            busy--;
+            runsWritten++;
+        }
+        jobDone.notify_all();
+    }
+}
+
+void ScanSorter::writeRun(Run& run, const std::string& runFilename) {
+    SortRunWriter writer(runFilename);
+    for (size_t i=0; i<run.size(); i++) {
+        writer.add(run[i]);
+        // Gives each profile's memory back as soon as it's written
+        std::vector<short>().swap(run[i].profile.ranges);
+    }
+    if (!writer.close()) {
+        fail("Unable to write sorted run '" + runFilename + "'");
+    }
+}
+
+// Sorts a slice of the run
+static void sortSlice(std::vector<SortedProfile>* run, size_t first, size_t last, const YOrder& order) {
+    std::sort(run->begin() + first, run->begin() + last, order);
+}
+
+// Merges two sorted neighbouring slices of the run
+static void mergeSlices(std::vector<SortedProfile>* run, size_t first, size_t middle, size_t last,
+                        const YOrder& order) {
+    std::inplace_merge(run->begin() + first, run->begin() + middle, run->begin() + last, order);
+}
+
+void ScanSorter::sortInMemory(Run& run) {
+    size_t slice = std::max(run.size()/settings.threads, static_cast<size_t>(1));
+    std::vector<size_t> bounds;
+    for (size_t i=0; i<run.size(); i+=slice) {
+        bounds.push_back(i);
+    }
+    if (bounds.size() > settings.threads) {
+        bounds.pop_back(); // Last slice takes the remainder
+    }
+    bounds.push_back(run.size());
+    boost::thread_group sorters;
+    for (size_t i=0; i+1<bounds.size(); i++) {
+        sorters.create_thread(boost::bind(&sortSlice, &run, bounds[i], bounds[i+1], boost::cref(order)));
+    }
+    sorters.join_all();
+    // Pairs of slices merged in parallel, halving the slices each time
+    for (size_t step=1; step+1<bounds.size(); step*=2) {
+        boost::thread_group mergers;
+        for (size_t i=0; i+step+1<bounds.size(); i+=2*step) {
+            size_t last = std::min(i + 2*step, bounds.size() - 1);
+            mergers.create_thread(boost::bind(&mergeSlices, &run, bounds[i], bounds[i+step], bounds[last],
+                                              boost::cref(order)));
+        }
+        mergers.join_all();
+    }
+}
+
+// Orders the merge heap so the run with the next profile in Y is on top
+class RunOrder {
+    public:
+        RunOrder(const std::vector<boost::shared_ptr<SortRun> >& mergeRuns, const YOrder& yOrder):
+        runs(&mergeRuns), before(yOrder) {}
+        bool operator()(size_t a, size_t b) const {
+            return before((*runs)[b]->current, (*runs)[a]->current);
+        }
+    private:
+        const std::vector<boost::shared_ptr<SortRun> >* runs;
+        YOrder before;
+};
+
+void ScanSorter::merge(const std::vector<std::string>& runFilenames, size_t bufferSize,
+                       boost::function<void (const SortedProfile&)> emit) {
+    std::vector<boost::shared_ptr<SortRun> > mergeRuns;
+    for (size_t i=0; i<runFilenames.size(); i++) {
+        mergeRuns.push_back(boost::shared_ptr<SortRun>(new SortRun(runFilenames[i], bufferSize)));
+    }
+    std::priority_queue<size_t, std::vector<size_t>, RunOrder> heap(RunOrder(mergeRuns, order));
+    for (size_t i=0; i<mergeRuns.size(); i++) {
+        if (mergeRuns[i]->next()) {
+            heap.push(i);
+        }
+    }
+    while (!heap.empty()) {
+        size_t top = heap.top();
+        heap.pop();
+        emit(mergeRuns[top]->current);
+        if (mergeRuns[top]->next()) {
+            heap.push(top);
+        }
+    }
+}
+
+void ScanSorter::mergePasses() {
+    while (runs.size() > SORT_MAX_FAN_IN) {
+        std::vector<std::string> inputs = runs;
+        std::vector<std::vector<std::string> > groups;
+        std::vector<std::string> merged;
+        for (size_t i=0; i<inputs.size(); i+=SORT_MAX_FAN_IN) {
+            size_t end = std::min(i + SORT_MAX_FAN_IN, inputs.size());
+            groups.push_back(std::vector<std::string>(inputs.begin() + i, inputs.begin() + end));
+            merged.push_back(nextRunFilename());
+        }
+        mergeGroups(groups, merged);
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+        for (size_t i=0; i<inputs.size(); i++) {
+            filesystem::remove(inputs[i]);
+        }
+        runs = merged;
+        passes++;
+    }
+}
+
+void ScanSorter::mergeGroup(const std::vector<std::string>& group, const std::string& mergedFilename,
+                            size_t bufferSize) {
+    try {
+        SortRunWriter writer(mergedFilename);
+        merge(group, bufferSize, boost::bind(&SortRunWriter::add, &writer, _1));
+        if (!writer.close()) {
+            fail("Unable to write sorted run '" + mergedFilename + "'");
+        }
+    } catch (std::runtime_error& err) {
+        fail(err.what());
+    }
+}
+
+// Merges the groups on up to threads threads at a time
+void ScanSorter::mergeGroups(const std::vector<std::vector<std::string> >& groups,
+                             const std::vector<std::string>& merged) {
+    size_t bufferSize = readBuffer(settings.threads*SORT_MAX_FAN_IN);
+    for (size_t first=0; first<groups.size(); first+=settings.threads) {
+        boost::thread_group mergers;
+        for (size_t i=first; i<std::min(first + settings.threads, groups.size()); i++) {
+            mergers.create_thread(boost::bind(&ScanSorter::mergeGroup, this, boost::cref(groups[i]),
+                                              boost::cref(merged[i]), bufferSize));
+        }
+        mergers.join_all();
+    }
+}
+
+// Shares the memory between the runs being merged
+size_t ScanSorter::readBuffer(size_t mergedRuns) const {
+    Go2UInt64 share = settings.memory/std::max(mergedRuns, static_cast<size_t>(1));
+    return static_cast<size_t>(std::min(std::max(share, static_cast<Go2UInt64>(SORT_MIN_READ_BUFFER)),
+                                        static_cast<Go2UInt64>(SORT_MAX_READ_BUFFER)));
+}
+
+void ScanSorter::resolve(const SortedProfile& sorted) {
+    const Profile& profile = sorted.profile;
+    const Profile* averaged;
+    switch (settings.duplicates) {
+        case DUPLICATES_LAST:
+            // Profiles with the same count arrive in recording order, so the last one wins
+            if (holding && last.encoder != profile.encoder) {
+                output(last);
+                written++;
+            } else if (holding) {
+                duplicates++;
+            }
+            last = profile;
+            holding = true;
+            break;
+        case DUPLICATES_AVERAGE:
+            averager.add(profile);
+            while ((averaged = averager.next()) != NULL) {
+                output(*averaged);
+                written++;
+            }
+            break;
+        default:
+            output(profile);
+            written++;
+    }
+}
+
+// Passes on whatever resolve() held back for the next profile
+void ScanSorter::flush() {
+    const Profile* averaged;
+    if (settings.duplicates == DUPLICATES_LAST && holding) {
+        output(last);
+        written++;
+        holding = false;
+    } else if (settings.duplicates == DUPLICATES_AVERAGE) {
+        averager.finish();
+        while ((averaged = averager.next()) != NULL) {
+            output(*averaged);
+            written++;
+        }
+        duplicates = averager.mergedCount();
+    }
+}
+
+// Names the next run and remembers it, so it's removed even if the sort fails
+std::string ScanSorter::nextRunFilename() {
+    std::ostringstream runFilename;
+    runFilename << runPrefix << "-" << nextRun++ << SORT_RUN_EXTENSION;
+    runs.push_back(runFilename.str());
+    return runFilename.str();
+}
+
+// Remembers the first error for the reader to throw
+void ScanSorter::fail(const std::string& message) {
+    boost::lock_guard<boost::mutex> guard(lock);
+    if (error.empty()) {
+        error = message;
+    }
+    jobDone.notify_all();
+}
+
+std::string ScanSorter::describe() const {
+    switch (settings.duplicates) {
+        case DUPLICATES_LAST:
+            return "sorted by Y, last of each duplicate kept";
+        case DUPLICATES_AVERAGE:
+            return "sorted by Y, duplicates averaged";
+        default:
+            return "sorted by Y";
+    }
+}
+
+void ScanSorter::report(std::ostream& os) const {
+    os << "Sorted " << read << " profiles in " << std::fixed << std::setprecision(2) << seconds << " s";
+    if (ordered) {
+        os << " (already in Y order)";
+    }
+    if (runsWritten > 0) {
+        os << ": " << runsWritten << " runs of up to " << std::setprecision(1) << runBytes/(1024.0*1024.0) << " MB";
+        if (passes > 0) {
+            os << ", " << passes << " extra merge passes";
+        }
+    } else {
+        os << " in memory";
+    }
+    os << "; " << written << " written";
+    if (settings.duplicates == DUPLICATES_LAST) {
+        os << ", " << duplicates << " duplicates dropped";
+    } else if (settings.duplicates == DUPLICATES_AVERAGE) {
+        os << ", " << duplicates << " duplicates averaged";
+    }
+    os << std::endl;
+}
@@ -0,0 +1,166 @@
+#include "segmentedoutput.h"
+namespace filesystem = boost::filesystem;
+
+SegmentedOutput::SegmentedOutput(const std::string& outputFilename, const SegmentSettings& segmentSettings,
+                                 bool verboseFlag):
+baseFilename(outputFilename), settings(segmentSettings), verbose(verboseFlag), number(0), completed(0), failed(0),
+stopping(false) {
+    handOffThread = boost::thread(&SegmentedOutput::handOff, this);
+}
+
+std::string SegmentedOutput::segmentFilename(Go2UInt64 segment) const {
+    filesystem::path path(baseFilename);
+    std::ostringstream filename;
+    filename << path.stem().string() << "_seg" << std::setw(SEGMENT_DIGITS) << std::setfill('0') << segment
+             << path.extension().string();
+    return (path.parent_path() / filename.str()).string();
+}
+
+bool SegmentedOutput::open(OutputFile& file) {
+    if (!settings.completedFolder.empty() && !filesystem::is_directory(settings.completedFolder)) {
+        std::cerr << "<< Completed segment folder '" << settings.completedFolder << "' doesn't exist >>" << std::endl;
+        return false;
+    }
+    return openSegment(file);
+}
+
+bool SegmentedOutput::next(OutputFile& file, boost::shared_ptr<FinishedSegment> finished) {
+    closeSegment(file, finished);
+    return openSegment(file);
+}
+
+void SegmentedOutput::close(OutputFile& file, boost::shared_ptr<FinishedSegment> finished) {
+    if (file.isOpen()) {
+        closeSegment(file, finished);
+    }
+}
+
+bool SegmentedOutput::openSegment(OutputFile& file) {
+    number++;
+    current = segmentFilename(number);
+    try {
+        filesystem::remove(current.c_str());
+        filesystem::remove((current + SCAN_INDEX_EXTENSION).c_str());
+        filesystem::remove((current + HEIGHTMAP_EXTENSION).c_str());
+    } catch (filesystem::filesystem_error &err) {
+        std::cerr << "<< Unable to overwrite '" << current << ",' appending >>" << std::endl;
+    }
+    if (!file.open(current)) {
+        std::cerr << "<< Unable to open/write to segment '" << current << "' >>" << std::endl;
+        return false;
+    }
+    if (settings.preallocate > 0 && !file.reserve(settings.preallocate) && number == 1) {
+        std::cerr << "<< Unable to preallocate segments on this filesystem, continuing without >>" << std::endl;
+    }
+    if (verbose) {
+        std::cout << "<< Recording segment '" << current << "' >>" << std::endl;
+    }
+    return true;
+}
+
+// Queues the segment for the hand-off thread, waiting if it has fallen too far behind
+void SegmentedOutput::closeSegment(OutputFile& file, boost::shared_ptr<FinishedSegment> finished) {
+    finished->filename = current;
+    finished->number = number;
+    finished->bytes = file.bytesWritten();
+    file.close();
+    if (file.fail()) {
+        std::cerr << "<< Encountered error writing to '" << current << ",' data may have been lost >>" << std::endl;
+    }
+    boost::unique_lock<boost::mutex> guard(lock);
+    while (closed.size() >= SEGMENT_HANDOFF_DEPTH) {
+        changed.wait(guard);
+    }
+    closed.push_back(finished);
+    changed.notify_all();
+}
+
+void SegmentedOutput::finish() {
+    {
+        boost::lock_guard<boost::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    if (handOffThread.joinable()) {
+        handOffThread.join();
+    }
+}
+
+Go2UInt64 SegmentedOutput::handedOffCount() const {
+    boost::lock_guard<boost::mutex> guard(lock);
+    return completed;
+}
+
+Go2UInt64 SegmentedOutput::failedCount() const {
+    boost::lock_guard<boost::mutex> guard(lock);
+    return failed;
+}
+
+// Hand-off thread - finishes closed segments in the order they were recorded
+void SegmentedOutput::handOff() {
+    while (true) {
+        boost::shared_ptr<FinishedSegment> segment;
+        {
+            boost::unique_lock<boost::mutex> guard(lock);
+            while (closed.empty() && !stopping) {
+                changed.wait(guard);
+            }
+            if (closed.empty()) {
+                return;
+            }
+            segment = closed.front();
+        }
+        complete(*segment);
+        boost::lock_guard<boost::mutex> guard(lock);
+        closed.pop_front();
+        changed.notify_all();
+    }
+}
+
+// Writes the segment's index and height map, then moves all of it to the completed folder
+void SegmentedOutput::complete(const FinishedSegment& segment) {
+    bool ok = true;
+    std::string indexFilename = segment.filename + SCAN_INDEX_EXTENSION;
+    std::string heightMapFilename = segment.filename + HEIGHTMAP_EXTENSION;
+    if (!segment.index.empty() && !segment.index.save(indexFilename)) {
+        std::cerr << "<< Unable to write index for '" << segment.filename << "' >>" << std::endl;
+        ok = false;
+    }
+    if (segment.heightMap && segment.heightMap->enabled() && !segment.heightMap->save(heightMapFilename)) {
+        std::cerr << "<< Unable to write height map for '" << segment.filename << "' >>" << std::endl;
+        ok = false;
+    }
+    if (!settings.completedFolder.empty()) {
+        // Sidecars first, so a scan in the completed folder always has them
+        if (!segment.index.empty()) {
+            ok = move(indexFilename) && ok;
+        }
+        if (segment.heightMap && segment.heightMap->enabled()) {
+            ok = move(heightMapFilename) && ok;
+        }
+        ok = move(segment.filename) && ok;
+    }
+    if (verbose) {
+        std::cout << "<< Segment " << segment.number << " complete: " << segment.profiles << " profiles, "
+                  << segment.bytes << " bytes >>" << std::endl;
+    }
+    boost::lock_guard<boost::mutex> guard(lock);
+    if (ok) {
+        completed++;
+    } else {
+        failed++;
+    }
+}
+
+bool SegmentedOutput::move(const std::string& filename) {
+    filesystem::path from(filename);
+    filesystem::path to = filesystem::path(settings.completedFolder) / from.filename();
+    try {
+        filesystem::rename(from, to);
+    } catch (filesystem::filesystem_error &err) {
+        std::cerr << "<< Unable to move '" << filename << "' to '" << settings.completedFolder << "': "
+                  << err.what() << " >>" << std::endl;
+        return false;
+    }
+    return true;
+}
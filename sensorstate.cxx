@@ -0,0 +1,89 @@
+#include "sensorstate.h"
+
+SensorState::SensorState(Go2System& go2system, bool verboseFlag):
+sys(go2system), verbose(verboseFlag), sent(0), skipped(0),
+triggerSource("TriggerSource", Go2System_TriggerSource, Go2System_SetTriggerSource),
+triggerGate("TriggerGate", Go2System_TriggerGateEnabled, Go2System_EnableTriggerGate),
+travelResolution("TravelResolution", Go2System_TravelResolution, Go2System_SetTravelResolution),
+frameRate("FrameRate", Go2System_FrameRate, Go2System_SetFrameRate),
+encoderPeriod("EncoderPeriod", Go2System_EncoderPeriod, Go2System_SetEncoderPeriod),
+encoderTriggerMode("EncoderTriggerMode", Go2System_EncoderTriggerMode, Go2System_SetEncoderTriggerMode),
+xResampling("XResamplingType", Go2System_XResamplingType, Go2System_SetXResamplingType),
+xGap("XGapFillingEnabled", Go2System_XGapFillingEnabled, Go2System_SetXGapFillingEnabled),
+yGap("YGapFillingEnabled", Go2System_YGapFillingEnabled, Go2System_SetYGapFillingEnabled),
+xSmooth("XSmoothingEnabled", Go2System_XSmoothingEnabled, Go2System_SetXSmoothingEnabled),
+ySmooth("YSmoothingEnabled", Go2System_YSmoothingEnabled, Go2System_SetYSmoothingEnabled),
+xGapWindow("XGapFillingWindow", Go2System_XGapFillingWindow, Go2System_SetXGapFillingWindow),
+yGapWindow("YGapFillingWindow", Go2System_YGapFillingWindow, Go2System_SetYGapFillingWindow),
+xSmoothWindow("XSmoothingWindow", Go2System_XSmoothingWindow, Go2System_SetXSmoothingWindow),
+ySmoothWindow("YSmoothingWindow", Go2System_YSmoothingWindow, Go2System_SetYSmoothingWindow) {}
+
+template <typename T>
+void SensorState::push(SensorSetting<T>& setting, unsigned int& failures) {
+    switch (setting.push(sys, verbose)) {
+        case SENT:
+            sent++;
+            break;
+        case ALREADY_SET:
+            skipped++;
+            break;
+        case REFUSED:
+            failures++;
+            break;
+        case NOT_STAGED:
+            break;
+    }
+}
+
+// Trigger settings go first, then resampling and the filters it limits, then
+// each filter's switch before its window; everything sent is read back at the
+// end, since a later setting can change what the sensor did with an earlier one
+unsigned int SensorState::commit() {
+    unsigned int failures = 0, sentBefore = sent, skippedBefore = skipped;
+    push(triggerSource, failures);
+    push(triggerGate, failures);
+    push(travelResolution, failures);
+    push(frameRate, failures);
+    push(encoderPeriod, failures);
+    push(encoderTriggerMode, failures);
+    push(xResampling, failures);
+    push(xGap, failures);
+    push(xGapWindow, failures);
+    push(yGap, failures);
+    push(yGapWindow, failures);
+    push(xSmooth, failures);
+    push(xSmoothWindow, failures);
+    push(ySmooth, failures);
+    push(ySmoothWindow, failures);
+    unsigned int pushed = sent - sentBefore;
+    if (pushed > 0) {
+        failures += !triggerSource.verify(sys) + !triggerGate.verify(sys) + !travelResolution.verify(sys) +
+                    !frameRate.verify(sys) + !encoderPeriod.verify(sys) + !encoderTriggerMode.verify(sys) +
+                    !xResampling.verify(sys) + !xGap.verify(sys) + !xGapWindow.verify(sys) + !yGap.verify(sys) +
+                    !yGapWindow.verify(sys) + !xSmooth.verify(sys) + !xSmoothWindow.verify(sys) +
+                    !ySmooth.verify(sys) + !ySmoothWindow.verify(sys);
+    }
+    if (verbose) {
+        std::cout << "<< Sensor settings: " << pushed << " sent, " << skipped - skippedBefore
+                  << " already set, " << failures << " refused or not kept >>" << std::endl;
+    }
+    return failures;
+}
+
+void SensorState::forget() {
+    triggerSource.forget();
+    triggerGate.forget();
+    travelResolution.forget();
+    frameRate.forget();
+    encoderPeriod.forget();
+    encoderTriggerMode.forget();
+    xResampling.forget();
+    xGap.forget();
+    yGap.forget();
+    xSmooth.forget();
+    ySmooth.forget();
+    xGapWindow.forget();
+    yGapWindow.forget();
+    xSmoothWindow.forget();
+    ySmoothWindow.forget();
+}
@@ -0,0 +1,25 @@
+#!/usr/bin/env python
+"""setup.py - builds the _gocatorscan extension used by gocatorscan.py
+
+python setup.py build_ext --inplace (or make python)
+Go2.h is taken from $GOCATOR_SDK/include, as in the Makefile.
+"""
+
+import os
+import os.path
+try:
+    from setuptools import setup, Extension
+except ImportError:
+    from distutils.core import setup, Extension
+
+sdk = os.environ.get('GOCATOR_SDK', '/home/ccoughlin/src/c/14400-3.4.1.155_SOFTWARE_Go2_SDK')
+
+extension = Extension('_gocatorscan',
+                      sources=['gocatorscanmodule.cxx', 'mappedscan.cxx', 'scanformat.cxx', 'databatch.cxx'],
+                      include_dirs=['include', os.path.join(sdk, 'include')],
+                      libraries=['z'])
+
+setup(name='gocatorscan',
+      description='Zero-copy reader for recorded Gocator scans',
+      py_modules=['gocatorscan'],
+      ext_modules=[extension])
@@ -0,0 +1,116 @@
+#include "statsreporter.h"
+
+StatsReporter::StatsReporter(const RecordingPipeline& recordingPipeline, double intervalSeconds, std::ostream& output):
+pipeline(recordingPipeline), interval(intervalSeconds), os(output) {
+    first = snapshot();
+}
+
+void StatsReporter::start() {
+    first = snapshot();
+    if (interval > 0 && !reporter.joinable()) {
+        reporter = boost::thread(&StatsReporter::run, this);
+    }
+}
+
+void StatsReporter::stop() {
+    if (reporter.joinable()) {
+        reporter.interrupt();
+        reporter.join();
+    }
+}
+
+StatsReporter::StageSnapshot StatsReporter::snapshot() const {
+    StageSnapshot current;
+    current.time = monotonicNanoseconds();
+    current.pipeline = pipeline.stats();
+    current.timeouts = pipeline.receiveStage().timeoutCount();
+    current.receiveWait = pipeline.receiveStage().receiveWait().snapshot();
+    current.batchSize = pipeline.receiveStage().batchSize().snapshot();
+    current.conversion = pipeline.conversionTime().snapshot();
+    current.write = pipeline.writeTime().snapshot();
+    return current;
+}
+
+// Reporter thread - one line per interval until interrupted
+void StatsReporter::run() {
+    StageSnapshot previous = first;
+    try {
+        while (true) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(static_cast<long>(interval*1000)));
+            StageSnapshot current = snapshot();
+            printLine(current, previous);
+            previous = current;
+        }
+    } catch (boost::thread_interrupted &err) {
+    }
+}
+
+void StatsReporter::printLine(const StageSnapshot& current, const StageSnapshot& previous) {
+    double seconds = (current.time - previous.time)*1e-9;
+    HistogramSnapshot waits = difference(current.receiveWait, previous.receiveWait);
+    HistogramSnapshot batches = difference(current.batchSize, previous.batchSize);
+    HistogramSnapshot conversions = difference(current.conversion, previous.conversion);
+    HistogramSnapshot writes = difference(current.write, previous.write);
+    std::ostringstream line;
+    line.precision(4);
+    line << "<< " << (current.time - first.time)*1e-9 << " s | "
+         << (seconds > 0 ? (current.pipeline.received - previous.pipeline.received)/seconds : 0) << " profiles/s, "
+         << current.pipeline.dropped - previous.pipeline.dropped << " dropped, "
+         << current.timeouts - previous.timeouts << " timeouts, "
+         << current.pipeline.missing - previous.pipeline.missing << " missing | "
+         << "wait p99 " << formatNanoseconds(percentile(waits, 0.99)) << " | "
+         << "batch p50 " << percentile(batches, 0.50) << " | "
+         << "convert p99 " << formatNanoseconds(percentile(conversions, 0.99)) << " | "
+         << "write p99 " << formatNanoseconds(percentile(writes, 0.99)) << " | "
+         << "queue high-water " << current.pipeline.profileHighWater << "/" << current.pipeline.profileQueueDepth
+         << " >>";
+    os << line.str() << std::endl;
+}
+
+std::string StatsReporter::formatNanoseconds(Go2UInt64 nanoseconds) {
+    std::ostringstream formatted;
+    formatted.precision(3);
+    if (nanoseconds >= 1000000) {
+        formatted << nanoseconds*1e-6 << " ms";
+    } else if (nanoseconds >= 1000) {
+        formatted << nanoseconds*1e-3 << " us";
+    } else {
+        formatted << nanoseconds << " ns";
+    }
+    return formatted.str();
+}
+
+bool StatsReporter::writeJson(const std::string& filename) {
+    std::ofstream json(filename.c_str());
+    writeJson(json);
+    return static_cast<bool>(json);
+}
+
+// Report of the whole scan so far
+void StatsReporter::writeJson(std::ostream& json) {
+    StageSnapshot current = snapshot();
+    const PipelineStats& stats = current.pipeline;
+    json << "{\n";
+    json << "  \"duration_s\": " << (current.time - first.time)*1e-9 << ",\n";
+    json << "  \"profiles\": {\"received\": " << stats.received << ", \"written\": " << stats.written
+         << ", \"dropped\": " << stats.dropped << "},\n";
+    json << "  \"frame_gaps\": {\"gaps\": " << stats.gaps << ", \"missing\": " << stats.missing
+         << ", \"duplicates\": " << stats.duplicates << ", \"reversals\": " << stats.reversals << "},\n";
+    json << "  \"bytes_written\": " << stats.bytesWritten << ",\n";
+    json << "  \"segments\": " << stats.segments << ",\n";
+    json << "  \"receive_timeouts\": " << current.timeouts << ",\n";
+    json << "  \"profile_queue\": {\"depth\": " << stats.profileQueueDepth
+         << ", \"high_water\": " << stats.profileHighWater << "},\n";
+    json << "  \"block_queue\": {\"depth\": " << stats.blockQueueDepth << ", \"high_water\": " << stats.blockHighWater
+         << ", \"waits\": " << stats.blockWaits << "},\n";
+    json << "  \"stages\": {\n";
+    json << "    \"receive_wait_ns\": ";
+    ::writeJson(json, current.receiveWait);
+    json << ",\n    \"batch_profiles\": ";
+    ::writeJson(json, current.batchSize);
+    json << ",\n    \"conversion_ns\": ";
+    ::writeJson(json, current.conversion);
+    json << ",\n    \"write_ns\": ";
+    ::writeJson(json, current.write);
+    json << "\n  }\n}" << std::endl;
+}
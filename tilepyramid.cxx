@@ -0,0 +1,514 @@
+#include "tilepyramid.h"
+
+// Appends a plain value to the block in host byte order
+template<typename T> static void append(std::string& block, const T& value) {
+    block.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T> static bool read(std::istream& fidin, T& value) {
+    return static_cast<bool>(fidin.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+TilePyramidBuilder::TilePyramidBuilder(const std::string& filename, double cellWidth, double cellHeight,
+                                       Go2UInt32 tileSize, unsigned int threads):
+outputFilename(filename), cellX(cellWidth), cellY(cellHeight), size(tileSize > 0 ? tileSize : TILE_SIZE),
+configured(false), mappedOffset(0), mappedResolution(0), mappedWidth(0),
+threadCount(threads > 0 ? threads : 1), jobs(2*threadCount + 1), filled(0), emitted(0), stopping(false),
+offset(0), profiles(0), skipped(0), clipped(0), rawBytes(0), packedBytes(0), failed(false) {
+    if (cellY <= 0) {
+        cellY = cellX;
+    }
+    for (size_t i=0; i<jobs.size(); i++) {
+        jobs[i].ready = false;
+    }
+    for (unsigned int i=0; i<threadCount; i++) {
+        workers.create_thread(boost::bind(&TilePyramidBuilder::compress, this));
+    }
+}
+
+TilePyramidBuilder::~TilePyramidBuilder() {
+    {
+        boost::lock_guard<boost::mutex> guard(lock);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    workers.join_all();
+}
+
+// Leaves a core for reading the scan and building the bands
+unsigned int TilePyramidBuilder::defaultThreads() {
+    unsigned int cores = boost::thread::hardware_concurrency();
+    if (cores <= 1) {
+        return 1;
+    }
+    return std::min(cores - 1, static_cast<unsigned int>(TILE_MAX_THREADS));
+}
+
+bool TilePyramidBuilder::start(const ScanInfo& scanInfo) {
+    info = scanInfo;
+    fidout.open(outputFilename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!fidout) {
+        std::cerr << "<< Unable to open/write to tile file '" << outputFilename << "' >>" << std::endl;
+        failed = true;
+    }
+    return !failed;
+}
+
+// Sizes every level from the first profile's field of view
+void TilePyramidBuilder::setup(const Profile& profile) {
+    if (cellX <= 0) {
+        cellX = std::fabs(profile.xResolution);
+        cellY = cellY > 0 ? cellY : cellX;
+    }
+    size_t width = profile.width();
+    double xFirst = profile.xOffset;
+    double xLast = profile.xOffset + (width - 1)*profile.xResolution;
+    Go2Int64 columnLow = static_cast<Go2Int64>(std::floor(std::min(xFirst, xLast)/cellX));
+    Go2Int64 columnHigh = static_cast<Go2Int64>(std::floor(std::max(xFirst, xLast)/cellX));
+    // Halve until the field of view is no wider than a tile
+    size_t levelCount = 1;
+    while (levelCount < TILE_MAX_LEVELS && ((columnHigh - columnLow) >> (levelCount - 1)) >= size) {
+        levelCount++;
+    }
+    levels.resize(levelCount);
+    writtenBands.resize(levelCount);
+    for (size_t level=0; level<levelCount; level++) {
+        TileBand& band = levels[level];
+        Go2Int64 low = floorDiv(floorDiv(columnLow, Go2Int64(1) << level), size);
+        Go2Int64 high = floorDiv(floorDiv(columnHigh, Go2Int64(1) << level), size);
+        band.band = 0;
+        band.active = false;
+        band.firstColumn = low*size;
+        band.columns = static_cast<size_t>(high - low + 1)*size;
+        band.low.resize(band.columns*size);
+        band.high.resize(band.columns*size);
+        band.sum.resize(band.columns*size);
+        band.count.assign(band.columns*size, 0);
+    }
+    std::string header;
+    header.append(TILE_MAGIC, sizeof(TILE_MAGIC));
+    append(header, static_cast<Go2UInt32>(TILE_VERSION));
+    append(header, size);
+    append(header, static_cast<Go2UInt32>(levelCount));
+    append(header, cellX);
+    append(header, cellY);
+    fidout.write(header.data(), header.size());
+    offset = header.size();
+    configured = true;
+}
+
+void TilePyramidBuilder::add(const Profile& profile) {
+    size_t width = profile.width();
+    if (failed || width == 0) {
+        return;
+    }
+    if (!configured) {
+        setup(profile);
+    }
+    profiles++;
+    double y = (profile.encoder - info.startingEncoder)*info.encoderResolution;
+    Go2Int64 row = static_cast<Go2Int64>(std::floor(y/cellY));
+    Go2Int64 bandIndex = floorDiv(row, size);
+    TileBand& band = levels[0];
+    if (!band.active || band.band != bandIndex) {
+        if (written(bandIndex)) {
+            skipped++;
+            return;
+        }
+        if (band.active) {
+            flush(0);
+        }
+        activate(0, bandIndex);
+    }
+    if (width != mappedWidth || profile.xOffset != mappedOffset || profile.xResolution != mappedResolution) {
+        columnOf.resize(width);
+        for (size_t i=0; i<width; i++) {
+            double x = profile.xOffset + i*profile.xResolution;
+            Go2Int64 column = static_cast<Go2Int64>(std::floor(x/cellX)) - band.firstColumn;
+            columnOf[i] = column >= 0 && column < static_cast<Go2Int64>(band.columns) ? static_cast<Go2Int32>(column) : -1;
+        }
+        mappedWidth = width;
+        mappedOffset = profile.xOffset;
+        mappedResolution = profile.xResolution;
+    }
+    // Runs of neighbouring points mostly share a cell, so each is combined
+    // first and the cell updated once per run, as in HeightMap
+    size_t start = static_cast<size_t>(row - bandIndex*size)*band.columns;
+    const short* ranges = profile.rangeData();
+    float zOffset = static_cast<float>(profile.zOffset);
+    float zResolution = static_cast<float>(profile.zResolution);
+    size_t i = 0;
+    while (i < width) {
+        if (ranges[i] == static_cast<short>(INVALID_RANGE_16BIT)) {
+            i++;
+            continue;
+        }
+        Go2Int32 column = columnOf[i];
+        short runLow = ranges[i], runHigh = ranges[i];
+        Go2Int64 runSum = 0;
+        Go2UInt32 runCount = 0;
+        for (; i<width && columnOf[i] == column; i++) {
+            short range = ranges[i];
+            if (range == static_cast<short>(INVALID_RANGE_16BIT)) {
+                continue;
+            }
+            runLow = std::min(runLow, range);
+            runHigh = std::max(runHigh, range);
+            runSum += range;
+            runCount++;
+        }
+        if (column < 0) {
+            clipped += runCount;
+            continue;
+        }
+        float low = zOffset + zResolution*runLow;
+        float high = zOffset + zResolution*runHigh;
+        if (zResolution < 0) {
+            std::swap(low, high);
+        }
+        size_t cell = start + column;
+        if (band.count[cell] == 0) {
+            band.low[cell] = low;
+            band.high[cell] = high;
+            band.sum[cell] = 0;
+        } else {
+            band.low[cell] = std::min(band.low[cell], low);
+            band.high[cell] = std::max(band.high[cell], high);
+        }
+        band.sum[cell] += runCount*static_cast<double>(zOffset) + static_cast<double>(zResolution)*runSum;
+        band.count[cell] += runCount;
+    }
+}
+
+// True if the band, or the band covering it at any level above, has
+// already gone to the file
+bool TilePyramidBuilder::written(Go2Int64 bandIndex) const {
+    for (size_t level=0; level<levels.size(); level++, bandIndex=floorDiv(bandIndex, 2)) {
+        if (writtenBands[level].count(bandIndex) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TilePyramidBuilder::activate(size_t level, Go2Int64 bandIndex) {
+    TileBand& band = levels[level];
+    band.band = bandIndex;
+    band.active = true;
+}
+
+// Hands a finished band's tiles to the workers, merges it into the level
+// above and clears it
+void TilePyramidBuilder::flush(size_t level) {
+    TileBand& band = levels[level];
+    queueTiles(band, level);
+    if (level + 1 < levels.size()) {
+        TileBand& parent = levels[level + 1];
+        Go2Int64 parentIndex = floorDiv(band.band, 2);
+        if (parent.active && parent.band != parentIndex) {
+            flush(level + 1);
+        }
+        if (!parent.active) {
+            activate(level + 1, parentIndex);
+        }
+        size_t rowStart = static_cast<size_t>(band.band - 2*parentIndex)*(size/2);
+        for (size_t row=0; row<size; row++) {
+            size_t parentRow = (rowStart + row/2)*parent.columns;
+            for (size_t column=0; column<band.columns; column++) {
+                size_t cell = row*band.columns + column;
+                if (band.count[cell] == 0) {
+                    continue;
+                }
+                size_t target = parentRow + static_cast<size_t>(floorDiv(band.firstColumn + column, 2) - parent.firstColumn);
+                if (parent.count[target] == 0) {
+                    parent.low[target] = band.low[cell];
+                    parent.high[target] = band.high[cell];
+                    parent.sum[target] = band.sum[cell];
+                } else {
+                    parent.low[target] = std::min(parent.low[target], band.low[cell]);
+                    parent.high[target] = std::max(parent.high[target], band.high[cell]);
+                    parent.sum[target] += band.sum[cell];
+                }
+                parent.count[target] += band.count[cell];
+            }
+        }
+    }
+    writtenBands[level].insert(band.band);
+    std::fill(band.count.begin(), band.count.end(), 0);
+    band.active = false;
+}
+
+// Copies each non-empty tile of a band into a job for the workers
+void TilePyramidBuilder::queueTiles(const TileBand& band, size_t level) {
+    float empty = std::numeric_limits<float>::quiet_NaN();
+    size_t cells = static_cast<size_t>(size)*size;
+    for (size_t first=0; first<band.columns; first+=size) {
+        bool occupied = false;
+        for (size_t row=0; row<size && !occupied; row++) {
+            const Go2UInt32* counts = &band.count[row*band.columns + first];
+            for (size_t column=0; column<size; column++) {
+                if (counts[column] != 0) {
+                    occupied = true;
+                    break;
+                }
+            }
+        }
+        if (!occupied) {
+            continue;
+        }
+        // Only wait if every job is still with the workers
+        collect(filled >= jobs.size() ? filled - jobs.size() + 1 : 0);
+        Tile& tile = jobs[filled % jobs.size()].cells;
+        tile.level = static_cast<Go2UInt32>(level);
+        tile.column = static_cast<Go2Int32>((band.firstColumn + first)/size);
+        tile.row = static_cast<Go2Int32>(band.band);
+        tile.low.resize(cells);
+        tile.high.resize(cells);
+        tile.mean.resize(cells);
+        for (size_t row=0; row<size; row++) {
+            size_t source = row*band.columns + first;
+            for (size_t column=0; column<size; column++) {
+                size_t target = row*size + column;
+                Go2UInt32 count = band.count[source + column];
+                if (count == 0) {
+                    tile.low[target] = tile.high[target] = tile.mean[target] = empty;
+                } else {
+                    tile.low[target] = band.low[source + column];
+                    tile.high[target] = band.high[source + column];
+                    tile.mean[target] = static_cast<float>(band.sum[source + column]/count);
+                }
+            }
+        }
+        submit();
+    }
+}
+
+// Hands the job being filled to the workers
+void TilePyramidBuilder::submit() {
+    {
+        boost::lock_guard<boost::mutex> guard(lock);
+        jobs[filled % jobs.size()].ready = false;
+        pending.push_back(filled % jobs.size());
+        filled++;
+    }
+    jobAvailable.notify_one();
+}
+
+// Writes compressed tiles in the order they were queued, waiting for those
+// before `until`
+void TilePyramidBuilder::collect(Go2UInt64 until) {
+    boost::unique_lock<boost::mutex> guard(lock);
+    while (emitted < filled) {
+        TileJob& job = jobs[emitted % jobs.size()];
+        if (!job.ready) {
+            if (emitted >= until) {
+                break;
+            }
+            jobReady.wait(guard);
+            continue;
+        }
+        guard.unlock();
+        TileEntry entry;
+        entry.level = job.cells.level;
+        entry.column = job.cells.column;
+        entry.row = job.cells.row;
+        entry.offset = offset;
+        entry.size = static_cast<Go2UInt32>(job.packed.size());
+        directory.push_back(entry);
+        std::string record;
+        append(record, entry.level);
+        append(record, entry.column);
+        append(record, entry.row);
+        append(record, entry.size);
+        fidout.write(record.data(), record.size());
+        fidout.write(job.packed.data(), job.packed.size());
+        offset += record.size() + job.packed.size();
+        rawBytes += 3*job.cells.mean.size()*sizeof(float);
+        packedBytes += job.packed.size();
+        guard.lock();
+        emitted++;
+    }
+}
+
+// Worker thread - deflates queued tiles
+void TilePyramidBuilder::compress() {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit(&stream, TILE_COMPRESSION_LEVEL) != Z_OK) {
+        std::cerr << "<< Unable to start tile compression thread >>" << std::endl;
+        return;
+    }
+    while (true) {
+        size_t slot;
+        {
+            boost::unique_lock<boost::mutex> guard(lock);
+            while (pending.empty() && !stopping) {
+                jobAvailable.wait(guard);
+            }
+            if (pending.empty()) {
+                break;
+            }
+            slot = pending.front();
+            pending.erase(pending.begin());
+        }
+        TileJob& job = jobs[slot];
+        const std::vector<float>* planes[] = {&job.cells.low, &job.cells.high, &job.cells.mean};
+        size_t planeBytes = job.cells.mean.size()*sizeof(float);
+        deflateReset(&stream);
+        job.packed.resize(deflateBound(&stream, 3*planeBytes));
+        stream.next_out = reinterpret_cast<Bytef*>(&job.packed[0]);
+        stream.avail_out = job.packed.size();
+        int status = Z_OK;
+        for (int plane=0; plane<3 && status == Z_OK; plane++) {
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<float*>(&(*planes[plane])[0]));
+            stream.avail_in = planeBytes;
+            status = deflate(&stream, plane == 2 ? Z_FINISH : Z_NO_FLUSH);
+        }
+        if (status != Z_STREAM_END) {
+            std::cerr << "<< Unable to compress tile " << job.cells.column << "," << job.cells.row
+                      << " of level " << job.cells.level << " >>" << std::endl;
+        }
+        job.packed.resize(stream.total_out);
+        {
+            boost::lock_guard<boost::mutex> guard(lock);
+            job.ready = true;
+        }
+        jobReady.notify_all();
+    }
+    deflateEnd(&stream);
+}
+
+bool TilePyramidBuilder::finish() {
+    if (failed) {
+        return false;
+    }
+    if (!configured) {
+        std::cerr << "<< No profiles to build tiles from >>" << std::endl;
+        return false;
+    }
+    for (size_t level=0; level<levels.size(); level++) {
+        if (levels[level].active) {
+            flush(level);
+        }
+    }
+    collect(filled);
+    std::string block;
+    block.reserve(32 + directory.size()*sizeof(TileEntry));
+    append(block, static_cast<Go2UInt64>(directory.size()));
+    for (size_t i=0; i<directory.size(); i++) {
+        append(block, directory[i].level);
+        append(block, directory[i].column);
+        append(block, directory[i].row);
+        append(block, directory[i].offset);
+        append(block, directory[i].size);
+    }
+    append(block, offset);
+    block.append(TILE_INDEX_MAGIC, sizeof(TILE_INDEX_MAGIC));
+    fidout.write(block.data(), block.size());
+    fidout.close();
+    if (!fidout) {
+        std::cerr << "<< Unable to write tile file '" << outputFilename << "' >>" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void TilePyramidBuilder::report(std::ostream& os) {
+    os << "<< Tile pyramid >>" << std::endl;
+    os << "    Levels:  " << levels.size() << " from " << cellX << " x " << cellY << " mm cells, "
+       << size << " x " << size << " cells per tile" << std::endl;
+    os << "    Tiles:   " << directory.size() << ", " << packedBytes << " bytes compressed from "
+       << rawBytes << std::endl;
+    os << "    Profiles: " << profiles << " (" << skipped << " skipped going back into a finished band), "
+       << clipped << " points outside the first profile's field of view" << std::endl;
+}
+
+bool TilePyramid::open(const std::string& filename) {
+    directory.clear();
+    if (fidin.is_open()) {
+        fidin.close();
+    }
+    fidin.clear();
+    fidin.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    char magic[sizeof(TILE_MAGIC)];
+    Go2UInt32 version;
+    if (!fidin.read(magic, sizeof(magic)) || memcmp(magic, TILE_MAGIC, sizeof(TILE_MAGIC)) != 0 ||
+        !read(fidin, version) || version != TILE_VERSION || !read(fidin, size) || size == 0 ||
+        !read(fidin, levelCount) || !read(fidin, cellX) || !read(fidin, cellY) || cellX <= 0 || cellY <= 0) {
+        return false;
+    }
+    Go2UInt64 directoryOffset, count;
+    char indexMagic[sizeof(TILE_INDEX_MAGIC)];
+    if (!fidin.seekg(-static_cast<std::streamoff>(sizeof(directoryOffset) + sizeof(indexMagic)), std::ios_base::end) ||
+        !read(fidin, directoryOffset) || !fidin.read(indexMagic, sizeof(indexMagic)) ||
+        memcmp(indexMagic, TILE_INDEX_MAGIC, sizeof(TILE_INDEX_MAGIC)) != 0 ||
+        !fidin.seekg(directoryOffset) || !read(fidin, count)) {
+        return false;
+    }
+    directory.resize(count);
+    for (Go2UInt64 i=0; i<count; i++) {
+        TileEntry& entry = directory[i];
+        if (!read(fidin, entry.level) || !read(fidin, entry.column) || !read(fidin, entry.row) ||
+            !read(fidin, entry.offset) || !read(fidin, entry.size)) {
+            directory.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<TileEntry> TilePyramid::findTiles(Go2UInt32 level, double x0, double y0, double x1, double y1) const {
+    std::vector<TileEntry> found;
+    double tileWidth = cellWidth(level)*size;
+    double tileHeight = cellHeight(level)*size;
+    double columnLow = std::floor(std::min(x0, x1)/tileWidth), columnHigh = std::floor(std::max(x0, x1)/tileWidth);
+    double rowLow = std::floor(std::min(y0, y1)/tileHeight), rowHigh = std::floor(std::max(y0, y1)/tileHeight);
+    for (size_t i=0; i<directory.size(); i++) {
+        const TileEntry& entry = directory[i];
+        if (entry.level == level && entry.column >= columnLow && entry.column <= columnHigh &&
+            entry.row >= rowLow && entry.row <= rowHigh) {
+            found.push_back(entry);
+        }
+    }
+    return found;
+}
+
+bool TilePyramid::readTile(const TileEntry& entry, Tile& tile) {
+    Go2UInt32 level, packedSize;
+    Go2Int32 column, row;
+    fidin.clear();
+    if (!fidin.seekg(entry.offset) || !read(fidin, level) || !read(fidin, column) || !read(fidin, row) ||
+        !read(fidin, packedSize) || level != entry.level || column != entry.column || row != entry.row) {
+        return false;
+    }
+    packed.resize(packedSize);
+    if (packedSize == 0 || !fidin.read(&packed[0], packedSize)) {
+        return false;
+    }
+    size_t cells = static_cast<size_t>(size)*size;
+    tile.level = level;
+    tile.column = column;
+    tile.row = row;
+    tile.low.resize(cells);
+    tile.high.resize(cells);
+    tile.mean.resize(cells);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(&packed[0]);
+    stream.avail_in = packedSize;
+    std::vector<float>* planes[] = {&tile.low, &tile.high, &tile.mean};
+    int status = Z_OK;
+    for (int plane=0; plane<3 && status == Z_OK; plane++) {
+        stream.next_out = reinterpret_cast<Bytef*>(&(*planes[plane])[0]);
+        stream.avail_out = cells*sizeof(float);
+        status = inflate(&stream, Z_FINISH);
+        if (status == Z_BUF_ERROR && stream.avail_out == 0) {
+            status = Z_OK;
+        }
+    }
+    inflateEnd(&stream);
+    return status == Z_STREAM_END && stream.avail_out == 0;
+}